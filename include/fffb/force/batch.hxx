@@ -0,0 +1,215 @@
+//
+//
+//      fffb
+//      force/batch.hxx
+//
+
+#pragma once
+
+#include <fffb/util/types.hxx>
+#include <fffb/util/fixed.hxx>
+#include <fffb/util/fixed_simd.hxx>
+#include <fffb/telemetry/state.hxx>
+#include <fffb/force/effect_graph.hxx>
+
+
+namespace fffb
+{
+
+
+////////////////////////////////////////////////////////////////////////////////
+
+// recorded telemetry as one column per field. columns of float fields point to
+// floats, the int ones (gear) to ints. only fields the program reads need one,
+// timestamps only if it has filters
+
+struct telemetry_columns
+{
+        timestamp_t const * timestamp { nullptr } ;
+        void        const *    fields [ static_cast< uti::u8_t >( telemetry_field::count ) ] {} ;
+        uti::u64_t              count { 0 } ;
+
+        constexpr void set ( telemetry_field _field_, float const * _column_ ) noexcept { fields[ static_cast< uti::u8_t >( _field_ ) ] = _column_ ; }
+        constexpr void set ( telemetry_field _field_, int   const * _column_ ) noexcept { fields[ static_cast< uti::u8_t >( _field_ ) ] = _column_ ; }
+} ;
+
+// one output column per sink, sinks without a column are computed but dropped
+struct effect_columns
+{
+        q16 * sinks [ static_cast< uti::u8_t >( effect_sink::count ) ] {} ;
+
+        constexpr void set ( effect_sink _sink_, q16 * _column_ ) noexcept { sinks[ static_cast< uti::u8_t >( _sink_ ) ] = _column_ ; }
+} ;
+
+////////////////////////////////////////////////////////////////////////////////
+
+// runs a compiled program over FFFB_SIMD_LANES samples per instruction.
+// sample i gets exactly the bits evaluate() would produce for it when called
+// frame by frame with the same dt the simulator derives from the timestamps.
+// the samples are taken as given, the simulator's predictor is not applied.
+// filter state carries over between run() calls, so a long recording can be
+// fed in chunks. fffb_batch_check holds it to that on a recording
+
+class batch_evaluator
+{
+public:
+        constexpr explicit batch_evaluator ( effect_program const & _program_ ) noexcept : program_( _program_ ) {}
+
+        [[ nodiscard ]] bool run ( telemetry_columns const & _in_, effect_columns const & _out_ ) noexcept ;
+
+        constexpr void reset () noexcept { fx_state_ = {} ; last_eval_ = 0 ; }
+private:
+        effect_program const & program_ ;
+
+        effect_state fx_state_ {} ;
+        timestamp_t last_eval_ { 0 } ;
+
+        [[ nodiscard ]] bool _check ( telemetry_columns const & _in_ ) const noexcept ;
+
+        void _run_block ( telemetry_columns const & _in_, effect_columns const & _out_, uti::u64_t _base_, uti::i32_t _count_ ) noexcept ;
+} ;
+
+////////////////////////////////////////////////////////////////////////////////
+////////////////////////////////////////////////////////////////////////////////
+
+inline bool batch_evaluator::run ( telemetry_columns const & _in_, effect_columns const & _out_ ) noexcept
+{
+        if( !_check( _in_ ) ) return false ;
+
+        for( uti::u64_t base = 0; base < _in_.count; base += FFFB_SIMD_LANES )
+        {
+                uti::u64_t const left = _in_.count - base ;
+
+                _run_block( _in_, _out_, base, left < FFFB_SIMD_LANES ? static_cast< uti::i32_t >( left ) : FFFB_SIMD_LANES ) ;
+        }
+        return true ;
+}
+
+inline bool batch_evaluator::_check ( telemetry_columns const & _in_ ) const noexcept
+{
+        for( uti::u8_t field = 0; field < static_cast< uti::u8_t >( telemetry_field::count ); ++field )
+        {
+                if( ( program_.field_mask >> field ) & 1 && !_in_.fields[ field ] )
+                {
+                        FFFB_F_ERR_S( "batch_evaluator::run", "missing column for '%s'", telemetry_fields[ field ].name ) ;
+                        return false ;
+                }
+        }
+        if( program_.state_count && !_in_.timestamp )
+        {
+                FFFB_F_ERR_S( "batch_evaluator::run", "program has filters but no timestamp column" ) ;
+                return false ;
+        }
+        return true ;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
+inline void batch_evaluator::_run_block ( telemetry_columns const & _in_, effect_columns const & _out_, uti::u64_t _base_, uti::i32_t _count_ ) noexcept
+{
+        simd::lanes r [ FFFB_EFFECT_MAX_REGISTERS ] ;
+        simd::lanes dt {} ;
+
+        // the short block at the end of a column is padded so loads never read past it
+        union
+        {
+                float f [ FFFB_SIMD_LANES ] ;
+                int   i [ FFFB_SIMD_LANES ] ;
+        } tail {} ;
+
+        if( _in_.timestamp )
+        {
+                for( uti::i32_t i = 0; i < _count_; ++i )
+                {
+                        timestamp_t const now = _in_.timestamp[ _base_ + i ] ;
+
+                        if( now > last_eval_ && last_eval_ != 0 ) dt[ i ] = q16_from_us( now - last_eval_ ).raw() ;
+
+                        last_eval_ = now ;
+                }
+        }
+        for( uti::u8_t n = 0; n < program_.op_count; ++n )
+        {
+                effect_op const & op = program_.ops[ n ] ;
+
+                switch( op.code )
+                {
+                        case effect_opcode::load_float :
+                        {
+                                float const * column = static_cast< float const * >( _in_.fields[ op.aux ] ) + _base_ ;
+
+                                if( _count_ < FFFB_SIMD_LANES )
+                                {
+                                        for( uti::i32_t i = 0; i < _count_; ++i ) tail.f[ i ] = column[ i ] ;
+                                        column = tail.f ;
+                                }
+                                simd::from_float( r[ op.dst ], column ) ;
+                                break ;
+                        }
+                        case effect_opcode::load_int :
+                        {
+                                int const * column = static_cast< int const * >( _in_.fields[ op.aux ] ) + _base_ ;
+
+                                if( _count_ < FFFB_SIMD_LANES )
+                                {
+                                        for( uti::i32_t i = 0; i < _count_; ++i ) tail.i[ i ] = column[ i ] ;
+                                        column = tail.i ;
+                                }
+                                simd::from_int( r[ op.dst ], column ) ;
+                                break ;
+                        }
+                        case effect_opcode::load_const    : simd::broadcast    ( r[ op.dst ], op.k0 ) ; break ;
+                        case effect_opcode::abs           : simd::abs          ( r[ op.dst ], r[ op.a ] ) ; break ;
+                        case effect_opcode::neg           : simd::neg          ( r[ op.dst ], r[ op.a ] ) ; break ;
+                        case effect_opcode::add           : simd::add          ( r[ op.dst ], r[ op.a ], r[ op.b ] ) ; break ;
+                        case effect_opcode::mul           : simd::mul          ( r[ op.dst ], r[ op.a ], r[ op.b ] ) ; break ;
+                        case effect_opcode::affine        : simd::affine       ( r[ op.dst ], r[ op.a ], op.k0, op.k1 ) ; break ;
+                        case effect_opcode::clamp         : simd::clamp        ( r[ op.dst ], r[ op.a ], op.k0, op.k1 ) ; break ;
+                        case effect_opcode::less          : simd::less         ( r[ op.dst ], r[ op.a ], op.k0 ) ; break ;
+                        case effect_opcode::greater_equal : simd::greater_equal( r[ op.dst ], r[ op.a ], op.k0 ) ; break ;
+                        case effect_opcode::equal         : simd::equal        ( r[ op.dst ], r[ op.a ], op.k0 ) ; break ;
+                        case effect_opcode::select        : simd::select       ( r[ op.dst ], r[ op.a ], r[ op.b ], r[ op.c ] ) ; break ;
+                        case effect_opcode::curve :
+                        {
+                                curve_lut const & lut = program_.curves[ op.aux ] ;
+
+                                for( uti::i32_t i = 0; i < FFFB_SIMD_LANES; ++i ) r[ op.dst ][ i ] = lut( q16::from_raw( r[ op.a ][ i ] ) ).raw() ;
+                                break ;
+                        }
+                        case effect_opcode::lowpass :
+                        {
+                                // the recurrence runs through time, lanes are walked in order
+                                q16 & s = fx_state_.filters[ op.aux ] ;
+                                uti::u32_t const bit = uti::u32_t( 1 ) << op.aux ;
+
+                                for( uti::i32_t i = 0; i < _count_; ++i )
+                                {
+                                        q16 const    x = q16::from_raw( r[ op.a ][ i ] ) ;
+                                        q16 const dt_s = q16::from_raw( dt[ i ] ) ;
+
+                                        if( fx_state_.primed & bit ) s += ( dt_s / ( op.k0 + dt_s ) ) * ( x - s ) ;
+                                        else                         s  = x ;
+
+                                        fx_state_.primed |= bit ;
+                                        r[ op.dst ][ i ] = s.raw() ;
+                                }
+                                break ;
+                        }
+                        case effect_opcode::store :
+                        {
+                                q16 * column = _out_.sinks[ op.aux ] ;
+
+                                if( column )
+                                {
+                                        for( uti::i32_t i = 0; i < _count_; ++i ) column[ _base_ + i ] = q16::from_raw( r[ op.a ][ i ] ) ;
+                                }
+                                break ;
+                        }
+                }
+        }
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
+
+} // namespace fffb
@@ -0,0 +1,175 @@
+//
+//
+//      fffb
+//      force/clipping.hxx
+//
+
+#pragma once
+
+#include <fffb/util/types.hxx>
+#include <fffb/util/fixed.hxx>
+
+#include <cmath>
+
+#define FFFB_CLIP_WINDOW 256
+
+
+namespace fffb
+{
+
+
+////////////////////////////////////////////////////////////////////////////////
+
+// saturation statistics of one slot over the last FFFB_CLIP_WINDOW updates.
+// levels come in normalized so 1 is the rail of the report, anything at or past
+// it can't be told apart by the wheel. running sums make every update O(1)
+
+class clip_window
+{
+public:
+        static_assert( ( FFFB_CLIP_WINDOW & ( FFFB_CLIP_WINDOW - 1 ) ) == 0, "clip window has to be a power of two" ) ;
+
+        constexpr void add ( q16 _level_ ) noexcept ;
+
+        constexpr void reset () noexcept { *this = {} ; }
+
+        [[ nodiscard ]] constexpr uti::u32_t   count () const noexcept { return filled_ ; }
+        [[ nodiscard ]] constexpr uti::u32_t clipped () const noexcept { return clipped_ ; }
+        [[ nodiscard ]] constexpr q16           peak () const noexcept { return peak_ ; }
+
+        [[ nodiscard ]] constexpr q16 clip_ratio () const noexcept
+        { return filled_ ? q16::from_raw( static_cast< uti::i32_t >( ( static_cast< uti::u64_t >( clipped_ ) << q16::frac_bits ) / filled_ ) ) : q16{} ; }
+
+        // diagnostics only
+        [[ nodiscard ]] float rms () const noexcept
+        { return filled_ ? std::sqrt( static_cast< float >( sum_sq_ ) / static_cast< float >( filled_ ) ) / static_cast< float >( q16::one_raw ) : 0.0f ; }
+private:
+        // stored levels are capped so the sum of squares can't overflow
+        static constexpr q16 max_level { q16::from_int( 4 ) } ;
+
+        q16 levels_ [ FFFB_CLIP_WINDOW ] {} ;
+
+        uti::u64_t  sum_sq_ { 0 } ;
+        uti::u32_t clipped_ { 0 } ;
+        uti::u32_t    head_ { 0 } ;
+        uti::u32_t  filled_ { 0 } ;
+
+        q16 peak_ {} ; // since the last reset, not windowed
+} ;
+
+////////////////////////////////////////////////////////////////////////////////
+
+struct agc_config
+{
+        bool enabled { false } ;
+
+        float target   { 0.02f } ; // clip ratio the loop steers below
+        float step     { 0.02f } ; // relative gain change per adjustment
+        float min_gain { 0.25f } ;
+        float max_gain { 1.00f } ;
+
+        timestamp_t interval_us { 500000 } ;
+
+        [[ nodiscard ]] constexpr bool valid () const noexcept
+        {
+                return target > 0.0f && target < 1.0f && step > 0.0f && step < 1.0f &&
+                       min_gain > 0.0f && min_gain <= max_gain && max_gain <= 4.0f ;
+        }
+} ;
+
+// slow loop on the master gain. backs off while the worst slot clips more than
+// the target, creeps back up once it clips less than half of it. disabled it
+// holds the gain at 1
+
+class auto_gain
+{
+public:
+        bool configure ( agc_config const & _config_ ) noexcept ;
+
+        [[ nodiscard ]] constexpr agc_config const & config () const noexcept { return config_ ; }
+        [[ nodiscard ]] constexpr q16                  gain () const noexcept { return   gain_ ; }
+
+        constexpr void update ( q16 _clip_ratio_, timestamp_t _now_us_ ) noexcept ;
+private:
+        agc_config config_ {} ;
+
+        q16 gain_     { q16::one() } ;
+        q16 target_   {} ;
+        q16 step_     {} ;
+        q16 min_gain_ { q16::one() } ;
+        q16 max_gain_ { q16::one() } ;
+
+        timestamp_t next_us_ { 0 } ;
+} ;
+
+////////////////////////////////////////////////////////////////////////////////
+////////////////////////////////////////////////////////////////////////////////
+
+constexpr void clip_window::add ( q16 _level_ ) noexcept
+{
+        q16 const level = q16_clamp( q16_abs( _level_ ), q16{}, max_level ) ;
+
+        if( filled_ == FFFB_CLIP_WINDOW )
+        {
+                q16 const old = levels_[ head_ ] ;
+
+                sum_sq_  -= static_cast< uti::u64_t >( old.raw() ) * static_cast< uti::u64_t >( old.raw() ) ;
+                clipped_ -= old >= q16::one() ;
+        }
+        else
+        {
+                ++filled_ ;
+        }
+        levels_[ head_ ] = level ;
+
+        sum_sq_  += static_cast< uti::u64_t >( level.raw() ) * static_cast< uti::u64_t >( level.raw() ) ;
+        clipped_ += level >= q16::one() ;
+
+        head_ = ( head_ + 1 ) & ( FFFB_CLIP_WINDOW - 1 ) ;
+
+        if( level > peak_ ) peak_ = level ;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
+inline bool auto_gain::configure ( agc_config const & _config_ ) noexcept
+{
+        if( _config_.enabled && !_config_.valid() )
+        {
+                FFFB_F_ERR_S( "auto_gain::configure", "invalid configuration" ) ;
+                return false ;
+        }
+        config_   = _config_ ;
+        target_   = q16::from_float( _config_.target   ) ;
+        step_     = q16::from_float( _config_.step     ) ;
+        min_gain_ = q16::from_float( _config_.min_gain ) ;
+        max_gain_ = q16::from_float( _config_.max_gain ) ;
+        gain_     = _config_.enabled ? q16_clamp( gain_, min_gain_, max_gain_ ) : q16::one() ;
+        next_us_  = 0 ;
+
+        return true ;
+}
+
+constexpr void auto_gain::update ( q16 _clip_ratio_, timestamp_t _now_us_ ) noexcept
+{
+        if( !config_.enabled ) return ;
+
+        // a clock that jumped back further than an interval restarts it
+        if( next_us_ != 0 && _now_us_ < next_us_ && _now_us_ + config_.interval_us >= next_us_ ) return ;
+
+        next_us_ = _now_us_ + config_.interval_us ;
+
+        if( _clip_ratio_ > target_ )
+        {
+                gain_ = q16_clamp( gain_ - gain_ * step_, min_gain_, max_gain_ ) ;
+        }
+        else if( _clip_ratio_ + _clip_ratio_ < target_ )
+        {
+                gain_ = q16_clamp( gain_ + gain_ * step_, min_gain_, max_gain_ ) ;
+        }
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
+
+} // namespace fffb
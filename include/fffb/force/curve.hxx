@@ -0,0 +1,115 @@
+//
+//
+//      fffb
+//      force/curve.hxx
+//
+
+#pragma once
+
+#include <fffb/util/types.hxx>
+#include <fffb/util/fixed.hxx>
+
+#define FFFB_CURVE_LUT_SIZE 256
+
+
+namespace fffb
+{
+
+
+////////////////////////////////////////////////////////////////////////////////
+
+struct curve_point
+{
+        float x ;
+        float y ;
+} ;
+
+// piecewise linear through the control points, held flat outside of them.
+// only used while baking, the hot path goes through curve_lut
+
+[[ nodiscard ]] constexpr float sample_curve ( curve_point const * _points_, uti::u8_t _count_, float _x_ ) noexcept
+{
+        if( _x_ <= _points_[ 0 ].x ) return _points_[ 0 ].y ;
+
+        for( uti::u8_t i = 1; i < _count_; ++i )
+        {
+                curve_point const & p0 = _points_[ i - 1 ] ;
+                curve_point const & p1 = _points_[ i     ] ;
+
+                if( _x_ <= p1.x )
+                {
+                        float const span = p1.x - p0.x ;
+                        return span > 0.0f ? p0.y + ( p1.y - p0.y ) * ( ( _x_ - p0.x ) / span ) : p1.y ;
+                }
+        }
+        return _points_[ _count_ - 1 ].y ;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
+// a response curve sampled at evenly spaced inputs. lookups quantize the input
+// into the table and interpolate between neighbouring entries, so a curve costs
+// the same no matter how it was described. baking happens in float, lookups are
+// pure fixed point
+
+struct curve_lut
+{
+        q16   table [ FFFB_CURVE_LUT_SIZE + 1 ] {} ;
+        q16   x_min {} ;
+        q16 x_scale {} ;
+
+        [[ nodiscard ]] constexpr q16 operator() ( q16 _x_ ) const noexcept
+        {
+                q16 const pos = ( _x_ - x_min ) * x_scale ;
+
+                if( pos.raw() <= 0                              ) return table[ 0                   ] ;
+                if( pos >= q16::from_int( FFFB_CURVE_LUT_SIZE ) ) return table[ FFFB_CURVE_LUT_SIZE ] ;
+
+                uti::i32_t const i = pos.to_int() ;
+                q16        const f = q16::from_raw( pos.raw() & ( q16::one_raw - 1 ) ) ;
+
+                return table[ i ] + ( table[ i + 1 ] - table[ i ] ) * f ;
+        }
+
+        template< typename Fn >
+        [[ nodiscard ]] static constexpr curve_lut from_function ( Fn && _fn_, float _x_min_, float _x_max_ ) noexcept ;
+
+        [[ nodiscard ]] static constexpr curve_lut from_points ( curve_point const * _points_, uti::u8_t _count_ ) noexcept ;
+
+        template< uti::u8_t N >
+        [[ nodiscard ]] static constexpr curve_lut from_points ( curve_point const ( & _points_ )[ N ] ) noexcept
+        { return from_points( _points_, N ) ; }
+} ;
+
+////////////////////////////////////////////////////////////////////////////////
+////////////////////////////////////////////////////////////////////////////////
+
+template< typename Fn >
+constexpr curve_lut curve_lut::from_function ( Fn && _fn_, float _x_min_, float _x_max_ ) noexcept
+{
+        curve_lut lut {} ;
+
+        float const range = _x_max_ - _x_min_ ;
+
+        lut.x_min   = q16::from_float( _x_min_ ) ;
+        lut.x_scale = q16::from_float( range > 0.0f ? static_cast< float >( FFFB_CURVE_LUT_SIZE ) / range : 0.0f ) ;
+
+        for( uti::i32_t i = 0; i <= FFFB_CURVE_LUT_SIZE; ++i )
+        {
+                lut.table[ i ] = q16::from_float( _fn_( _x_min_ + range * ( static_cast< float >( i ) / FFFB_CURVE_LUT_SIZE ) ) ) ;
+        }
+        return lut ;
+}
+
+constexpr curve_lut curve_lut::from_points ( curve_point const * _points_, uti::u8_t _count_ ) noexcept
+{
+        if( _count_ == 0 ) return {} ;
+
+        return from_function( [ & ]( float _x_ ){ return sample_curve( _points_, _count_, _x_ ) ; },
+                              _points_[ 0 ].x, _points_[ _count_ - 1 ].x ) ;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
+
+} // namespace fffb
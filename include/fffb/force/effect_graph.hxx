@@ -0,0 +1,449 @@
+//
+//
+//      fffb
+//      force/effect_graph.hxx
+//
+
+#pragma once
+
+#include <fffb/util/types.hxx>
+#include <fffb/util/fixed.hxx>
+#include <fffb/telemetry/state.hxx>
+#include <fffb/force/curve.hxx>
+
+#include <cstring>
+
+#define FFFB_EFFECT_MAX_NODES     64
+#define FFFB_EFFECT_MAX_REGISTERS 16
+#define FFFB_EFFECT_MAX_CURVES     8
+#define FFFB_EFFECT_MAX_STATES     8
+
+
+namespace fffb
+{
+
+
+////////////////////////////////////////////////////////////////////////////////
+
+enum class effect_sink : uti::u8_t
+{
+        constant_torque     ,
+        spring_enabled      ,
+        spring_amplitude    ,
+        spring_slope        ,
+        damper_enabled      ,
+        damper_slope        ,
+        trapezoid_enabled   ,
+        trapezoid_amplitude ,
+        trapezoid_period    ,
+        count               ,
+} ;
+
+enum class effect_opcode : uti::u8_t
+{
+        load_float    ,
+        load_int      ,
+        load_const    ,
+        abs           ,
+        neg           ,
+        add           ,
+        mul           ,
+        affine        ,
+        clamp         ,
+        less          ,
+        greater_equal ,
+        equal         ,
+        select        ,
+        curve         ,
+        lowpass       ,
+        store         ,
+} ;
+
+// one instruction of a compiled program, registers are indices into a q16 file.
+// aux is the sink, field, filter state or curve table, imm the field offset
+
+struct effect_op
+{
+        effect_opcode code { effect_opcode::load_const } ;
+        uti::u8_t      dst { 0 } ;
+        uti::u8_t        a { 0 } ;
+        uti::u8_t        b { 0 } ;
+        uti::u8_t        c { 0 } ;
+        uti::u8_t      aux { 0 } ;
+        uti::u16_t     imm { 0 } ;
+        q16             k0 {   } ;
+        q16             k1 {   } ;
+} ;
+
+struct effect_program
+{
+        effect_op ops    [ FFFB_EFFECT_MAX_NODES  ] {} ;
+        curve_lut curves [ FFFB_EFFECT_MAX_CURVES ] {} ;
+
+        uti::u8_t       op_count { 0 } ;
+        uti::u8_t register_count { 0 } ;
+        uti::u8_t    curve_count { 0 } ;
+        uti::u8_t    state_count { 0 } ;
+
+        uti::u32_t field_mask { 0 } ;
+        uti::u32_t  sink_mask { 0 } ;
+} ;
+
+struct effect_state
+{
+        q16        filters [ FFFB_EFFECT_MAX_STATES ] {} ;
+        uti::u32_t  primed { 0 } ;
+} ;
+
+struct effect_outputs
+{
+        q16        values [ static_cast< uti::u8_t >( effect_sink::count ) ] {} ;
+        uti::u32_t written { 0 } ;
+
+        [[ nodiscard ]] constexpr bool has ( effect_sink _sink_ ) const noexcept
+        { return ( written >> static_cast< uti::u8_t >( _sink_ ) ) & 1 ; }
+
+        [[ nodiscard ]] constexpr q16 operator[] ( effect_sink _sink_ ) const noexcept
+        { return values[ static_cast< uti::u8_t >( _sink_ ) ] ; }
+
+        [[ nodiscard ]] constexpr bool flag ( effect_sink _sink_ ) const noexcept
+        { return has( _sink_ ) && operator[]( _sink_ ).raw() > q16::half_raw ; }
+} ;
+
+////////////////////////////////////////////////////////////////////////////////
+
+// declarative description of the effects. nodes can only refer to nodes created
+// before them, so creation order is already a valid evaluation order.
+// compile() drops everything that doesn't reach a sink and assigns registers
+
+class effect_graph
+{
+public:
+        using node = uti::u8_t ;
+
+        static constexpr node invalid_node { 0xFF } ;
+
+        constexpr node   source ( telemetry_field _field_ ) noexcept ;
+        constexpr node constant ( float         _value_ ) noexcept ;
+
+        constexpr node abs ( node _x_ ) noexcept { return _push( { effect_opcode::abs, _x_ } ) ; }
+        constexpr node neg ( node _x_ ) noexcept { return _push( { effect_opcode::neg, _x_ } ) ; }
+
+        constexpr node add ( node _x_, node _y_ ) noexcept { return _push( { effect_opcode::add, _x_, _y_ } ) ; }
+        constexpr node mul ( node _x_, node _y_ ) noexcept { return _push( { effect_opcode::mul, _x_, _y_ } ) ; }
+
+        constexpr node affine ( node _x_, float _scale_, float _offset_ ) noexcept
+        { return _push( { effect_opcode::affine, _x_, 0, 0, 0, 0, q16::from_float( _scale_ ), q16::from_float( _offset_ ) } ) ; }
+
+        constexpr node clamp ( node _x_, float _lo_, float _hi_ ) noexcept
+        { return _push( { effect_opcode::clamp, _x_, 0, 0, 0, 0, q16::from_float( _lo_ ), q16::from_float( _hi_ ) } ) ; }
+
+        constexpr node          less ( node _x_, float _threshold_ ) noexcept { return _push( { effect_opcode::         less, _x_, 0, 0, 0, 0, q16::from_float( _threshold_ ) } ) ; }
+        constexpr node greater_equal ( node _x_, float _threshold_ ) noexcept { return _push( { effect_opcode::greater_equal, _x_, 0, 0, 0, 0, q16::from_float( _threshold_ ) } ) ; }
+        constexpr node         equal ( node _x_, float     _value_ ) noexcept { return _push( { effect_opcode::        equal, _x_, 0, 0, 0, 0, q16::from_float(     _value_ ) } ) ; }
+
+        constexpr node select ( node _cond_, node _if_true_, node _if_false_ ) noexcept
+        { return _push( { effect_opcode::select, _cond_, _if_true_, _if_false_ } ) ; }
+
+        // control points are baked into a lookup table right away
+        constexpr node curve ( node _x_, curve_lut   const &  _lut_                      ) noexcept ;
+        constexpr node curve ( node _x_, curve_point const * _points_, uti::u8_t _count_ ) noexcept
+        { return curve( _x_, curve_lut::from_points( _points_, _count_ ) ) ; }
+
+        template< uti::u8_t N >
+        constexpr node curve ( node _x_, curve_point const ( & _points_ )[ N ] ) noexcept { return curve( _x_, _points_, N ) ; }
+
+        // one pole low pass with time constant in seconds
+        constexpr node lowpass ( node _x_, float _tau_s_ ) noexcept ;
+
+        constexpr void sink ( effect_sink _sink_, node _x_ ) noexcept ;
+
+        [[ nodiscard ]] constexpr bool compile ( effect_program & _program_ ) const noexcept ;
+
+        [[ nodiscard ]] constexpr bool valid () const noexcept { return !error_ ; }
+private:
+        struct _node
+        {
+                effect_opcode code ;
+                node             a { invalid_node } ;
+                node             b { invalid_node } ;
+                node             c { invalid_node } ;
+                uti::u8_t      aux { 0 } ;
+                uti::u16_t     imm { 0 } ;
+                q16             k0 {   } ;
+                q16             k1 {   } ;
+        } ;
+
+        _node     nodes_  [ FFFB_EFFECT_MAX_NODES  ] {} ;
+        curve_lut curves_ [ FFFB_EFFECT_MAX_CURVES ] {} ;
+
+        uti::u8_t  node_count_ { 0 } ;
+        uti::u8_t curve_count_ { 0 } ;
+        uti::u8_t state_count_ { 0 } ;
+        uti::u32_t field_mask_ { 0 } ;
+
+        bool error_ { false } ;
+
+        constexpr node _push ( _node const & _node_ ) noexcept ;
+
+        [[ nodiscard ]] static constexpr uti::u8_t _arity ( effect_opcode _code_ ) noexcept ;
+} ;
+
+////////////////////////////////////////////////////////////////////////////////
+////////////////////////////////////////////////////////////////////////////////
+
+constexpr effect_graph::node effect_graph::source ( telemetry_field _field_ ) noexcept
+{
+        telemetry_field_info const & info = field_info( _field_ ) ;
+
+        field_mask_ |= uti::u32_t( 1 ) << static_cast< uti::u8_t >( _field_ ) ;
+
+        _node n { info.is_int ? effect_opcode::load_int : effect_opcode::load_float } ;
+        n.imm = info.offset ;
+        n.aux = static_cast< uti::u8_t >( _field_ ) ;
+
+        return _push( n ) ;
+}
+
+constexpr effect_graph::node effect_graph::constant ( float _value_ ) noexcept
+{
+        _node n { effect_opcode::load_const } ;
+        n.k0 = q16::from_float( _value_ ) ;
+
+        return _push( n ) ;
+}
+
+constexpr effect_graph::node effect_graph::curve ( node _x_, curve_lut const & _lut_ ) noexcept
+{
+        if( curve_count_ == FFFB_EFFECT_MAX_CURVES )
+        {
+                FFFB_F_ERR_S( "effect_graph::curve", "curve pool exhausted" ) ;
+                error_ = true ;
+                return invalid_node ;
+        }
+        _node n { effect_opcode::curve, _x_ } ;
+        n.aux = curve_count_ ;
+
+        curves_[ curve_count_++ ] = _lut_ ;
+
+        return _push( n ) ;
+}
+
+constexpr effect_graph::node effect_graph::lowpass ( node _x_, float _tau_s_ ) noexcept
+{
+        if( state_count_ == FFFB_EFFECT_MAX_STATES )
+        {
+                FFFB_F_ERR_S( "effect_graph::lowpass", "filter state pool exhausted" ) ;
+                error_ = true ;
+                return invalid_node ;
+        }
+        _node n { effect_opcode::lowpass, _x_ } ;
+        n.aux = state_count_++ ;
+        n.k0  = q16::from_float( _tau_s_ ) ;
+
+        return _push( n ) ;
+}
+
+constexpr void effect_graph::sink ( effect_sink _sink_, node _x_ ) noexcept
+{
+        _node n { effect_opcode::store, _x_ } ;
+        n.aux = static_cast< uti::u8_t >( _sink_ ) ;
+
+        _push( n ) ;
+}
+
+constexpr effect_graph::node effect_graph::_push ( _node const & _node_ ) noexcept
+{
+        uti::u8_t const arity = _arity( _node_.code ) ;
+
+        node const inputs[ 3 ] { _node_.a, _node_.b, _node_.c } ;
+
+        for( uti::u8_t i = 0; i < arity; ++i )
+        {
+                if( inputs[ i ] >= node_count_ ) error_ = true ;
+        }
+        if( node_count_ == FFFB_EFFECT_MAX_NODES ) error_ = true ;
+
+        if( error_ )
+        {
+                FFFB_F_ERR_S( "effect_graph::push", "invalid input or node pool exhausted" ) ;
+                return invalid_node ;
+        }
+        nodes_[ node_count_ ] = _node_ ;
+
+        return node_count_++ ;
+}
+
+constexpr uti::u8_t effect_graph::_arity ( effect_opcode _code_ ) noexcept
+{
+        switch( _code_ )
+        {
+                case effect_opcode::load_float :
+                case effect_opcode::load_int   :
+                case effect_opcode::load_const : return 0 ;
+                case effect_opcode::add        :
+                case effect_opcode::mul        : return 2 ;
+                case effect_opcode::select     : return 3 ;
+                default                        : return 1 ;
+        }
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
+constexpr bool effect_graph::compile ( effect_program & _program_ ) const noexcept
+{
+        if( error_ )
+        {
+                FFFB_F_ERR_S( "effect_graph::compile", "graph is invalid" ) ;
+                return false ;
+        }
+        bool      live     [ FFFB_EFFECT_MAX_NODES ] {} ;
+        uti::u8_t last_use [ FFFB_EFFECT_MAX_NODES ] {} ;
+        uti::u8_t reg      [ FFFB_EFFECT_MAX_NODES ] {} ;
+
+        // sinks keep their inputs alive, walking backwards reaches every dependency
+        for( uti::i32_t i = node_count_ - 1; i >= 0; --i )
+        {
+                _node const & n = nodes_[ i ] ;
+
+                if( n.code == effect_opcode::store ) live[ i ] = true ;
+                if( !live[ i ] ) continue ;
+
+                node const inputs[ 3 ] { n.a, n.b, n.c } ;
+
+                for( uti::u8_t j = 0; j < _arity( n.code ); ++j )
+                {
+                        live[ inputs[ j ] ] = true ;
+                        if( last_use[ inputs[ j ] ] < i ) last_use[ inputs[ j ] ] = static_cast< uti::u8_t >( i ) ;
+                }
+        }
+        effect_program program {} ;
+
+        uti::u32_t free_regs { ( uti::u32_t( 1 ) << FFFB_EFFECT_MAX_REGISTERS ) - 1 } ;
+
+        for( uti::u8_t i = 0; i < node_count_; ++i )
+        {
+                if( !live[ i ] ) continue ;
+
+                _node const & n = nodes_[ i ] ;
+
+                effect_op op { n.code } ;
+                op.aux = n.aux ;
+                op.imm = n.imm ;
+                op.k0  = n.k0  ;
+                op.k1  = n.k1  ;
+
+                node const inputs[ 3 ] { n.a, n.b, n.c } ;
+                uti::u8_t * operands[ 3 ] { &op.a, &op.b, &op.c } ;
+
+                for( uti::u8_t j = 0; j < _arity( n.code ); ++j )
+                {
+                        *operands[ j ] = reg[ inputs[ j ] ] ;
+                }
+                // operands are read before the result is written, so a dying input can hand over its register
+                for( uti::u8_t j = 0; j < _arity( n.code ); ++j )
+                {
+                        if( last_use[ inputs[ j ] ] == i ) free_regs |= uti::u32_t( 1 ) << reg[ inputs[ j ] ] ;
+                }
+                if( n.code == effect_opcode::store )
+                {
+                        program.sink_mask |= uti::u32_t( 1 ) << n.aux ;
+                }
+                else
+                {
+                        if( free_regs == 0 )
+                        {
+                                FFFB_F_ERR_S( "effect_graph::compile", "out of registers" ) ;
+                                return false ;
+                        }
+                        uti::u8_t const r = static_cast< uti::u8_t >( __builtin_ctz( free_regs ) ) ;
+
+                        free_regs &= ~( uti::u32_t( 1 ) << r ) ;
+
+                        reg[ i ] = op.dst = r ;
+
+                        if( r >= program.register_count ) program.register_count = r + 1 ;
+                }
+                program.ops[ program.op_count++ ] = op ;
+        }
+        for( uti::u8_t i = 0; i < curve_count_; ++i ) program.curves[ i ] = curves_[ i ] ;
+
+        program.curve_count = curve_count_ ;
+        program.state_count = state_count_ ;
+        program.field_mask  = field_mask_  ;
+
+        _program_ = program ;
+        return true ;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+////////////////////////////////////////////////////////////////////////////////
+
+// runs a compiled program over one telemetry sample, _dt_s_ is the time since the previous run.
+// telemetry floats are converted as they are loaded, everything after that is fixed point
+
+inline void evaluate ( effect_program const & _program_, telemetry_state const & _state_, q16 _dt_s_,
+                       effect_state & _fx_state_, effect_outputs & _outputs_ ) noexcept
+{
+        q16 r [ FFFB_EFFECT_MAX_REGISTERS ] ;
+
+        unsigned char const * const base = reinterpret_cast< unsigned char const * >( &_state_ ) ;
+
+        _outputs_.written = 0 ;
+
+        for( uti::u8_t i = 0; i < _program_.op_count; ++i )
+        {
+                effect_op const & op = _program_.ops[ i ] ;
+
+                switch( op.code )
+                {
+                        case effect_opcode::load_float :
+                        {
+                                float v ;
+                                std::memcpy( &v, base + op.imm, sizeof( v ) ) ;
+                                r[ op.dst ] = q16::from_float( v ) ;
+                                break ;
+                        }
+                        case effect_opcode::load_int :
+                        {
+                                int v ;
+                                std::memcpy( &v, base + op.imm, sizeof( v ) ) ;
+                                r[ op.dst ] = q16::from_int( v ) ;
+                                break ;
+                        }
+                        case effect_opcode::load_const    : r[ op.dst ] = op.k0 ; break ;
+                        case effect_opcode::abs           : r[ op.dst ] = q16_abs( r[ op.a ] ) ; break ;
+                        case effect_opcode::neg           : r[ op.dst ] = -r[ op.a ] ; break ;
+                        case effect_opcode::add           : r[ op.dst ] = r[ op.a ] + r[ op.b ] ; break ;
+                        case effect_opcode::mul           : r[ op.dst ] = r[ op.a ] * r[ op.b ] ; break ;
+                        case effect_opcode::affine        : r[ op.dst ] = r[ op.a ] * op.k0 + op.k1 ; break ;
+                        case effect_opcode::clamp         : r[ op.dst ] = q16_clamp( r[ op.a ], op.k0, op.k1 ) ; break ;
+                        case effect_opcode::less          : r[ op.dst ] = r[ op.a ] <  op.k0 ? q16::one() : q16{} ; break ;
+                        case effect_opcode::greater_equal : r[ op.dst ] = r[ op.a ] >= op.k0 ? q16::one() : q16{} ; break ;
+                        case effect_opcode::equal         : r[ op.dst ] = r[ op.a ] == op.k0 ? q16::one() : q16{} ; break ;
+                        case effect_opcode::select        : r[ op.dst ] = r[ op.a ].raw() > q16::half_raw ? r[ op.b ] : r[ op.c ] ; break ;
+                        case effect_opcode::curve         : r[ op.dst ] = _program_.curves[ op.aux ]( r[ op.a ] ) ; break ;
+                        case effect_opcode::lowpass :
+                        {
+                                q16 & s = _fx_state_.filters[ op.aux ] ;
+                                uti::u32_t const bit = uti::u32_t( 1 ) << op.aux ;
+
+                                if( _fx_state_.primed & bit ) s += ( _dt_s_ / ( op.k0 + _dt_s_ ) ) * ( r[ op.a ] - s ) ;
+                                else                          s  = r[ op.a ] ;
+
+                                _fx_state_.primed |= bit ;
+                                r[ op.dst ] = s ;
+                                break ;
+                        }
+                        case effect_opcode::store :
+                                _outputs_.values[ op.aux ] = r[ op.a ] ;
+                                _outputs_.written |= uti::u32_t( 1 ) << op.aux ;
+                                break ;
+                }
+        }
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
+
+} // namespace fffb
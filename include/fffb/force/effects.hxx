@@ -0,0 +1,101 @@
+//
+//
+//      fffb
+//      force/effects.hxx
+//
+
+#pragma once
+
+#include <fffb/util/types.hxx>
+#include <fffb/telemetry/state.hxx>
+#include <fffb/force/curve.hxx>
+#include <fffb/force/effect_graph.hxx>
+
+#define FFFB_EFFECT_MAX_CURVE_POINTS 16
+
+
+namespace fffb
+{
+
+
+////////////////////////////////////////////////////////////////////////////////
+
+// spring stiffness over absolute speed, steep while parking, flattening out at cruising speed.
+// the last point keeps the table step at exactly 1 so the corners land on entries
+constexpr curve_point spring_amplitude_curve []
+{
+        {   0.0f,   0.0f },
+        {   2.0f,  32.0f },
+        {   2.0f,  33.0f },
+        {  70.0f,  67.0f },
+        { 256.0f, 253.0f },
+} ;
+
+////////////////////////////////////////////////////////////////////////////////
+
+// tuning knobs of the built-in effects, defaults are what fffb has always shipped with
+
+struct effect_params
+{
+        curve_point spring_curve [ FFFB_EFFECT_MAX_CURVE_POINTS ] {} ;
+        uti::u8_t   spring_points { 0 } ;
+        uti::u8_t   spring_slope  { 3 } ;
+        float   spring_min_speed  { 0.10f } ;
+
+        float torque_gain { 1.0f } ;
+
+        uti::u8_t damper_slope_running { 3 } ;
+        uti::u8_t damper_slope_stopped { 6 } ;
+} ;
+
+[[ nodiscard ]] constexpr effect_params default_effect_params () noexcept
+{
+        effect_params params {} ;
+
+        for( auto const & point : spring_amplitude_curve ) params.spring_curve[ params.spring_points++ ] = point ;
+
+        return params ;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
+[[ nodiscard ]] constexpr effect_graph make_effect_graph ( effect_params const & _params_ ) noexcept
+{
+        effect_graph g ;
+
+        auto const steering = g.source( telemetry_field::steering ) ;
+        auto const    speed = g.abs( g.source( telemetry_field::speed ) ) ;
+        auto const      rpm = g.source( telemetry_field::rpm ) ;
+
+        auto const moving = g.greater_equal( speed, _params_.spring_min_speed ) ;
+        auto const spring = g.curve( speed, _params_.spring_curve, _params_.spring_points ) ;
+
+        g.sink( effect_sink::  spring_enabled, moving ) ;
+        g.sink( effect_sink::spring_amplitude, spring ) ;
+        g.sink( effect_sink::    spring_slope, g.constant( _params_.spring_slope ) ) ;
+
+        // aligning torque for the streamed constant effect, as stiff as the spring would be.
+        // steering is counterclockwise positive, so is the torque
+        auto const stiffness = g.mul( g.affine( spring, _params_.torque_gain / 255.0f, 0.0f ), moving ) ;
+
+        g.sink( effect_sink::constant_torque, g.mul( g.neg( steering ), stiffness ) ) ;
+
+        // heavier steering with the engine off
+        float const running = _params_.damper_slope_running ;
+        float const stopped = _params_.damper_slope_stopped ;
+
+        g.sink( effect_sink::damper_enabled, g.constant( 1.0f ) ) ;
+        g.sink( effect_sink::  damper_slope, g.affine( g.equal( rpm, 0.0f ), stopped - running, running ) ) ;
+
+        return g ;
+}
+
+[[ nodiscard ]] constexpr effect_graph default_effect_graph () noexcept
+{
+        return make_effect_graph( default_effect_params() ) ;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
+
+} // namespace fffb
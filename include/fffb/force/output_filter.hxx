@@ -0,0 +1,187 @@
+//
+//
+//      fffb
+//      force/output_filter.hxx
+//
+
+#pragma once
+
+#include <fffb/util/types.hxx>
+#include <fffb/util/fixed.hxx>
+
+#include <cmath>
+
+
+namespace fffb
+{
+
+
+////////////////////////////////////////////////////////////////////////////////
+
+// one filter per force slot, each runs on the value that ends up as the slot's level
+enum class filter_slot : uti::u8_t
+{
+        constant  , // constant_torque
+        spring    , // spring_amplitude
+        damper    , // damper_slope
+        trapezoid , // trapezoid_amplitude
+        count     ,
+} ;
+
+enum class filter_kind : uti::u8_t
+{
+        none     ,
+        slew     ,
+        one_pole ,
+        biquad   ,
+} ;
+
+struct filter_config
+{
+        filter_kind kind { filter_kind::none } ;
+
+        float slew_per_s {       0.0f } ; // slew, largest change per second in output units
+        float      tau_s {       0.0f } ; // one_pole, time constant
+        float  cutoff_hz {       0.0f } ; // biquad
+        float          q { 0.7071068f } ; // biquad
+        float    rate_hz {      60.0f } ; // biquad, the rate the slot is stepped at
+
+        [[ nodiscard ]] constexpr bool valid () const noexcept
+        {
+                switch( kind )
+                {
+                        case filter_kind::none     : return true ;
+                        case filter_kind::slew     : return slew_per_s > 0.0f ;
+                        case filter_kind::one_pole : return tau_s >= 0.0f ;
+                        case filter_kind::biquad   : return cutoff_hz > 0.0f && rate_hz > 0.0f && cutoff_hz < rate_hz * 0.5f && q > 0.0f ;
+                }
+                return false ;
+        }
+} ;
+
+////////////////////////////////////////////////////////////////////////////////
+
+// smooths slot levels between the effect program and the encoder. a slot costs
+// the same fixed handful of multiplies per step whatever the filter, and all of
+// its state lives in the slot. the first step after a reset passes the input
+// through and primes the history with it, so there is no ramp up from zero
+
+class output_filter
+{
+public:
+        bool configure ( filter_slot _slot_, filter_config const & _config_ ) noexcept ;
+
+        [[ nodiscard ]] constexpr filter_config const & config ( filter_slot _slot_ ) const noexcept
+        { return slots_[ _index( _slot_ ) ].config ; }
+
+        // forgets history, keeps the configuration
+        constexpr void reset () noexcept { for( auto & slot : slots_ ) slot.primed = false ; }
+
+        [[ nodiscard ]] constexpr q16 step ( filter_slot _slot_, q16 _x_, q16 _dt_s_ ) noexcept ;
+private:
+        struct _slot
+        {
+                filter_config config {} ;
+
+                // slew step per second or time constant, biquad coefficients normalized by a0
+                q16 k {} ;
+                q16 b0 {}, b1 {}, b2 {}, a1 {}, a2 {} ;
+
+                q16 x1 {}, x2 {}, y1 {}, y2 {} ;
+                bool primed { false } ;
+        } ;
+
+        _slot slots_ [ static_cast< uti::u8_t >( filter_slot::count ) ] {} ;
+
+        [[ nodiscard ]] static constexpr uti::u8_t _index ( filter_slot _slot_ ) noexcept
+        { return static_cast< uti::u8_t >( _slot_ ) ; }
+} ;
+
+////////////////////////////////////////////////////////////////////////////////
+////////////////////////////////////////////////////////////////////////////////
+
+inline bool output_filter::configure ( filter_slot _slot_, filter_config const & _config_ ) noexcept
+{
+        if( !_config_.valid() )
+        {
+                FFFB_F_ERR_S( "output_filter::configure", "invalid configuration for slot %u", _index( _slot_ ) ) ;
+                return false ;
+        }
+        _slot slot {} ;
+        slot.config = _config_ ;
+
+        switch( _config_.kind )
+        {
+                case filter_kind::none     : break ;
+                case filter_kind::slew     : slot.k = q16::from_float( _config_.slew_per_s ) ; break ;
+                case filter_kind::one_pole : slot.k = q16::from_float( _config_.tau_s      ) ; break ;
+                case filter_kind::biquad   :
+                {
+                        // rbj cookbook low pass
+                        float const w0    = 2.0f * 3.14159265f * _config_.cutoff_hz / _config_.rate_hz ;
+                        float const cos   = std::cos( w0 ) ;
+                        float const alpha = std::sin( w0 ) / ( 2.0f * _config_.q ) ;
+                        float const a0    = 1.0f + alpha ;
+
+                        slot.b0 = q16::from_float( ( 1.0f - cos ) * 0.5f / a0 ) ;
+                        slot.b2 = slot.b0 ;
+                        slot.a1 = q16::from_float( -2.0f * cos / a0 ) ;
+                        slot.a2 = q16::from_float( ( 1.0f - alpha ) / a0 ) ;
+
+                        // rounding the coefficients would leave the dc gain slightly off 1, with a low cutoff
+                        // enough to shift the output by a few counts, b1 absorbs the difference
+                        slot.b1 = q16::one() + slot.a1 + slot.a2 - slot.b0 - slot.b2 ;
+                        break ;
+                }
+        }
+        slots_[ _index( _slot_ ) ] = slot ;
+        return true ;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
+constexpr q16 output_filter::step ( filter_slot _slot_, q16 _x_, q16 _dt_s_ ) noexcept
+{
+        _slot & s = slots_[ _index( _slot_ ) ] ;
+
+        if( !s.primed || s.config.kind == filter_kind::none )
+        {
+                s.x1 = s.x2 = s.y1 = s.y2 = _x_ ;
+                s.primed = true ;
+                return _x_ ;
+        }
+        q16 y { _x_ } ;
+
+        switch( s.config.kind )
+        {
+                case filter_kind::none :
+                        break ;
+                case filter_kind::slew :
+                {
+                        q16 const max_step = s.k * _dt_s_ ;
+
+                        y = s.y1 + q16_clamp( _x_ - s.y1, -max_step, max_step ) ;
+                        break ;
+                }
+                case filter_kind::one_pole :
+                {
+                        q16 const span = s.k + _dt_s_ ;
+
+                        // a zero time constant passes the input straight through
+                        y = span == q16{} ? _x_ : s.y1 + ( _dt_s_ / span ) * ( _x_ - s.y1 ) ;
+                        break ;
+                }
+                case filter_kind::biquad :
+                        y = s.b0 * _x_ + s.b1 * s.x1 + s.b2 * s.x2 - s.a1 * s.y1 - s.a2 * s.y2 ;
+                        break ;
+        }
+        s.x2 = s.x1 ; s.x1 = _x_ ;
+        s.y2 = s.y1 ; s.y1 =   y ;
+
+        return y ;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
+
+} // namespace fffb
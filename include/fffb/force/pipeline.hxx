@@ -0,0 +1,134 @@
+//
+//
+//      fffb
+//      force/pipeline.hxx
+//
+
+#pragma once
+
+#include <fffb/util/types.hxx>
+#include <fffb/util/clock.hxx>
+#include <fffb/telemetry/state.hxx>
+#include <fffb/force/simulator.hxx>
+#include <fffb/force/streamer.hxx>
+#include <fffb/force/scheduler.hxx>
+#include <fffb/force/rate_controller.hxx>
+#include <fffb/force/profile.hxx>
+
+#include <mutex>
+
+
+namespace fffb
+{
+
+
+////////////////////////////////////////////////////////////////////////////////
+
+// what one complete telemetry frame goes through on its way to the wheel.
+// the rate controller and the scheduler pick the due tasks, the simulator runs
+// them and the wheel encodes and writes the reports. the plugin feeds it from
+// frame end, the replay tool from a recording
+
+class frame_pipeline
+{
+public:
+        constexpr frame_pipeline ( simulator & _simulator_, force_streamer & _streamer_, task_scheduler & _scheduler_, rate_controller & _rate_ ) noexcept
+                : simulator_( _simulator_ ), streamer_( _streamer_ ), scheduler_( _scheduler_ ), rate_( _rate_ ) {}
+
+        // true if _profile_ wasn't applied yet and now is, whatever else hangs
+        // off the profile is up to the caller
+        bool apply_profile ( force_profile const & _profile_ ) noexcept ;
+
+        // charges the cpu time and the reports it and the stream took to the rate controller
+        bool update ( telemetry_state const & _telemetry_, led_ladder const & _leds_ ) noexcept ;
+
+        // the tasks the last update ran
+        [[ nodiscard ]] constexpr task_mask last_due () const noexcept { return last_due_ ; }
+private:
+        simulator       & simulator_ ;
+        force_streamer  &  streamer_ ;
+        task_scheduler  & scheduler_ ;
+        rate_controller &      rate_ ;
+
+        task_mask last_due_ { 0 } ;
+
+        bool _update      ( telemetry_state const & _telemetry_, led_ladder const & _leds_ ) noexcept ;
+        bool _update_leds ( float                   _rpm_      , led_ladder const & _leds_ ) noexcept ;
+} ;
+
+////////////////////////////////////////////////////////////////////////////////
+////////////////////////////////////////////////////////////////////////////////
+
+inline bool frame_pipeline::apply_profile ( force_profile const & _profile_ ) noexcept
+{
+        if( &_profile_ == simulator_.profile() ) return false ;
+
+        std::lock_guard< std::mutex > io_lock( streamer_.io_mutex() ) ;
+        simulator_.apply_profile( _profile_ ) ;
+
+        return true ;
+}
+
+inline bool frame_pipeline::update ( telemetry_state const & _telemetry_, led_ladder const & _leds_ ) noexcept
+{
+        timestamp_t const cpu_start = thread_cpu_us() ;
+
+        bool const ok = _update( _telemetry_, _leds_ ) ;
+
+        wheel const & wheel = simulator_.wheel_ref() ;
+
+        rate_.account( _telemetry_.timestamp, thread_cpu_us() - cpu_start, wheel.reports_written(), wheel.stream_reports_written() ) ;
+
+        return ok ;
+}
+
+inline bool frame_pipeline::_update ( telemetry_state const & _telemetry_, led_ladder const & _leds_ ) noexcept
+{
+        last_due_ = 0 ;
+
+        if( !simulator_.wheel_ref() ) return false ;
+
+        simulator_.observe( _telemetry_, streamer_.running() ? streamer_.period_us() : 0 ) ;
+
+        if( streamer_.running() )
+        {
+                streamer_.publish( simulator_.torque_target() ) ;
+        }
+
+        // leaving idle puts every task back on its deadline right away
+        if( rate_.observe( _telemetry_, simulator_.outputs() ) ) scheduler_.reset() ;
+
+        streamer_.set_idle( rate_.mode() == rate_mode::idle ) ;
+
+        task_mask const due = rate_.gate( scheduler_.poll( _telemetry_.timestamp ), _telemetry_.timestamp ) ;
+
+        last_due_ = due ;
+
+        if( due == 0 ) return true ;
+
+        std::lock_guard< std::mutex > io_lock( streamer_.io_mutex() ) ;
+
+        simulator_.update_forces( _telemetry_, due ) ;
+
+        if( task_due( due, ffb_task::leds ) )
+        {
+                _update_leds( _telemetry_.rpm, _leds_ ) ;
+        }
+        return true ;
+}
+
+inline bool frame_pipeline::_update_leds ( float _rpm_, led_ladder const & _leds_ ) noexcept
+{
+        wheel & wheel = simulator_.wheel_ref() ;
+
+        // the pattern only goes out when it changed
+        wheel_state desired = wheel.device_state() ;
+        desired.leds = _leds_.pattern( _rpm_ ) ;
+
+        return wheel.apply( desired ) ;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
+
+} // namespace fffb
@@ -0,0 +1,218 @@
+//
+//
+//      fffb
+//      force/predictor.hxx
+//
+
+#pragma once
+
+#include <fffb/util/types.hxx>
+
+
+namespace fffb
+{
+
+
+////////////////////////////////////////////////////////////////////////////////
+
+class alpha_beta_filter
+{
+public:
+        constexpr alpha_beta_filter ( float _alpha_, float _beta_ ) noexcept : alpha_( _alpha_ ), beta_( _beta_ ) {}
+
+        constexpr void update ( float _measured_, timestamp_t _time_us_ ) noexcept ;
+
+        [[ nodiscard ]] constexpr float predict ( timestamp_t _lead_us_ ) const noexcept
+        { return x_ + v_ * ( static_cast< float >( _lead_us_ ) * 1e-6f ) ; }
+
+        constexpr void reset () noexcept { primed_ = false ; x_ = v_ = 0.0f ; }
+
+        constexpr void set_gains ( float _alpha_, float _beta_ ) noexcept { alpha_ = _alpha_ ; beta_ = _beta_ ; }
+
+        [[ nodiscard ]] constexpr float    value () const noexcept { return x_ ; }
+        [[ nodiscard ]] constexpr float velocity () const noexcept { return v_ ; }
+private:
+        float alpha_ ;
+        float  beta_ ;
+
+        float x_ { 0.0f } ;
+        float v_ { 0.0f } ;
+
+        timestamp_t last_us_ { 0 } ;
+        bool         primed_ { false } ;
+} ;
+
+constexpr void alpha_beta_filter::update ( float _measured_, timestamp_t _time_us_ ) noexcept
+{
+        if( !primed_ || _time_us_ <= last_us_ )
+        {
+                // first sample, timer restart or a repeated frame while paused
+                if( !primed_ || _time_us_ < last_us_ ) { x_ = _measured_ ; v_ = 0.0f ; }
+                last_us_ = _time_us_ ;
+                primed_  = true ;
+                return ;
+        }
+        float const dt = static_cast< float >( _time_us_ - last_us_ ) * 1e-6f ;
+        last_us_ = _time_us_ ;
+
+        float const x_pred = x_ + v_ * dt ;
+        float const  resid = _measured_ - x_pred ;
+
+        x_  = x_pred + alpha_ * resid ;
+        v_ +=  (  beta_ / dt ) * resid ;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
+// exponentially weighted latency estimate, keeps the worst sample around for diagnostics
+
+class latency_estimator
+{
+public:
+        constexpr void add ( timestamp_t _sample_us_ ) noexcept
+        {
+                float const sample = static_cast< float >( _sample_us_ ) ;
+
+                mean_us_ = count_ ? mean_us_ + weight * ( sample - mean_us_ ) : sample ;
+
+                if( _sample_us_ > max_us_ ) max_us_ = _sample_us_ ;
+                ++count_ ;
+        }
+
+        [[ nodiscard ]] constexpr timestamp_t mean_us () const noexcept { return static_cast< timestamp_t >( mean_us_ ) ; }
+        [[ nodiscard ]] constexpr timestamp_t  max_us () const noexcept { return  max_us_ ; }
+        [[ nodiscard ]] constexpr uti::u64_t    count () const noexcept { return   count_ ; }
+private:
+        static constexpr float weight { 0.05f } ;
+
+        float       mean_us_ { 0 } ;
+        timestamp_t  max_us_ { 0 } ;
+        uti::u64_t    count_ { 0 } ;
+} ;
+
+////////////////////////////////////////////////////////////////////////////////
+
+enum class lead_mode
+{
+        off      ,
+        fixed    ,
+        measured ,
+} ;
+
+struct predictor_config
+{
+        lead_mode        mode { lead_mode::measured } ;
+        timestamp_t   lead_us {      0 } ; // used by lead_mode::fixed
+        timestamp_t    max_us { 100000 } ;
+
+        float alpha { 0.50f } ;
+        float  beta { 0.10f } ;
+} ;
+
+////////////////////////////////////////////////////////////////////////////////
+
+// tracks steering, speed and rpm with alpha-beta filters and extrapolates them
+// by the end to end latency of the force pipeline. the latency is made of the
+// time from frame start until the reports are written plus, on average, half
+// of the interval a force is held until the next update. a streamed force is
+// held for one stream period, not for a refresh interval
+
+template< typename State >
+class predictor
+{
+public:
+        constexpr void observe ( State const & _state_ ) noexcept ;
+
+        [[ nodiscard ]] constexpr State predict ( State const & _state_                        ) const noexcept { return predict( _state_, lead_us() ) ; }
+        [[ nodiscard ]] constexpr State predict ( State const & _state_, timestamp_t _lead_us_ ) const noexcept ;
+
+        constexpr void record_update ( timestamp_t _frame_start_us_, timestamp_t _written_us_ ) noexcept ;
+
+        constexpr void configure ( predictor_config const & _config_ ) noexcept
+        {
+                config_ = _config_ ;
+                steering_.set_gains( config_.alpha, config_.beta ) ;
+                   speed_.set_gains( config_.alpha, config_.beta ) ;
+                     rpm_.set_gains( config_.alpha, config_.beta ) ;
+        }
+
+        [[ nodiscard ]] constexpr predictor_config const & config () const noexcept { return config_ ; }
+
+        // the lead for a force held _hold_us_ until it is sent again
+        [[ nodiscard ]] constexpr timestamp_t lead_us ( timestamp_t _hold_us_ ) const noexcept ;
+        [[ nodiscard ]] constexpr timestamp_t lead_us (                       ) const noexcept { return lead_us( interval_.mean_us() ) ; }
+
+        [[ nodiscard ]] constexpr latency_estimator const &  pipeline_latency () const noexcept { return  pipeline_ ; }
+        [[ nodiscard ]] constexpr latency_estimator const & update_interval  () const noexcept { return  interval_ ; }
+private:
+        predictor_config config_ {} ;
+
+        alpha_beta_filter steering_ { predictor_config{}.alpha, predictor_config{}.beta } ;
+        alpha_beta_filter    speed_ { predictor_config{}.alpha, predictor_config{}.beta } ;
+        alpha_beta_filter      rpm_ { predictor_config{}.alpha, predictor_config{}.beta } ;
+
+        latency_estimator pipeline_ {} ;
+        latency_estimator interval_ {} ;
+
+        timestamp_t last_write_us_ { 0 } ;
+} ;
+
+////////////////////////////////////////////////////////////////////////////////
+
+template< typename State >
+constexpr void predictor< State >::observe ( State const & _state_ ) noexcept
+{
+        steering_.update( _state_.steering, _state_.timestamp ) ;
+           speed_.update( _state_.speed   , _state_.timestamp ) ;
+             rpm_.update( _state_.rpm     , _state_.timestamp ) ;
+}
+
+template< typename State >
+constexpr State predictor< State >::predict ( State const & _state_, timestamp_t _lead_us_ ) const noexcept
+{
+        if( _lead_us_ == 0 ) return _state_ ;
+
+        State predicted = _state_ ;
+
+        predicted.steering = steering_.predict( _lead_us_ ) ;
+        predicted.speed    =    speed_.predict( _lead_us_ ) ;
+        predicted.rpm      =      rpm_.predict( _lead_us_ ) ;
+
+        if( predicted.steering >  1.0f ) predicted.steering =  1.0f ;
+        if( predicted.steering < -1.0f ) predicted.steering = -1.0f ;
+        if( predicted.rpm      <  0.0f ) predicted.rpm      =  0.0f ;
+
+        // don't let the prediction flip the direction of travel
+        if( ( predicted.speed < 0.0f ) != ( _state_.speed < 0.0f ) ) predicted.speed = 0.0f ;
+
+        return predicted ;
+}
+
+template< typename State >
+constexpr void predictor< State >::record_update ( timestamp_t _frame_start_us_, timestamp_t _written_us_ ) noexcept
+{
+        if( _written_us_ >= _frame_start_us_ ) pipeline_.add( _written_us_ - _frame_start_us_ ) ;
+
+        if( last_write_us_ && _written_us_ > last_write_us_ ) interval_.add( _written_us_ - last_write_us_ ) ;
+
+        last_write_us_ = _written_us_ ;
+}
+
+template< typename State >
+constexpr timestamp_t predictor< State >::lead_us ( timestamp_t _hold_us_ ) const noexcept
+{
+        timestamp_t lead { 0 } ;
+
+        switch( config_.mode )
+        {
+                case lead_mode::off      : return 0 ;
+                case lead_mode::fixed    : lead = config_.lead_us ; break ;
+                case lead_mode::measured : lead = pipeline_.mean_us() + _hold_us_ / 2 ; break ;
+        }
+        return lead < config_.max_us ? lead : config_.max_us ;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
+
+} // namespace fffb
@@ -0,0 +1,514 @@
+//
+//
+//      fffb
+//      force/profile.hxx
+//
+
+#pragma once
+
+#include <fffb/util/types.hxx>
+#include <fffb/util/file_watcher.hxx>
+#include <fffb/joy/protocol.hxx>
+#include <fffb/force/effect_graph.hxx>
+#include <fffb/force/effects.hxx>
+#include <fffb/force/output_filter.hxx>
+#include <fffb/force/clipping.hxx>
+
+#include <new>
+#include <atomic>
+#include <thread>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+#ifndef   FFFB_PROFILE_FILE_PATH
+#define   FFFB_PROFILE_FILE_PATH "/tmp/fffb.profile"
+#endif // FFFB_PROFILE_FILE_PATH
+
+#define FFFB_PROFILE_MAX_SIZE  16384
+#define FFFB_PROFILE_LED_STEPS     4
+
+
+namespace fffb
+{
+
+
+////////////////////////////////////////////////////////////////////////////////
+
+// everything the force path is tuned with. snapshots are built and validated
+// off the game thread and never change once published
+//
+// file format, one 'key = value' per line, '#' starts a comment:
+//
+//      spring.curve          = 0:0 2:32 2:33 70:67 256:253
+//      spring.slope          = 3
+//      spring.min_speed      = 0.1
+//      torque.gain           = 1.0
+//      damper.slope.running  = 3
+//      damper.slope.stopped  = 6
+//      leds.fraction         = 0.40 0.52 0.64 0.72  # of the truck's rpm limit
+//      leds.rpm              = 1000 1300 1600 1800  # absolute, replaces leds.fraction
+//      autocenter.baseline   = 3072
+//      filter.constant       = slew 4             # units per second
+//      filter.spring         = one_pole 0.05      # time constant
+//      filter.damper         = none
+//      filter.trapezoid      = biquad 5 0.707 60  # cutoff, q, update rate
+//      agc                   = 0.02               # clip ratio to stay under, or off
+
+// rpm thresholds resolved for one truck, one more led for every one reached,
+// all off with the engine off
+struct led_ladder
+{
+        float rpm [ FFFB_PROFILE_LED_STEPS ] {} ;
+
+        [[ nodiscard ]] constexpr uti::u8_t pattern ( float _rpm_ ) const noexcept
+        {
+                if( _rpm_ == 0 ) return 0x00 ;
+
+                uti::u8_t leds { 1 } ;
+
+                for( auto const threshold : rpm ) leds += _rpm_ >= threshold ;
+
+                return static_cast< uti::u8_t >( ( 1u << leds ) - 1 ) ;
+        }
+} ;
+
+struct force_profile
+{
+        effect_params  params { default_effect_params() } ;
+        effect_program program {} ;
+
+        // the default fractions land on 1000 1300 1600 1800 at a 2500 rpm limit
+        float led_fraction [ FFFB_PROFILE_LED_STEPS ] { 0.40f, 0.52f, 0.64f, 0.72f } ;
+        float led_rpm      [ FFFB_PROFILE_LED_STEPS ] {} ;
+        bool  led_absolute { false } ;
+
+        uti::u16_t baseline_autocenter { protocol::HIDPP_FF_BASELINE_AUTOCENTER } ;
+
+        filter_config filters [ static_cast< uti::u8_t >( filter_slot::count ) ] {} ;
+
+        agc_config agc {} ;
+
+        uti::u32_t version { 0 } ;
+
+        [[ nodiscard ]] constexpr led_ladder leds ( float _rpm_limit_ ) const noexcept
+        {
+                led_ladder ladder {} ;
+
+                for( uti::u8_t i = 0; i < FFFB_PROFILE_LED_STEPS; ++i )
+                {
+                        ladder.rpm[ i ] = led_absolute ? led_rpm[ i ] : led_fraction[ i ] * _rpm_limit_ ;
+                }
+                return ladder ;
+        }
+
+        [[ nodiscard ]] bool compile () noexcept { return make_effect_graph( params ).compile( program ) ; }
+} ;
+
+[[ nodiscard ]] bool parse_profile ( char const * _text_, force_profile & _profile_ ) noexcept ;
+[[ nodiscard ]] bool  load_profile ( char const * _path_, force_profile & _profile_ ) noexcept ;
+
+////////////////////////////////////////////////////////////////////////////////
+
+// owns the published snapshot and the thread that rebuilds it when the file changes.
+// readers grab current() once per frame and report the one they switched to with
+// applied(), replaced snapshots older than that are freed on the next reload
+
+class profile_manager
+{
+public:
+                   profile_manager () noexcept ;
+                  ~profile_manager () noexcept ;
+
+        profile_manager ( profile_manager const & ) = delete ;
+        profile_manager & operator= ( profile_manager const & ) = delete ;
+
+        bool start ( char const * _path_ ) noexcept ;
+        void stop  (                     ) noexcept ;
+
+        [[ nodiscard ]] force_profile const & current () const noexcept { return *current_.load( std::memory_order_acquire ) ; }
+
+        // the reader holds no snapshot older than _profile_ anymore
+        void applied ( force_profile const & _profile_ ) noexcept { applied_.store( _profile_.version, std::memory_order_release ) ; }
+private:
+        force_profile default_ {} ;
+
+        std::atomic< force_profile const * > current_ { &default_ } ;
+
+        vector< force_profile * > retired_ {} ;
+
+        std::atomic< uti::u32_t > applied_ { 0 } ;
+
+        file_watcher watcher_ {} ;
+        std::thread   thread_ ;
+        std::atomic< bool > running_ { false } ;
+
+        uti::u32_t version_ { 0 } ;
+
+        bool _reload  () noexcept ;
+        void _reclaim () noexcept ;
+        void _run     () noexcept ;
+} ;
+
+////////////////////////////////////////////////////////////////////////////////
+////////////////////////////////////////////////////////////////////////////////
+
+namespace detail
+{
+
+
+inline char const * _skip_space ( char const * _p_ ) noexcept
+{
+        while( *_p_ == ' ' || *_p_ == '\t' ) ++_p_ ;
+        return _p_ ;
+}
+
+inline bool _key_is ( char const * _key_, uti::ssize_t _len_, char const * _name_ ) noexcept
+{
+        return static_cast< uti::ssize_t >( std::strlen( _name_ ) ) == _len_ && std::strncmp( _key_, _name_, _len_ ) == 0 ;
+}
+
+inline bool _parse_float ( char const * & _p_, float & _out_ ) noexcept
+{
+        char * end ;
+        _out_ = std::strtof( _p_, &end ) ;
+
+        if( end == _p_ ) return false ;
+
+        _p_ = end ;
+        return true ;
+}
+
+inline bool _parse_uint ( char const * & _p_, uti::u32_t _max_, uti::u32_t & _out_ ) noexcept
+{
+        char * end ;
+        unsigned long const value = std::strtoul( _p_, &end, 0 ) ;
+
+        if( end == _p_ || value > _max_ ) return false ;
+
+        _out_ = static_cast< uti::u32_t >( value ) ;
+        _p_   = end ;
+        return true ;
+}
+
+inline bool _parse_filter ( char const * _p_, filter_config & _config_ ) noexcept
+{
+        filter_config config {} ;
+
+        char const * kind = _skip_space( _p_ ) ;
+        char const * end  = kind ;
+
+        while( *end && *end != ' ' && *end != '\t' ) ++end ;
+
+        _p_ = end ;
+
+        if( _key_is( kind, end - kind, "none" ) )
+        {
+                config.kind = filter_kind::none ;
+        }
+        else if( _key_is( kind, end - kind, "slew" ) )
+        {
+                config.kind = filter_kind::slew ;
+                if( !_parse_float( _p_, config.slew_per_s ) ) return false ;
+        }
+        else if( _key_is( kind, end - kind, "one_pole" ) )
+        {
+                config.kind = filter_kind::one_pole ;
+                if( !_parse_float( _p_, config.tau_s ) ) return false ;
+        }
+        else if( _key_is( kind, end - kind, "biquad" ) )
+        {
+                config.kind = filter_kind::biquad ;
+                if( !_parse_float( _p_, config.cutoff_hz ) || !_parse_float( _p_, config.q ) || !_parse_float( _p_, config.rate_hz ) ) return false ;
+        }
+        else
+        {
+                return false ;
+        }
+        if( !config.valid() ) return false ;
+
+        _config_ = config ;
+        return true ;
+}
+
+inline bool _parse_line ( char const * _key_, uti::ssize_t _len_, char const * _p_, force_profile & _profile_ ) noexcept
+{
+        effect_params & params = _profile_.params ;
+
+        uti::u32_t u { 0 } ;
+
+        if( _key_is( _key_, _len_, "spring.curve" ) )
+        {
+                params.spring_points = 0 ;
+
+                for( _p_ = _skip_space( _p_ ); *_p_; _p_ = _skip_space( _p_ ) )
+                {
+                        curve_point point ;
+
+                        if( params.spring_points == FFFB_EFFECT_MAX_CURVE_POINTS ) return false ;
+
+                        if( !_parse_float( _p_, point.x ) || *_p_++ != ':' || !_parse_float( _p_, point.y ) ) return false ;
+
+                        // control points have to be sorted for the baked table to make sense
+                        if( params.spring_points && point.x < params.spring_curve[ params.spring_points - 1 ].x ) return false ;
+
+                        if( point.y < 0.0f || point.y > 255.0f ) return false ;
+
+                        params.spring_curve[ params.spring_points++ ] = point ;
+                }
+                return params.spring_points >= 2 ;
+        }
+        if( _key_is( _key_, _len_, "spring.slope" ) )
+        {
+                if( !_parse_uint( _p_, 7, u ) ) return false ;
+                params.spring_slope = static_cast< uti::u8_t >( u ) ;
+                return true ;
+        }
+        if( _key_is( _key_, _len_, "spring.min_speed" ) )
+        {
+                return _parse_float( _p_, params.spring_min_speed ) && params.spring_min_speed >= 0.0f ;
+        }
+        if( _key_is( _key_, _len_, "torque.gain" ) )
+        {
+                return _parse_float( _p_, params.torque_gain ) && params.torque_gain >= 0.0f && params.torque_gain <= 4.0f ;
+        }
+        if( _key_is( _key_, _len_, "damper.slope.running" ) )
+        {
+                if( !_parse_uint( _p_, 7, u ) ) return false ;
+                params.damper_slope_running = static_cast< uti::u8_t >( u ) ;
+                return true ;
+        }
+        if( _key_is( _key_, _len_, "damper.slope.stopped" ) )
+        {
+                if( !_parse_uint( _p_, 7, u ) ) return false ;
+                params.damper_slope_stopped = static_cast< uti::u8_t >( u ) ;
+                return true ;
+        }
+        if( _key_is( _key_, _len_, "leds.rpm" ) )
+        {
+                for( uti::ssize_t i = 0; i < FFFB_PROFILE_LED_STEPS; ++i )
+                {
+                        if( !_parse_float( _p_, _profile_.led_rpm[ i ] ) ) return false ;
+                        if( i && _profile_.led_rpm[ i ] < _profile_.led_rpm[ i - 1 ] ) return false ;
+                }
+                _profile_.led_absolute = true ;
+                return true ;
+        }
+        if( _key_is( _key_, _len_, "leds.fraction" ) )
+        {
+                for( uti::ssize_t i = 0; i < FFFB_PROFILE_LED_STEPS; ++i )
+                {
+                        if( !_parse_float( _p_, _profile_.led_fraction[ i ] ) ) return false ;
+                        if( _profile_.led_fraction[ i ] <= 0.0f || _profile_.led_fraction[ i ] > 2.0f ) return false ;
+                        if( i && _profile_.led_fraction[ i ] < _profile_.led_fraction[ i - 1 ] ) return false ;
+                }
+                return true ;
+        }
+        if( _key_is( _key_, _len_, "autocenter.baseline" ) )
+        {
+                if( !_parse_uint( _p_, 0xFFFF, u ) ) return false ;
+                _profile_.baseline_autocenter = static_cast< uti::u16_t >( u ) ;
+                return true ;
+        }
+        if( _key_is( _key_, _len_, "agc" ) )
+        {
+                _profile_.agc = {} ;
+
+                if( std::strncmp( _skip_space( _p_ ), "off", 3 ) == 0 ) return true ;
+
+                _profile_.agc.enabled = true ;
+
+                return _parse_float( _p_, _profile_.agc.target ) && _profile_.agc.valid() ;
+        }
+        constexpr char const * filter_keys [] { "filter.constant", "filter.spring", "filter.damper", "filter.trapezoid" } ;
+
+        static_assert( sizeof( filter_keys ) / sizeof( filter_keys[ 0 ] ) == static_cast< uti::u8_t >( filter_slot::count ) ) ;
+
+        for( uti::u8_t slot = 0; slot < static_cast< uti::u8_t >( filter_slot::count ); ++slot )
+        {
+                if( _key_is( _key_, _len_, filter_keys[ slot ] ) ) return _parse_filter( _p_, _profile_.filters[ slot ] ) ;
+        }
+        FFFB_F_WARN_S( "profile::parse", "ignoring unknown key '%.*s'", static_cast< int >( _len_ ), _key_ ) ;
+        return true ;
+}
+
+
+} // namespace detail
+
+////////////////////////////////////////////////////////////////////////////////
+
+inline bool parse_profile ( char const * _text_, force_profile & _profile_ ) noexcept
+{
+        force_profile profile {} ;
+
+        char line [ 512 ] ;
+        uti::u32_t line_no { 0 } ;
+
+        for( char const * p = _text_; *p; )
+        {
+                char const * eol = std::strchr( p, '\n' ) ;
+                uti::ssize_t len = eol ? eol - p : static_cast< uti::ssize_t >( std::strlen( p ) ) ;
+
+                ++line_no ;
+
+                if( len >= static_cast< uti::ssize_t >( sizeof( line ) ) )
+                {
+                        FFFB_F_ERR_S( "profile::parse", "line %u too long", line_no ) ;
+                        return false ;
+                }
+                std::memcpy( line, p, len ) ;
+                line[ len ] = '\0' ;
+
+                p = eol ? eol + 1 : p + len ;
+
+                if( char * comment = std::strchr( line, '#'  ) ) *comment = '\0' ;
+                if( char *      cr = std::strchr( line, '\r' ) ) *cr      = '\0' ;
+
+                char const * key = detail::_skip_space( line ) ;
+
+                if( *key == '\0' ) continue ;
+
+                char const * eq = std::strchr( key, '=' ) ;
+
+                if( !eq )
+                {
+                        FFFB_F_ERR_S( "profile::parse", "line %u : expected 'key = value'", line_no ) ;
+                        return false ;
+                }
+                char const * key_end = eq ;
+                while( key_end > key && ( key_end[ -1 ] == ' ' || key_end[ -1 ] == '\t' ) ) --key_end ;
+
+                if( !detail::_parse_line( key, key_end - key, detail::_skip_space( eq + 1 ), profile ) )
+                {
+                        FFFB_F_ERR_S( "profile::parse", "line %u : invalid value for '%.*s'", line_no, static_cast< int >( key_end - key ), key ) ;
+                        return false ;
+                }
+        }
+        if( !profile.compile() )
+        {
+                FFFB_F_ERR_S( "profile::parse", "failed compiling effects" ) ;
+                return false ;
+        }
+        _profile_ = profile ;
+        return true ;
+}
+
+inline bool load_profile ( char const * _path_, force_profile & _profile_ ) noexcept
+{
+        FILE * file = std::fopen( _path_, "rb" ) ;
+
+        if( !file ) return false ;
+
+        // too big for the stack of whatever thread loads it
+        vector< char > text( FFFB_PROFILE_MAX_SIZE + 1, '\0' ) ;
+
+        uti::ssize_t const len = static_cast< uti::ssize_t >( std::fread( text.data(), 1, FFFB_PROFILE_MAX_SIZE + 1, file ) ) ;
+        std::fclose( file ) ;
+
+        if( len > FFFB_PROFILE_MAX_SIZE )
+        {
+                FFFB_F_ERR_S( "profile::load", "'%s' is larger than %d bytes", _path_, FFFB_PROFILE_MAX_SIZE ) ;
+                return false ;
+        }
+        text[ len ] = '\0' ;
+
+        return parse_profile( text.data(), _profile_ ) ;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
+inline profile_manager::profile_manager () noexcept
+{
+        if( !default_.compile() ) FFFB_F_ERR_S( "profile_manager", "failed compiling default effects!" ) ;
+}
+
+inline profile_manager::~profile_manager () noexcept
+{
+        stop() ;
+
+        for( auto * profile : retired_ ) delete profile ;
+
+        if( current_.load() != &default_ ) delete current_.load() ;
+}
+
+inline bool profile_manager::start ( char const * _path_ ) noexcept
+{
+        if( running_.load( std::memory_order_acquire ) ) return true ;
+
+        if( !watcher_.open( _path_ ) ) return false ;
+
+        // the first load happens right away so the first frame already uses it
+        if( !_reload() ) FFFB_F_INFO_S( "profile_manager::start", "no usable profile at '%s', using defaults", _path_ ) ;
+
+        running_.store( true, std::memory_order_release ) ;
+        thread_ = std::thread( &profile_manager::_run, this ) ;
+
+        return true ;
+}
+
+inline void profile_manager::stop () noexcept
+{
+        if( !running_.exchange( false, std::memory_order_acq_rel ) ) return ;
+
+        if( thread_.joinable() ) thread_.join() ;
+
+        watcher_.close() ;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
+inline bool profile_manager::_reload () noexcept
+{
+        force_profile * profile = new ( std::nothrow ) force_profile {} ;
+
+        if( !profile ) return false ;
+
+        if( !load_profile( watcher_.path(), *profile ) )
+        {
+                delete profile ;
+                return false ;
+        }
+        profile->version = ++version_ ;
+
+        force_profile const * old = current_.exchange( profile, std::memory_order_acq_rel ) ;
+
+        _reclaim() ;
+
+        if( old != &default_ ) retired_.push_back( const_cast< force_profile * >( old ) ) ;
+
+        FFFB_F_INFO_S( "profile_manager::reload", "loaded profile v%u from '%s'", profile->version, watcher_.path() ) ;
+        return true ;
+}
+
+// versions only go up, so whatever came before the applied one is out of the reader's hands
+inline void profile_manager::_reclaim () noexcept
+{
+        uti::u32_t const applied = applied_.load( std::memory_order_acquire ) ;
+
+        for( uti::ssize_t i = retired_.size() - 1; i >= 0; --i )
+        {
+                if( retired_[ i ]->version >= applied ) continue ;
+
+                delete retired_[ i ] ;
+                retired_.erase( i ) ;
+        }
+}
+
+inline void profile_manager::_run () noexcept
+{
+        while( running_.load( std::memory_order_acquire ) )
+        {
+                if( !watcher_.wait( 250 ) ) continue ;
+
+                // let the writer finish before reading a half saved file
+                std::this_thread::sleep_for( std::chrono::milliseconds( 50 ) ) ;
+
+                ( void ) _reload() ;
+        }
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
+
+} // namespace fffb
@@ -0,0 +1,206 @@
+//
+//
+//      fffb
+//      force/rate_controller.hxx
+//
+
+#pragma once
+
+#include <fffb/util/types.hxx>
+#include <fffb/telemetry/state.hxx>
+#include <fffb/force/scheduler.hxx>
+#include <fffb/force/effect_graph.hxx>
+
+
+namespace fffb
+{
+
+
+////////////////////////////////////////////////////////////////////////////////
+
+enum class rate_mode : uti::u8_t
+{
+        active ,
+        idle   ,
+        count  ,
+} ;
+
+// rates of change below which a signal counts as steady, per second
+struct rate_controller_config
+{
+        bool enabled { true } ;
+
+        float steering_per_s {  0.02f } ;
+        float    speed_per_s {  0.20f } ;
+        float      rpm_per_s { 20.00f } ;
+        float   torque_per_s {  0.02f } ;
+        float    level_per_s {  2.00f } ; // every other sink, in its own units
+
+        timestamp_t    settle_us { 1000000 } ; // steady this long before idling
+        timestamp_t keepalive_us { 1000000 } ; // update period while idle
+} ;
+
+struct rate_mode_stats
+{
+        timestamp_t time_us { 0 } ;
+        timestamp_t  cpu_us { 0 } ;
+        uti::u64_t  reports { 0 } ; // from the game thread
+        uti::u64_t   stream { 0 } ; // from the stream thread
+        uti::u64_t   frames { 0 } ;
+
+        [[ nodiscard ]] constexpr float per_minute ( float _value_ ) const noexcept
+        { return time_us ? _value_ * 60.0e6f / static_cast< float >( time_us ) : 0.0f ; }
+
+        [[ nodiscard ]] constexpr float     cpu_ms_per_minute () const noexcept { return per_minute( static_cast< float >( cpu_us ) * 1e-3f ) ; }
+        [[ nodiscard ]] constexpr float    reports_per_minute () const noexcept { return per_minute( static_cast< float >( reports ) ) ; }
+        [[ nodiscard ]] constexpr float     stream_per_minute () const noexcept { return per_minute( static_cast< float >(  stream ) ) ; }
+} ;
+
+////////////////////////////////////////////////////////////////////////////////
+
+// drops force and led updates to a keep-alive while inputs and force targets sit
+// still, and goes back to the scheduler's full rate on the first frame where any
+// of them moves faster than its threshold
+
+class rate_controller
+{
+public:
+        constexpr void configure ( rate_controller_config const & _config_ ) noexcept { config_ = _config_ ; mode_ = rate_mode::active ; }
+
+        // true when a steady stretch just ended, every task should run right away
+        [[ nodiscard ]] constexpr bool observe ( telemetry_state const & _state_, effect_outputs const & _outputs_ ) noexcept ;
+
+        // what of the scheduler's due tasks actually runs
+        [[ nodiscard ]] constexpr task_mask gate ( task_mask _due_, timestamp_t _now_ ) noexcept ;
+
+        // charges cpu time and the running report counts to the current mode
+        constexpr void account ( timestamp_t _now_, timestamp_t _cpu_us_, uti::u64_t _reports_total_, uti::u64_t _stream_total_ ) noexcept ;
+
+        [[ nodiscard ]] constexpr rate_mode mode () const noexcept { return mode_ ; }
+
+        [[ nodiscard ]] constexpr rate_mode_stats const & stats ( rate_mode _mode_ ) const noexcept
+        { return stats_[ static_cast< uti::u8_t >( _mode_ ) ] ; }
+private:
+        rate_controller_config config_ {} ;
+
+        rate_mode mode_ { rate_mode::active } ;
+
+        float steering_ { 0 } ;
+        float    speed_ { 0 } ;
+        float      rpm_ { 0 } ;
+        effect_outputs outputs_ {} ;
+
+        timestamp_t      last_ { 0 } ;
+        timestamp_t    steady_ { 0 } ; // since when nothing moved
+        timestamp_t keepalive_ { 0 } ;
+
+        rate_mode_stats stats_ [ static_cast< uti::u8_t >( rate_mode::count ) ] {} ;
+
+        timestamp_t last_account_ { 0 } ;
+        uti::u64_t  last_reports_ { 0 } ;
+        uti::u64_t   last_stream_ { 0 } ;
+
+        [[ nodiscard ]] constexpr bool _moved ( telemetry_state const & _state_, effect_outputs const & _outputs_, float _dt_s_ ) const noexcept ;
+} ;
+
+////////////////////////////////////////////////////////////////////////////////
+////////////////////////////////////////////////////////////////////////////////
+
+constexpr bool rate_controller::observe ( telemetry_state const & _state_, effect_outputs const & _outputs_ ) noexcept
+{
+        timestamp_t const now = _state_.timestamp ;
+
+        bool moved { true } ;
+
+        if( last_ != 0 && now > last_ )
+        {
+                moved = _moved( _state_, _outputs_, static_cast< float >( now - last_ ) * 1e-6f ) ;
+        }
+        else if( last_ != 0 && now == last_ )
+        {
+                // repeated frame while paused, nothing to compare
+                moved = false ;
+        }
+        steering_ = _state_.steering ;
+        speed_    = _state_.speed    ;
+        rpm_      = _state_.rpm      ;
+        outputs_  = _outputs_        ;
+        last_     = now ;
+
+        if( moved || !config_.enabled )
+        {
+                steady_ = now ;
+
+                bool const woke = mode_ == rate_mode::idle ;
+                mode_ = rate_mode::active ;
+
+                if( woke ) FFFB_F_DBG_S( "rate_controller", "forces moving, back to full rate" ) ;
+                return woke ;
+        }
+        if( mode_ == rate_mode::active && now - steady_ >= config_.settle_us )
+        {
+                FFFB_F_DBG_S( "rate_controller", "forces steady, idling" ) ;
+
+                mode_      = rate_mode::idle ;
+                keepalive_ = now + config_.keepalive_us ;
+        }
+        return false ;
+}
+
+constexpr task_mask rate_controller::gate ( task_mask _due_, timestamp_t _now_ ) noexcept
+{
+        if( mode_ == rate_mode::active ) return _due_ ;
+
+        if( _now_ < keepalive_ && keepalive_ - _now_ <= config_.keepalive_us ) return 0 ;
+
+        keepalive_ = _now_ + config_.keepalive_us ;
+        return _due_ ;
+}
+
+constexpr void rate_controller::account ( timestamp_t _now_, timestamp_t _cpu_us_, uti::u64_t _reports_total_, uti::u64_t _stream_total_ ) noexcept
+{
+        rate_mode_stats & stats = stats_[ static_cast< uti::u8_t >( mode_ ) ] ;
+
+        if( last_account_ != 0 && _now_ > last_account_ ) stats.time_us += _now_ - last_account_ ;
+
+        stats.cpu_us  += _cpu_us_ ;
+        stats.reports += _reports_total_ - last_reports_ ;
+        stats.stream  +=  _stream_total_ -  last_stream_ ;
+        stats.frames  += 1 ;
+
+        last_account_ = _now_ ;
+        last_reports_ = _reports_total_ ;
+        last_stream_  =  _stream_total_ ;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
+constexpr bool rate_controller::_moved ( telemetry_state const & _state_, effect_outputs const & _outputs_, float _dt_s_ ) const noexcept
+{
+        auto const exceeds = [ & ]( float _now_, float _before_, float _per_s_ )
+        {
+                float const delta = _now_ - _before_ ;
+                return ( delta < 0.0f ? -delta : delta ) > _per_s_ * _dt_s_ ;
+        } ;
+
+        if( exceeds( _state_.steering, steering_, config_.steering_per_s ) ) return true ;
+        if( exceeds( _state_.speed   , speed_   , config_.   speed_per_s ) ) return true ;
+        if( exceeds( _state_.rpm     , rpm_     , config_.     rpm_per_s ) ) return true ;
+
+        if( _outputs_.written != outputs_.written ) return true ;
+
+        for( uti::u8_t sink = 0; sink < static_cast< uti::u8_t >( effect_sink::count ); ++sink )
+        {
+                if( !( ( _outputs_.written >> sink ) & 1 ) ) continue ;
+
+                float const per_s = sink == static_cast< uti::u8_t >( effect_sink::constant_torque ) ? config_.torque_per_s : config_.level_per_s ;
+
+                if( exceeds( _outputs_.values[ sink ].to_float(), outputs_.values[ sink ].to_float(), per_s ) ) return true ;
+        }
+        return false ;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
+
+} // namespace fffb
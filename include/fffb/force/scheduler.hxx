@@ -0,0 +1,116 @@
+//
+//
+//      fffb
+//      force/scheduler.hxx
+//
+
+#pragma once
+
+#include <fffb/util/types.hxx>
+
+
+namespace fffb
+{
+
+
+////////////////////////////////////////////////////////////////////////////////
+
+enum class ffb_task : uti::u8_t
+{
+        constant  ,
+        spring    ,
+        damper    ,
+        trapezoid ,
+        leds      ,
+        count     ,
+} ;
+
+using task_mask = uti::u32_t ;
+
+[[ nodiscard ]] constexpr task_mask task_bit ( ffb_task _task_ ) noexcept
+{ return task_mask( 1 ) << static_cast< uti::u8_t >( _task_ ) ; }
+
+[[ nodiscard ]] constexpr bool task_due ( task_mask _due_, ffb_task _task_ ) noexcept
+{ return ( _due_ & task_bit( _task_ ) ) != 0 ; }
+
+////////////////////////////////////////////////////////////////////////////////
+
+// runs every task at its own period on the telemetry clock, independent of the frame rate.
+// a task whose deadline slipped by more than a period is rescheduled from now instead of
+// catching up, a clock that went backwards (timer restart) makes everything due again
+
+class task_scheduler
+{
+public:
+        static constexpr uti::ssize_t task_count { static_cast< uti::ssize_t >( ffb_task::count ) } ;
+
+        constexpr task_scheduler () noexcept ;
+
+        constexpr void set_period ( ffb_task _task_, timestamp_t _period_us_ ) noexcept
+        { period_us_[ _index( _task_ ) ] = _period_us_ ; }
+
+        constexpr void set_rate_hz ( ffb_task _task_, uti::u32_t _rate_hz_ ) noexcept
+        { set_period( _task_, _rate_hz_ ? 1000000 / _rate_hz_ : 0 ) ; }
+
+        [[ nodiscard ]] constexpr timestamp_t period_us ( ffb_task _task_ ) const noexcept
+        { return period_us_[ _index( _task_ ) ] ; }
+
+        [[ nodiscard ]] constexpr task_mask poll ( timestamp_t _now_us_ ) noexcept ;
+
+        constexpr void reset () noexcept ;
+private:
+        timestamp_t period_us_ [ task_count ] {} ;
+        timestamp_t   next_us_ [ task_count ] {} ;
+
+        timestamp_t last_us_ { 0 } ;
+
+        [[ nodiscard ]] static constexpr uti::ssize_t _index ( ffb_task _task_ ) noexcept
+        { return static_cast< uti::ssize_t >( _task_ ) ; }
+} ;
+
+////////////////////////////////////////////////////////////////////////////////
+////////////////////////////////////////////////////////////////////////////////
+
+constexpr task_scheduler::task_scheduler () noexcept
+{
+        set_rate_hz( ffb_task:: constant, 60 ) ;
+        set_rate_hz( ffb_task::   spring, 60 ) ;
+        set_rate_hz( ffb_task::   damper, 30 ) ;
+        set_rate_hz( ffb_task::trapezoid, 60 ) ;
+        set_rate_hz( ffb_task::     leds, 15 ) ;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
+constexpr task_mask task_scheduler::poll ( timestamp_t _now_us_ ) noexcept
+{
+        if( _now_us_ < last_us_ ) reset() ;
+
+        last_us_ = _now_us_ ;
+
+        task_mask due { 0 } ;
+
+        for( uti::ssize_t i = 0; i < task_count; ++i )
+        {
+                if( period_us_[ i ] == 0 || _now_us_ < next_us_[ i ] ) continue ;
+
+                due |= task_mask( 1 ) << i ;
+
+                next_us_[ i ] += period_us_[ i ] ;
+
+                if( next_us_[ i ] <= _now_us_ ) next_us_[ i ] = _now_us_ + period_us_[ i ] ;
+        }
+        return due ;
+}
+
+constexpr void task_scheduler::reset () noexcept
+{
+        for( auto & next : next_us_ ) next = 0 ;
+
+        last_us_ = 0 ;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
+
+} // namespace fffb
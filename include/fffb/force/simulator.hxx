@@ -7,7 +7,16 @@
 #pragma once
 
 #include <fffb/util/types.hxx>
+#include <fffb/util/clock.hxx>
+#include <fffb/telemetry/state.hxx>
 #include <fffb/joy/wheel.hxx>
+#include <fffb/force/predictor.hxx>
+#include <fffb/force/scheduler.hxx>
+#include <fffb/force/effect_graph.hxx>
+#include <fffb/force/effects.hxx>
+#include <fffb/force/output_filter.hxx>
+#include <fffb/force/clipping.hxx>
+#include <fffb/force/profile.hxx>
 
 
 namespace fffb
@@ -16,60 +25,80 @@ namespace fffb
 
 ////////////////////////////////////////////////////////////////////////////////
 
-struct telemetry_state
+// evaluates the effect program once per telemetry frame on the predicted state.
+// the scheduler then decides which of the cached outputs get sent to the wheel
+
+class simulator
 {
-        timestamp_t                       timestamp { static_cast< timestamp_t >( -1 ) } ;
-        timestamp_t         raw_rendering_timestamp { static_cast< timestamp_t >( -1 ) } ;
-        timestamp_t        raw_simulation_timestamp { static_cast< timestamp_t >( -1 ) } ;
-        timestamp_t raw_paused_simulation_timestamp { static_cast< timestamp_t >( -1 ) } ;
+public:
+        constexpr  simulator () noexcept ;
+        constexpr ~simulator () noexcept = default ;
 
-        bool orientation_available { false } ;
+        constexpr bool initialize_wheel () noexcept ;
 
-        float heading { -1.0 } ;
-        float   pitch { -1.0 } ;
-        float    roll { -1.0 } ;
+        constexpr bool load_effects ( effect_graph const & _graph_ ) noexcept ;
 
-        float steering { -1.0 } ;
-        float throttle { -1.0 } ;
-        float    brake { -1.0 } ;
-        float   clutch { -1.0 } ;
+        // the profile has to outlive its use, profile_manager keeps it until a newer one is applied
+        void apply_profile ( force_profile const & _profile_ ) noexcept ;
 
-        float    speed { -1.0 } ;
-        float      rpm { -1.0 } ;
-        int       gear { -1   } ;
+        [[ nodiscard ]] constexpr force_profile const * profile () const noexcept { return profile_ ; }
 
-        int substance_l { -1 } ;
-        int substance_r { -1 } ;
-} ;
+        // _stream_period_us_ is nonzero while the constant torque is streamed at that period
+        void observe       ( telemetry_state const & _new_state_, uti::u32_t _stream_period_us_ = 0 ) noexcept ;
+        void update_forces ( telemetry_state const & _new_state_, task_mask _due_ = ~task_mask( 0 ) ) noexcept ;
 
-////////////////////////////////////////////////////////////////////////////////
+        // filtered, the raw value is in outputs()
+        [[ nodiscard ]] constexpr q16 torque_target () const noexcept { return torque_ ; }
 
-class simulator
-{
-public:
-        constexpr  simulator () noexcept ;
-        constexpr ~simulator () noexcept = default ;
+        [[ nodiscard ]] constexpr effect_program const & program () const noexcept { return *active_ ; }
+        [[ nodiscard ]] constexpr effect_outputs const & outputs () const noexcept { return outputs_ ; }
 
-        constexpr bool initialize_wheel () noexcept ;
+        bool configure_filter ( filter_slot _slot_, filter_config const & _config_ ) noexcept ;
+
+        [[ nodiscard ]] constexpr output_filter const & filters () const noexcept { return filters_ ; }
+
+        bool configure_agc ( agc_config const & _config_ ) noexcept { return agc_.configure( _config_ ) ; }
 
-        constexpr void update_forces ( telemetry_state const & _new_state_ ) noexcept ;
+        [[ nodiscard ]] constexpr q16 gain () const noexcept { return agc_.gain() ; }
+
+        // levels as sent, normalized to the rail of each slot
+        [[ nodiscard ]] constexpr clip_window const & clip_stats ( filter_slot _slot_ ) const noexcept
+        { return clips_[ static_cast< uti::u8_t >( _slot_ ) ] ; }
+
+        constexpr void configure_predictor ( predictor_config const & _config_ ) noexcept { predictor_.configure( _config_ ) ; }
+
+        constexpr predictor< telemetry_state > const & predictor_ref () const noexcept { return predictor_ ; }
 
         constexpr wheel       & wheel_ref ()       noexcept { return wheel_ ; }
         constexpr wheel const & wheel_ref () const noexcept { return wheel_ ; }
 private:
         wheel wheel_ ;
 
-        constexpr void _update_autocenter ( telemetry_state const & _new_state_ ) noexcept ;
-        constexpr void _update_constant   ( telemetry_state const & _new_state_ ) noexcept ;
-        constexpr void _update_spring     ( telemetry_state const & _new_state_ ) noexcept ;
-        constexpr void _update_damper     ( telemetry_state const & _new_state_ ) noexcept ;
-        constexpr void _update_trapezoid  ( telemetry_state const & _new_state_ ) noexcept ;
+        predictor< telemetry_state > predictor_ {} ;
+
+        effect_program         program_ {} ;
+        effect_program const * active_  { &program_ } ;
+        force_profile  const * profile_ { nullptr } ;
+
+        effect_state  fx_state_ {} ;
+        effect_outputs outputs_ {} ;
 
-        constexpr uti::u8_t _map_rmp_to_freq ( float _rpm_ ) const noexcept
-        { return ( 255 - ( _rpm_ / 3000.0f * 255.0f ) ) / 4 ; }
+        timestamp_t last_eval_ { 0 } ;
 
-        constexpr uti::u8_t _map_speed_to_freq ( float _speed_ ) const noexcept
-        { return ( 255 - ( _speed_ / 160.0f * 255.0f ) ) / 4 ; }
+        output_filter filters_ {} ;
+        q16            torque_ {} ;
+
+        timestamp_t last_filtered_ [ static_cast< uti::u8_t >( filter_slot::count ) ] {} ;
+
+        clip_window clips_ [ static_cast< uti::u8_t >( filter_slot::count ) ] {} ;
+        auto_gain     agc_ {} ;
+
+        [[ nodiscard ]] constexpr uti::u8_t _apply_outputs ( task_mask _due_, timestamp_t _now_ ) noexcept ;
+
+        [[ nodiscard ]] constexpr q16 _filtered ( filter_slot _slot_, effect_sink _sink_, timestamp_t _now_ ) noexcept ;
+
+        [[ nodiscard ]] static constexpr uti::u8_t _to_u8 ( q16 _value_ ) noexcept
+        { return static_cast< uti::u8_t >( q16_clamp( _value_, q16{}, q16::from_int( 255 ) ).to_int() ) ; }
 } ;
 
 ////////////////////////////////////////////////////////////////////////////////
@@ -78,6 +107,8 @@ private:
 constexpr simulator::simulator () noexcept
 {
         if( !initialize_wheel() ) FFFB_F_ERR_S( "simulator", "failed initializing wheel!" ) ;
+
+        if( !load_effects( default_effect_graph() ) ) FFFB_F_ERR_S( "simulator", "failed compiling default effects!" ) ;
 }
 
 ////////////////////////////////////////////////////////////////////////////////
@@ -94,74 +125,189 @@ constexpr bool simulator::initialize_wheel () noexcept
 
 ////////////////////////////////////////////////////////////////////////////////
 
-constexpr void simulator::update_forces ( telemetry_state const & _new_state_ ) noexcept
+constexpr bool simulator::load_effects ( effect_graph const & _graph_ ) noexcept
 {
-        _update_autocenter( _new_state_ ) ;
-        _update_constant  ( _new_state_ ) ;
-        _update_spring    ( _new_state_ ) ;
-        _update_damper    ( _new_state_ ) ;
-        _update_trapezoid ( _new_state_ ) ;
+        effect_program program ;
 
-        wheel_.refresh_forces() ;
-}
+        if( !_graph_.compile( program ) ) return false ;
 
-////////////////////////////////////////////////////////////////////////////////
+        program_  = program ;
+        active_   = &program_ ;
+        profile_  = nullptr ;
+        fx_state_ = {} ;
+        outputs_  = {} ;
 
-constexpr void simulator::_update_autocenter ( [[ maybe_unused ]] telemetry_state const & _new_state_ ) noexcept
-{}
+        filters_.reset() ;
 
-////////////////////////////////////////////////////////////////////////////////
+        FFFB_F_DBG_S( "simulator::load_effects", "loaded %u ops using %u registers", program_.op_count, program_.register_count ) ;
+        return true ;
+}
+
+inline void simulator::apply_profile ( force_profile const & _profile_ ) noexcept
+{
+        profile_  = &_profile_ ;
+        active_   = &_profile_.program ;
+        fx_state_ = {} ;
+
+        for( uti::u8_t slot = 0; slot < static_cast< uti::u8_t >( filter_slot::count ); ++slot )
+        {
+                ( void ) configure_filter( static_cast< filter_slot >( slot ), _profile_.filters[ slot ] ) ;
+        }
+        ( void ) configure_agc( _profile_.agc ) ;
 
-constexpr void simulator::_update_constant ( [[ maybe_unused ]] telemetry_state const & _new_state_ ) noexcept
-{}
+        if( !wheel_.set_baseline_autocenter( _profile_.baseline_autocenter ) )
+        {
+                FFFB_F_WARN_S( "simulator::apply_profile", "failed applying baseline autocenter" ) ;
+        }
+        FFFB_F_INFO_S( "simulator::apply_profile", "switched to profile v%u", _profile_.version ) ;
+}
 
 ////////////////////////////////////////////////////////////////////////////////
 
-constexpr void simulator::_update_spring ( telemetry_state const & _new_state_ ) noexcept
+inline void simulator::observe ( telemetry_state const & _new_state_, uti::u32_t _stream_period_us_ ) noexcept
 {
-        double speed = _new_state_.speed < 0.0 ? -_new_state_.speed : _new_state_.speed ;
+        predictor_.observe( _new_state_ ) ;
 
-        wheel_.spring_force() = wheel::default_spring_f ;
+        q16 dt {} ;
 
-        if( speed < 0.10 )
+        if( _new_state_.timestamp > last_eval_ && last_eval_ != 0 )
         {
-                wheel_.spring_force().enabled = false ;
+                dt = q16_from_us( _new_state_.timestamp - last_eval_ ) ;
         }
-        else
+        last_eval_ = _new_state_.timestamp ;
+
+        // the streamed torque is extrapolated by its own shorter lead. both runs step
+        // the filters from the same state, the one for the refreshed forces keeps it
+        if( _stream_period_us_ )
         {
-                wheel_.spring_force().enabled = true ;
+                effect_state   stream_state = fx_state_ ;
+                effect_outputs stream       {} ;
+
+                evaluate( *active_, predictor_.predict( _new_state_, predictor_.lead_us( _stream_period_us_ ) ), dt, stream_state, stream ) ;
+                evaluate( *active_, predictor_.predict( _new_state_ ), dt, fx_state_, outputs_ ) ;
 
-                if     ( speed <=  2.0 ) { wheel_.spring_force().amplitude = static_cast< uti::u8_t >(      ( speed * 16 ) ) ; }
-                else if( speed <= 70.0 ) { wheel_.spring_force().amplitude = static_cast< uti::u8_t >( 32 + ( speed /  2 ) ) ; }
-                else                     { wheel_.spring_force().amplitude = static_cast< uti::u8_t >( 67 + ( speed - 70 ) ) ; }
+                outputs_.values[ static_cast< uti::u8_t >( effect_sink::constant_torque ) ] = stream[ effect_sink::constant_torque ] ;
+        }
+        else
+        {
+                evaluate( *active_, predictor_.predict( _new_state_ ), dt, fx_state_, outputs_ ) ;
         }
+
+        torque_ = _filtered( filter_slot::constant, effect_sink::constant_torque, _new_state_.timestamp ) ;
+
+        // the gain scales every amplitude, so the worst of them decides
+        q16 worst { clips_[ static_cast< uti::u8_t >( filter_slot::constant ) ].clip_ratio() } ;
+
+        if( clips_[ static_cast< uti::u8_t >( filter_slot::spring    ) ].clip_ratio() > worst ) worst = clips_[ static_cast< uti::u8_t >( filter_slot::spring    ) ].clip_ratio() ;
+        if( clips_[ static_cast< uti::u8_t >( filter_slot::trapezoid ) ].clip_ratio() > worst ) worst = clips_[ static_cast< uti::u8_t >( filter_slot::trapezoid ) ].clip_ratio() ;
+
+        agc_.update( worst, _new_state_.timestamp ) ;
+}
+
+inline bool simulator::configure_filter ( filter_slot _slot_, filter_config const & _config_ ) noexcept
+{
+        if( !filters_.configure( _slot_, _config_ ) ) return false ;
+
+        last_filtered_[ static_cast< uti::u8_t >( _slot_ ) ] = 0 ;
+        return true ;
 }
 
 ////////////////////////////////////////////////////////////////////////////////
 
-constexpr void simulator::_update_damper ( telemetry_state const & _new_state_ ) noexcept
+inline void simulator::update_forces ( telemetry_state const & _new_state_, task_mask _due_ ) noexcept
 {
-        double rpm = _new_state_.rpm ;
+        uti::u8_t const refresh = _apply_outputs( _due_, _new_state_.timestamp ) ;
+
+        if( refresh == 0 ) return ;
+
+        wheel_.refresh_forces( refresh ) ;
 
-        wheel_.damper_force() = wheel::default_damper_f ;
-        wheel_.damper_force().enabled = true ;
+        predictor_.record_update( _new_state_.host_timestamp, host_time_us() ) ;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
+constexpr uti::u8_t simulator::_apply_outputs ( task_mask _due_, timestamp_t _now_ ) noexcept
+{
+        uti::u8_t refresh { 0 } ;
 
-        if( rpm == 0 )
+        if( task_due( _due_, ffb_task::constant ) )
         {
-                wheel_.damper_force().slope_left  = 6 ;
-                wheel_.damper_force().slope_right = 6 ;
+                refresh |= force_bit( force_type::CONSTANT ) ;
         }
-        else
+        if( task_due( _due_, ffb_task::spring ) )
+        {
+                auto & spring = wheel_.spring_force() ;
+
+                spring = wheel::default_spring_f ;
+                spring.enabled = outputs_.flag( effect_sink::spring_enabled ) ;
+
+                if( outputs_.has( effect_sink::spring_amplitude ) ) spring.amplitude = _to_u8( _filtered( filter_slot::spring, effect_sink::spring_amplitude, _now_ ) ) ;
+                if( outputs_.has( effect_sink::spring_slope     ) ) spring.slope_left = spring.slope_right = _to_u8( outputs_[ effect_sink::spring_slope ] ) ;
+
+                refresh |= force_bit( force_type::SPRING ) ;
+        }
+        if( task_due( _due_, ffb_task::damper ) )
+        {
+                auto & damper = wheel_.damper_force() ;
+
+                damper = wheel::default_damper_f ;
+                damper.enabled = outputs_.flag( effect_sink::damper_enabled ) ;
+
+                if( outputs_.has( effect_sink::damper_slope ) ) damper.slope_left = damper.slope_right = _to_u8( _filtered( filter_slot::damper, effect_sink::damper_slope, _now_ ) ) ;
+
+                refresh |= force_bit( force_type::DAMPER ) ;
+        }
+        if( task_due( _due_, ffb_task::trapezoid ) )
         {
-                wheel_.damper_force().slope_left  = 3 ;
-                wheel_.damper_force().slope_right = 3 ;
+                auto & trapezoid = wheel_.trapezoid_force() ;
+
+                trapezoid = wheel::default_trap_f ;
+                trapezoid.enabled = outputs_.flag( effect_sink::trapezoid_enabled ) ;
+
+                if( outputs_.has( effect_sink::trapezoid_amplitude ) )
+                {
+                        uti::u8_t const amplitude = _to_u8( _filtered( filter_slot::trapezoid, effect_sink::trapezoid_amplitude, _now_ ) ) / 2 ;
+
+                        trapezoid.amplitude_max = 128 - amplitude ;
+                        trapezoid.amplitude_min = 128 + amplitude ;
+                }
+                if( outputs_.has( effect_sink::trapezoid_period ) )
+                {
+                        trapezoid.t_at_max = trapezoid.t_at_min = _to_u8( outputs_[ effect_sink::trapezoid_period ] ) ;
+                }
+                refresh |= force_bit( force_type::TRAPEZOID ) ;
         }
+        return refresh ;
 }
 
 ////////////////////////////////////////////////////////////////////////////////
 
-constexpr void simulator::_update_trapezoid ( [[ maybe_unused ]] telemetry_state const & _new_state_ ) noexcept
-{}
+// scales amplitudes by the master gain and steps the slot's filter with the time since it
+// last ran. slots are stepped at their task rate, except the constant torque which follows
+// every telemetry frame. the result is what gets quantized, so that is where clipping counts
+constexpr q16 simulator::_filtered ( filter_slot _slot_, effect_sink _sink_, timestamp_t _now_ ) noexcept
+{
+        uti::u8_t const index = static_cast< uti::u8_t >( _slot_ ) ;
+
+        timestamp_t & last = last_filtered_[ index ] ;
+
+        q16 const dt = _now_ > last && last != 0 ? q16_from_us( _now_ - last ) : q16{} ;
+
+        last = _now_ ;
+
+        // damper slope is a coefficient, not an amplitude
+        q16 const x = _slot_ == filter_slot::damper ? outputs_[ _sink_ ] : outputs_[ _sink_ ] * agc_.gain() ;
+        q16 const y = filters_.step( _slot_, x, dt ) ;
+
+        switch( _slot_ )
+        {
+                case filter_slot::constant : clips_[ index ].add( y ) ; break ;
+                case filter_slot::damper   : clips_[ index ].add( y / q16::from_int(   7 ) ) ; break ;
+                default                    : clips_[ index ].add( y / q16::from_int( 255 ) ) ; break ;
+        }
+        return y ;
+}
 
 ////////////////////////////////////////////////////////////////////////////////
 
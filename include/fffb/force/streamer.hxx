@@ -0,0 +1,350 @@
+//
+//
+//      fffb
+//      force/streamer.hxx
+//
+
+#pragma once
+
+#include <fffb/util/types.hxx>
+#include <fffb/util/clock.hxx>
+#include <fffb/util/fixed.hxx>
+#include <fffb/joy/wheel.hxx>
+
+#include <atomic>
+#include <mutex>
+#include <thread>
+#include <chrono>
+#include <cmath>
+
+#ifndef   FFFB_STREAM_RATE_HZ
+#define   FFFB_STREAM_RATE_HZ 500
+#endif // FFFB_STREAM_RATE_HZ
+
+// periods per tick while the rate controller idles
+#ifndef   FFFB_STREAM_IDLE_DIVIDER
+#define   FFFB_STREAM_IDLE_DIVIDER 10
+#endif // FFFB_STREAM_IDLE_DIVIDER
+
+
+namespace fffb
+{
+
+
+////////////////////////////////////////////////////////////////////////////////
+
+enum class stream_mode
+{
+        hold        ,
+        interpolate ,
+        extrapolate ,
+} ;
+
+struct stream_stats
+{
+        uti::u64_t    ticks { 0 } ;
+        uti::u64_t   writes { 0 } ;
+        uti::u64_t  skipped { 0 } ;
+        uti::u64_t failures { 0 } ;
+        uti::u64_t  overrun { 0 } ;
+
+        double jitter_sum_us    { 0 } ;
+        double jitter_sum_sq_us { 0 } ;
+        double jitter_max_us    { 0 } ;
+
+        [[ nodiscard ]] constexpr double jitter_mean_us () const noexcept
+        { return ticks ? jitter_sum_us / ticks : 0.0 ; }
+
+        [[ nodiscard ]] constexpr double jitter_rms_us () const noexcept
+        { return ticks ? std::sqrt( jitter_sum_sq_us / ticks ) : 0.0 ; }
+} ;
+
+////////////////////////////////////////////////////////////////////////////////
+
+// drives the constant effect from a dedicated thread at a fixed rate.
+// the game thread only publishes torque targets, the stream thread
+// interpolates between them and owns the constant slot while running.
+// every other wheel access has to hold io_mutex() while the stream is active.
+// offline tools start it stepped instead, without a thread, and tick() it
+// once per period of their own clock
+
+class force_streamer
+{
+public:
+        static constexpr uti::u32_t min_rate_hz {  250 } ;
+        static constexpr uti::u32_t max_rate_hz { 1000 } ;
+
+        explicit force_streamer ( wheel & _wheel_ ) noexcept : wheel_( _wheel_ ) {}
+
+        ~force_streamer () noexcept { stop() ; }
+
+        force_streamer ( force_streamer const & ) = delete ;
+        force_streamer & operator= ( force_streamer const & ) = delete ;
+
+        bool start         ( uti::u32_t _rate_hz_ = FFFB_STREAM_RATE_HZ, stream_mode _mode_ = stream_mode::interpolate ) noexcept ;
+        bool start_stepped ( uti::u32_t _rate_hz_ = FFFB_STREAM_RATE_HZ, stream_mode _mode_ = stream_mode::interpolate ) noexcept ;
+        void stop          (                                                                                           ) noexcept ;
+
+        // one period of a stepped stream at host_time_us(), idle streams skip all but every FFFB_STREAM_IDLE_DIVIDER'th
+        void tick () noexcept ;
+
+        void publish ( q16 _torque_ ) noexcept ;
+
+        void suspend () noexcept { suspended_.store(  true, std::memory_order_release ) ; }
+        void resume  () noexcept { suspended_.store( false, std::memory_order_release ) ; }
+
+        // steady targets don't need the full rate, the stream slows down until they move again
+        void set_idle ( bool _idle_ ) noexcept { idle_.store( _idle_, std::memory_order_release ) ; }
+
+        [[ nodiscard ]] bool running () const noexcept { return running_.load( std::memory_order_acquire ) ; }
+
+        [[ nodiscard ]] std::mutex & io_mutex () noexcept { return io_mutex_ ; }
+
+        [[ nodiscard ]] uti::u32_t rate_hz   () const noexcept { return rate_hz_ ; }
+        [[ nodiscard ]] uti::u32_t period_us () const noexcept { return 1000000 / rate_hz_ ; }
+        [[ nodiscard ]] stream_mode   mode () const noexcept { return    mode_ ; }
+
+        [[ nodiscard ]] stream_stats stats () const noexcept ;
+
+        [[ nodiscard ]] static constexpr uti::u8_t torque_to_amplitude ( q16 _torque_ ) noexcept
+        { return to_classic_amplitude( _torque_ ) ; }
+private:
+        struct sample
+        {
+                uti::u32_t time ;
+                q16      torque ;
+        } ;
+
+        wheel & wheel_ ;
+
+        std::thread      thread_ ;
+        std::mutex     io_mutex_ ;
+        mutable std::mutex stats_mutex_ ;
+
+        std::atomic< bool >   running_ { false } ;
+        std::atomic< bool > suspended_ { false } ;
+        std::atomic< bool >      idle_ { false } ;
+
+        // time in the lower half, raw torque in the upper half, published with a single store
+        std::atomic< uti::u64_t > target_ { 0 } ;
+
+        uti::u32_t rate_hz_ { FFFB_STREAM_RATE_HZ } ;
+        stream_mode   mode_ { stream_mode::interpolate } ;
+
+        stream_stats stats_ {} ;
+
+        // stream side, the thread's or whoever ticks a stepped stream
+        sample          prev_ {} ;
+        sample          last_ {} ;
+        uti::i32_t last_amplitude_ { -1 } ;
+        uti::u32_t     idle_ticks_ {  0 } ;
+
+        bool _prepare ( uti::u32_t _rate_hz_, stream_mode _mode_ ) noexcept ;
+
+        void _run  (                                ) noexcept ;
+        void _tick ( double _late_us_, bool _overrun_ ) noexcept ;
+
+        [[ nodiscard ]] static constexpr uti::u64_t _pack ( sample const & _sample_ ) noexcept
+        {
+                return ( static_cast< uti::u64_t >( static_cast< uti::u32_t >( _sample_.torque.raw() ) ) << 32 ) | _sample_.time ;
+        }
+        [[ nodiscard ]] static constexpr sample _unpack ( uti::u64_t _packed_ ) noexcept
+        {
+                return { static_cast< uti::u32_t >( _packed_ ), q16::from_raw( static_cast< uti::i32_t >( _packed_ >> 32 ) ) } ;
+        }
+
+        [[ nodiscard ]] static constexpr q16 _evaluate ( stream_mode _mode_, sample const & _prev_, sample const & _last_, uti::u32_t _now_ ) noexcept ;
+} ;
+
+////////////////////////////////////////////////////////////////////////////////
+////////////////////////////////////////////////////////////////////////////////
+
+inline bool force_streamer::start ( uti::u32_t _rate_hz_, stream_mode _mode_ ) noexcept
+{
+        if( running() ) return true ;
+
+        if( !_prepare( _rate_hz_, _mode_ ) ) return false ;
+
+        running_.store( true, std::memory_order_release ) ;
+        thread_ = std::thread( &force_streamer::_run, this ) ;
+
+        FFFB_F_INFO_S( "force_streamer::start", "streaming constant force at %u Hz", rate_hz_ ) ;
+        return true ;
+}
+
+inline bool force_streamer::start_stepped ( uti::u32_t _rate_hz_, stream_mode _mode_ ) noexcept
+{
+        if( running() ) return true ;
+
+        if( !_prepare( _rate_hz_, _mode_ ) ) return false ;
+
+        running_.store( true, std::memory_order_release ) ;
+
+        FFFB_F_INFO_S( "force_streamer::start_stepped", "stepping constant force at %u Hz", rate_hz_ ) ;
+        return true ;
+}
+
+inline bool force_streamer::_prepare ( uti::u32_t _rate_hz_, stream_mode _mode_ ) noexcept
+{
+        if( !wheel_ ) return false ;
+
+        if( _rate_hz_ < min_rate_hz ) _rate_hz_ = min_rate_hz ;
+        if( _rate_hz_ > max_rate_hz ) _rate_hz_ = max_rate_hz ;
+
+        rate_hz_ = _rate_hz_ ;
+           mode_ =    _mode_ ;
+
+        {
+                std::lock_guard< std::mutex > lock( stats_mutex_ ) ;
+                stats_ = {} ;
+        }
+        target_.store( _pack( { static_cast< uti::u32_t >( host_time_us() ), q16{} } ), std::memory_order_release ) ;
+
+        prev_ = last_ = _unpack( target_.load( std::memory_order_relaxed ) ) ;
+
+        last_amplitude_ = -1 ;
+            idle_ticks_ =  0 ;
+
+        return true ;
+}
+
+inline void force_streamer::stop () noexcept
+{
+        if( !running_.exchange( false, std::memory_order_acq_rel ) ) return ;
+
+        if( thread_.joinable() ) thread_.join() ;
+
+        std::lock_guard< std::mutex > lock( io_mutex_ ) ;
+        wheel_.stop_constant_stream() ;
+
+        [[ maybe_unused ]] stream_stats const s = stats() ;
+        FFFB_F_INFO_S( "force_streamer::stop", "ticks=%lu writes=%lu skipped=%lu failures=%lu overruns=%lu jitter mean=%.1fus rms=%.1fus max=%.1fus",
+                       s.ticks, s.writes, s.skipped, s.failures, s.overrun, s.jitter_mean_us(), s.jitter_rms_us(), s.jitter_max_us ) ;
+}
+
+inline void force_streamer::tick () noexcept
+{
+        if( !running() || thread_.joinable() ) return ;
+
+        if( idle_.load( std::memory_order_acquire ) && idle_ticks_++ % FFFB_STREAM_IDLE_DIVIDER != 0 ) return ;
+
+        _tick( 0.0, false ) ;
+}
+
+inline void force_streamer::publish ( q16 _torque_ ) noexcept
+{
+        target_.store( _pack( { static_cast< uti::u32_t >( host_time_us() ), _torque_ } ), std::memory_order_release ) ;
+}
+
+inline stream_stats force_streamer::stats () const noexcept
+{
+        std::lock_guard< std::mutex > lock( stats_mutex_ ) ;
+        return stats_ ;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
+constexpr q16 force_streamer::_evaluate ( stream_mode _mode_, sample const & _prev_, sample const & _last_, uti::u32_t _now_ ) noexcept
+{
+        if( _mode_ == stream_mode::hold ) return _last_.torque ;
+
+        uti::u32_t const span = _last_.time - _prev_.time ;
+
+        if( span == 0 ) return _last_.torque ;
+
+        uti::u32_t const elapsed = _now_ - _last_.time ;
+
+        // never reach further than one telemetry interval
+        q16 const s = elapsed >= span ? q16::one()
+                                      : q16::from_raw( static_cast< uti::i32_t >( ( static_cast< uti::u64_t >( elapsed ) << q16::frac_bits ) / span ) ) ;
+
+        if( _mode_ == stream_mode::interpolate )
+        {
+                return _prev_.torque + ( _last_.torque - _prev_.torque ) * s ;
+        }
+        return _last_.torque + ( _last_.torque - _prev_.torque ) * s ;
+}
+
+inline void force_streamer::_run () noexcept
+{
+        using clock = std::chrono::steady_clock ;
+
+        auto const active_period = std::chrono::microseconds( period_us() ) ;
+        auto const   idle_period = active_period * FFFB_STREAM_IDLE_DIVIDER ;
+
+        auto deadline = clock::now() + active_period ;
+
+        while( running_.load( std::memory_order_acquire ) )
+        {
+                std::this_thread::sleep_until( deadline ) ;
+
+                auto const period = idle_.load( std::memory_order_acquire ) ? idle_period : active_period ;
+
+                auto const woke = clock::now() ;
+
+                double const late_us = std::chrono::duration< double, std::micro >( woke - deadline ).count() ;
+
+                deadline += period ;
+
+                bool overrun { false } ;
+                if( woke > deadline )
+                {
+                        // fell behind by a whole period, drop the missed ticks instead of bursting
+                        deadline = woke + period ;
+                        overrun  = true ;
+                }
+                _tick( late_us, overrun ) ;
+        }
+}
+
+inline void force_streamer::_tick ( double _late_us_, bool _overrun_ ) noexcept
+{
+        sample const current = _unpack( target_.load( std::memory_order_acquire ) ) ;
+
+        if( current.time != last_.time )
+        {
+                prev_ = last_   ;
+                last_ = current ;
+        }
+
+        bool wrote { false } ;
+        bool  fail { false } ;
+
+        if( !suspended_.load( std::memory_order_acquire ) )
+        {
+                auto const now = static_cast< uti::u32_t >( host_time_us() ) ;
+
+                uti::u8_t const amplitude = torque_to_amplitude( _evaluate( mode_, prev_, last_, now ) ) ;
+
+                if( amplitude != last_amplitude_ )
+                {
+                        std::lock_guard< std::mutex > lock( io_mutex_ ) ;
+
+                        fail  = !wheel_.stream_constant_force( amplitude ) ;
+                        wrote = !fail ;
+
+                        last_amplitude_ = fail ? -1 : amplitude ;
+                }
+        }
+        else
+        {
+                last_amplitude_ = -1 ;
+        }
+
+        std::lock_guard< std::mutex > lock( stats_mutex_ ) ;
+
+        ++stats_.ticks ;
+        stats_.writes   += wrote ;
+        stats_.failures += fail  ;
+        stats_.skipped  += !wrote && !fail ;
+        stats_.overrun  += _overrun_ ;
+
+        stats_.jitter_sum_us    += _late_us_ ;
+        stats_.jitter_sum_sq_us += _late_us_ * _late_us_ ;
+        if( _late_us_ > stats_.jitter_max_us ) stats_.jitter_max_us = _late_us_ ;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
+
+} // namespace fffb
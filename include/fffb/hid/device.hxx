@@ -8,6 +8,10 @@
 
 #include <fffb/util/types.hxx>
 #include <fffb/hid/report.hxx>
+
+#ifdef FFFB_MEMORY_TRANSPORT
+#include <fffb/hid/memory_device.hxx>
+#else
 #include <IOKit/hid/IOHIDLib.h>
 #include <CoreFoundation/CoreFoundation.h>
 #include <chrono>
@@ -440,3 +444,4 @@ constexpr vector< hid_device > _list_devices ( apple::hid_manager * manager ) no
 
 
 } // namespace fffb
+#endif // FFFB_MEMORY_TRANSPORT
@@ -0,0 +1,240 @@
+//
+//
+//      fffb
+//      hid/memory_device.hxx
+//
+
+#pragma once
+
+#include <fffb/util/types.hxx>
+#include <fffb/hid/report.hxx>
+
+#include <cstring>
+
+#define FFFB_MEMORY_VENDOR_ID  0x046D
+#define FFFB_MEMORY_PRODUCT_ID 0xC262
+
+// what the emulated wheel hands out for root get_feature( 0x8123 )
+#define FFFB_MEMORY_FF_FEATURE_INDEX 0x0B
+
+
+namespace fffb
+{
+
+
+////////////////////////////////////////////////////////////////////////////////
+
+// called for every report written to a memory device, in order
+using memory_sink = void ( * )( void * _context_, report const & _report_ ) noexcept ;
+
+struct memory_transport_stats
+{
+        uti::u64_t  writes { 0 } ;
+        uti::u64_t   bytes { 0 } ;
+        uti::u64_t replies { 0 } ;
+} ;
+
+// the other end of a memory hid_device, a wheel that answers hid++ like a g920.
+// replies land in a single slot that the next reply overwrites, the same as
+// the iokit input callback, and are there right away so no read ever waits.
+// writes go to the sink, which is how the replay tool sees the report stream.
+// it is plugged in from the start, so a plugin built on it finds a wheel
+
+class memory_transport
+{
+public:
+        constexpr void attach () noexcept { attached_ = true ; }
+        constexpr void detach () noexcept { attached_ = false ; reply_ready_ = false ; }
+
+        [[ nodiscard ]] constexpr bool attached () const noexcept { return attached_ ; }
+
+        constexpr void set_sink ( memory_sink _sink_, void * _context_ ) noexcept { sink_ = _sink_ ; context_ = _context_ ; }
+
+        bool write      ( report const & _report_ ) noexcept ;
+        bool read_input ( report       & _report_ ) noexcept ;
+
+        [[ nodiscard ]] constexpr memory_transport_stats const & stats () const noexcept { return stats_ ; }
+private:
+        bool attached_ { true } ;
+
+        memory_sink sink_ { nullptr } ;
+        void *   context_ { nullptr } ;
+
+        report reply_ {} ;
+        bool   reply_ready_ { false } ;
+
+        // effect slots are handed out in order, 0 asks for a new one
+        uti::u8_t next_slot_ { 1 } ;
+
+        memory_transport_stats stats_ {} ;
+
+        void _answer_hidpp ( report const & _request_ ) noexcept ;
+} ;
+
+// the single memory wheel list_hid_devices() reports while attached
+[[ nodiscard ]] inline memory_transport & memory_wheel () noexcept
+{
+        static memory_transport transport ;
+        return transport ;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
+class hid_device
+{
+public:
+        constexpr hid_device () noexcept = default ;
+
+        constexpr hid_device ( memory_transport * _transport_ ) noexcept
+                : transport_ ( _transport_ )
+                ,  vendor_id_( FFFB_MEMORY_VENDOR_ID  )
+                , product_id_( FFFB_MEMORY_PRODUCT_ID )
+                ,  device_id_( ( ( product_id_ & 0xFFFF ) << 16 ) | ( vendor_id_ & 0xFFFF ) )
+                , usage_page_( 0x01 )
+                , usage_     ( 0x04 )
+        {}
+
+        [[ nodiscard ]] constexpr operator bool () const noexcept { return transport_ != nullptr ; }
+
+        [[ nodiscard ]] constexpr bool  open () const noexcept { return transport_ && transport_->attached() ; }
+        [[ nodiscard ]] constexpr bool close () const noexcept { return transport_ != nullptr ; }
+
+        [[ nodiscard ]] bool write ( report const & _report_ ) const noexcept
+        { return open() && transport_->write( _report_ ) ; }
+
+        // there are no feature reports to get
+        [[ nodiscard ]] constexpr bool read ( [[ maybe_unused ]] report & _report_ ) const noexcept { return false ; }
+
+        [[ nodiscard ]] constexpr bool enable_input_reports () const noexcept { return open() ; }
+
+        // replies are there right away or not at all, the timeout never runs
+        [[ nodiscard ]] bool read_input ( report & _report_, [[ maybe_unused ]] int _timeout_ms_ ) const noexcept
+        { return open() && transport_->read_input( _report_ ) ; }
+
+        [[ nodiscard ]] constexpr device_id_t  vendor_id () const noexcept { return  vendor_id_ ; }
+        [[ nodiscard ]] constexpr device_id_t product_id () const noexcept { return product_id_ ; }
+        [[ nodiscard ]] constexpr device_id_t  device_id () const noexcept { return  device_id_ ; }
+
+        [[ nodiscard ]] constexpr device_id_t usage_page () const noexcept { return usage_page_ ; }
+        [[ nodiscard ]] constexpr device_id_t usage      () const noexcept { return usage_      ; }
+
+        constexpr bool operator== ( hid_device const & other ) const noexcept
+        {
+                return transport_  == other.transport_
+                    && usage_page_ == other.usage_page_
+                    && usage_      == other.usage_    ;
+        }
+        constexpr bool operator!= ( hid_device const & other ) const noexcept { return !operator==( other ) ; }
+private:
+        memory_transport * transport_ { nullptr } ;
+
+        device_id_t  vendor_id_ { 0 } ;
+        device_id_t product_id_ { 0 } ;
+        device_id_t  device_id_ { 0 } ;
+        device_id_t usage_page_ { 0 } ;
+        device_id_t usage_      { 0 } ;
+} ;
+
+////////////////////////////////////////////////////////////////////////////////
+
+inline vector< hid_device > list_hid_devices () noexcept
+{
+        vector< hid_device > devices ;
+
+        if( memory_wheel().attached() ) devices.push_back( hid_device( &memory_wheel() ) ) ;
+
+        return devices ;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+////////////////////////////////////////////////////////////////////////////////
+
+inline bool memory_transport::write ( report const & _report_ ) noexcept
+{
+        if( !attached_ || _report_.len == 0 || _report_.len > _report_.capacity() )
+        {
+                FFFB_F_ERR_S( "memory_transport::write", "invalid report len=%zu", static_cast< size_t >( _report_.len ) ) ;
+                return false ;
+        }
+        ++stats_.writes ;
+        stats_.bytes += _report_.len ;
+
+        if( sink_ ) sink_( context_, _report_ ) ;
+
+        // classic reports go unanswered
+        if( _report_.report_id >= 0x10 && _report_.report_id <= 0x12 ) _answer_hidpp( _report_ ) ;
+
+        return true ;
+}
+
+inline bool memory_transport::read_input ( report & _report_ ) noexcept
+{
+        if( !reply_ready_ ) return false ;
+
+        _report_     = reply_ ;
+        reply_ready_ = false ;
+
+        return true ;
+}
+
+inline void memory_transport::_answer_hidpp ( report const & _request_ ) noexcept
+{
+        // the report id may or may not lead the payload
+        uti::ssize_t const off = _request_.data[ 0 ] == _request_.report_id ? 1 : 0 ;
+
+        if( static_cast< uti::ssize_t >( _request_.len ) < off + 3 ) return ;
+
+        uti::u8_t const * const msg = _request_.data + off ;
+
+        // [ dev index ] [ feature index ] [ function | sw id ] [ params ... ], long reports with the id leading
+        reply_ = {} ;
+        reply_.report_type = kIOHIDReportTypeInput ;
+        reply_.report_id   = 0x11 ;
+        reply_.len         = 20 ;
+        reply_.data[ 0 ]   = 0x11 ;
+
+        uti::u8_t * const out = reply_.data + 1 ;
+
+        out[ 0 ] = msg[ 0 ] ;
+        out[ 1 ] = msg[ 1 ] ;
+        out[ 2 ] = msg[ 2 ] ;
+
+        if( msg[ 1 ] == 0x00 )
+        {
+                if( ( msg[ 2 ] >> 4 ) == 0x1 )
+                {
+                        // ping, protocol 4.2 and the ping byte back
+                        out[ 3 ] = 4 ;
+                        out[ 4 ] = 2 ;
+                        out[ 5 ] = msg[ 5 ] ;
+                }
+                else
+                {
+                        // root get_feature, only force feedback is there
+                        bool const ff = msg[ 3 ] == 0x81 && msg[ 4 ] == 0x23 ;
+
+                        out[ 3 ] = ff ? FFFB_MEMORY_FF_FEATURE_INDEX : 0 ;
+                        out[ 4 ] = 0 ;
+                }
+        }
+        else
+        {
+                // everything else is acknowledged with its params, downloads get a slot
+                uti::ssize_t const params = static_cast< uti::ssize_t >( _request_.len ) - off - 3 ;
+
+                std::memcpy( out + 3, msg + 3, static_cast< size_t >( params < 16 ? params : 16 ) ) ;
+
+                if( msg[ 1 ] == FFFB_MEMORY_FF_FEATURE_INDEX && ( msg[ 2 ] & 0xF0 ) == 0x20 && msg[ 3 ] == 0 )
+                {
+                        out[ 3 ] = next_slot_ ;
+                        next_slot_ = next_slot_ == 0x7F ? 1 : next_slot_ + 1 ;
+                }
+        }
+        reply_ready_ = true ;
+        ++stats_.replies ;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
+
+} // namespace fffb
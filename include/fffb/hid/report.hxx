@@ -8,7 +8,9 @@
 #include <fffb/util/log.hxx>
 #include <fffb/util/types.hxx>
 
+#ifndef FFFB_MEMORY_TRANSPORT
 #include <IOKit/hid/IOHIDLib.h>
+#endif
 #include <cstddef>   // size_t
 #include <cstdint>   // uint8_t
 
@@ -20,6 +22,17 @@
 namespace fffb
 {
 
+#ifdef FFFB_MEMORY_TRANSPORT
+// same names and values as iokit, so the encoders don't care which transport they feed
+enum IOHIDReportType
+{
+        kIOHIDReportTypeInput   ,
+        kIOHIDReportTypeOutput  ,
+        kIOHIDReportTypeFeature ,
+        kIOHIDReportTypeCount   ,
+} ;
+#endif
+
 struct report
 {
         // HID report id (0 if none). HID++ commonly uses 0x10/0x11/0x12 depending on format.
@@ -39,6 +52,7 @@ struct report
         [[nodiscard]] constexpr std::size_t capacity() const noexcept { return FFFB_REPORT_MAX_LEN; }
 };
 
+#ifndef FFFB_MEMORY_TRANSPORT
 // Send exactly `report.len` bytes using `report.report_id` and `report.report_type`.
 [[nodiscard]] inline bool write_report( apple::hid_device * device, report const & rep ) noexcept
 {
@@ -85,6 +99,7 @@ struct report
         rep.len = (std::size_t)n;
         return true;
 }
+#endif // FFFB_MEMORY_TRANSPORT
 
 } // namespace fffb
 
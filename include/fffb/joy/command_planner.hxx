@@ -0,0 +1,172 @@
+//
+//
+//      fffb
+//      joy/command_planner.hxx
+//
+
+#pragma once
+
+#include <fffb/util/types.hxx>
+#include <fffb/joy/protocol.hxx>
+
+#include <cstring>
+
+#define FFFB_PLAN_HISTORY 64
+
+#define FFFB_LED_PATTERN_MASK    0b00011111
+#define FFFB_LED_PATTERN_UNKNOWN 0xFF
+
+
+namespace fffb
+{
+
+
+////////////////////////////////////////////////////////////////////////////////
+
+// everything the wheel can be told, either what it should be doing or, mirrored
+// by the wheel, what it was told last
+
+struct wheel_state
+{
+        constant_force_params   constant {} ;
+        spring_force_params       spring {} ;
+        damper_force_params       damper {} ;
+        trapezoid_force_params trapezoid {} ;
+
+        uti::u8_t     active { 0 } ; // force bits downloaded and playing, unused in a desired state
+        bool      autocenter { true } ;
+        uti::u8_t       leds { FFFB_LED_PATTERN_UNKNOWN } ;
+
+        // force bits that should be playing
+        [[ nodiscard ]] constexpr uti::u8_t enabled () const noexcept
+        {
+                return ( constant .enabled ? force_bit( force_type:: CONSTANT ) : 0 )
+                     | ( spring   .enabled ? force_bit( force_type::   SPRING ) : 0 )
+                     | ( damper   .enabled ? force_bit( force_type::   DAMPER ) : 0 )
+                     | ( trapezoid.enabled ? force_bit( force_type::TRAPEZOID ) : 0 ) ;
+        }
+} ;
+
+// the commands taking one state to another. they go out in member order,
+// autocenter first so a stop can't be briefly left without a centering spring
+struct command_plan
+{
+        timestamp_t at_us { 0 } ;
+
+        bool  set_autocenter { false } ;
+        bool      autocenter { false } ;
+
+        uti::u8_t     stop { 0 } ; // force bits
+        uti::u8_t download { 0 } ; // force bits, downloaded and started
+        uti::u8_t  refresh { 0 } ; // force bits
+
+        bool  set_leds { false } ;
+        uti::u8_t leds { 0 } ;
+
+        // filled in by the wheel once executed
+        uti::u8_t reports { 0 } ;
+        bool           ok { true } ;
+
+        [[ nodiscard ]] constexpr bool empty () const noexcept
+        { return !set_autocenter && !stop && !download && !refresh && !set_leds ; }
+} ;
+
+////////////////////////////////////////////////////////////////////////////////
+
+template< typename Params >
+[[ nodiscard ]] inline bool same_params ( Params const & _lhs_, Params const & _rhs_ ) noexcept
+{
+        return std::memcmp( &_lhs_, &_rhs_, sizeof( Params ) ) == 0 ;
+}
+
+// new forces get downloaded, forces that stay get refreshed only if their params
+// changed, forces no longer wanted get stopped. nothing else goes out
+[[ nodiscard ]] inline command_plan plan_commands ( wheel_state const & _desired_, wheel_state const & _device_ ) noexcept
+{
+        command_plan plan {} ;
+
+        uti::u8_t const wanted = _desired_.enabled() ;
+        uti::u8_t const   kept = wanted & _device_.active ;
+
+        plan.stop     = _device_.active & ~wanted ;
+        plan.download = wanted & ~_device_.active ;
+
+        if( kept & force_bit( force_type:: CONSTANT ) && !same_params( _desired_.constant , _device_.constant  ) ) plan.refresh |= force_bit( force_type:: CONSTANT ) ;
+        if( kept & force_bit( force_type::   SPRING ) && !same_params( _desired_.spring   , _device_.spring    ) ) plan.refresh |= force_bit( force_type::   SPRING ) ;
+        if( kept & force_bit( force_type::   DAMPER ) && !same_params( _desired_.damper   , _device_.damper    ) ) plan.refresh |= force_bit( force_type::   DAMPER ) ;
+        if( kept & force_bit( force_type::TRAPEZOID ) && !same_params( _desired_.trapezoid, _device_.trapezoid ) ) plan.refresh |= force_bit( force_type::TRAPEZOID ) ;
+
+        if( _desired_.autocenter != _device_.autocenter )
+        {
+                plan.set_autocenter = true ;
+                plan.autocenter     = _desired_.autocenter ;
+        }
+        uti::u8_t const leds = _desired_.leds & FFFB_LED_PATTERN_MASK ;
+
+        // a desired state copied from a mirror that never set them leaves them alone
+        if( _desired_.leds != FFFB_LED_PATTERN_UNKNOWN && leds != _device_.leds )
+        {
+                plan.set_leds = true ;
+                plan.leds     = leds ;
+        }
+        return plan ;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
+struct plan_totals
+{
+        uti::u64_t     plans { 0 } ;
+        uti::u64_t     empty { 0 } ; // nothing went out, not recorded
+        uti::u64_t    failed { 0 } ;
+        uti::u64_t     stops { 0 } ; // forces, not reports
+        uti::u64_t downloads { 0 } ;
+        uti::u64_t refreshes { 0 } ;
+        uti::u64_t   reports { 0 } ;
+} ;
+
+// the last FFFB_PLAN_HISTORY plans that did something, for diagnostics
+class plan_log
+{
+public:
+        constexpr void record ( command_plan const & _plan_ ) noexcept ;
+
+        constexpr void skip () noexcept { ++totals_.empty ; }
+
+        [[ nodiscard ]] constexpr uti::u32_t size () const noexcept
+        { return totals_.plans < FFFB_PLAN_HISTORY ? static_cast< uti::u32_t >( totals_.plans ) : FFFB_PLAN_HISTORY ; }
+
+        // 0 is the newest, has to be below size()
+        [[ nodiscard ]] constexpr command_plan const & recent ( uti::u32_t _age_ ) const noexcept
+        { return plans_[ ( head_ + FFFB_PLAN_HISTORY - 1 - _age_ ) % FFFB_PLAN_HISTORY ] ; }
+
+        [[ nodiscard ]] constexpr plan_totals const & totals () const noexcept { return totals_ ; }
+private:
+        command_plan plans_ [ FFFB_PLAN_HISTORY ] {} ;
+        uti::u32_t    head_ { 0 } ;
+
+        plan_totals totals_ {} ;
+} ;
+
+////////////////////////////////////////////////////////////////////////////////
+////////////////////////////////////////////////////////////////////////////////
+
+constexpr void plan_log::record ( command_plan const & _plan_ ) noexcept
+{
+        plans_[ head_ ] = _plan_ ;
+        head_ = ( head_ + 1 ) % FFFB_PLAN_HISTORY ;
+
+        auto const count = [ & ]( uti::u8_t _forces_ ) { return static_cast< uti::u64_t >( __builtin_popcount( _forces_ ) ) ; } ;
+
+        ++totals_.plans ;
+        totals_.failed    += !_plan_.ok ;
+        totals_.stops     += count( _plan_.stop     ) ;
+        totals_.downloads += count( _plan_.download ) ;
+        totals_.refreshes += count( _plan_.refresh  ) ;
+        totals_.reports   += _plan_.reports ;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
+
+} // namespace fffb
@@ -0,0 +1,151 @@
+//
+//
+//      fffb
+//      joy/delta_gate.hxx
+//
+
+#pragma once
+
+#include <fffb/util/types.hxx>
+#include <fffb/joy/protocol.hxx>
+
+#include <cstddef>
+#include <cstring>
+
+#define FFFB_GATE_DEFAULT_THRESHOLD         1
+#define FFFB_GATE_DEFAULT_MAX_STALE_US 100000
+
+
+namespace fffb
+{
+
+
+////////////////////////////////////////////////////////////////////////////////
+
+struct delta_gate_config
+{
+        uti::u8_t     threshold { FFFB_GATE_DEFAULT_THRESHOLD    } ; // largest level change still held back
+        timestamp_t max_stale_us { FFFB_GATE_DEFAULT_MAX_STALE_US } ; // held back changes go out after this, 0 never
+} ;
+
+struct delta_gate_stats
+{
+        uti::u64_t       sent { 0 } ;
+        uti::u64_t      stale { 0 } ; // sent only because the deadline ran out, part of sent
+        uti::u64_t  identical { 0 } ;
+        uti::u64_t suppressed { 0 } ;
+} ;
+
+////////////////////////////////////////////////////////////////////////////////
+
+// bytes of each params struct that carry a level, a small change there can wait.
+// everything else (slot, enabled, slopes, dead band, period) goes out on any change
+
+[[ nodiscard ]] constexpr uti::u16_t level_bytes ( constant_force_params const & ) noexcept
+{ return uti::u16_t( 1 ) << offsetof( constant_force_params, amplitude ) ; }
+
+[[ nodiscard ]] constexpr uti::u16_t level_bytes ( spring_force_params const & ) noexcept
+{ return uti::u16_t( 1 ) << offsetof( spring_force_params, amplitude ) ; }
+
+[[ nodiscard ]] constexpr uti::u16_t level_bytes ( damper_force_params const & ) noexcept
+{ return 0 ; }
+
+[[ nodiscard ]] constexpr uti::u16_t level_bytes ( trapezoid_force_params const & ) noexcept
+{
+        return uti::u16_t( 1 ) << offsetof( trapezoid_force_params, amplitude_max )
+             | uti::u16_t( 1 ) << offsetof( trapezoid_force_params, amplitude_min ) ;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
+// decides per slot whether new params are worth a report. identical params never
+// are, level changes within the threshold wait until they grow or go stale.
+// changes are measured against what was last sent, so slow drift still gets out
+
+class delta_gate
+{
+public:
+        constexpr void configure ( delta_gate_config const & _config_ ) noexcept { config_ = _config_ ; }
+
+        // true if the params should be sent, they are then taken as sent
+        template< typename Params >
+        [[ nodiscard ]] bool pass ( Params const & _params_, timestamp_t _now_us_ ) noexcept ;
+
+        // the device no longer holds what was sent last
+        constexpr void invalidate () noexcept { valid_ = false ; }
+
+        [[ nodiscard ]] constexpr delta_gate_config const & config () const noexcept { return config_ ; }
+        [[ nodiscard ]] constexpr delta_gate_stats  const &  stats () const noexcept { return  stats_ ; }
+private:
+        static constexpr uti::ssize_t max_size { FFFB_FORCE_MAX_PARAMS + 2 } ;
+
+        delta_gate_config config_ {} ;
+        delta_gate_stats   stats_ {} ;
+
+        uti::u8_t last_ [ max_size ] {} ;
+        bool     valid_ { false } ;
+
+        timestamp_t sent_us_ { 0 } ;
+
+        template< typename Params >
+        bool _send ( Params const & _params_, timestamp_t _now_us_ ) noexcept ;
+} ;
+
+////////////////////////////////////////////////////////////////////////////////
+////////////////////////////////////////////////////////////////////////////////
+
+template< typename Params >
+bool delta_gate::pass ( Params const & _params_, timestamp_t _now_us_ ) noexcept
+{
+        static_assert( sizeof( Params ) <= max_size, "params too large for the gate" ) ;
+
+        if( !valid_ ) return _send( _params_, _now_us_ ) ;
+
+        uti::u8_t bytes [ sizeof( Params ) ] ;
+        std::memcpy( bytes, &_params_, sizeof( Params ) ) ;
+
+        if( std::memcmp( bytes, last_, sizeof( Params ) ) == 0 )
+        {
+                ++stats_.identical ;
+                return false ;
+        }
+        uti::u16_t const levels = level_bytes( _params_ ) ;
+        uti::i32_t       delta  { 0 } ;
+
+        for( uti::ssize_t i = 0; i < static_cast< uti::ssize_t >( sizeof( Params ) ); ++i )
+        {
+                if( bytes[ i ] == last_[ i ] ) continue ;
+
+                if( !( levels >> i & 1 ) ) return _send( _params_, _now_us_ ) ;
+
+                uti::i32_t const d = bytes[ i ] > last_[ i ] ? bytes[ i ] - last_[ i ] : last_[ i ] - bytes[ i ] ;
+
+                if( d > delta ) delta = d ;
+        }
+        if( delta > config_.threshold ) return _send( _params_, _now_us_ ) ;
+
+        if( config_.max_stale_us && _now_us_ - sent_us_ >= config_.max_stale_us )
+        {
+                ++stats_.stale ;
+                return _send( _params_, _now_us_ ) ;
+        }
+        ++stats_.suppressed ;
+        return false ;
+}
+
+template< typename Params >
+bool delta_gate::_send ( Params const & _params_, timestamp_t _now_us_ ) noexcept
+{
+        std::memcpy( last_, &_params_, sizeof( Params ) ) ;
+
+        valid_   = true ;
+        sent_us_ = _now_us_ ;
+
+        ++stats_.sent ;
+        return true ;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
+
+} // namespace fffb
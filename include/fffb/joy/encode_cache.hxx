@@ -0,0 +1,154 @@
+//
+//
+//      fffb
+//      joy/encode_cache.hxx
+//
+
+#pragma once
+
+#include <fffb/util/types.hxx>
+#include <fffb/joy/protocol.hxx>
+
+#include <cstddef>
+#include <cstring>
+#include <type_traits>
+
+#define FFFB_ENCODE_CACHE_BITS     6
+#define FFFB_CLASSIC_PAYLOAD_SIZE  8
+
+
+namespace fffb
+{
+
+
+////////////////////////////////////////////////////////////////////////////////
+
+struct encode_cache_stats
+{
+        uti::u64_t      hits { 0 } ;
+        uti::u64_t    misses { 0 } ;
+        uti::u64_t evictions { 0 } ; // misses that replaced another encoding
+
+        [[ nodiscard ]] constexpr float hit_ratio () const noexcept
+        { return hits + misses ? static_cast< float >( hits ) / static_cast< float >( hits + misses ) : 0.0f ; }
+} ;
+
+////////////////////////////////////////////////////////////////////////////////
+
+// classic reports are a pure function of the params, so levels that keep coming
+// back (spring amplitudes mostly) are encoded once. direct mapped per force type,
+// 1 << FFFB_ENCODE_CACHE_BITS entries each. keys are the params without the
+// enabled flag, which the encoding doesn't look at. refreshes share the entry of
+// the download they only differ from in the command nibble
+
+class encode_cache
+{
+public:
+        template< typename Params >
+        [[ nodiscard ]] report download ( Params const & _params_ ) noexcept { return _report( _payload( _params_ ) ) ; }
+
+        template< typename Params >
+        [[ nodiscard ]] report refresh ( Params const & _params_ ) noexcept
+        {
+                report rep = _report( _payload( _params_ ) ) ;
+
+                rep.data[ 0 ] &= 0xF0 ;
+                rep.data[ 0 ] |= 0x0C ;
+
+                return rep ;
+        }
+
+        constexpr void clear () noexcept { for( auto & table : tables_ ) for( auto & entry : table ) entry.valid = false ; }
+
+        [[ nodiscard ]] constexpr encode_cache_stats const & stats () const noexcept { return stats_ ; }
+private:
+        static constexpr uti::u32_t size { 1u << FFFB_ENCODE_CACHE_BITS } ;
+
+        struct _entry
+        {
+                uti::u64_t key { 0 } ;
+                uti::u8_t  payload [ FFFB_CLASSIC_PAYLOAD_SIZE ] {} ;
+                bool       valid { false } ;
+        } ;
+
+        _entry tables_ [ static_cast< uti::u8_t >( force_type::COUNT ) ][ size ] {} ;
+
+        encode_cache_stats stats_ {} ;
+
+        template< typename Params >
+        [[ nodiscard ]] uti::u8_t const * _payload ( Params const & _params_ ) noexcept ;
+
+        [[ nodiscard ]] static report _report ( uti::u8_t const * _payload_ ) noexcept ;
+
+        template< typename Params >
+        [[ nodiscard ]] static constexpr force_type _type () noexcept ;
+} ;
+
+////////////////////////////////////////////////////////////////////////////////
+////////////////////////////////////////////////////////////////////////////////
+
+template< typename Params >
+uti::u8_t const * encode_cache::_payload ( Params const & _params_ ) noexcept
+{
+        static_assert( sizeof( Params ) == FFFB_FORCE_MAX_PARAMS + 2, "params don't pack into a key" ) ;
+        static_assert( offsetof( Params, enabled ) == 1, "params don't pack into a key" ) ;
+
+        uti::u8_t bytes [ sizeof( Params ) ] ;
+        std::memcpy( bytes, &_params_, sizeof( Params ) ) ;
+
+        // slot and the params after the enabled flag, 8 bytes
+        uti::u64_t key { bytes[ 0 ] } ;
+
+        for( uti::u32_t i = 2; i < sizeof( Params ); ++i ) key |= static_cast< uti::u64_t >( bytes[ i ] ) << ( ( i - 1 ) * 8 ) ;
+
+        uti::u64_t const index = ( key * 0x9E3779B97F4A7C15ull ) >> ( 64 - FFFB_ENCODE_CACHE_BITS ) ;
+
+        _entry & entry = tables_[ static_cast< uti::u8_t >( _type< Params >() ) ][ index ] ;
+
+        if( entry.valid && entry.key == key )
+        {
+                ++stats_.hits ;
+                return entry.payload ;
+        }
+        ++stats_.misses ;
+        stats_.evictions += entry.valid ;
+
+        report const rep = protocol::encode_force< ffb_protocol::logitech_classic >( _params_ ) ;
+
+        std::memcpy( entry.payload, rep.data, FFFB_CLASSIC_PAYLOAD_SIZE ) ;
+        entry.key   = key ;
+        entry.valid = true ;
+
+        return entry.payload ;
+}
+
+inline report encode_cache::_report ( uti::u8_t const * _payload_ ) noexcept
+{
+        report rep {} ;
+
+        rep.report_type = kIOHIDReportTypeOutput ;
+        rep.report_id   = 0 ;
+        rep.len         = FFFB_CLASSIC_PAYLOAD_SIZE ;
+
+        std::memcpy( rep.data, _payload_, FFFB_CLASSIC_PAYLOAD_SIZE ) ;
+
+        return rep ;
+}
+
+template< typename Params >
+constexpr force_type encode_cache::_type () noexcept
+{
+        if      constexpr( std::is_same_v< Params,  constant_force_params > ) return force_type:: CONSTANT ;
+        else if constexpr( std::is_same_v< Params,    spring_force_params > ) return force_type::   SPRING ;
+        else if constexpr( std::is_same_v< Params,    damper_force_params > ) return force_type::   DAMPER ;
+        else
+        {
+                static_assert( std::is_same_v< Params, trapezoid_force_params >, "unknown params" ) ;
+                return force_type::TRAPEZOID ;
+        }
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
+
+} // namespace fffb
@@ -8,6 +8,7 @@
 
 
 #include <fffb/util/types.hxx>
+#include <fffb/util/fixed.hxx>
 #include <fffb/hid/report.hxx>
 #include <fffb/hid/device.hxx>
 
@@ -76,6 +77,13 @@ enum class force_type
         COUNT     ,
 } ;
 
+[[ nodiscard ]] constexpr uti::u8_t force_bit ( force_type const type ) noexcept
+{
+        return static_cast< uti::u8_t >( 1u << static_cast< uti::u8_t >( type ) ) ;
+}
+
+constexpr uti::u8_t all_forces_mask { ( 1u << static_cast< uti::u8_t >( force_type::COUNT ) ) - 1 } ;
+
 struct force_params
 {
         uti::u8_t   slot ;
@@ -208,6 +216,24 @@ public:
 
         static constexpr vector< report > init_sequence ( ffb_protocol const protocol, uti::u32_t device_id ) noexcept ;
 
+        // encoders specialized per protocol, no force union and no runtime switch
+        template< ffb_protocol P > static constexpr report encode_force (  constant_force_params const & _params_ ) noexcept ;
+        template< ffb_protocol P > static constexpr report encode_force (    spring_force_params const & _params_ ) noexcept ;
+        template< ffb_protocol P > static constexpr report encode_force (    damper_force_params const & _params_ ) noexcept ;
+        template< ffb_protocol P > static constexpr report encode_force ( trapezoid_force_params const & _params_ ) noexcept ;
+
+        template< ffb_protocol P, typename Params >
+        static constexpr report encode_refresh ( Params const & _params_ ) noexcept ;
+
+        // hid++ has no autocenter switch, on is the _baseline_ spring and off no spring
+        template< ffb_protocol P > static constexpr report encode_autocenter ( bool _on_, uti::u16_t _baseline_ ) noexcept ;
+
+        // hid++ downloads autostart and a stop resets every effect, neither has a report of its own
+        template< ffb_protocol P > static constexpr report encode_play ( uti::u8_t _slots_ ) noexcept ;
+        template< ffb_protocol P > static constexpr report encode_stop ( uti::u8_t _slots_ ) noexcept ;
+
+        template< ffb_protocol P > static constexpr report encode_leds ( uti::u8_t _pattern_ ) noexcept ;
+
         static bool hidpp_download_force_sync(hid_device& dev, force const& f) noexcept;
         static bool hidpp_set_effect_state_sync(hid_device& dev,
                                         uti::u8_t effect_slot,
@@ -229,6 +255,7 @@ public:
         uti::u8_t & out_feature_type
         ) noexcept;
         static report hidpp_ff_reset_all() noexcept;
+        static void hidpp_forget_slots() noexcept;
 
 
 
@@ -774,10 +801,7 @@ inline bool protocol::hidpp_download_force_sync(hid_device & dev, force const &
     uti::u8_t amplitude = f.constant.amplitude;
     uti::u8_t & slot_ref = ctx.ff_slot_by_force_mask[f.params.slot & 0x0F];
 
-    int delta = (int)amplitude - 128;
-    int level = (delta >= 0) ? (delta * 0x7fff) / 127 : (delta * 0x8000) / 128;
-    if (level >  0x7fff) level =  0x7fff;
-    if (level < -0x8000) level = -0x8000;
+    int level = hidpp_level(amplitude);
 
     uti::u8_t params[14] = {0};
     params[0] = slot_ref; // 0 => allocate
@@ -896,7 +920,7 @@ constexpr report protocol::set_led_pattern ( ffb_protocol const protocol, uti::u
 
         switch( protocol )
         {
-                case ffb_protocol::logitech_classic : return _classic_4b( 0xF8, 0x12, pattern, 0x00) ;
+                case ffb_protocol::logitech_classic : return encode_leds< ffb_protocol::logitech_classic >( pattern ) ;
                 case ffb_protocol::logitech_hidpp   : return {} ;
                         FFFB_F_ERR_S( "protocol::set_led_pattern", "protocol not implemented" ) ;
                         return {} ;
@@ -919,7 +943,7 @@ inline report protocol::disable_autocenter(ffb_protocol const protocol, uti::u8_
 
         case ffb_protocol::logitech_hidpp:
         (void)slots;
-        return hidpp_ff_set_autocenter(0);
+        return encode_autocenter< ffb_protocol::logitech_hidpp >( false, 0 ) ;
 
         default:
             return {};
@@ -934,7 +958,7 @@ inline report protocol::enable_autocenter ( ffb_protocol const protocol, uti::u8
         switch( protocol )
         {
                 case ffb_protocol::logitech_classic : return _classic_1b( command ); ;
-                case ffb_protocol::logitech_hidpp: (void)slots; return hidpp_ff_set_autocenter(protocol::HIDPP_FF_BASELINE_AUTOCENTER);
+                case ffb_protocol::logitech_hidpp: (void)slots; return encode_autocenter< ffb_protocol::logitech_hidpp >( true, HIDPP_FF_BASELINE_AUTOCENTER ) ;
                         FFFB_F_ERR_S( "protocol::enable_autocenter", "protocol not implemented" ) ;
                         return {} ;
                 default :
@@ -982,12 +1006,11 @@ inline report protocol::download_force ( ffb_protocol const protocol, force cons
 inline report protocol::play_force(ffb_protocol const protocol, uti::u8_t slots) noexcept
 {
         FFFB_F_ERR_S("protocol::play_force", "NEW_PLAY_FORCE_IS_RUNNING");
-        uti::u8_t command = ( slots << 4 ) | 0x02;
 
         switch( protocol )
         {
                 case ffb_protocol::logitech_classic:
-                        return _classic_2b(command, 0x00);
+                        return encode_play< ffb_protocol::logitech_classic >( slots ) ;
 
                 case ffb_protocol::logitech_hidpp:
                 {
@@ -1042,6 +1065,12 @@ inline report protocol::hidpp_ff_reset_all() noexcept
     return _hidpp_ff_cmd(protocol::HIDPP_FF_RESET_ALL, nullptr, 0);
 }
 
+inline void protocol::hidpp_forget_slots() noexcept
+{
+    auto & ctx = hidpp_ctx();
+    for (auto & slot : ctx.ff_slot_by_force_mask) slot = 0;
+}
+
 inline report protocol::hidpp_ff_set_autocenter(uti::u16_t magnitude) noexcept
 {
     auto const& ctx = hidpp_ctx();
@@ -1069,12 +1098,10 @@ inline report protocol::hidpp_ff_set_autocenter(uti::u16_t magnitude) noexcept
 
 inline report protocol::stop_force(ffb_protocol const protocol, uti::u8_t slots) noexcept
 {
-    uti::u8_t command = (slots << 4) | 0x03;
-
     switch (protocol)
     {
         case ffb_protocol::logitech_classic:
-            return _classic_2b(command, 0x00);
+            return encode_stop< ffb_protocol::logitech_classic >( slots ) ;
 
         case ffb_protocol::logitech_hidpp:
         {
@@ -1119,92 +1146,10 @@ constexpr vector< report > protocol::init_sequence ( ffb_protocol const protocol
 
 constexpr report protocol::_constant_force ( ffb_protocol const protocol, force const & f ) noexcept
 {
-        uti::u8_t command   = f.params.slot << 4 ;
-        uti::u8_t amplitude = f.constant.amplitude ;
-
         switch( protocol )
         {
-                case ffb_protocol::logitech_classic:
-                {
-                        auto rep = _make_classic_report(); // sets type/id/len and zeros data[]
-
-                        rep.data[0] = command;
-                        rep.data[1] = 0x00;
-                        rep.data[2] = amplitude;
-                        rep.data[3] = amplitude;
-                        rep.data[4] = amplitude;
-                        rep.data[5] = amplitude;
-                        rep.data[6] = 0x00;
-                        // rep.data[7]
-
-                        return rep;
-                }
-                // case ffb_protocol::logitech_hidpp:
-                // {
-                // auto const & ctx = hidpp_ctx();
-                // if (!ctx.ff_ready)
-                // {
-                //         FFFB_F_ERR_S("protocol::_constant_force", "hidpp not initialized (no ff feature index)");
-                //         return {};
-                // }
-
-                // // Your amplitude is 0..255, with 128 treated as "neutral" (0 force).
-                // // Convert to signed 16-bit like the Linux driver expects in params[6..7]. :contentReference[oaicite:3]{index=3}
-                // const int force_s16 = ((int)amplitude - 128) << 8; // -32768..~32512
-
-                // // Linux upload layout: size = 14 for FF_CONSTANT. :contentReference[oaicite:4]{index=4}
-                // uti::u8_t params[14] = {0};
-
-                // // Slot handling note:
-                // // Linux sets params[0] (slot) in its work handler; for new effects it ends up as 0 (allocate). :contentReference[oaicite:5]{index=5}
-                // // Your code uses fixed "slots", so we try using your slot number directly.
-                // // If this turns out to be incompatible, change params[0] to 0 to "allocate a slot".
-                // // params[0] = f.params.slot;
-                // params[0] = 0;
-                // params[1] = (uti::u8_t)(HIDPP_FF_EFFECT_CONSTANT | HIDPP_FF_EFFECT_AUTOSTART);
-
-                // // replay.length and replay.delay (ms). You don’t have these in your struct yet, so keep 0 = continuous/no delay.
-                // params[2] = params[3] = 0;
-                // params[4] = params[5] = 0;
-
-                // // Force, big-endian (matches Linux: params[6]=force>>8, params[7]=force&255). :contentReference[oaicite:6]{index=6}
-                // params[6] = (uti::u8_t)((force_s16 >> 8) & 0xFF);
-                // params[7] = (uti::u8_t)(force_s16 & 0xFF);
-
-                // // Envelope [8..13] left as 0 (no attack/fade).
-
-                // return _hidpp_ff_cmd(HIDPP_FF_DOWNLOAD_EFFECT, params, sizeof(params));
-                // }
-                case ffb_protocol::logitech_hidpp:
-                {
-                auto & ctx = hidpp_ctx();
-                if (!ctx.ff_ready) return {};
-
-                uti::u8_t & slot_ref = ctx.ff_slot_by_force_mask[f.params.slot & 0x0F];
-                uti::u8_t slot = slot_ref;          // 0 if unknown -> allocate
-
-                // Map amplitude (0..255, 128 neutral) -> s16 level
-                int delta = (int)amplitude - 128;
-                int level;
-                if (delta >= 0) level = (delta * 0x7fff) / 127;
-                else            level = (delta * 0x8000) / 128;
-                if (level >  0x7fff) level =  0x7fff;
-                if (level < -0x8000) level = -0x8000;
-
-                uti::u8_t params[14] = {0};
-                params[0] = slot;  // 0 => allocate slot (device returns slot in reply) :contentReference[oaicite:8]{index=8}
-                params[1] = (uti::u8_t)(protocol::HIDPP_FF_EFFECT_CONSTANT | protocol::HIDPP_FF_EFFECT_AUTOSTART);
-
-                // length/delay = 0 (continuous)
-                params[2]=params[3]=params[4]=params[5]=0;
-
-                params[6] = (uti::u8_t)((level >> 8) & 0xFF);
-                params[7] = (uti::u8_t)(level & 0xFF);
-
-                // envelope [8..13] left as 0
-                return _hidpp_ff_cmd(protocol::HIDPP_FF_DOWNLOAD_EFFECT, params, sizeof(params));
-                }
-
+                case ffb_protocol::logitech_classic : return encode_force< ffb_protocol::logitech_classic >( f.constant ) ;
+                case ffb_protocol::logitech_hidpp   : return encode_force< ffb_protocol::logitech_hidpp   >( f.constant ) ;
                 default :
                         FFFB_F_ERR_S( "protocol::_constant_force", "protocol not supported" ) ;
                         return {} ;
@@ -1213,115 +1158,38 @@ constexpr report protocol::_constant_force ( ffb_protocol const protocol, force
 
 constexpr report protocol::_spring_force ( ffb_protocol const protocol, force const & f ) noexcept
 {
-        uti::u8_t command = f.params.slot << 4 ;
-
-        uti::u8_t dead_start   = f.spring.dead_start   ;
-        uti::u8_t dead_end     = f.spring.dead_end     ;
-        uti::u8_t slope_left   = f.spring.slope_left   & 0b0111 ;
-        uti::u8_t slope_right  = f.spring.slope_right  & 0b0111 ;
-        uti::u8_t invert_left  = f.spring.invert_left  & 0b0001 ;
-        uti::u8_t invert_right = f.spring.invert_right & 0b0001 ;
-        uti::u8_t amplitude    = f.spring.amplitude    ;
-
         switch( protocol )
         {
-                case ffb_protocol::logitech_classic:
-                {
-                        auto rep = _make_classic_report(); // sets type/id/len and zeros data[]
-
-                        rep.data[0] = command;
-                        rep.data[1] = 0x01;
-                        rep.data[2] = dead_start;
-                        rep.data[3] = dead_end;
-                        rep.data[4] = uti::u8_t( (  slope_right << 4 ) |  slope_left );
-                        rep.data[5] = uti::u8_t( ( invert_right << 4 ) | invert_left );
-                        rep.data[6] = amplitude ;
-                        // rep.data[7]
-
-                        return rep;
-                }
-                // case ffb_protocol::logitech_classic : return { command, 0x01,
-                //                                                dead_start, dead_end,
-                //                                                uti::u8_t( (  slope_right << 4 ) |  slope_left ),
-                //                                                uti::u8_t( ( invert_right << 4 ) | invert_left ),
-                //                                                amplitude } ;
-                case ffb_protocol::logitech_hidpp :
+                case ffb_protocol::logitech_classic : return encode_force< ffb_protocol::logitech_classic >( f.spring ) ;
+                case ffb_protocol::logitech_hidpp   :
                         FFFB_F_ERR_S( "protocol::_spring_force", "protocol not implemented" ) ;
                         return {} ;
                 default :
                         FFFB_F_ERR_S( "protocol::_spring_force", "protocol not supported" ) ;
                         return {} ;
         }
-
 }
 
 constexpr report protocol::_damper_force ( ffb_protocol const protocol, force const & f ) noexcept
 {
-        uti::u8_t command = f.params.slot << 4 ;
-
-        uti::u8_t slope_left   = f.damper.slope_left   & 0b0111 ;
-        uti::u8_t slope_right  = f.damper.slope_right  & 0b0111 ;
-        uti::u8_t invert_left  = f.damper.invert_left  & 0b0001 ;
-        uti::u8_t invert_right = f.damper.invert_right & 0b0001 ;
-
         switch( protocol )
-        {       
-                case ffb_protocol::logitech_classic:
-                {
-                        auto rep = _make_classic_report(); // sets type/id/len and zeros data[]
-
-                        rep.data[0] = command;
-                        rep.data[1] = 0x02;
-                        rep.data[2] = slope_left;
-                        rep.data[3] = invert_left;
-                        rep.data[4] = slope_right;
-                        rep.data[5] = invert_right;
-                        rep.data[6] = 0x00;
-                        // rep.data[7] stays 0 (already zeroed)
-
-                        return rep;
-                }
-                // case ffb_protocol::logitech_classic : return { command, 0x02, slope_left, invert_left, slope_right, invert_right, 0x00 } ;
-                case ffb_protocol::logitech_hidpp :
+        {
+                case ffb_protocol::logitech_classic : return encode_force< ffb_protocol::logitech_classic >( f.damper ) ;
+                case ffb_protocol::logitech_hidpp   :
                         FFFB_F_ERR_S( "protocol::_damper_force", "protocol not implemented" ) ;
                         return {} ;
                 default :
                         FFFB_F_ERR_S( "protocol::_damper_force", "protocol not supported" ) ;
                         return {} ;
         }
-
 }
 
 constexpr report protocol::_trapezoid_force ( ffb_protocol const protocol, force const & f ) noexcept
 {
-        uti::u8_t command = f.params.slot << 4 ;
-
-        uti::u8_t max_amp =   f.trapezoid.amplitude_max ;
-        uti::u8_t min_amp =   f.trapezoid.amplitude_min ;
-        uti::u8_t   t_max =   f.trapezoid.t_at_max ;
-        uti::u8_t   t_min =   f.trapezoid.t_at_min ;
-        uti::u8_t    dxdy = ( f.trapezoid.slope_step_x << 4 )
-                            | f.trapezoid.slope_step_y ;
-
         switch( protocol )
         {
-                case ffb_protocol::logitech_classic:
-                {
-                        auto rep = _make_classic_report(); // sets type/id/len and zeros data[]
-
-                        rep.data[0] = command;
-                        rep.data[1] = 0x06;
-                        rep.data[2] = max_amp;
-                        rep.data[3] = min_amp;
-                        rep.data[4] = t_max;
-                        rep.data[5] = t_min;
-                        rep.data[6] = dxdy;
-                        // rep.data[7]
-
-                        return rep;
-                }
-                // case ffb_protocol::logitech_classic : return { command, 0x06, max_amp, min_amp, t_max, t_min, dxdy } ;
-                case ffb_protocol::logitech_hidpp :
+                case ffb_protocol::logitech_classic : return encode_force< ffb_protocol::logitech_classic >( f.trapezoid ) ;
+                case ffb_protocol::logitech_hidpp   :
                         FFFB_F_ERR_S( "protocol::_trapezoid_force", "protocol not implemented" ) ;
                         return {} ;
                 default :
@@ -1330,6 +1198,183 @@ constexpr report protocol::_trapezoid_force ( ffb_protocol const protocol, force
         }
 }
 
+////////////////////////////////////////////////////////////////////////////////
+
+template< ffb_protocol P >
+constexpr report protocol::encode_force ( constant_force_params const & _params_ ) noexcept
+{
+        uti::u8_t amplitude = _params_.amplitude ;
+
+        if constexpr( P == ffb_protocol::logitech_classic )
+        {
+                auto rep = _make_classic_report() ;
+
+                rep.data[ 0 ] = _params_.slot << 4 ;
+                rep.data[ 1 ] = 0x00      ;
+                rep.data[ 2 ] = amplitude ;
+                rep.data[ 3 ] = amplitude ;
+                rep.data[ 4 ] = amplitude ;
+                rep.data[ 5 ] = amplitude ;
+                rep.data[ 6 ] = 0x00      ;
+
+                return rep ;
+        }
+        else if constexpr( P == ffb_protocol::logitech_hidpp )
+        {
+                auto & ctx = hidpp_ctx() ;
+                if( !ctx.ff_ready ) return {} ;
+
+                // 0 if unknown -> device allocates a slot and returns it in the reply
+                uti::u8_t slot = ctx.ff_slot_by_force_mask[ _params_.slot & 0x0F ] ;
+
+                // amplitude (0..255, 128 neutral) -> s16 level
+                uti::i16_t const level = hidpp_level( amplitude ) ;
+
+                uti::u8_t params[ 14 ] = { 0 } ;
+                params[ 0 ] = slot ;
+                params[ 1 ] = static_cast< uti::u8_t >( HIDPP_FF_EFFECT_CONSTANT | HIDPP_FF_EFFECT_AUTOSTART ) ;
+
+                // length/delay = 0 (continuous), envelope [8..13] left as 0
+                params[ 6 ] = static_cast< uti::u8_t >( ( level >> 8 ) & 0xFF ) ;
+                params[ 7 ] = static_cast< uti::u8_t >(   level        & 0xFF ) ;
+
+                return _hidpp_ff_cmd( HIDPP_FF_DOWNLOAD_EFFECT, params, sizeof( params ) ) ;
+        }
+        else
+        {
+                static_assert( P == ffb_protocol::logitech_classic || P == ffb_protocol::logitech_hidpp, "protocol not supported" ) ;
+        }
+}
+
+template< ffb_protocol P >
+constexpr report protocol::encode_force ( spring_force_params const & _params_ ) noexcept
+{
+        if constexpr( P == ffb_protocol::logitech_classic )
+        {
+                uti::u8_t slope_left   = _params_.slope_left   & 0b0111 ;
+                uti::u8_t slope_right  = _params_.slope_right  & 0b0111 ;
+                uti::u8_t invert_left  = _params_.invert_left  & 0b0001 ;
+                uti::u8_t invert_right = _params_.invert_right & 0b0001 ;
+
+                auto rep = _make_classic_report() ;
+
+                rep.data[ 0 ] = _params_.slot << 4 ;
+                rep.data[ 1 ] = 0x01 ;
+                rep.data[ 2 ] = _params_.dead_start ;
+                rep.data[ 3 ] = _params_.dead_end   ;
+                rep.data[ 4 ] = uti::u8_t( (  slope_right << 4 ) |  slope_left ) ;
+                rep.data[ 5 ] = uti::u8_t( ( invert_right << 4 ) | invert_left ) ;
+                rep.data[ 6 ] = _params_.amplitude  ;
+
+                return rep ;
+        }
+        else
+        {
+                // not implemented over HID++ yet, baseline autocenter stands in for it
+                (void) _params_ ;
+                return {} ;
+        }
+}
+
+template< ffb_protocol P >
+constexpr report protocol::encode_force ( damper_force_params const & _params_ ) noexcept
+{
+        if constexpr( P == ffb_protocol::logitech_classic )
+        {
+                auto rep = _make_classic_report() ;
+
+                rep.data[ 0 ] = _params_.slot << 4 ;
+                rep.data[ 1 ] = 0x02 ;
+                rep.data[ 2 ] = _params_.slope_left   & 0b0111 ;
+                rep.data[ 3 ] = _params_.invert_left  & 0b0001 ;
+                rep.data[ 4 ] = _params_.slope_right  & 0b0111 ;
+                rep.data[ 5 ] = _params_.invert_right & 0b0001 ;
+                rep.data[ 6 ] = 0x00 ;
+
+                return rep ;
+        }
+        else
+        {
+                (void) _params_ ;
+                return {} ;
+        }
+}
+
+template< ffb_protocol P >
+constexpr report protocol::encode_force ( trapezoid_force_params const & _params_ ) noexcept
+{
+        if constexpr( P == ffb_protocol::logitech_classic )
+        {
+                auto rep = _make_classic_report() ;
+
+                rep.data[ 0 ] = _params_.slot << 4 ;
+                rep.data[ 1 ] = 0x06 ;
+                rep.data[ 2 ] = _params_.amplitude_max ;
+                rep.data[ 3 ] = _params_.amplitude_min ;
+                rep.data[ 4 ] = _params_.t_at_max ;
+                rep.data[ 5 ] = _params_.t_at_min ;
+                rep.data[ 6 ] = ( _params_.slope_step_x << 4 ) | _params_.slope_step_y ;
+
+                return rep ;
+        }
+        else
+        {
+                (void) _params_ ;
+                return {} ;
+        }
+}
+
+template< ffb_protocol P, typename Params >
+constexpr report protocol::encode_refresh ( Params const & _params_ ) noexcept
+{
+        report rep = encode_force< P >( _params_ ) ;
+
+        if constexpr( P == ffb_protocol::logitech_classic )
+        {
+                rep.data[ 0 ] &= 0xF0 ;
+                rep.data[ 0 ] |= 0x0C ;
+        }
+        // HID++ downloads into an allocated slot update the effect in place
+        return rep ;
+}
+
+template< ffb_protocol P >
+constexpr report protocol::encode_autocenter ( bool _on_, uti::u16_t _baseline_ ) noexcept
+{
+        if constexpr( P == ffb_protocol::logitech_classic )
+        {
+                ( void ) _baseline_ ;
+                return _classic_1b( _on_ ? 0xF4 : 0xF5 ) ;
+        }
+        else
+        {
+                return hidpp_ff_set_autocenter( _on_ ? _baseline_ : 0 ) ;
+        }
+}
+
+template< ffb_protocol P >
+constexpr report protocol::encode_play ( uti::u8_t _slots_ ) noexcept
+{
+        if constexpr( P == ffb_protocol::logitech_classic ) return _classic_2b( uti::u8_t( _slots_ << 4 ) | 0x02, 0x00 ) ;
+        else                                                { ( void ) _slots_ ; return {} ; }
+}
+
+template< ffb_protocol P >
+constexpr report protocol::encode_stop ( uti::u8_t _slots_ ) noexcept
+{
+        if constexpr( P == ffb_protocol::logitech_classic ) return _classic_2b( uti::u8_t( _slots_ << 4 ) | 0x03, 0x00 ) ;
+        else                                                { ( void ) _slots_ ; return {} ; }
+}
+
+template< ffb_protocol P >
+constexpr report protocol::encode_leds ( uti::u8_t _pattern_ ) noexcept
+{
+        if constexpr( P == ffb_protocol::logitech_classic ) return _classic_4b( 0xF8, 0x12, _pattern_ & 0b00011111, 0x00 ) ;
+        else                                                { ( void ) _pattern_ ; return {} ; }
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
 
 
 constexpr ffb_protocol get_supported_protocol ( hid_device const & device ) noexcept
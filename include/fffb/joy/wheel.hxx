@@ -6,8 +6,14 @@
 
 #pragma once
 
+#include <fffb/util/clock.hxx>
 #include <fffb/hid/device.hxx>
 #include <fffb/joy/protocol.hxx>
+#include <fffb/joy/delta_gate.hxx>
+#include <fffb/joy/command_planner.hxx>
+#include <fffb/joy/encode_cache.hxx>
+
+#include <atomic>
 
 #define FFFB_WHEEL_USAGE_PAGE 0x01
 #define FFFB_WHEEL_USAGE      0x04
@@ -35,32 +41,68 @@ public:
 
         constexpr bool calibrate () noexcept ;
 
-        constexpr bool disable_autocenter () const noexcept ;
-        constexpr bool  enable_autocenter () const noexcept ;
+        // these all plan against the mirrored device state, see apply()
+        bool disable_autocenter () noexcept ;
+        bool  enable_autocenter () noexcept ;
 
+        // a download starts the forces too, play_forces() only starts what isn't yet
         bool download_forces () noexcept ;
-        constexpr bool  refresh_forces ()       noexcept ;
+        bool  refresh_forces ( uti::u8_t _forces_ = all_forces_mask ) noexcept ;
 
         bool play_forces () noexcept ;
         bool stop_forces () noexcept ;
 
-        constexpr bool set_led_pattern ( uti::u8_t _pattern_ ) const noexcept ;
+        bool set_led_pattern ( uti::u8_t _pattern_ ) noexcept ;
+
+        // takes the wheel to _desired_ with as few reports as the mirrored device state allows
+        bool apply ( wheel_state const & _desired_ ) noexcept ;
+
+        // the current params of _forces_, everything else as the device has it
+        [[ nodiscard ]] constexpr wheel_state desired_state ( uti::u8_t _forces_ = all_forces_mask ) const noexcept
+        { return _desired( mirror_, _forces_ ) ; }
+
+        [[ nodiscard ]] constexpr wheel_state const & device_state () const noexcept { return mirror_ ; }
+        [[ nodiscard ]] constexpr plan_log    const &        plans () const noexcept { return  plans_ ; }
+
+        // classic downloads and refreshes, hid++ encodings depend on the allocated slots
+        [[ nodiscard ]] constexpr encode_cache_stats const & encode_stats () const noexcept { return encodings_.stats() ; }
+
+        bool set_baseline_autocenter ( uti::u16_t _magnitude_ ) noexcept ;
+
+        // refresh_forces() only sends what changed noticeably, see delta_gate
+        constexpr void configure_gate ( force_type _type_, delta_gate_config const & _config_ ) noexcept
+        { gates_[ static_cast< uti::u8_t >( _type_ ) ].configure( _config_ ) ; }
+
+        [[ nodiscard ]] constexpr delta_gate_stats const & gate_stats ( force_type _type_ ) const noexcept
+        { return gates_[ static_cast< uti::u8_t >( _type_ ) ].stats() ; }
+
+        // reports written for the game thread, what the stream sent is counted apart
+        [[ nodiscard ]] uti::u64_t        reports_written () const noexcept { return reports_written_.load( std::memory_order_relaxed ) ; }
+        [[ nodiscard ]] uti::u64_t stream_reports_written () const noexcept { return  stream_reports_.load( std::memory_order_relaxed ) ; }
 
-        constexpr void q_disable_autocenter () noexcept ;
-        constexpr void  q_enable_autocenter () noexcept ;
+        bool stream_constant_force ( uti::u8_t _amplitude_ ) noexcept { return ( this->*stream_      )( _amplitude_ ) ; }
+        bool   stop_constant_stream (                      ) noexcept { return ( this->*stop_stream_ )(             ) ; }
+
+        // the q_ calls plan against what the device will hold once the queue is flushed
+        void q_disable_autocenter () noexcept ;
+        void  q_enable_autocenter () noexcept ;
         void q_set_autocenter(uti::u16_t magnitude) noexcept;
 
-        constexpr void q_download_forces () noexcept ;
-        constexpr void  q_refresh_forces () noexcept ;
+        void q_download_forces () noexcept ;
+        void  q_refresh_forces () noexcept ;
+
+        void q_play_forces () noexcept ;
+        void q_stop_forces () noexcept ;
 
-        constexpr void q_play_forces () noexcept ;
-        constexpr void q_stop_forces () noexcept ;
+        void q_set_led_pattern ( uti::u8_t _pattern_ ) noexcept ;
 
-        constexpr void q_set_led_pattern ( uti::u8_t _pattern_ ) noexcept ;
+        // takes the queued device state to _desired_, the reports go out with the next flush
+        void q_apply ( wheel_state const & _desired_ ) noexcept ;
 
         constexpr bool flush_reports () noexcept ;
 
-        [[ nodiscard ]] constexpr hid_device const & device () const noexcept { return device_ ; }
+        [[ nodiscard ]] constexpr hid_device const &   device () const noexcept { return   device_ ; }
+        [[ nodiscard ]] constexpr ffb_protocol       protocol () const noexcept { return protocol_ ; }
 
         [[ nodiscard ]] constexpr constant_force_params       & constant_force ()       noexcept { return constant_ ; }
         [[ nodiscard ]] constexpr constant_force_params const & constant_force () const noexcept { return constant_ ; }
@@ -82,13 +124,100 @@ private:
         damper_force_params       damper_ { default_damper_f } ;
         trapezoid_force_params trapezoid_ { default_trap_f   } ;
 
-        bool playing_ { false } ;
+        bool streaming_ { false } ;
+
+        // force bits the protocol has an effect for
+        uti::u8_t supported_ { all_forces_mask } ;
+
+        uti::u16_t baseline_autocenter_ { protocol::HIDPP_FF_BASELINE_AUTOCENTER } ;
+
+        delta_gate gates_ [ static_cast< uti::u8_t >( force_type::COUNT ) ] {} ;
+
+        mutable std::atomic< uti::u64_t > reports_written_ { 0 } ;
+        mutable std::atomic< uti::u64_t >  stream_reports_ { 0 } ;
+
+        // what the device was last told, autocenter assumed on until told otherwise
+        wheel_state mirror_ { default_const_f, default_spring_f, default_damper_f, default_trap_f } ;
+        plan_log     plans_ {} ;
+
+        // what it will have been told once the queued reports are flushed
+        wheel_state queued_mirror_ {} ;
+        bool        mirror_queued_ { false } ;
+
+        encode_cache encodings_ {} ;
 
         vector< report > reports_ {} ;
 
-        constexpr bool _write_report (          report   const & report , char const * scope ) const noexcept ;
+        // writes for the force stream count apart from the game thread's
+        constexpr bool _write_report (          report   const & report , char const * scope, bool stream = false ) const noexcept ;
         constexpr bool _write_reports ( vector< report > const & reports, char const * scope ) const noexcept ;
 
+        constexpr bool _write_reports ( report const * reports, uti::ssize_t count, char const * scope, bool stream = false ) const noexcept ;
+
+        // every path that sends reports is specialized for the protocol, picked once
+        // the device is known. below them nothing switches on the protocol per call
+        using execute_fn = bool ( wheel::* )( command_plan const & ) noexcept ;
+        using enqueue_fn = void ( wheel::* )( command_plan const &, wheel_state & ) noexcept ;
+        using  stream_fn = bool ( wheel::* )( uti::u8_t ) noexcept ;
+        using    stop_fn = bool ( wheel::* )() noexcept ;
+
+        execute_fn     execute_ { &wheel::_execute     < ffb_protocol::logitech_classic > } ;
+        enqueue_fn     enqueue_ { &wheel::_enqueue     < ffb_protocol::logitech_classic > } ;
+         stream_fn      stream_ { &wheel::_stream      < ffb_protocol::logitech_classic > } ;
+           stop_fn stop_stream_ { &wheel::_stop_stream < ffb_protocol::logitech_classic > } ;
+
+        constexpr void _bind_protocol () noexcept ;
+
+        constexpr void _invalidate_gates () noexcept { for( auto & gate : gates_ ) gate.invalidate() ; }
+
+        // forces the protocol can't play are always left as _device_ has them
+        [[ nodiscard ]] constexpr wheel_state _desired ( wheel_state const & _device_, uti::u8_t _forces_ ) const noexcept ;
+        [[ nodiscard ]] constexpr wheel_state _stopped ( wheel_state const & _device_                     ) const noexcept ;
+
+        template< ffb_protocol P > bool _execute ( command_plan const & _plan_ ) noexcept ;
+
+        // the queued counterpart, assumes every report goes out
+        template< ffb_protocol P > void _enqueue ( command_plan const & _plan_, wheel_state & _queued_ ) noexcept ;
+
+        template< ffb_protocol P > bool     _stop_slots ( uti::u8_t _forces_ ) noexcept ;
+        template< ffb_protocol P > bool _download_slots ( uti::u8_t _forces_ ) noexcept ;
+        template< ffb_protocol P > constexpr bool _refresh_forces ( uti::u8_t _forces_ ) noexcept ;
+
+        // a report stopping _forces_ on a device in state _device_, and the forces it stops.
+        // classic slot masks overlap, those can take more than asked for with them
+        template< ffb_protocol P >
+        [[ nodiscard ]] constexpr report _stop_report ( uti::u8_t _forces_, wheel_state const & _device_, uti::u8_t & _stopped_ ) const noexcept ;
+
+        // classic only, hid++ downloads wait for the slot in the reply. the last report plays them
+        [[ nodiscard ]] uti::ssize_t _download_reports ( uti::u8_t _forces_, report * _reports_ ) noexcept ;
+
+        template< ffb_protocol P > bool _stream      ( uti::u8_t _amplitude_ ) noexcept ;
+        template< ffb_protocol P > bool _stop_stream (                       ) noexcept ;
+
+        constexpr void _take_params ( uti::u8_t _forces_, wheel_state const & _from_ ) noexcept ;
+        constexpr void  _mirror_params ( uti::u8_t _forces_, wheel_state & _to_ ) const noexcept ;
+        constexpr void _mirror_stopped ( uti::u8_t _forces_, wheel_state & _to_ ) const noexcept ;
+
+        constexpr void  _mirror_params ( uti::u8_t _forces_ ) noexcept {  _mirror_params( _forces_, mirror_ ) ; }
+        constexpr void _mirror_stopped ( uti::u8_t _forces_ ) noexcept { _mirror_stopped( _forces_, mirror_ ) ; }
+
+        // reports without an encoding for the protocol are left out, false for those
+        constexpr bool _queue ( report const & _report_ ) noexcept
+        {
+                if( _report_.len == 0 ) return false ;
+
+                reports_.emplace_back( _report_ ) ;
+                return true ;
+        }
+
+        // the mirror the q_ calls update, it replaces the real one once they are flushed
+        constexpr wheel_state & _queued_mirror () noexcept
+        {
+                if( !mirror_queued_ ) queued_mirror_ = mirror_ ;
+                mirror_queued_ = true ;
+                return queued_mirror_ ;
+        }
+
         bool _init_protocol () noexcept ;
 } ;
 
@@ -133,6 +262,7 @@ constexpr wheel::wheel () noexcept
                 }
                 if( device_ )
                 {
+                        _bind_protocol() ;
                         _init_protocol() ;
                 }
                 else
@@ -213,17 +343,20 @@ constexpr bool wheel::calibrate () noexcept
 
 ////////////////////////////////////////////////////////////////////////////////
 
-constexpr bool wheel::disable_autocenter () const noexcept
-{       auto rep = protocol::disable_autocenter(protocol_, 0x0F);
-        if (rep.len == 0) return true;   // treat “not implemented” as no-op
-        return _write_report( rep, "wheel::disable_autocenter" ) ;
+inline bool wheel::disable_autocenter () noexcept
+{
+        wheel_state desired { mirror_ } ;
+        desired.autocenter = false ;
+
+        return apply( desired ) ;
 }
 
 inline void wheel::q_set_autocenter(uti::u16_t magnitude) noexcept
 {
     if (protocol_ == ffb_protocol::logitech_hidpp)
     {
-        reports_.emplace_back(protocol::hidpp_ff_set_autocenter(magnitude));
+        _queued_mirror().autocenter = magnitude != 0 ;
+        _queue(protocol::hidpp_ff_set_autocenter(magnitude));
         return;
     }
 
@@ -235,20 +368,28 @@ inline void wheel::q_set_autocenter(uti::u16_t magnitude) noexcept
 }
 
 
-constexpr bool wheel::enable_autocenter () const noexcept
-{       auto rep = protocol::enable_autocenter(protocol_, 0x0F);
-        if (rep.len == 0) return true;   // treat “not implemented” as no-op
-        return _write_report(rep, "wheel::enable_autocenter" ) ;
+inline bool wheel::enable_autocenter () noexcept
+{
+        wheel_state desired { mirror_ } ;
+        desired.autocenter = true ;
+
+        return apply( desired ) ;
 }
 
-constexpr void wheel::q_disable_autocenter () noexcept
+inline void wheel::q_disable_autocenter () noexcept
 {
-        reports_.emplace_back( protocol::disable_autocenter( protocol_, 0x0F ) ) ;
+        wheel_state desired { _queued_mirror() } ;
+        desired.autocenter = false ;
+
+        q_apply( desired ) ;
 }
 
-constexpr void wheel::q_enable_autocenter () noexcept
+inline void wheel::q_enable_autocenter () noexcept
 {
-        reports_.emplace_back( protocol::enable_autocenter( protocol_, 0x0F ) ) ;
+        wheel_state desired { _queued_mirror() } ;
+        desired.autocenter = true ;
+
+        q_apply( desired ) ;
 }
 
 ////////////////////////////////////////////////////////////////////////////////
@@ -286,119 +427,26 @@ constexpr void wheel::q_enable_autocenter () noexcept
 //         return _write_reports( reports, "wheel::download_forces" ) ;
 // }
 
-inline bool wheel::download_forces() noexcept
+inline bool wheel::download_forces () noexcept
 {
-    force f_const  { force_type::CONSTANT , {} };
-    force f_spring { force_type::SPRING   , {} };
-    force f_damper { force_type::DAMPER   , {} };
-    force f_trap   { force_type::TRAPEZOID, {} };
-
-    f_const .constant  = constant_;
-    f_spring.spring    = spring_;
-    f_damper.damper    = damper_;
-    f_trap  .trapezoid = trapezoid_;
-
-    // --- HID++ path: do “send + read reply” per effect (no report batching) ---
-    if (protocol_ == ffb_protocol::logitech_hidpp)
-    {
-        if (!device_.open())
-            return false;
-
-        if (!device_.enable_input_reports())
-        {
-            device_.close();
-            return false;
-        }
-
-        bool ok = true;
-
-        if (f_const.params.enabled)
-            ok = ok && protocol::hidpp_download_force_sync(device_, f_const);
-
-        if (f_spring.params.enabled)
-            ok = ok && protocol::hidpp_download_force_sync(device_, f_spring);
-
-        if (f_damper.params.enabled)
-            ok = ok && protocol::hidpp_download_force_sync(device_, f_damper);
-
-        if (f_trap.params.enabled)
-            ok = ok && protocol::hidpp_download_force_sync(device_, f_trap);
-
-        device_.close();
-        return ok;
-    }
-
-    // --- Classic path: batch output reports like before ---
-    vector<report> reports;
-    reports.reserve(4);  // IMPORTANT: don't pre-fill with empty reports
-
-    if (f_const.params.enabled)  reports.emplace_back(protocol::download_force(protocol_, f_const));
-    if (f_spring.params.enabled) reports.emplace_back(protocol::download_force(protocol_, f_spring));
-    if (f_damper.params.enabled) reports.emplace_back(protocol::download_force(protocol_, f_damper));
-    if (f_trap.params.enabled)   reports.emplace_back(protocol::download_force(protocol_, f_trap));
-
-    return _write_reports(reports, "wheel::download_forces");
+        return apply( desired_state() ) ;
 }
 
-constexpr void wheel::q_download_forces () noexcept
+inline void wheel::q_download_forces () noexcept
 {
-        force f_const  { force_type::CONSTANT , {} } ;
-        force f_spring { force_type::SPRING   , {} } ;
-        force f_damper { force_type::DAMPER   , {} } ;
-        force f_trap   { force_type::TRAPEZOID, {} } ;
-
-        f_const .constant  = constant_   ;
-        f_spring.spring    = spring_     ;
-        f_damper.damper    = damper_     ;
-        f_trap  .trapezoid = trapezoid_  ;
-
-        if( f_const.params.enabled )
-        {
-                reports_.emplace_back( protocol::download_force( protocol_, f_const ) ) ;
-        }
-        if( f_spring.params.enabled )
-        {
-                reports_.emplace_back( protocol::download_force( protocol_, f_spring ) ) ;
-        }
-        if( f_damper.params.enabled )
-        {
-                reports_.emplace_back( protocol::download_force( protocol_, f_damper ) ) ;
-        }
-        if( f_trap.params.enabled )
-        {
-                reports_.emplace_back( protocol::download_force( protocol_, f_trap ) ) ;
-        }
+        q_apply( _desired( _queued_mirror(), all_forces_mask ) ) ;
 }
 
 ////////////////////////////////////////////////////////////////////////////////
 
 inline bool wheel::play_forces () noexcept
 {
-        playing_ = true ;
-
-        uti::u8_t slots { 0 } ;
-
-        if( constant_ .enabled ) slots |= constant_ .slot ;
-        if( spring_   .enabled ) slots |= spring_   .slot ;
-        if( damper_   .enabled ) slots |= damper_   .slot ;
-        if( trapezoid_.enabled ) slots |= trapezoid_.slot ;
-        auto rep = protocol::play_force(protocol_, slots);
-        if (rep.len == 0) return true;   // treat “not implemented” as no-op
-        return _write_report(rep,  "wheel::play_forces" ) ;
+        return apply( desired_state() ) ;
 }
 
-constexpr void wheel::q_play_forces () noexcept
+inline void wheel::q_play_forces () noexcept
 {
-        playing_ = true ;
-
-        uti::u8_t slots { 0 } ;
-
-        if( constant_ .enabled ) slots |= constant_ .slot ;
-        if( spring_   .enabled ) slots |= spring_   .slot ;
-        if( damper_   .enabled ) slots |= damper_   .slot ;
-        if( trapezoid_.enabled ) slots |= trapezoid_.slot ;
-
-        reports_.emplace_back( protocol::play_force( protocol_, slots ) ) ;
+        q_apply( _desired( _queued_mirror(), all_forces_mask ) ) ;
 }
 
 ////////////////////////////////////////////////////////////////////////////////
@@ -449,125 +497,527 @@ constexpr void wheel::q_play_forces () noexcept
 //     return _write_report(rep, "wheel::stop_forces");
 // }
 
-inline bool wheel::stop_forces() noexcept
+inline bool wheel::stop_forces () noexcept
 {
-    playing_ = false;
+        // the stream gets the constant back with its next download
+        streaming_ = false ;
 
-    // For HID++: RESET_ALL clears everything, including your baseline spring.
-    // Re-apply baseline autocenter immediately so the wheel doesn't go back to "default stiff".
-    if (protocol_ == ffb_protocol::logitech_hidpp)
-    {
-        bool ok = true;
+        return apply( _stopped( mirror_ ) ) ;
+}
 
-        // stop everything
-        ok = ok && _write_report(protocol::hidpp_ff_reset_all(), "wheel::hidpp_ff_reset_all(stop)");
+inline void wheel::q_stop_forces () noexcept
+{
+        streaming_ = false ;
 
-        // choose one of these:
-        ok = ok && _write_report(
-            protocol::hidpp_ff_set_autocenter(protocol::HIDPP_FF_BASELINE_AUTOCENTER),
-            "wheel::hidpp_ff_set_autocenter(BASELINE-after-stop)"
-        );
+        q_apply( _stopped( _queued_mirror() ) ) ;
+}
 
-        // If you want it totally limp after stop instead, use:
-        // ok = ok && _write_report(protocol::hidpp_ff_set_autocenter(0), "autocenter_off_after_stop");
+////////////////////////////////////////////////////////////////////////////////
 
-        return ok;
-    }
+inline bool wheel::refresh_forces ( uti::u8_t _forces_ ) noexcept
+{
+        // the stream thread owns the constant, a hid++ refresh of it would garble the stream
+        if( streaming_ ) _forces_ &= ~force_bit( force_type::CONSTANT ) ;
 
-    // Classic path unchanged
-    auto rep = protocol::stop_force(protocol_, 0x0F);
-    if (rep.len == 0) return true;
-    return _write_report(rep, "wheel::stop_forces");
+        return apply( desired_state( _forces_ ) ) ;
 }
 
-constexpr void wheel::q_stop_forces () noexcept
+template< ffb_protocol P >
+constexpr bool wheel::_refresh_forces ( uti::u8_t _forces_ ) noexcept
 {
-        playing_ = false ;
+        report    reports [ 4 ] ;
+        uti::ssize_t count { 0 } ;
+        uti::u8_t     sent { 0 } ;
+
+        timestamp_t const now = host_time_us() ;
+
+        auto const refresh = [ & ]( auto const & _params_, force_type _type_ )
+        {
+                if( !( _forces_ & force_bit( _type_ ) ) ) return ;
+
+                delta_gate & gate = gates_[ static_cast< uti::u8_t >( _type_ ) ] ;
+
+                // nothing goes out for a disabled force, send it in full once it comes back
+                if( !_params_.enabled ) { gate.invalidate() ; return ; }
+
+                if( !gate.pass( _params_, now ) ) return ;
+
+                report rep ;
+
+                if constexpr( P == ffb_protocol::logitech_classic ) rep = encodings_.refresh( _params_ ) ;
+                else                                                rep = protocol::encode_refresh< P >( _params_ ) ;
+
+                // hid++ has no encoding for some forces, those never count as sent
+                if( rep.len == 0 ) return ;
+
+                reports[ count++ ] = rep ;
+                sent |= force_bit( _type_ ) ;
+        } ;
+
+        refresh(  constant_, force_type:: CONSTANT ) ;
+        refresh(    spring_, force_type::   SPRING ) ;
+        refresh(    damper_, force_type::   DAMPER ) ;
+        refresh( trapezoid_, force_type::TRAPEZOID ) ;
+
+        if( count == 0 ) return true ;
+
+        if( _write_reports( reports, count, "wheel::refresh_forces" ) )
+        {
+                _mirror_params( sent ) ;
+                return true ;
+        }
 
-        reports_.emplace_back( protocol::stop_force( protocol_, 0x0F ) ) ;
+        // whatever the device got is unknown now
+        for( uti::u8_t type = 0; type < static_cast< uti::u8_t >( force_type::COUNT ); ++type )
+        {
+                if( sent & ( 1u << type ) ) gates_[ type ].invalidate() ;
+        }
+        return false ;
+}
+
+constexpr void wheel::_bind_protocol () noexcept
+{
+        auto const bind = [ & ]< ffb_protocol P >()
+        {
+                execute_     = &wheel::_execute     < P > ;
+                enqueue_     = &wheel::_enqueue     < P > ;
+                stream_      = &wheel::_stream      < P > ;
+                stop_stream_ = &wheel::_stop_stream < P > ;
+        } ;
+
+        switch( protocol_ )
+        {
+                case ffb_protocol::logitech_hidpp : bind.template operator()< ffb_protocol::logitech_hidpp   >() ; break ;
+                default                           : bind.template operator()< ffb_protocol::logitech_classic >() ; break ;
+        }
+        supported_ = protocol_ == ffb_protocol::logitech_hidpp ? force_bit( force_type::CONSTANT ) : all_forces_mask ;
+}
+
+inline void wheel::q_refresh_forces () noexcept
+{
+        uti::u8_t forces { all_forces_mask } ;
+
+        if( streaming_ ) forces &= ~force_bit( force_type::CONSTANT ) ;
+
+        q_apply( _desired( _queued_mirror(), forces ) ) ;
 }
 
 ////////////////////////////////////////////////////////////////////////////////
 
-constexpr bool wheel::refresh_forces () noexcept
+inline bool wheel::apply ( wheel_state const & _desired_ ) noexcept
 {
-        if( !playing_ ) return play_forces() ;
+        command_plan plan = plan_commands( _desired_, mirror_ ) ;
 
-        force f_const  { force_type::CONSTANT , {} } ;
-        force f_spring { force_type::SPRING   , {} } ;
-        force f_damper { force_type::DAMPER   , {} } ;
-        force f_trap   { force_type::TRAPEZOID, {} } ;
+        if( plan.empty() )
+        {
+                plans_.skip() ;
+                return true ;
+        }
+        _take_params( plan.download | plan.refresh, _desired_ ) ;
 
-        f_const.constant =  constant_ ;
-        f_spring. spring =    spring_ ;
-        f_damper. damper =    damper_ ;
-        f_trap.trapezoid = trapezoid_ ;
+        uti::u64_t const before = reports_written() ;
 
-        vector< report > reports( 4 ) ;
+        plan.at_us   = host_time_us() ;
+        plan.ok      = ( this->*execute_ )( plan ) ;
+        plan.reports = static_cast< uti::u8_t >( reports_written() - before ) ;
 
-        if( f_const.params.enabled )
+        // nothing went on the wire, a failure is still worth keeping
+        if( plan.ok && plan.reports == 0 )
         {
-                reports.emplace_back( protocol::refresh_force( protocol_, f_const ) ) ;
+                plans_.skip() ;
+                return true ;
         }
-        if( f_spring.params.enabled )
+        plans_.record( plan ) ;
+        return plan.ok ;
+}
+
+inline void wheel::q_apply ( wheel_state const & _desired_ ) noexcept
+{
+        wheel_state & queued = _queued_mirror() ;
+
+        command_plan const plan = plan_commands( _desired_, queued ) ;
+
+        if( plan.empty() ) return ;
+
+        _take_params( plan.download | plan.refresh, _desired_ ) ;
+        ( this->*enqueue_ )( plan, queued ) ;
+}
+
+constexpr wheel_state wheel::_desired ( wheel_state const & _device_, uti::u8_t _forces_ ) const noexcept
+{
+        wheel_state desired { _device_ } ;
+
+        _forces_ &= supported_ ;
+
+        if( _forces_ & force_bit( force_type:: CONSTANT ) ) desired.constant  =  constant_ ;
+        if( _forces_ & force_bit( force_type::   SPRING ) ) desired.spring    =    spring_ ;
+        if( _forces_ & force_bit( force_type::   DAMPER ) ) desired.damper    =    damper_ ;
+        if( _forces_ & force_bit( force_type::TRAPEZOID ) ) desired.trapezoid = trapezoid_ ;
+
+        return desired ;
+}
+
+constexpr wheel_state wheel::_stopped ( wheel_state const & _device_ ) const noexcept
+{
+        wheel_state desired { _desired( _device_, all_forces_mask ) } ;
+
+        _mirror_stopped( all_forces_mask, desired ) ;
+
+        return desired ;
+}
+
+// every step updates the mirror only with what actually went out, a failed step
+// leaves it showing the difference so the next plan retries it
+template< ffb_protocol P >
+bool wheel::_execute ( command_plan const & _plan_ ) noexcept
+{
+        bool ok { true } ;
+
+        if( _plan_.set_autocenter )
+        {
+                // hid++ wheels fall back to the baseline spring rather than the firmware default
+                report const rep = protocol::encode_autocenter< P >( _plan_.autocenter, baseline_autocenter_ ) ;
+
+                if( rep.len == 0 || _write_report( rep, "wheel::apply" ) ) mirror_.autocenter = _plan_.autocenter ;
+                else                                                       ok = false ;
+        }
+        if( _plan_.stop     ) ok = _stop_slots    < P >( _plan_.stop     ) && ok ;
+        if( _plan_.download ) ok = _download_slots< P >( _plan_.download ) && ok ;
+        if( _plan_.refresh  ) ok = _refresh_forces< P >( _plan_.refresh  ) && ok ;
+
+        if( _plan_.set_leds )
+        {
+                report const rep = protocol::encode_leds< P >( _plan_.leds ) ;
+
+                if( rep.len == 0 || _write_report( rep, "wheel::apply" ) ) mirror_.leds = _plan_.leds ;
+                else                                                       ok = false ;
+        }
+        return ok ;
+}
+
+// the gates are bypassed, whatever they last passed is no longer what the device holds
+template< ffb_protocol P >
+void wheel::_enqueue ( command_plan const & _plan_, wheel_state & _queued_ ) noexcept
+{
+        uti::u8_t const touched = _plan_.stop | _plan_.download | _plan_.refresh ;
+
+        for( uti::u8_t type = 0; type < static_cast< uti::u8_t >( force_type::COUNT ); ++type )
         {
-                reports.emplace_back( protocol::refresh_force( protocol_, f_spring ) ) ;
+                if( touched & ( 1u << type ) ) gates_[ type ].invalidate() ;
         }
-        if( f_damper.params.enabled )
+        if( _plan_.set_autocenter )
         {
-                reports.emplace_back( protocol::refresh_force( protocol_, f_damper ) ) ;
+                _queue( protocol::encode_autocenter< P >( _plan_.autocenter, baseline_autocenter_ ) ) ;
+                _queued_.autocenter = _plan_.autocenter ;
         }
-        if( f_trap.params.enabled )
+        if( _plan_.stop )
         {
-                reports.emplace_back( protocol::refresh_force( protocol_, f_trap ) ) ;
+                uti::u8_t stopped { 0 } ;
+
+                _queue( _stop_report< P >( _plan_.stop, _queued_, stopped ) ) ;
+                _mirror_stopped( stopped, _queued_ ) ;
+        }
+        // hid++ downloads can't be queued, the forces stay inactive for the next plan to download
+        if constexpr( P == ffb_protocol::logitech_classic )
+        {
+                if( _plan_.download )
+                {
+                        report reports [ 5 ] ;
+
+                        uti::ssize_t const count = _download_reports( _plan_.download, reports ) ;
+
+                        for( uti::ssize_t i = 0; i < count; ++i ) _queue( reports[ i ] ) ;
+
+                        _mirror_params( _plan_.download, _queued_ ) ;
+                        _queued_.active |= _plan_.download ;
+                }
+        }
+        if( _plan_.refresh )
+        {
+                uti::u8_t refreshed { 0 } ;
+
+                auto const refresh = [ & ]( auto const & _params_, force_type _type_ )
+                {
+                        if( !( _plan_.refresh & force_bit( _type_ ) ) ) return ;
+
+                        report rep ;
+
+                        if constexpr( P == ffb_protocol::logitech_classic ) rep = encodings_.refresh( _params_ ) ;
+                        else                                                rep = protocol::encode_refresh< P >( _params_ ) ;
+
+                        if( _queue( rep ) ) refreshed |= force_bit( _type_ ) ;
+                } ;
+
+                refresh(  constant_, force_type:: CONSTANT ) ;
+                refresh(    spring_, force_type::   SPRING ) ;
+                refresh(    damper_, force_type::   DAMPER ) ;
+                refresh( trapezoid_, force_type::TRAPEZOID ) ;
+
+                _mirror_params( refreshed, _queued_ ) ;
+        }
+        if( _plan_.set_leds )
+        {
+                _queue( protocol::encode_leds< P >( _plan_.leds ) ) ;
+                _queued_.leds = _plan_.leds ;
         }
-        return _write_reports( reports, "wheel::refresh_forces" ) ;
 }
 
-constexpr void wheel::q_refresh_forces () noexcept
+template< ffb_protocol P >
+bool wheel::_stop_slots ( uti::u8_t _forces_ ) noexcept
 {
-        if( !playing_ ) q_play_forces() ;
+        for( uti::u8_t type = 0; type < static_cast< uti::u8_t >( force_type::COUNT ); ++type )
+        {
+                if( _forces_ & ( 1u << type ) ) gates_[ type ].invalidate() ;
+        }
+        uti::u8_t stopped { 0 } ;
 
-        force f_const  { force_type::CONSTANT , {} } ;
-        force f_spring { force_type::SPRING   , {} } ;
-        force f_damper { force_type::DAMPER   , {} } ;
-        force f_trap   { force_type::TRAPEZOID, {} } ;
+        report const rep = _stop_report< P >( _forces_, mirror_, stopped ) ;
 
-        f_const.constant =  constant_ ;
-        f_spring. spring =    spring_ ;
-        f_damper. damper =    damper_ ;
-        f_trap.trapezoid = trapezoid_ ;
+        if( rep.len != 0 && !_write_report( rep, "wheel::apply" ) ) return false ;
 
-        if( f_const.params.enabled )
+        _mirror_stopped( stopped ) ;
+        return true ;
+}
+
+template< ffb_protocol P >
+bool wheel::_download_slots ( uti::u8_t _forces_ ) noexcept
+{
+        for( uti::u8_t type = 0; type < static_cast< uti::u8_t >( force_type::COUNT ); ++type )
         {
-                reports_.emplace_back( protocol::refresh_force( protocol_, f_const ) ) ;
+                if( _forces_ & ( 1u << type ) ) gates_[ type ].invalidate() ;
         }
-        if( f_spring.params.enabled )
+        if constexpr( P == ffb_protocol::logitech_hidpp )
         {
-                reports_.emplace_back( protocol::refresh_force( protocol_, f_spring ) ) ;
+                // only the constant effect is supported there, downloads autostart and need the reply for the slot
+                force f_const { force_type::CONSTANT, {} } ;
+                f_const.constant = constant_ ;
+
+                if( !device_.open() ) return false ;
+
+                bool const ok = device_.enable_input_reports() && protocol::hidpp_download_force_sync( device_, f_const ) ;
+
+                device_.close() ;
+
+                if( !ok ) return false ;
+
+                reports_written_.fetch_add( 1, std::memory_order_relaxed ) ;
+
+                _mirror_params( force_bit( force_type::CONSTANT ) ) ;
+                mirror_.active |= force_bit( force_type::CONSTANT ) ;
+                return true ;
+        }
+        else
+        {
+                report reports [ 5 ] ;
+
+                uti::ssize_t const count = _download_reports( _forces_, reports ) ;
+
+                if( !_write_reports( reports, count, "wheel::apply" ) ) return false ;
+
+                _mirror_params( _forces_ ) ;
+                mirror_.active |= _forces_ ;
+                return true ;
         }
-        if( f_damper.params.enabled )
+}
+
+template< ffb_protocol P >
+constexpr report wheel::_stop_report ( uti::u8_t _forces_, wheel_state const & _device_, uti::u8_t & _stopped_ ) const noexcept
+{
+        _stopped_ = _forces_ ;
+
+        if constexpr( P == ffb_protocol::logitech_hidpp )
         {
-                reports_.emplace_back( protocol::refresh_force( protocol_, f_damper ) ) ;
+                // a stop there resets every effect, a neutral constant keeps its slot allocated.
+                // nothing to send if the constant never got one
+                if( !( _forces_ & force_bit( force_type::CONSTANT ) ) || hidpp_ctx().ff_slot_by_force_mask[ constant_.slot & 0x0F ] == 0 ) return {} ;
+
+                constant_force_params neutral { default_const_f } ;
+
+                return protocol::encode_force< P >( neutral ) ;
         }
-        if( f_trap.params.enabled )
+        else
         {
-                reports_.emplace_back( protocol::refresh_force( protocol_, f_trap ) ) ;
+                uti::u8_t slots { 0 } ;
+
+                if( _forces_ & force_bit( force_type:: CONSTANT ) ) slots |= _device_.constant .slot ;
+                if( _forces_ & force_bit( force_type::   SPRING ) ) slots |= _device_.spring   .slot ;
+                if( _forces_ & force_bit( force_type::   DAMPER ) ) slots |= _device_.damper   .slot ;
+                if( _forces_ & force_bit( force_type::TRAPEZOID ) ) slots |= _device_.trapezoid.slot ;
+
+                // slot masks overlap (spring shares the constant's bit), whatever else got hit counts as stopped too
+                if( _device_.constant .slot & slots ) _stopped_ |= force_bit( force_type:: CONSTANT ) ;
+                if( _device_.spring   .slot & slots ) _stopped_ |= force_bit( force_type::   SPRING ) ;
+                if( _device_.damper   .slot & slots ) _stopped_ |= force_bit( force_type::   DAMPER ) ;
+                if( _device_.trapezoid.slot & slots ) _stopped_ |= force_bit( force_type::TRAPEZOID ) ;
+
+                return protocol::encode_stop< P >( slots ) ;
         }
 }
 
+inline uti::ssize_t wheel::_download_reports ( uti::u8_t _forces_, report * _reports_ ) noexcept
+{
+        uti::ssize_t count { 0 } ;
+        uti::u8_t    slots { 0 } ;
+
+        auto const download = [ & ]( auto const & _params_, force_type _type_ )
+        {
+                if( !( _forces_ & force_bit( _type_ ) ) ) return ;
+
+                _reports_[ count++ ] = encodings_.download( _params_ ) ;
+                slots |= _params_.slot ;
+        } ;
+
+        download(  constant_, force_type:: CONSTANT ) ;
+        download(    spring_, force_type::   SPRING ) ;
+        download(    damper_, force_type::   DAMPER ) ;
+        download( trapezoid_, force_type::TRAPEZOID ) ;
+
+        _reports_[ count++ ] = protocol::encode_play< ffb_protocol::logitech_classic >( slots ) ;
+
+        return count ;
+}
+
+constexpr void wheel::_take_params ( uti::u8_t _forces_, wheel_state const & _from_ ) noexcept
+{
+        if( _forces_ & force_bit( force_type:: CONSTANT ) )  constant_ = _from_.constant  ;
+        if( _forces_ & force_bit( force_type::   SPRING ) )    spring_ = _from_.spring    ;
+        if( _forces_ & force_bit( force_type::   DAMPER ) )    damper_ = _from_.damper    ;
+        if( _forces_ & force_bit( force_type::TRAPEZOID ) ) trapezoid_ = _from_.trapezoid ;
+}
+
+constexpr void wheel::_mirror_params ( uti::u8_t _forces_, wheel_state & _to_ ) const noexcept
+{
+        if( _forces_ & force_bit( force_type:: CONSTANT ) ) _to_.constant  =  constant_ ;
+        if( _forces_ & force_bit( force_type::   SPRING ) ) _to_.spring    =    spring_ ;
+        if( _forces_ & force_bit( force_type::   DAMPER ) ) _to_.damper    =    damper_ ;
+        if( _forces_ & force_bit( force_type::TRAPEZOID ) ) _to_.trapezoid = trapezoid_ ;
+}
+
+// stopped forces show as disabled, so a desired state copied from the mirror keeps them stopped
+constexpr void wheel::_mirror_stopped ( uti::u8_t _forces_, wheel_state & _to_ ) const noexcept
+{
+        if( _forces_ & force_bit( force_type:: CONSTANT ) ) _to_.constant .enabled = false ;
+        if( _forces_ & force_bit( force_type::   SPRING ) ) _to_.spring   .enabled = false ;
+        if( _forces_ & force_bit( force_type::   DAMPER ) ) _to_.damper   .enabled = false ;
+        if( _forces_ & force_bit( force_type::TRAPEZOID ) ) _to_.trapezoid.enabled = false ;
+
+        _to_.active &= ~_forces_ ;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
+inline bool wheel::set_led_pattern ( uti::u8_t _pattern_ ) noexcept
+{
+        wheel_state desired { mirror_ } ;
+        desired.leds = _pattern_ & FFFB_LED_PATTERN_MASK ;
+
+        return apply( desired ) ;
+}
+
+inline void wheel::q_set_led_pattern ( uti::u8_t _pattern_ ) noexcept
+{
+        wheel_state desired { _queued_mirror() } ;
+        desired.leds = _pattern_ & FFFB_LED_PATTERN_MASK ;
+
+        q_apply( desired ) ;
+}
+
+inline bool wheel::set_baseline_autocenter ( uti::u16_t _magnitude_ ) noexcept
+{
+        if( _magnitude_ == baseline_autocenter_ ) return true ;
+
+        baseline_autocenter_ = _magnitude_ ;
+
+        // classic wheels have no baseline spring
+        if( protocol_ != ffb_protocol::logitech_hidpp ) return true ;
+
+        return _write_report( protocol::hidpp_ff_set_autocenter( baseline_autocenter_ ), "wheel::set_baseline_autocenter" ) ;
+}
+
 ////////////////////////////////////////////////////////////////////////////////
 
-constexpr bool wheel::set_led_pattern ( uti::u8_t pattern ) const noexcept
+template< ffb_protocol P >
+bool wheel::_stream ( uti::u8_t _amplitude_ ) noexcept
 {
-        auto rep = protocol::set_led_pattern(protocol_, pattern);
-        if (rep.len == 0) return true;   // treat “not implemented” as no-op
-        return _write_report( rep, "wheel::set_led_pattern" ) ;
+        constant_.  enabled = true ;
+        constant_.amplitude = _amplitude_ ;
+
+        if constexpr( P == ffb_protocol::logitech_hidpp )
+        {
+                // first update allocates the device slot and has to wait for the reply,
+                // afterwards the effect is updated in place without a round trip
+                if( hidpp_ctx().ff_slot_by_force_mask[ constant_.slot & 0x0F ] == 0 )
+                {
+                        force f_const { force_type::CONSTANT, {} } ;
+                        f_const.constant = constant_ ;
+
+                        if( !device_.open() ) return false ;
+
+                        bool ok = protocol::hidpp_download_force_sync( device_, f_const ) ;
+
+                        device_.close() ;
+                        streaming_ = ok ;
+
+                        // active from here on, so no plan downloads it under the stream
+                        if( ok )
+                        {
+                                _mirror_params( force_bit( force_type::CONSTANT ) ) ;
+                                mirror_.active |= force_bit( force_type::CONSTANT ) ;
+                        }
+                        return ok ;
+                }
+                streaming_ = true ;
+
+                if( !_write_report( protocol::encode_force< P >( constant_ ), "wheel::stream_constant_force", true ) ) return false ;
+
+                _mirror_params( force_bit( force_type::CONSTANT ) ) ;
+                mirror_.active |= force_bit( force_type::CONSTANT ) ;
+                return true ;
+        }
+        else
+        {
+                if( !streaming_ )
+                {
+                        report const reports[ 2 ]
+                        {
+                                protocol::encode_force< P >( constant_ ),
+                                protocol::encode_play < P >( constant_.slot ),
+                        } ;
+                        streaming_ = _write_reports( reports, 2, "wheel::stream_constant_force", true ) ;
+
+                        if( streaming_ )
+                        {
+                                _mirror_params( force_bit( force_type::CONSTANT ) ) ;
+                                mirror_.active |= force_bit( force_type::CONSTANT ) ;
+                        }
+                        return streaming_ ;
+                }
+                if( !_write_report( protocol::encode_refresh< P >( constant_ ), "wheel::stream_constant_force", true ) ) return false ;
+
+                _mirror_params( force_bit( force_type::CONSTANT ) ) ;
+                return true ;
+        }
 }
 
-constexpr void wheel::q_set_led_pattern ( uti::u8_t pattern ) noexcept
+template< ffb_protocol P >
+bool wheel::_stop_stream () noexcept
 {
-        reports_.emplace_back( protocol::set_led_pattern( protocol_, pattern ) ) ;
+        if( !streaming_ ) return true ;
+
+        streaming_ = false ;
+
+        constant_.  enabled = false ;
+        constant_.amplitude = default_const_f.amplitude ;
+
+        // a neutral level on hid++ keeps the allocated slot around for the next stream
+        report const rep = P == ffb_protocol::logitech_hidpp ? protocol::encode_force< P >( constant_ )
+                                                             : protocol::encode_stop < P >( constant_.slot ) ;
+
+        if( !_write_report( rep, "wheel::stop_constant_stream", true ) ) return false ;
+
+        _mirror_params ( force_bit( force_type::CONSTANT ) ) ;
+        _mirror_stopped( force_bit( force_type::CONSTANT ) ) ;
+        return true ;
 }
 
 ////////////////////////////////////////////////////////////////////////////////
@@ -577,12 +1027,16 @@ constexpr bool wheel::flush_reports () noexcept
         auto res = _write_reports( reports_, "wheel::flush" ) ;
         reports_.clear() ;
 
+        // after a failed flush what got through is unknown, the old mirror makes the next plan resend it
+        if( res && mirror_queued_ ) mirror_ = queued_mirror_ ;
+        mirror_queued_ = false ;
+
         return res ;
 }
 
 ////////////////////////////////////////////////////////////////////////////////
 
-constexpr bool wheel::_write_report ( report const & report, [[ maybe_unused ]] char const * scope ) const noexcept
+constexpr bool wheel::_write_report ( report const & report, [[ maybe_unused ]] char const * scope, bool stream ) const noexcept
 {
         if( !device_.open() )
         {
@@ -594,6 +1048,7 @@ constexpr bool wheel::_write_report ( report const & report, [[ maybe_unused ]]
                 FFFB_F_ERR_S( scope, "failed sending report to device %x", device_.device_id() ) ;
                 return false ;
         }
+        ( stream ? stream_reports_ : reports_written_ ).fetch_add( 1, std::memory_order_relaxed ) ;
         if( !device_.close() )
         {
                 FFFB_F_ERR_S( scope, "failed closing device %x", device_.device_id() ) ;
@@ -618,6 +1073,31 @@ constexpr bool wheel::_write_reports ( vector< report > const & reports, [[ mayb
                         FFFB_F_ERR_S( scope, "failed sending report to device %x", device_.device_id() ) ;
                         return false ;
                 }
+                reports_written_.fetch_add( 1, std::memory_order_relaxed ) ;
+        }
+        if( !device_.close() )
+        {
+                FFFB_F_ERR_S( scope, "failed closing device %x", device_.device_id() ) ;
+                return false ;
+        }
+        return true ;
+}
+
+constexpr bool wheel::_write_reports ( report const * reports, uti::ssize_t count, [[ maybe_unused ]] char const * scope, bool stream ) const noexcept
+{
+        if( !device_.open() )
+        {
+                FFFB_F_ERR_S( scope, "failed opening device %x", device_.device_id() ) ;
+                return false ;
+        }
+        for( uti::ssize_t i = 0; i < count; ++i )
+        {
+                if( !device_.write( reports[ i ] ) )
+                {
+                        FFFB_F_ERR_S( scope, "failed sending report to device %x", device_.device_id() ) ;
+                        return false ;
+                }
+                ( stream ? stream_reports_ : reports_written_ ).fetch_add( 1, std::memory_order_relaxed ) ;
         }
         if( !device_.close() )
         {
@@ -672,7 +1152,7 @@ bool wheel::_init_protocol() noexcept
         if (!device_.write(protocol::hidpp_ff_reset_all()))
         FFFB_F_ERR_S("wheel::init_protocol", "hidpp_ff_reset_all write failed");
 
-        if (!device_.write(protocol::hidpp_ff_set_autocenter(protocol::HIDPP_FF_BASELINE_AUTOCENTER)))
+        if (!device_.write(protocol::hidpp_ff_set_autocenter(baseline_autocenter_)))
         FFFB_F_ERR_S("wheel::init_protocol", "hidpp_ff_set_autocenter write failed");
 
         device_.close();
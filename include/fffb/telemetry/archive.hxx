@@ -0,0 +1,926 @@
+//
+//
+//      fffb
+//      telemetry/archive.hxx
+//
+
+#pragma once
+
+#include <fffb/util/types.hxx>
+#include <fffb/telemetry/state.hxx>
+#include <fffb/telemetry/recorder.hxx>
+#include <fffb/force/effect_graph.hxx>
+
+#include <cerrno>
+#include <cstddef>
+#include <cstring>
+#include <iterator>
+
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#define FFFB_ARCHIVE_VERSION    1
+#define FFFB_ARCHIVE_BLOCK_ROWS 4096
+
+
+namespace fffb
+{
+
+
+////////////////////////////////////////////////////////////////////////////////
+
+// long term storage for recordings. rows are recording records, every column
+// is one value out of them, stored block by block so a block decodes on its
+// own and a reader only touches the columns it asks for.
+//
+// a column stores every row as the difference to the row before it, the
+// previous value starts at zero in every block:
+//      bits   - xor of the raw bits, floats, masks and enums
+//      delta  - zigzagged difference, counters and fixed point values
+//      delta2 - zigzagged difference of differences, clocks ticking at a steady rate
+// differences are varints, a zero difference is a zero followed by the varint
+// length of the run minus one, which is what most slow channels are.
+//
+// the file is an archive_header, the blocks, and an index with the rows and
+// game time span of every block. a block is an archive_block_header, the
+// configs of its config records and the columns
+
+enum class archive_codec : uti::u8_t
+{
+        bits   ,
+        delta  ,
+        delta2 ,
+} ;
+
+struct archive_column
+{
+        char const *      name ;
+        uti::u16_t      offset ; // into a recording_record
+        uti:: u8_t       width ; // bytes
+        archive_codec    codec ;
+} ;
+
+namespace _detail
+{
+
+constexpr uti::u16_t archived_frame ( std::size_t _offset_ ) noexcept
+{ return static_cast< uti::u16_t >( offsetof( recording_record, frame ) + _offset_ ) ; }
+
+constexpr uti::u16_t archived_value ( telemetry_field _field_ ) noexcept
+{ return archived_frame( offsetof( recorded_frame, values ) + static_cast< uti::u8_t >( _field_ ) * sizeof( float ) ) ; }
+
+constexpr uti::u16_t archived_substance ( uti::u8_t _wheel_ ) noexcept
+{ return archived_frame( offsetof( recorded_frame, substance ) + _wheel_ ) ; }
+
+constexpr uti::u16_t archived_output ( effect_sink _sink_ ) noexcept
+{ return archived_frame( offsetof( recorded_frame, outputs ) + static_cast< uti::u8_t >( _sink_ ) * sizeof( uti::i32_t ) ) ; }
+
+} // namespace _detail
+
+constexpr archive_column archive_columns []
+{
+        { "kind"          , offsetof( recording_record, kind           ), 1, archive_codec::  bits },
+        { "sequence"      , offsetof( recording_record, sequence       ), 4, archive_codec::delta2 },
+        { "timestamp"     , offsetof( recording_record, timestamp      ), 8, archive_codec::delta2 },
+        { "host_timestamp", offsetof( recording_record, host_timestamp ), 8, archive_codec::delta2 },
+
+        { "fields"   , _detail::archived_frame( offsetof( recorded_frame, fields    ) ), 4, archive_codec:: bits },
+        { "callbacks", _detail::archived_frame( offsetof( recorded_frame, callbacks ) ), 4, archive_codec::delta },
+
+        { "heading"  , _detail::archived_value( telemetry_field::heading   ), 4, archive_codec::bits },
+        { "pitch"    , _detail::archived_value( telemetry_field::pitch     ), 4, archive_codec::bits },
+        { "roll"     , _detail::archived_value( telemetry_field::roll      ), 4, archive_codec::bits },
+        { "steering" , _detail::archived_value( telemetry_field::steering  ), 4, archive_codec::bits },
+        { "throttle" , _detail::archived_value( telemetry_field::throttle  ), 4, archive_codec::bits },
+        { "brake"    , _detail::archived_value( telemetry_field::brake     ), 4, archive_codec::bits },
+        { "clutch"   , _detail::archived_value( telemetry_field::clutch    ), 4, archive_codec::bits },
+        { "speed"    , _detail::archived_value( telemetry_field::speed     ), 4, archive_codec::bits },
+        { "rpm"      , _detail::archived_value( telemetry_field::rpm       ), 4, archive_codec::bits },
+        { "gear"     , _detail::archived_value( telemetry_field::gear      ), 4, archive_codec::bits },
+        { "rpm_ratio", _detail::archived_value( telemetry_field::rpm_ratio ), 4, archive_codec::bits },
+
+        { "substance.0" , _detail::archived_substance(  0 ), 1, archive_codec::bits },
+        { "substance.1" , _detail::archived_substance(  1 ), 1, archive_codec::bits },
+        { "substance.2" , _detail::archived_substance(  2 ), 1, archive_codec::bits },
+        { "substance.3" , _detail::archived_substance(  3 ), 1, archive_codec::bits },
+        { "substance.4" , _detail::archived_substance(  4 ), 1, archive_codec::bits },
+        { "substance.5" , _detail::archived_substance(  5 ), 1, archive_codec::bits },
+        { "substance.6" , _detail::archived_substance(  6 ), 1, archive_codec::bits },
+        { "substance.7" , _detail::archived_substance(  7 ), 1, archive_codec::bits },
+        { "substance.8" , _detail::archived_substance(  8 ), 1, archive_codec::bits },
+        { "substance.9" , _detail::archived_substance(  9 ), 1, archive_codec::bits },
+        { "substance.10", _detail::archived_substance( 10 ), 1, archive_codec::bits },
+        { "substance.11", _detail::archived_substance( 11 ), 1, archive_codec::bits },
+        { "substance.12", _detail::archived_substance( 12 ), 1, archive_codec::bits },
+        { "substance.13", _detail::archived_substance( 13 ), 1, archive_codec::bits },
+        { "substance.14", _detail::archived_substance( 14 ), 1, archive_codec::bits },
+        { "substance.15", _detail::archived_substance( 15 ), 1, archive_codec::bits },
+
+        { "written", _detail::archived_frame( offsetof( recorded_frame, written ) ), 4, archive_codec::bits },
+
+        { "constant_torque"    , _detail::archived_output( effect_sink::constant_torque     ), 4, archive_codec::delta },
+        { "spring_enabled"     , _detail::archived_output( effect_sink::spring_enabled      ), 4, archive_codec::delta },
+        { "spring_amplitude"   , _detail::archived_output( effect_sink::spring_amplitude    ), 4, archive_codec::delta },
+        { "spring_slope"       , _detail::archived_output( effect_sink::spring_slope        ), 4, archive_codec::delta },
+        { "damper_enabled"     , _detail::archived_output( effect_sink::damper_enabled      ), 4, archive_codec::delta },
+        { "damper_slope"       , _detail::archived_output( effect_sink::damper_slope        ), 4, archive_codec::delta },
+        { "trapezoid_enabled"  , _detail::archived_output( effect_sink::trapezoid_enabled   ), 4, archive_codec::delta },
+        { "trapezoid_amplitude", _detail::archived_output( effect_sink::trapezoid_amplitude ), 4, archive_codec::delta },
+        { "trapezoid_period"   , _detail::archived_output( effect_sink::trapezoid_period    ), 4, archive_codec::delta },
+
+        { "torque", _detail::archived_frame( offsetof( recorded_frame, torque ) ), 4, archive_codec::delta },
+} ;
+
+constexpr uti::u32_t archive_column_count { static_cast< uti::u32_t >( std::size( archive_columns ) ) } ;
+
+static_assert( archive_column_count == 6 + static_cast< uti::u32_t >( telemetry_field::count ) + FFFB_TELEMETRY_MAX_WHEELS + 1
+                                         + static_cast< uti::u32_t >( effect_sink::count ) + 1, "archive columns out of sync with recorded_frame" ) ;
+static_assert( archive_column_count <= 64, "archive column masks are 64 bits" ) ;
+
+// frame columns repeat their value through records that aren't frames, a repeat only costs nothing without delta2
+static_assert( []
+{
+        for( auto const & column : archive_columns )
+        {
+                if( column.offset >= offsetof( recording_record, frame ) && column.codec == archive_codec::delta2 ) return false ;
+        }
+        return true ;
+}(), "frame columns can't use delta2" ) ;
+
+constexpr uti::u32_t archive_kind_column      { 0 } ;
+constexpr uti::u32_t archive_timestamp_column { 2 } ;
+
+[[ nodiscard ]] constexpr uti::u64_t archive_column_bit ( uti::u32_t _column_ ) noexcept { return uti::u64_t( 1 ) << _column_ ; }
+
+constexpr uti::u64_t archive_all_columns { archive_column_count == 64 ? ~uti::u64_t( 0 ) : archive_column_bit( archive_column_count ) - 1 } ;
+
+// every decode reads these, rows have to know what they are and when
+constexpr uti::u64_t archive_required_columns { archive_column_bit( archive_kind_column ) | archive_column_bit( archive_timestamp_column ) } ;
+
+// archive_column_count if there is no such column
+[[ nodiscard ]] constexpr uti::u32_t find_archive_column ( char const * _name_, std::size_t _length_ ) noexcept
+{
+        for( uti::u32_t column = 0; column < archive_column_count; ++column )
+        {
+                char const * name = archive_columns[ column ].name ;
+
+                std::size_t i = 0 ;
+                while( i < _length_ && name[ i ] == _name_[ i ] ) ++i ;
+
+                if( i == _length_ && name[ i ] == '\0' ) return column ;
+        }
+        return archive_column_count ;
+}
+
+// a comma separated list of column names, false on an unknown name
+[[ nodiscard ]] constexpr bool parse_archive_columns ( char const * _list_, uti::u64_t & _columns_ ) noexcept
+{
+        _columns_ = 0 ;
+
+        while( *_list_ )
+        {
+                std::size_t length = 0 ;
+                while( _list_[ length ] && _list_[ length ] != ',' ) ++length ;
+
+                uti::u32_t const column = find_archive_column( _list_, length ) ;
+
+                if( column == archive_column_count ) return false ;
+
+                _columns_ |= archive_column_bit( column ) ;
+
+                _list_ += length ;
+                if( *_list_ == ',' ) ++_list_ ;
+        }
+        return true ;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
+struct archive_header
+{
+        char        magic [ 8 ] ; // "FFFBARC" and a zero
+        uti::u32_t  version ;
+        uti::u32_t  column_count ;
+        uti::u32_t  block_rows ;
+        uti::u32_t  blocks ;
+        uti::u64_t  rows ;
+        uti::u64_t  index_offset ; // 0 until the archive was closed
+        recording_header recording ; // of the recording the rows came from
+} ;
+
+struct archive_block_header
+{
+        uti::u32_t rows ;
+        uti::u32_t configs ;
+        uti::u32_t size ; // header included
+        uti::u32_t reserved ;
+        uti::u32_t column_end [ archive_column_count ] ; // from the start of the column data
+} ;
+
+struct archive_block_info
+{
+        uti::u64_t    offset ;
+        uti::u64_t first_row ;
+        timestamp_t    first ; // game time of the first and last row that has one
+        timestamp_t     last ;
+        uti::u32_t      rows ;
+        uti::u32_t      size ;
+} ;
+
+constexpr char archive_magic [ 8 ] { 'F', 'F', 'F', 'B', 'A', 'R', 'C', '\0' } ;
+
+////////////////////////////////////////////////////////////////////////////////
+
+namespace _detail
+{
+
+[[ nodiscard ]] constexpr uti::u64_t width_mask ( uti::u8_t _width_ ) noexcept
+{ return _width_ >= 8 ? ~uti::u64_t( 0 ) : ( uti::u64_t( 1 ) << ( _width_ * 8 ) ) - 1 ; }
+
+// differences wrap at the column's width, sign extending them keeps small negative steps small
+[[ nodiscard ]] constexpr uti::i64_t sign_extend ( uti::u64_t _value_, uti::u8_t _width_ ) noexcept
+{
+        uti::u32_t const shift = 64 - _width_ * 8 ;
+        return static_cast< uti::i64_t >( _value_ << shift ) >> shift ;
+}
+
+[[ nodiscard ]] constexpr uti::u64_t   zigzag ( uti::i64_t _value_ ) noexcept { return ( static_cast< uti::u64_t >( _value_ ) << 1 ) ^ static_cast< uti::u64_t >( _value_ >> 63 ) ; }
+[[ nodiscard ]] constexpr uti::i64_t unzigzag ( uti::u64_t _value_ ) noexcept { return static_cast< uti::i64_t >( _value_ >> 1 ) ^ -static_cast< uti::i64_t >( _value_ & 1 ) ; }
+
+[[ nodiscard ]] inline uti::u64_t load_column ( unsigned char const * _at_, uti::u8_t _width_ ) noexcept
+{
+        switch( _width_ )
+        {
+                case 1: { uti::u8_t  v ; std::memcpy( &v, _at_, 1 ) ; return v ; }
+                case 2: { uti::u16_t v ; std::memcpy( &v, _at_, 2 ) ; return v ; }
+                case 4: { uti::u32_t v ; std::memcpy( &v, _at_, 4 ) ; return v ; }
+                default:{ uti::u64_t v ; std::memcpy( &v, _at_, 8 ) ; return v ; }
+        }
+}
+
+inline void store_column ( unsigned char * _at_, uti::u8_t _width_, uti::u64_t _value_ ) noexcept
+{
+        switch( _width_ )
+        {
+                case 1: { uti::u8_t  v = static_cast< uti::u8_t  >( _value_ ) ; std::memcpy( _at_, &v, 1 ) ; return ; }
+                case 2: { uti::u16_t v = static_cast< uti::u16_t >( _value_ ) ; std::memcpy( _at_, &v, 2 ) ; return ; }
+                case 4: { uti::u32_t v = static_cast< uti::u32_t >( _value_ ) ; std::memcpy( _at_, &v, 4 ) ; return ; }
+                default:{                                                        std::memcpy( _at_, &_value_, 8 ) ; return ; }
+        }
+}
+
+inline void write_varint ( vector< uti::u8_t > & _out_, uti::u64_t _value_ )
+{
+        while( _value_ >= 0x80 )
+        {
+                _out_.push_back( static_cast< uti::u8_t >( _value_ | 0x80 ) ) ;
+                _value_ >>= 7 ;
+        }
+        _out_.push_back( static_cast< uti::u8_t >( _value_ ) ) ;
+}
+
+[[ nodiscard ]] inline bool read_varint ( uti::u8_t const * & _at_, uti::u8_t const * _end_, uti::u64_t & _value_ ) noexcept
+{
+        uti::u64_t value { 0 } ;
+
+        for( uti::u32_t shift = 0; shift < 64; shift += 7 )
+        {
+                if( _at_ == _end_ ) return false ;
+
+                uti::u8_t const byte = *_at_++ ;
+
+                value |= static_cast< uti::u64_t >( byte & 0x7f ) << shift ;
+
+                if( !( byte & 0x80 ) )
+                {
+                        _value_ = value ;
+                        return true ;
+                }
+        }
+        return false ;
+}
+
+} // namespace _detail
+
+////////////////////////////////////////////////////////////////////////////////
+
+struct archive_writer_stats
+{
+        uti::u64_t   rows { 0 } ;
+        uti::u32_t blocks { 0 } ;
+        uti::u64_t  bytes { 0 } ; // written so far, headers and index included
+} ;
+
+// builds an archive a block at a time, rows have to come in recording order
+
+class archive_writer
+{
+public:
+         archive_writer () noexcept = default ;
+        ~archive_writer () noexcept { close() ; }
+
+        archive_writer ( archive_writer const & ) = delete ;
+        archive_writer & operator= ( archive_writer const & ) = delete ;
+
+        bool open ( char const * _path_, recording_header const & _recording_, uti::u32_t _block_rows_ = FFFB_ARCHIVE_BLOCK_ROWS ) noexcept ;
+
+        bool push ( recording_record const & _record_ ) noexcept ;
+
+        // writes the last block, the index and the final header
+        bool close () noexcept ;
+
+        [[ nodiscard ]] archive_writer_stats const & stats () const noexcept { return stats_ ; }
+private:
+        int fd_ { -1 } ;
+
+        archive_header header_ {} ;
+
+        vector< recording_record   >  rows_ ;
+        vector< uti::u8_t          > block_ ;
+        vector< archive_block_info > index_ ;
+
+        archive_writer_stats stats_ {} ;
+
+        bool _flush () noexcept ;
+
+        bool _write ( void const * _data_, std::size_t _size_ ) noexcept ;
+
+        void _encode ( archive_column const & _column_ ) noexcept ;
+} ;
+
+////////////////////////////////////////////////////////////////////////////////
+
+// maps a whole archive and decodes blocks out of it
+
+class archive_reader
+{
+public:
+         archive_reader () noexcept = default ;
+        ~archive_reader () noexcept { close() ; }
+
+        archive_reader ( archive_reader const & ) = delete ;
+        archive_reader & operator= ( archive_reader const & ) = delete ;
+
+        bool open  ( char const * _path_ ) noexcept ;
+        void close (                     ) noexcept ;
+
+        [[ nodiscard ]] bool is_open () const noexcept { return data_ != nullptr ; }
+
+        // valid while open
+        [[ nodiscard ]] archive_header const & header () const noexcept { return *reinterpret_cast< archive_header const * >( data_ ) ; }
+
+        [[ nodiscard ]] uti::u32_t blocks () const noexcept { return header().blocks ; }
+
+        [[ nodiscard ]] archive_block_info const & block ( uti::u32_t _block_ ) const noexcept { return index_[ _block_ ] ; }
+
+        // false if the block doesn't fit the file or disagrees with the index
+        [[ nodiscard ]] bool block_header ( uti::u32_t _block_, archive_block_header & _header_ ) const noexcept ;
+
+        // the first block with a row at or after _timestamp_, blocks() if there is none.
+        // game time doesn't run backwards, so neither do the blocks
+        [[ nodiscard ]] uti::u32_t find ( timestamp_t _timestamp_ ) const noexcept ;
+
+        // decodes the block into _rows_, which has room for block( _block_ ).rows.
+        // columns left out of _columns_ come out zero, except for config records
+        [[ nodiscard ]] bool decode ( uti::u32_t _block_, uti::u64_t _columns_, recording_record * _rows_ ) const noexcept ;
+private:
+        uti::u8_t const *           data_ { nullptr } ;
+        std::size_t                 size_ { 0 } ;
+        archive_block_info const * index_ { nullptr } ;
+
+        [[ nodiscard ]] static bool _decode ( archive_column const & _column_, uti::u8_t const * _at_, uti::u8_t const * _end_, recording_record * _rows_, uti::u32_t _count_ ) noexcept ;
+} ;
+
+////////////////////////////////////////////////////////////////////////////////
+
+// streams rows out of an archive a block at a time, decoding only _columns_
+
+class archive_cursor
+{
+public:
+        archive_cursor ( archive_reader const & _reader_, uti::u64_t _columns_ = archive_all_columns ) noexcept
+                : reader_ { &_reader_ }, columns_ { _columns_ | archive_required_columns } {}
+
+        // next() continues at the first row at or after _timestamp_, false if there is none
+        bool seek ( timestamp_t _timestamp_ ) noexcept ;
+
+        void rewind () noexcept { block_ = 0 ; row_ = 0 ; count_ = 0 ; }
+
+        // the next row, valid until the following call. nullptr at the end or on a bad block
+        [[ nodiscard ]] recording_record const * next () noexcept ;
+
+        [[ nodiscard ]] bool failed () const noexcept { return failed_ ; }
+private:
+        archive_reader const * reader_ ;
+        uti::u64_t            columns_ ;
+
+        vector< recording_record > rows_ ;
+
+        uti::u32_t block_ { 0 } ; // the next block to decode
+        uti::u32_t   row_ { 0 } ;
+        uti::u32_t count_ { 0 } ; // rows decoded from the last block
+
+        bool failed_ { false } ;
+
+        bool _load ( uti::u32_t _block_ ) noexcept ;
+} ;
+
+////////////////////////////////////////////////////////////////////////////////
+
+// true if _path_ starts like an archive, anything else is taken for a recording
+[[ nodiscard ]] bool is_archive ( char const * _path_ ) noexcept ;
+
+// hands every record of a recording or an archive to _fn_, in order
+template< typename Fn >
+bool for_each_record ( char const * _path_, Fn && _fn_ ) ;
+
+////////////////////////////////////////////////////////////////////////////////
+////////////////////////////////////////////////////////////////////////////////
+
+inline bool archive_writer::open ( char const * _path_, recording_header const & _recording_, uti::u32_t _block_rows_ ) noexcept
+{
+        close() ;
+
+        fd_ = ::open( _path_, O_WRONLY | O_CREAT | O_TRUNC, 0644 ) ;
+
+        if( fd_ < 0 )
+        {
+                FFFB_ERR_S( "archive_writer::open", "failed opening '%s' : %s", _path_, std::strerror( errno ) ) ;
+                return false ;
+        }
+        header_ = {} ;
+        std::memcpy( header_.magic, archive_magic, sizeof( header_.magic ) ) ;
+        header_.version      = FFFB_ARCHIVE_VERSION ;
+        header_.column_count = archive_column_count ;
+        header_.block_rows   = _block_rows_ ? _block_rows_ : FFFB_ARCHIVE_BLOCK_ROWS ;
+        header_.recording    = _recording_ ;
+
+        stats_ = {} ;
+
+        rows_ .clear() ;
+        index_.clear() ;
+        rows_ .reserve( header_.block_rows ) ;
+
+        // rewritten on close, with the index in place
+        return _write( &header_, sizeof( header_ ) ) ;
+}
+
+inline bool archive_writer::push ( recording_record const & _record_ ) noexcept
+{
+        if( fd_ < 0 ) return false ;
+
+        rows_.push_back( _record_ ) ;
+
+        return static_cast< uti::u32_t >( rows_.size() ) < header_.block_rows || _flush() ;
+}
+
+inline bool archive_writer::close () noexcept
+{
+        if( fd_ < 0 ) return false ;
+
+        bool ok = _flush() ;
+
+        header_.blocks       = stats_.blocks ;
+        header_.rows         = stats_.rows ;
+        header_.index_offset = stats_.bytes ;
+
+        ok = ok && _write( index_.data(), static_cast< std::size_t >( index_.size() ) * sizeof( archive_block_info ) ) ;
+        ok = ok && ::pwrite( fd_, &header_, sizeof( header_ ), 0 ) == static_cast< ssize_t >( sizeof( header_ ) ) ;
+
+        if( !ok ) FFFB_ERR_S( "archive_writer::close", "failed finishing archive : %s", std::strerror( errno ) ) ;
+
+        ::close( fd_ ) ;
+        fd_ = -1 ;
+
+        return ok ;
+}
+
+inline bool archive_writer::_flush () noexcept
+{
+        uti::u32_t const count = static_cast< uti::u32_t >( rows_.size() ) ;
+
+        if( count == 0 ) return true ;
+
+        archive_block_header block {} ;
+        block.rows = count ;
+
+        block_.clear() ;
+        block_.reserve( sizeof( block ) + count * 64 ) ;
+
+        for( std::size_t i = 0; i < sizeof( block ); ++i ) block_.push_back( 0 ) ;
+
+        for( uti::u32_t row = 0; row < count; ++row )
+        {
+                if( rows_[ row ].kind != record_kind::config ) continue ;
+
+                auto const * config = reinterpret_cast< uti::u8_t const * >( &rows_[ row ].config ) ;
+
+                for( std::size_t i = 0; i < sizeof( recorded_config ); ++i ) block_.push_back( config[ i ] ) ;
+
+                ++block.configs ;
+        }
+        std::size_t const data = static_cast< std::size_t >( block_.size() ) ;
+
+        for( uti::u32_t column = 0; column < archive_column_count; ++column )
+        {
+                _encode( archive_columns[ column ] ) ;
+
+                block.column_end[ column ] = static_cast< uti::u32_t >( static_cast< std::size_t >( block_.size() ) - data ) ;
+        }
+        block.size = static_cast< uti::u32_t >( block_.size() ) ;
+
+        std::memcpy( block_.data(), &block, sizeof( block ) ) ;
+
+        // records from before the first frame carry no game time yet
+        constexpr timestamp_t unset { static_cast< timestamp_t >( -1 ) } ;
+
+        timestamp_t first { unset } ;
+        timestamp_t  last { index_.size() ? index_[ index_.size() - 1 ].last : 0 } ;
+
+        for( auto const & row : rows_ )
+        {
+                if( row.timestamp == unset ) continue ;
+
+                if( first == unset ) first = row.timestamp ;
+                last = row.timestamp ;
+        }
+        index_.push_back( { stats_.bytes, stats_.rows, first, last, count, block.size } ) ;
+
+        if( !_write( block_.data(), block.size ) ) return false ;
+
+        stats_.rows   += count ;
+        stats_.blocks += 1 ;
+
+        rows_.clear() ;
+
+        return true ;
+}
+
+// frame columns of records that aren't frames repeat the value before, the
+// decoder puts the record's own payload back in
+inline void archive_writer::_encode ( archive_column const & _column_ ) noexcept
+{
+        uti::u64_t const mask = _detail::width_mask( _column_.width ) ;
+
+        bool const in_frame = _column_.offset >= offsetof( recording_record, frame ) ;
+
+        uti::u64_t previous { 0 } ;
+        uti::u64_t     step { 0 } ;
+        uti::u64_t      run { 0 } ;
+
+        auto const flush_run = [ & ]
+        {
+                if( !run ) return ;
+
+                _detail::write_varint( block_, 0 ) ;
+                _detail::write_varint( block_, run - 1 ) ;
+                run = 0 ;
+        } ;
+        for( auto const & row : rows_ )
+        {
+                uti::u64_t const value = in_frame && row.kind != record_kind::frame
+                                       ? previous
+                                       : _detail::load_column( reinterpret_cast< unsigned char const * >( &row ) + _column_.offset, _column_.width ) ;
+                uti::u64_t payload ;
+
+                switch( _column_.codec )
+                {
+                        case archive_codec::bits:
+                                payload = value ^ previous ;
+                                break ;
+                        case archive_codec::delta:
+                                payload = _detail::zigzag( _detail::sign_extend( ( value - previous ) & mask, _column_.width ) ) ;
+                                break ;
+                        default:
+                        {
+                                uti::u64_t const next = ( value - previous ) & mask ;
+                                payload = _detail::zigzag( _detail::sign_extend( ( next - step ) & mask, _column_.width ) ) ;
+                                step = next ;
+                                break ;
+                        }
+                }
+                previous = value ;
+
+                if( payload == 0 )
+                {
+                        ++run ;
+                        continue ;
+                }
+                flush_run() ;
+                _detail::write_varint( block_, payload ) ;
+        }
+        flush_run() ;
+}
+
+inline bool archive_writer::_write ( void const * _data_, std::size_t _size_ ) noexcept
+{
+        auto const * at = static_cast< uti::u8_t const * >( _data_ ) ;
+
+        while( _size_ )
+        {
+                ssize_t const written = ::write( fd_, at, _size_ ) ;
+
+                if( written < 0 )
+                {
+                        if( errno == EINTR ) continue ;
+
+                        FFFB_ERR_S( "archive_writer::write", "failed writing archive : %s", std::strerror( errno ) ) ;
+                        return false ;
+                }
+                at          += written ;
+                _size_      -= static_cast< std::size_t >( written ) ;
+                stats_.bytes += static_cast< uti::u64_t >( written ) ;
+        }
+        return true ;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
+inline bool archive_reader::open ( char const * _path_ ) noexcept
+{
+        close() ;
+
+        int const fd = ::open( _path_, O_RDONLY ) ;
+
+        if( fd < 0 )
+        {
+                FFFB_ERR_S( "archive_reader::open", "failed opening '%s' : %s", _path_, std::strerror( errno ) ) ;
+                return false ;
+        }
+        struct stat info ;
+
+        if( ::fstat( fd, &info ) != 0 || static_cast< std::size_t >( info.st_size ) < sizeof( archive_header ) )
+        {
+                FFFB_ERR_S( "archive_reader::open", "'%s' is too short for an archive", _path_ ) ;
+                ::close( fd ) ;
+                return false ;
+        }
+        void * const mapping = ::mmap( nullptr, static_cast< std::size_t >( info.st_size ), PROT_READ, MAP_PRIVATE, fd, 0 ) ;
+
+        ::close( fd ) ;
+
+        if( mapping == MAP_FAILED )
+        {
+                FFFB_ERR_S( "archive_reader::open", "failed mapping '%s' : %s", _path_, std::strerror( errno ) ) ;
+                return false ;
+        }
+        data_ = static_cast< uti::u8_t const * >( mapping ) ;
+        size_ = static_cast< std::size_t >( info.st_size ) ;
+
+        archive_header const & head = header() ;
+
+        bool const valid = std::memcmp( head.magic, archive_magic, sizeof( archive_magic ) ) == 0
+                        && head.version      == FFFB_ARCHIVE_VERSION
+                        && head.column_count == archive_column_count
+                        && head.recording.record_size == FFFB_RECORDER_RECORD_SIZE ;
+
+        if( !valid )
+        {
+                FFFB_ERR_S( "archive_reader::open", "'%s' isn't an archive this build can read", _path_ ) ;
+                close() ;
+                return false ;
+        }
+        if( head.index_offset == 0 || head.index_offset + static_cast< uti::u64_t >( head.blocks ) * sizeof( archive_block_info ) > size_ )
+        {
+                FFFB_ERR_S( "archive_reader::open", "'%s' was never finished", _path_ ) ;
+                close() ;
+                return false ;
+        }
+        index_ = reinterpret_cast< archive_block_info const * >( data_ + head.index_offset ) ;
+
+        return true ;
+}
+
+inline void archive_reader::close () noexcept
+{
+        if( data_ ) ::munmap( const_cast< uti::u8_t * >( data_ ), size_ ) ;
+
+        data_  = nullptr ;
+        size_  = 0 ;
+        index_ = nullptr ;
+}
+
+inline uti::u32_t archive_reader::find ( timestamp_t _timestamp_ ) const noexcept
+{
+        uti::u32_t first { 0 } ;
+        uti::u32_t  last { blocks() } ;
+
+        while( first < last )
+        {
+                uti::u32_t const middle = first + ( last - first ) / 2 ;
+
+                if( index_[ middle ].last < _timestamp_ ) first = middle + 1 ;
+                else                                      last  = middle     ;
+        }
+        return first ;
+}
+
+inline bool archive_reader::block_header ( uti::u32_t _block_, archive_block_header & _header_ ) const noexcept
+{
+        if( _block_ >= blocks() ) return false ;
+
+        archive_block_info const & info = index_[ _block_ ] ;
+
+        if( info.offset + info.size > size_ || info.size < sizeof( archive_block_header ) )
+        {
+                FFFB_ERR_S( "archive_reader::block_header", "block %u is out of bounds", _block_ ) ;
+                return false ;
+        }
+        std::memcpy( &_header_, data_ + info.offset, sizeof( _header_ ) ) ;
+
+        std::size_t const columns = sizeof( _header_ ) + static_cast< std::size_t >( _header_.configs ) * sizeof( recorded_config ) ;
+
+        bool corrupt = _header_.rows != info.rows || _header_.size != info.size || columns > info.size
+                    || _header_.column_end[ archive_column_count - 1 ] != info.size - columns ;
+
+        // decode() slices the columns by these, so every one has to lie inside the block
+        for( uti::u32_t column = 0; column < archive_column_count && !corrupt; ++column )
+        {
+                uti::u32_t const begin = column ? _header_.column_end[ column - 1 ] : 0 ;
+
+                corrupt = _header_.column_end[ column ] < begin || _header_.column_end[ column ] > info.size - columns ;
+        }
+        if( corrupt )
+        {
+                FFFB_ERR_S( "archive_reader::block_header", "block %u is corrupt", _block_ ) ;
+                return false ;
+        }
+        return true ;
+}
+
+inline bool archive_reader::decode ( uti::u32_t _block_, uti::u64_t _columns_, recording_record * _rows_ ) const noexcept
+{
+        archive_block_header block ;
+
+        if( !block_header( _block_, block ) ) return false ;
+
+        uti::u8_t const * const configs = data_ + index_[ _block_ ].offset + sizeof( block ) ;
+        uti::u8_t const * const columns = configs + static_cast< std::size_t >( block.configs ) * sizeof( recorded_config ) ;
+        std::memset( static_cast< void * >( _rows_ ), 0, static_cast< std::size_t >( block.rows ) * sizeof( recording_record ) ) ;
+
+        _columns_ |= archive_required_columns ;
+
+        for( uti::u32_t column = 0; column < archive_column_count; ++column )
+        {
+                if( !( _columns_ & archive_column_bit( column ) ) ) continue ;
+
+                uti::u32_t const begin = column ? block.column_end[ column - 1 ] : 0 ;
+
+                if( !_decode( archive_columns[ column ], columns + begin, columns + block.column_end[ column ], _rows_, block.rows ) )
+                {
+                        FFFB_ERR_S( "archive_reader::decode", "column '%s' of block %u is corrupt", archive_columns[ column ].name, _block_ ) ;
+                        return false ;
+                }
+        }
+        // records that aren't frames carry their own payload, or none
+        uti::u32_t config { 0 } ;
+
+        for( uti::u32_t row = 0; row < block.rows; ++row )
+        {
+                recording_record & record = _rows_[ row ] ;
+
+                if( record.kind == record_kind::frame ) continue ;
+
+                std::memset( record.size, 0, sizeof( record.size ) ) ;
+
+                if( record.kind == record_kind::config && config < block.configs )
+                {
+                        std::memcpy( &record.config, configs + static_cast< std::size_t >( config++ ) * sizeof( recorded_config ), sizeof( recorded_config ) ) ;
+                }
+        }
+        return true ;
+}
+
+inline bool archive_reader::_decode ( archive_column const & _column_, uti::u8_t const * _at_, uti::u8_t const * _end_, recording_record * _rows_, uti::u32_t _count_ ) noexcept
+{
+        uti::u64_t const mask = _detail::width_mask( _column_.width ) ;
+
+        unsigned char * at = reinterpret_cast< unsigned char * >( _rows_ ) + _column_.offset ;
+
+        uti::u64_t previous { 0 } ;
+        uti::u64_t     step { 0 } ;
+        uti::u64_t      run { 0 } ;
+
+        for( uti::u32_t row = 0; row < _count_; ++row, at += sizeof( recording_record ) )
+        {
+                uti::u64_t payload { 0 } ;
+
+                if( run )
+                {
+                        --run ;
+                }
+                else
+                {
+                        if( !_detail::read_varint( _at_, _end_, payload ) ) return false ;
+
+                        if( payload == 0 && !_detail::read_varint( _at_, _end_, run ) ) return false ;
+                }
+                switch( _column_.codec )
+                {
+                        case archive_codec::bits:
+                                previous ^= payload ;
+                                break ;
+                        case archive_codec::delta:
+                                previous = ( previous + static_cast< uti::u64_t >( _detail::unzigzag( payload ) ) ) & mask ;
+                                break ;
+                        default:
+                                step     = ( step     + static_cast< uti::u64_t >( _detail::unzigzag( payload ) ) ) & mask ;
+                                previous = ( previous + step ) & mask ;
+                                break ;
+                }
+                _detail::store_column( at, _column_.width, previous ) ;
+        }
+        return _at_ == _end_ ;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
+inline bool archive_cursor::seek ( timestamp_t _timestamp_ ) noexcept
+{
+        rewind() ;
+
+        uti::u32_t const block = reader_->find( _timestamp_ ) ;
+
+        if( block >= reader_->blocks() || !_load( block ) ) return false ;
+
+        while( row_ < count_ && rows_[ row_ ].timestamp < _timestamp_ ) ++row_ ;
+
+        return row_ < count_ ;
+}
+
+inline recording_record const * archive_cursor::next () noexcept
+{
+        while( row_ == count_ )
+        {
+                if( failed_ || block_ >= reader_->blocks() || !_load( block_ ) ) return nullptr ;
+        }
+        return &rows_[ row_++ ] ;
+}
+
+inline bool archive_cursor::_load ( uti::u32_t _block_ ) noexcept
+{
+        uti::u32_t const rows = reader_->block( _block_ ).rows ;
+
+        if( static_cast< uti::u32_t >( rows_.size() ) < rows )
+        {
+                rows_ = vector< recording_record >( rows, recording_record{} ) ;
+        }
+        if( !reader_->decode( _block_, columns_, rows_.data() ) )
+        {
+                failed_ = true ;
+                return false ;
+        }
+        block_ = _block_ + 1 ;
+        row_   = 0 ;
+        count_ = rows ;
+
+        return true ;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
+inline bool is_archive ( char const * _path_ ) noexcept
+{
+        char magic [ sizeof( archive_magic ) ] {} ;
+
+        int const fd = ::open( _path_, O_RDONLY ) ;
+
+        if( fd < 0 ) return false ;
+
+        bool const archive = ::read( fd, magic, sizeof( magic ) ) == static_cast< ssize_t >( sizeof( magic ) )
+                          && std::memcmp( magic, archive_magic, sizeof( magic ) ) == 0 ;
+        ::close( fd ) ;
+
+        return archive ;
+}
+
+template< typename Fn >
+bool for_each_record ( char const * _path_, Fn && _fn_ )
+{
+        if( is_archive( _path_ ) )
+        {
+                archive_reader reader ;
+
+                if( !reader.open( _path_ ) ) return false ;
+
+                archive_cursor cursor( reader ) ;
+
+                while( recording_record const * row = cursor.next() ) _fn_( *row ) ;
+
+                return !cursor.failed() ;
+        }
+        recording_reader reader ;
+
+        if( !reader.open( _path_ ) ) return false ;
+
+        for( uti::u64_t i = 0; i < reader.records(); ++i ) _fn_( reader.record( i ) ) ;
+
+        return true ;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
+
+} // namespace fffb
@@ -0,0 +1,306 @@
+//
+//
+//      fffb
+//      telemetry/channels.hxx
+//
+
+#pragma once
+
+#include <fffb/util/types.hxx>
+#include <fffb/telemetry/state.hxx>
+#include <fffb/telemetry/timing.hxx>
+
+#include <scssdk_telemetry.h>
+#include <common/scssdk_telemetry_truck_common_channels.h>
+
+#include <cassert>
+#include <iterator>
+#include <type_traits>
+
+
+namespace fffb
+{
+
+
+////////////////////////////////////////////////////////////////////////////////
+
+// one game channel and the trampoline that stores it. every trampoline gets the
+// telemetry_state as its context, where the value lands is baked into it.
+// a channel is only registered while something reads one of its fields
+
+struct telemetry_channel
+{
+        char const *                       name ;
+        scs_u32_t                         count ; // indices 0 .. count - 1, 0 if not indexed
+        scs_value_type_t                   type ;
+        scs_u32_t                         flags ;
+        scs_telemetry_channel_callback_t  store ;
+        uti::u32_t                       fields ; // field_bit()s fed by the channel
+} ;
+
+////////////////////////////////////////////////////////////////////////////////
+
+template< scs_value_type_t Type >
+[[ nodiscard ]] constexpr auto scs_value ( scs_value_t const & _value_ ) noexcept
+{
+        if      constexpr( Type == SCS_VALUE_TYPE_float ) return _value_.value_float.value ;
+        else if constexpr( Type == SCS_VALUE_TYPE_s32   ) return _value_.  value_s32.value ;
+        else if constexpr( Type == SCS_VALUE_TYPE_u32   ) return _value_.  value_u32.value ;
+        else if constexpr( Type == SCS_VALUE_TYPE_bool  ) return _value_. value_bool.value ;
+        else static_assert( Type == SCS_VALUE_TYPE_float, "value type not supported" ) ;
+}
+
+// scalar members take the value as is, array members by channel index.
+// channels registered without a value reset the member when the game drops it
+template< auto Member, scs_value_type_t Type, scs_u32_t Flags >
+SCSAPI_VOID store_channel ( [[ maybe_unused ]] scs_string_t const name, [[ maybe_unused ]] scs_u32_t const index, scs_value_t const * const value, scs_context_t const context )
+{
+        assert( context ) ;
+        assert( !value || value->type == Type ) ;
+
+        telemetry_state & state = *static_cast< telemetry_state * >( context ) ;
+
+        ++state.callbacks ;
+
+        auto & member = state.*Member ;
+
+        using member_t = std::remove_reference_t< decltype( member ) > ;
+
+        if constexpr( std::is_array_v< member_t > )
+        {
+                if( index >= std::extent_v< member_t > ) return ;
+
+                using element_t = std::remove_extent_t< member_t > ;
+
+                if constexpr( ( Flags & SCS_TELEMETRY_CHANNEL_FLAG_no_value ) != 0 )
+                {
+                        if( !value ) { member[ index ] = element_t{} ; return ; }
+                }
+                member[ index ] = static_cast< element_t >( scs_value< Type >( *value ) ) ;
+        }
+        else
+        {
+                if constexpr( ( Flags & SCS_TELEMETRY_CHANNEL_FLAG_no_value ) != 0 )
+                {
+                        if( !value ) { member = member_t{} ; return ; }
+                }
+                member = static_cast< member_t >( scs_value< Type >( *value ) ) ;
+        }
+}
+
+// the game hands out orientation as fractions of a turn
+inline SCSAPI_VOID store_orientation ( [[ maybe_unused ]] scs_string_t const name, [[ maybe_unused ]] scs_u32_t const index, scs_value_t const * const value, scs_context_t const context )
+{
+        assert( context ) ;
+
+        telemetry_state & state = *static_cast< telemetry_state * >( context ) ;
+
+        ++state.callbacks ;
+
+        if( !value )
+        {
+                state.orientation_available = false ;
+                return ;
+        }
+        assert( value->type == SCS_VALUE_TYPE_euler ) ;
+        state.orientation_available = true ;
+        state.heading = value->value_euler.heading * 360.0f ;
+        state.  pitch = value->value_euler.  pitch * 360.0f ;
+        state.   roll = value->value_euler.   roll * 360.0f ;
+}
+
+// the scs value type follows from the member unless given, arrays register every index
+template< auto Member, scs_value_type_t Type = SCS_VALUE_TYPE_INVALID, scs_u32_t Flags = SCS_TELEMETRY_CHANNEL_FLAG_none >
+[[ nodiscard ]] constexpr telemetry_channel make_channel ( char const * _name_, uti::u32_t _fields_ ) noexcept
+{
+        using member_t  = std::remove_reference_t< decltype( std::declval< telemetry_state & >().*Member ) > ;
+        using element_t = std::remove_extent_t< member_t > ;
+
+        constexpr scs_value_type_t type = Type != SCS_VALUE_TYPE_INVALID        ? Type
+                                        : std::is_same_v< element_t, float >    ? SCS_VALUE_TYPE_float
+                                        : std::is_same_v< element_t, int   >    ? SCS_VALUE_TYPE_s32
+                                        : std::is_same_v< element_t, bool  >    ? SCS_VALUE_TYPE_bool
+                                        :                                         SCS_VALUE_TYPE_INVALID ;
+
+        static_assert( type != SCS_VALUE_TYPE_INVALID, "no scs value type for this member" ) ;
+
+        return { _name_, static_cast< scs_u32_t >( std::extent_v< member_t > ), type, Flags, &store_channel< Member, type, Flags >, _fields_ } ;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
+// the game only calls back when a value changed. fffb keeps the last value
+// in telemetry_state, so none of these need SCS_TELEMETRY_CHANNEL_FLAG_each_frame
+constexpr telemetry_channel telemetry_channels []
+{
+        { SCS_TELEMETRY_TRUCK_CHANNEL_world_placement, 0, SCS_VALUE_TYPE_euler, SCS_TELEMETRY_CHANNEL_FLAG_no_value, &store_orientation,
+          field_bit( telemetry_field::heading ) | field_bit( telemetry_field::pitch ) | field_bit( telemetry_field::roll ) },
+
+        make_channel< &telemetry_state::speed >( SCS_TELEMETRY_TRUCK_CHANNEL_speed      , field_bit( telemetry_field::speed ) ),
+        make_channel< &telemetry_state::  rpm >( SCS_TELEMETRY_TRUCK_CHANNEL_engine_rpm , field_bit( telemetry_field::  rpm ) | field_bit( telemetry_field::rpm_ratio ) ),
+        make_channel< &telemetry_state:: gear >( SCS_TELEMETRY_TRUCK_CHANNEL_engine_gear, field_bit( telemetry_field:: gear ) ),
+
+        make_channel< &telemetry_state::steering >( SCS_TELEMETRY_TRUCK_CHANNEL_effective_steering, field_bit( telemetry_field::steering ) ),
+        make_channel< &telemetry_state::throttle >( SCS_TELEMETRY_TRUCK_CHANNEL_effective_throttle, field_bit( telemetry_field::throttle ) ),
+        make_channel< &telemetry_state::   brake >( SCS_TELEMETRY_TRUCK_CHANNEL_effective_brake   , field_bit( telemetry_field::   brake ) ),
+        make_channel< &telemetry_state::  clutch >( SCS_TELEMETRY_TRUCK_CHANNEL_effective_clutch  , field_bit( telemetry_field::  clutch ) ),
+
+        // no effect reads substances yet, this one waits for the first that does
+        make_channel< &telemetry_state::substance, SCS_VALUE_TYPE_u32, SCS_TELEMETRY_CHANNEL_FLAG_no_value >( SCS_TELEMETRY_TRUCK_CHANNEL_wheel_substance, 0 ),
+} ;
+
+constexpr uti::u32_t telemetry_channel_count { static_cast< uti::u32_t >( std::size( telemetry_channels ) ) } ;
+
+////////////////////////////////////////////////////////////////////////////////
+
+// the context of a timed registration, the store runs with the state as before
+struct channel_binding
+{
+        scs_telemetry_channel_callback_t  store { nullptr } ;
+        telemetry_state *                 state { nullptr } ;
+        callback_timing *                timing { nullptr } ;
+} ;
+
+inline SCSAPI_VOID timed_store ( scs_string_t const name, scs_u32_t const index, scs_value_t const * const value, scs_context_t const context )
+{
+        assert( context ) ;
+
+        channel_binding const & binding = *static_cast< channel_binding const * >( context ) ;
+
+        uti::u64_t const start_ns = monotonic_ns() ;
+
+        binding.store( name, index, value, binding.state ) ;
+
+        binding.timing->record( timed_callback::channel, start_ns, monotonic_ns() ) ;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
+struct channel_stats
+{
+        uti::u64_t        frames { 0 } ;
+        uti::u64_t     callbacks { 0 } ;
+        uti::u32_t max_per_frame { 0 } ;
+        uti::u32_t          last { 0 } ;
+
+        [[ nodiscard ]] constexpr float per_frame () const noexcept
+        { return frames ? static_cast< float >( callbacks ) / static_cast< float >( frames ) : 0.0f ; }
+} ;
+
+// keeps the registered channels down to the ones feeding the fields asked for.
+// registration changes are only allowed from init and event callbacks, so
+// that's where update() has to be called from. with _timing_ every store
+// goes through timed_store
+
+class channel_subscription
+{
+public:
+        constexpr void bind ( scs_telemetry_register_for_channel_t _register_, scs_telemetry_unregister_from_channel_t _unregister_, telemetry_state & _state_,
+                              callback_timing * _timing_ = nullptr ) noexcept
+        {
+                register_ = _register_ ; unregister_ = _unregister_ ; state_ = &_state_ ;
+
+                for( uti::u32_t row = 0; row < telemetry_channel_count; ++row )
+                {
+                        bindings_[ row ] = { telemetry_channels[ row ].store, state_, _timing_ } ;
+                }
+                timed_ = _timing_ != nullptr ;
+        }
+
+        // registers every channel feeding one of _fields_ and drops the others.
+        // indexed channels get _wheels_ indices, all of them while that's 0.
+        // returns the number of registrations the game refused
+        [[ nodiscard ]] uti::u32_t update ( uti::u32_t _fields_, uti::u8_t _wheels_ ) noexcept ;
+
+        // once per frame at frame end, the state's count is reset at frame start
+        constexpr void count_frame ( telemetry_state const & _state_ ) noexcept
+        {
+                stats_.last       = _state_.callbacks ;
+                stats_.callbacks += _state_.callbacks ;
+                stats_.frames    += 1 ;
+
+                if( _state_.callbacks > stats_.max_per_frame ) stats_.max_per_frame = _state_.callbacks ;
+        }
+
+        [[ nodiscard ]] constexpr uti::u32_t fields () const noexcept { return fields_ ; }
+
+        // channel callbacks registered right now, indices counted separately
+        [[ nodiscard ]] constexpr uti::u32_t registered () const noexcept
+        {
+                uti::u32_t total { 0 } ;
+                for( auto const count : registered_ ) total += count ;
+                return total ;
+        }
+
+        [[ nodiscard ]] constexpr channel_stats const & stats () const noexcept { return stats_ ; }
+private:
+        scs_telemetry_register_for_channel_t      register_ { nullptr } ;
+        scs_telemetry_unregister_from_channel_t unregister_ { nullptr } ;
+        telemetry_state *                            state_ { nullptr } ;
+
+        channel_binding bindings_ [ telemetry_channel_count ] {} ;
+        bool            timed_ { false } ;
+
+        // indices registered per table row, 0 or 1 for plain channels
+        scs_u32_t registered_ [ telemetry_channel_count ] {} ;
+
+        uti::u32_t fields_ { 0 } ;
+
+        channel_stats stats_ {} ;
+} ;
+
+////////////////////////////////////////////////////////////////////////////////
+////////////////////////////////////////////////////////////////////////////////
+
+inline uti::u32_t channel_subscription::update ( uti::u32_t _fields_, uti::u8_t _wheels_ ) noexcept
+{
+        if( !register_ || !unregister_ || !state_ ) return 0 ;
+
+        uti::u32_t failed { 0 } ;
+
+        for( uti::u32_t row = 0; row < telemetry_channel_count; ++row )
+        {
+                telemetry_channel const & channel = telemetry_channels[ row ] ;
+
+                scs_u32_t const wanted = !( channel.fields & _fields_ )         ? 0
+                                       : !channel.count                         ? 1
+                                       : _wheels_ && _wheels_ < channel.count   ? _wheels_
+                                       :                                          channel.count ;
+
+                scs_u32_t & count = registered_[ row ] ;
+
+                auto const index = [ & ]( scs_u32_t _i_ ) { return channel.count ? _i_ : SCS_U32_NIL ; } ;
+
+                while( count > wanted )
+                {
+                        --count ;
+
+                        if( unregister_( channel.name, index( count ), channel.type ) != SCS_RESULT_ok )
+                        {
+                                FFFB_F_WARN_S( "telemetry::channel_subscription", "failed unregistering '%s' [%u]", channel.name, count ) ;
+                        }
+                }
+                while( count < wanted )
+                {
+                        bool const ok = timed_ ? register_( channel.name, index( count ), channel.type, channel.flags, &timed_store  , &bindings_[ row ] ) == SCS_RESULT_ok
+                                               : register_( channel.name, index( count ), channel.type, channel.flags, channel.store, state_            ) == SCS_RESULT_ok ;
+                        if( !ok )
+                        {
+                                FFFB_F_WARN_S( "telemetry::channel_subscription", "failed registering '%s' [%u]", channel.name, count ) ;
+                                ++failed ;
+                                break ;
+                        }
+                        ++count ;
+                }
+        }
+        fields_ = _fields_ ;
+
+        FFFB_F_INFO_S( "telemetry::channel_subscription", "fields %x, %u channel callbacks registered", fields_, registered() ) ;
+
+        return failed ;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
+
+} // namespace fffb
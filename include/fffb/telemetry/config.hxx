@@ -0,0 +1,291 @@
+//
+//
+//      fffb
+//      telemetry/config.hxx
+//
+
+#pragma once
+
+#include <fffb/util/types.hxx>
+#include <fffb/telemetry/state.hxx>
+
+#include <scssdk_telemetry.h>
+#include <common/scssdk_telemetry_common_configs.h>
+
+#include <cstring>
+
+#define FFFB_TELEMETRY_MAX_SUBSTANCES      32
+#define FFFB_TELEMETRY_SUBSTANCE_NAME_SIZE 24
+
+// what the constants fall back to before the game described the truck
+#define FFFB_TRUCK_DEFAULT_RPM_LIMIT 2500.0f
+
+
+namespace fffb
+{
+
+
+////////////////////////////////////////////////////////////////////////////////
+
+// the configuration attributes fffb cares about, as the game sent them.
+// zeroed before every parse so two parses of the same event compare equal
+
+struct truck_config
+{
+        float       rpm_limit { 0 } ;
+        uti::u32_t  forward_gears { 0 } ;
+        uti::u32_t  reverse_gears { 0 } ;
+        uti::u32_t    wheel_count { 0 } ;
+
+        bool  wheel_steerable [ FFFB_TELEMETRY_MAX_WHEELS ] {} ;
+        bool  wheel_powered   [ FFFB_TELEMETRY_MAX_WHEELS ] {} ;
+        float wheel_radius    [ FFFB_TELEMETRY_MAX_WHEELS ] {} ;
+} ;
+
+struct trailer_config
+{
+        uti::u32_t wheel_count { 0 } ;
+} ;
+
+struct substance_config
+{
+        uti::u32_t count { 0 } ;
+        char       names [ FFFB_TELEMETRY_MAX_SUBSTANCES ][ FFFB_TELEMETRY_SUBSTANCE_NAME_SIZE ] {} ;
+} ;
+
+////////////////////////////////////////////////////////////////////////////////
+
+// everything per frame math needs from the configuration, rebuilt only when an
+// event actually changed something. the hot path multiplies, never divides
+
+struct truck_constants
+{
+        uti::u32_t version { 0 } ; // bumped on every rebuild
+        bool     from_game { false } ;
+
+        float     rpm_limit { FFFB_TRUCK_DEFAULT_RPM_LIMIT } ;
+        float inv_rpm_limit { 1.0f / FFFB_TRUCK_DEFAULT_RPM_LIMIT } ;
+
+        uti::u8_t forward_gears { 0 } ;
+        uti::u8_t reverse_gears { 0 } ;
+
+        // 0 while unknown
+        uti::u8_t         wheel_count { 0 } ;
+        uti::u8_t trailer_wheel_count { 0 } ;
+
+        // wheel indices by role, in the game's order
+        uti::u8_t steered_count { 0 } ;
+        uti::u8_t powered_count { 0 } ;
+        uti::u8_t steered [ FFFB_TELEMETRY_MAX_WHEELS ] {} ;
+        uti::u8_t powered [ FFFB_TELEMETRY_MAX_WHEELS ] {} ;
+
+        // radians per meter rolled on the powered wheels, 0 while unknown
+        float powered_rad_per_m { 0 } ;
+
+        substance_config substances {} ;
+
+        [[ nodiscard ]] constexpr float rpm_ratio ( float _rpm_ ) const noexcept { return _rpm_ * inv_rpm_limit ; }
+
+        // name of the substance a wheel channel reported, "" if it's out of range
+        [[ nodiscard ]] constexpr char const * substance_name ( int _substance_ ) const noexcept
+        {
+                return _substance_ >= 0 && static_cast< uti::u32_t >( _substance_ ) < substances.count ? substances.names[ _substance_ ] : "" ;
+        }
+} ;
+
+[[ nodiscard ]] constexpr truck_constants build_truck_constants ( truck_config const & _truck_, trailer_config const & _trailer_, substance_config const & _substances_, uti::u32_t _version_ ) noexcept ;
+
+////////////////////////////////////////////////////////////////////////////////
+
+// parses configuration events as they come and keeps the constants in sync.
+// lives on the game thread, like the events
+
+class telemetry_config
+{
+public:
+        // true if the constants were rebuilt
+        bool ingest ( scs_telemetry_configuration_t const & _config_ ) noexcept ;
+
+        [[ nodiscard ]] constexpr truck_constants const & constants () const noexcept { return constants_ ; }
+private:
+        truck_config         truck_ {} ;
+        trailer_config     trailer_ {} ;
+        substance_config substances_ {} ;
+
+        truck_constants constants_ {} ;
+
+        template< typename Config >
+        bool _update ( Config & _current_, Config const & _parsed_ ) noexcept ;
+} ;
+
+////////////////////////////////////////////////////////////////////////////////
+////////////////////////////////////////////////////////////////////////////////
+
+namespace detail
+{
+
+
+[[ nodiscard ]] inline bool _attribute_is ( scs_named_value_t const & _attr_, char const * _name_, scs_value_type_t _type_ ) noexcept
+{
+        return _attr_.value.type == _type_ && std::strcmp( _attr_.name, _name_ ) == 0 ;
+}
+
+// indexed attributes outside of what fffb keeps are dropped
+[[ nodiscard ]] inline bool _wheel_index ( scs_named_value_t const & _attr_ ) noexcept
+{
+        return _attr_.index != SCS_U32_NIL && _attr_.index < FFFB_TELEMETRY_MAX_WHEELS ;
+}
+
+inline void _parse_truck ( scs_named_value_t const * _attrs_, truck_config & _out_ ) noexcept
+{
+        _out_ = {} ;
+
+        for( scs_named_value_t const * attr = _attrs_; attr->name; ++attr )
+        {
+                if( _attribute_is( *attr, SCS_TELEMETRY_CONFIG_ATTRIBUTE_rpm_limit, SCS_VALUE_TYPE_float ) )
+                {
+                        _out_.rpm_limit = attr->value.value_float.value ;
+                }
+                else if( _attribute_is( *attr, SCS_TELEMETRY_CONFIG_ATTRIBUTE_forward_gear_count, SCS_VALUE_TYPE_u32 ) )
+                {
+                        _out_.forward_gears = attr->value.value_u32.value ;
+                }
+                else if( _attribute_is( *attr, SCS_TELEMETRY_CONFIG_ATTRIBUTE_reverse_gear_count, SCS_VALUE_TYPE_u32 ) )
+                {
+                        _out_.reverse_gears = attr->value.value_u32.value ;
+                }
+                else if( _attribute_is( *attr, SCS_TELEMETRY_CONFIG_ATTRIBUTE_wheel_count, SCS_VALUE_TYPE_u32 ) )
+                {
+                        _out_.wheel_count = attr->value.value_u32.value ;
+                }
+                else if( _attribute_is( *attr, SCS_TELEMETRY_CONFIG_ATTRIBUTE_wheel_steerable, SCS_VALUE_TYPE_bool ) && _wheel_index( *attr ) )
+                {
+                        _out_.wheel_steerable[ attr->index ] = attr->value.value_bool.value != 0 ;
+                }
+                else if( _attribute_is( *attr, SCS_TELEMETRY_CONFIG_ATTRIBUTE_wheel_powered, SCS_VALUE_TYPE_bool ) && _wheel_index( *attr ) )
+                {
+                        _out_.wheel_powered[ attr->index ] = attr->value.value_bool.value != 0 ;
+                }
+                else if( _attribute_is( *attr, SCS_TELEMETRY_CONFIG_ATTRIBUTE_wheel_radius, SCS_VALUE_TYPE_float ) && _wheel_index( *attr ) )
+                {
+                        _out_.wheel_radius[ attr->index ] = attr->value.value_float.value ;
+                }
+        }
+}
+
+inline void _parse_trailer ( scs_named_value_t const * _attrs_, trailer_config & _out_ ) noexcept
+{
+        _out_ = {} ;
+
+        for( scs_named_value_t const * attr = _attrs_; attr->name; ++attr )
+        {
+                if( _attribute_is( *attr, SCS_TELEMETRY_CONFIG_ATTRIBUTE_wheel_count, SCS_VALUE_TYPE_u32 ) )
+                {
+                        _out_.wheel_count = attr->value.value_u32.value ;
+                }
+        }
+}
+
+inline void _parse_substances ( scs_named_value_t const * _attrs_, substance_config & _out_ ) noexcept
+{
+        _out_ = {} ;
+
+        for( scs_named_value_t const * attr = _attrs_; attr->name; ++attr )
+        {
+                if( !_attribute_is( *attr, SCS_TELEMETRY_CONFIG_ATTRIBUTE_id, SCS_VALUE_TYPE_string ) ) continue ;
+                if( attr->index == SCS_U32_NIL || attr->index >= FFFB_TELEMETRY_MAX_SUBSTANCES          ) continue ;
+
+                std::strncpy( _out_.names[ attr->index ], attr->value.value_string.value, FFFB_TELEMETRY_SUBSTANCE_NAME_SIZE - 1 ) ;
+
+                if( attr->index >= _out_.count ) _out_.count = attr->index + 1 ;
+        }
+}
+
+
+} // namespace detail
+
+////////////////////////////////////////////////////////////////////////////////
+
+constexpr truck_constants build_truck_constants ( truck_config const & _truck_, trailer_config const & _trailer_, substance_config const & _substances_, uti::u32_t _version_ ) noexcept
+{
+        truck_constants constants {} ;
+
+        constants.version   = _version_ ;
+        constants.from_game = _truck_.wheel_count != 0 || _truck_.rpm_limit > 0.0f ;
+
+        if( _truck_.rpm_limit > 0.0f )
+        {
+                constants.    rpm_limit = _truck_.rpm_limit ;
+                constants.inv_rpm_limit = 1.0f / _truck_.rpm_limit ;
+        }
+        constants.forward_gears = static_cast< uti::u8_t >( _truck_.forward_gears < 0xFF ? _truck_.forward_gears : 0xFF ) ;
+        constants.reverse_gears = static_cast< uti::u8_t >( _truck_.reverse_gears < 0xFF ? _truck_.reverse_gears : 0xFF ) ;
+
+        constants.        wheel_count = static_cast< uti::u8_t >( _truck_  .wheel_count < FFFB_TELEMETRY_MAX_WHEELS ? _truck_  .wheel_count : FFFB_TELEMETRY_MAX_WHEELS ) ;
+        constants.trailer_wheel_count = static_cast< uti::u8_t >( _trailer_.wheel_count < 0xFF                      ? _trailer_.wheel_count : 0xFF                      ) ;
+
+        float radius_sum { 0 } ;
+
+        for( uti::u8_t wheel = 0; wheel < constants.wheel_count; ++wheel )
+        {
+                if( _truck_.wheel_steerable[ wheel ] ) constants.steered[ constants.steered_count++ ] = wheel ;
+
+                if( _truck_.wheel_powered[ wheel ] )
+                {
+                        constants.powered[ constants.powered_count++ ] = wheel ;
+                        radius_sum += _truck_.wheel_radius[ wheel ] ;
+                }
+        }
+        if( radius_sum > 0.0f ) constants.powered_rad_per_m = static_cast< float >( constants.powered_count ) / radius_sum ;
+
+        constants.substances = _substances_ ;
+
+        return constants ;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
+inline bool telemetry_config::ingest ( scs_telemetry_configuration_t const & _config_ ) noexcept
+{
+        if( std::strcmp( _config_.id, SCS_TELEMETRY_CONFIG_truck ) == 0 )
+        {
+                truck_config parsed {} ;
+                detail::_parse_truck( _config_.attributes, parsed ) ;
+                return _update( truck_, parsed ) ;
+        }
+        // only the first trailer, the rest don't get anywhere near the steering
+        if( std::strcmp( _config_.id, SCS_TELEMETRY_CONFIG_trailer ) == 0 || std::strcmp( _config_.id, SCS_TELEMETRY_CONFIG_trailer ".0" ) == 0 )
+        {
+                trailer_config parsed {} ;
+                detail::_parse_trailer( _config_.attributes, parsed ) ;
+                return _update( trailer_, parsed ) ;
+        }
+        if( std::strcmp( _config_.id, SCS_TELEMETRY_CONFIG_substances ) == 0 )
+        {
+                substance_config parsed {} ;
+                detail::_parse_substances( _config_.attributes, parsed ) ;
+                return _update( substances_, parsed ) ;
+        }
+        return false ;
+}
+
+template< typename Config >
+bool telemetry_config::_update ( Config & _current_, Config const & _parsed_ ) noexcept
+{
+        // the game repeats configurations it didn't change, those cost nothing
+        if( std::memcmp( &_current_, &_parsed_, sizeof( Config ) ) == 0 ) return false ;
+
+        _current_  = _parsed_ ;
+        constants_ = build_truck_constants( truck_, trailer_, substances_, constants_.version + 1 ) ;
+
+        FFFB_F_INFO_S( "telemetry_config::ingest", "truck constants v%u : rpm limit=%.0f gears=%u/%u wheels=%u (steered=%u powered=%u) trailer wheels=%u substances=%u",
+                       constants_.version, constants_.rpm_limit, constants_.forward_gears, constants_.reverse_gears,
+                       constants_.wheel_count, constants_.steered_count, constants_.powered_count,
+                       constants_.trailer_wheel_count, constants_.substances.count ) ;
+        return true ;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
+
+} // namespace fffb
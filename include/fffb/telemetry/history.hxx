@@ -0,0 +1,185 @@
+//
+//
+//      fffb
+//      telemetry/history.hxx
+//
+
+#pragma once
+
+#include <fffb/util/types.hxx>
+#include <fffb/telemetry/state.hxx>
+
+#include <atomic>
+#include <cstring>
+
+#define FFFB_HISTORY_CAPACITY 256
+
+
+namespace fffb
+{
+
+
+////////////////////////////////////////////////////////////////////////////////
+
+// the last FFFB_HISTORY_CAPACITY telemetry frames, one column per field so a
+// window over one signal is a contiguous (wrapped) run of floats. int fields
+// are stored as floats. each column carries running prefix sums, which makes
+// averages over any window O(1) like the derivatives.
+//
+// one writer, once per frame. readers on the writer's thread see every push.
+// readers elsewhere load the count with acquire, and only the newest part of
+// the window is safe from being overwritten mid read, stay well below capacity
+
+class telemetry_history
+{
+public:
+        static constexpr uti::u32_t capacity { FFFB_HISTORY_CAPACITY } ;
+
+        static_assert( ( capacity & ( capacity - 1 ) ) == 0, "history capacity has to be a power of two" ) ;
+
+        void push ( telemetry_state const & _state_ ) noexcept ;
+
+        void clear () noexcept { count_.store( 0, std::memory_order_release ) ; }
+
+        // frames held, at most capacity
+        [[ nodiscard ]] uti::u32_t size () const noexcept
+        {
+                uti::u64_t const count = count_.load( std::memory_order_acquire ) ;
+                return count < capacity ? static_cast< uti::u32_t >( count ) : capacity ;
+        }
+
+        // age 0 is the newest frame, has to be below size()
+        [[ nodiscard ]] timestamp_t timestamp ( uti::u32_t _age_ ) const noexcept { return timestamps_[ _slot( _age_ ) ] ; }
+
+        [[ nodiscard ]] float value ( telemetry_field _field_, uti::u32_t _age_ ) const noexcept
+        { return columns_[ static_cast< uti::u8_t >( _field_ ) ][ _slot( _age_ ) ] ; }
+
+        // raw ring storage, index with ( count - 1 - age ) & ( capacity - 1 )
+        [[ nodiscard ]] float       const * column     ( telemetry_field _field_ ) const noexcept { return columns_[ static_cast< uti::u8_t >( _field_ ) ] ; }
+        [[ nodiscard ]] timestamp_t const * timestamps (                         ) const noexcept { return timestamps_ ; }
+
+        // change per second between the newest frame and the one _window_ frames back
+        [[ nodiscard ]] float derivative ( telemetry_field _field_, uti::u32_t _window_ ) const noexcept ;
+
+        // change of that rate per second, from frames 0, _window_ and 2 * _window_ back
+        [[ nodiscard ]] float second_derivative ( telemetry_field _field_, uti::u32_t _window_ ) const noexcept ;
+
+        // mean over the newest _window_ frames, at most capacity - 1
+        [[ nodiscard ]] float average ( telemetry_field _field_, uti::u32_t _window_ ) const noexcept ;
+private:
+        static constexpr uti::u32_t  mask { capacity - 1 } ;
+        static constexpr uti::u8_t fields { static_cast< uti::u8_t >( telemetry_field::count ) } ;
+
+        timestamp_t timestamps_ [ capacity ] {} ;
+
+        float columns_ [ fields ][ capacity ] {} ;
+
+        // sum of every value pushed up to and including the slot's, double so a long
+        // session doesn't eat the precision of a short window
+        double sums_ [ fields ][ capacity ] {} ;
+        double totals_ [ fields ] {} ;
+
+        std::atomic< uti::u64_t > count_ { 0 } ;
+
+        [[ nodiscard ]] uti::u32_t _slot ( uti::u32_t _age_ ) const noexcept
+        { return static_cast< uti::u32_t >( count_.load( std::memory_order_acquire ) - 1 - _age_ ) & mask ; }
+
+        // seconds between two frames, 0 if the clock didn't move forward
+        [[ nodiscard ]] float _span_s ( uti::u32_t _newer_, uti::u32_t _older_ ) const noexcept ;
+} ;
+
+////////////////////////////////////////////////////////////////////////////////
+////////////////////////////////////////////////////////////////////////////////
+
+inline void telemetry_history::push ( telemetry_state const & _state_ ) noexcept
+{
+        uti::u64_t const count = count_.load( std::memory_order_relaxed ) ;
+        uti::u32_t const  slot = static_cast< uti::u32_t >( count ) & mask ;
+
+        if( count == 0 ) for( auto & total : totals_ ) total = 0.0 ;
+
+        timestamps_[ slot ] = _state_.timestamp ;
+
+        unsigned char const * base = reinterpret_cast< unsigned char const * >( &_state_ ) ;
+
+        for( uti::u8_t field = 0; field < fields; ++field )
+        {
+                telemetry_field_info const & info = telemetry_fields[ field ] ;
+
+                float value ;
+
+                if( info.is_int )
+                {
+                        int i ;
+                        std::memcpy( &i, base + info.offset, sizeof( int ) ) ;
+                        value = static_cast< float >( i ) ;
+                }
+                else
+                {
+                        std::memcpy( &value, base + info.offset, sizeof( float ) ) ;
+                }
+                columns_[ field ][ slot ] = value ;
+
+                totals_[ field ] += value ;
+                sums_  [ field ][ slot ] = totals_[ field ] ;
+        }
+        count_.store( count + 1, std::memory_order_release ) ;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
+inline float telemetry_history::derivative ( telemetry_field _field_, uti::u32_t _window_ ) const noexcept
+{
+        if( _window_ == 0 || _window_ >= size() ) return 0.0f ;
+
+        float const span = _span_s( 0, _window_ ) ;
+
+        return span > 0.0f ? ( value( _field_, 0 ) - value( _field_, _window_ ) ) / span : 0.0f ;
+}
+
+inline float telemetry_history::second_derivative ( telemetry_field _field_, uti::u32_t _window_ ) const noexcept
+{
+        if( _window_ == 0 || 2 * _window_ >= size() ) return 0.0f ;
+
+        float const newer = _span_s(       0,     _window_ ) ;
+        float const older = _span_s( _window_, 2 * _window_ ) ;
+
+        if( newer <= 0.0f || older <= 0.0f ) return 0.0f ;
+
+        float const rate_newer = ( value( _field_,        0 ) - value( _field_,     _window_ ) ) / newer ;
+        float const rate_older = ( value( _field_, _window_ ) - value( _field_, 2 * _window_ ) ) / older ;
+
+        // the rates sit at the middle of their spans
+        return ( rate_newer - rate_older ) / ( 0.5f * ( newer + older ) ) ;
+}
+
+inline float telemetry_history::average ( telemetry_field _field_, uti::u32_t _window_ ) const noexcept
+{
+        uti::u32_t const held = size() ;
+
+        // the slot just past a full window has already been overwritten
+        if( _window_ >= capacity ) _window_ = capacity - 1 ;
+        if( _window_ >  held     ) _window_ = held ;
+        if( _window_ == 0        ) return 0.0f ;
+
+        uti::u8_t const field = static_cast< uti::u8_t >( _field_ ) ;
+
+        // the sum before the window is one slot further back, or nothing if the window reaches the first frame
+        double const newest = sums_[ field ][ _slot( 0 ) ] ;
+        double const before = _window_ < count_.load( std::memory_order_acquire ) ? sums_[ field ][ _slot( _window_ ) ] : 0.0 ;
+
+        return static_cast< float >( ( newest - before ) / _window_ ) ;
+}
+
+inline float telemetry_history::_span_s ( uti::u32_t _newer_, uti::u32_t _older_ ) const noexcept
+{
+        timestamp_t const newer = timestamp( _newer_ ) ;
+        timestamp_t const older = timestamp( _older_ ) ;
+
+        return newer > older ? static_cast< float >( newer - older ) * 1e-6f : 0.0f ;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
+
+} // namespace fffb
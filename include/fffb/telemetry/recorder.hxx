@@ -0,0 +1,582 @@
+//
+//
+//      fffb
+//      telemetry/recorder.hxx
+//
+
+#pragma once
+
+#include <fffb/util/types.hxx>
+#include <fffb/util/clock.hxx>
+#include <fffb/util/fixed.hxx>
+#include <fffb/telemetry/state.hxx>
+#include <fffb/telemetry/config.hxx>
+#include <fffb/force/effect_graph.hxx>
+
+#include <atomic>
+#include <thread>
+#include <chrono>
+#include <cerrno>
+#include <cstring>
+
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#define FFFB_RECORDER_VERSION      1
+#define FFFB_RECORDER_RECORD_SIZE  256
+#define FFFB_RECORDER_SEGMENT_SIZE ( 4u << 20 )
+#define FFFB_RECORDER_POLL_MS      10
+
+
+namespace fffb
+{
+
+
+////////////////////////////////////////////////////////////////////////////////
+
+// a recording is a header followed by fixed size records, every record one
+// FFFB_RECORDER_RECORD_SIZE slot. the header takes the first slot. slots past
+// the last record are zero, so a recording cut short by a crash still reads
+// fine up to the first empty record. all values are native endian
+
+enum class record_kind : uti::u8_t
+{
+        empty   ,
+        frame   ,
+        paused  ,
+        resumed ,
+        config  ,
+} ;
+
+struct recorded_frame
+{
+        uti::u32_t    fields ; // field_bit()s fed by a registered channel, the other values are stale
+        uti::u32_t callbacks ;
+
+        float     values    [ static_cast< uti::u8_t >( telemetry_field::count ) ] ; // int fields converted
+        uti::u8_t substance [ FFFB_TELEMETRY_MAX_WHEELS ] ;
+
+        uti::u32_t written ; // effect sinks written this frame
+        uti::i32_t outputs [ static_cast< uti::u8_t >( effect_sink::count ) ] ; // raw q16
+        uti::i32_t  torque ; // raw q16, the filtered torque target
+} ;
+
+struct recorded_config
+{
+        uti::u32_t version ;
+        float    rpm_limit ;
+
+        uti::u8_t       forward_gears ;
+        uti::u8_t       reverse_gears ;
+        uti::u8_t         wheel_count ;
+        uti::u8_t trailer_wheel_count ;
+        uti::u8_t       steered_count ;
+        uti::u8_t       powered_count ;
+        uti::u8_t     substance_count ;
+} ;
+
+struct recording_record
+{
+        record_kind     kind ;
+        uti::u8_t   reserved [ 3 ] ;
+        uti::u32_t  sequence ;
+        timestamp_t timestamp ; // game time
+        timestamp_t host_timestamp ;
+
+        union
+        {
+                recorded_frame   frame ;
+                recorded_config config ;
+                uti::u8_t          size [ FFFB_RECORDER_RECORD_SIZE - 24 ] ;
+        } ;
+} ;
+
+struct recording_header
+{
+        char        magic [ 8 ] ; // "FFFBREC" and a zero
+        uti::u32_t  version ;
+        uti::u32_t  record_size ;
+        uti::u32_t  segment_size ;
+        uti::u32_t  field_count ;
+        uti::u32_t  sink_count ;
+        uti::u32_t  max_wheels ;
+        timestamp_t started_us ; // host time
+        uti::u64_t  records ;    // written on stop, 0 if the recording was cut short
+        uti::u8_t   size [ FFFB_RECORDER_RECORD_SIZE - 48 ] ;
+} ;
+
+static_assert( sizeof( recording_record ) == FFFB_RECORDER_RECORD_SIZE, "record doesn't fit its slot" ) ;
+static_assert( sizeof( recording_header ) == FFFB_RECORDER_RECORD_SIZE, "header doesn't fit its slot" ) ;
+static_assert( FFFB_RECORDER_SEGMENT_SIZE % FFFB_RECORDER_RECORD_SIZE == 0, "segments have to hold whole records" ) ;
+
+constexpr char recording_magic [ 8 ] { 'F', 'F', 'F', 'B', 'R', 'E', 'C', '\0' } ;
+
+////////////////////////////////////////////////////////////////////////////////
+
+struct recorder_stats
+{
+        uti::u64_t  records { 0 } ;
+        uti::u64_t  dropped { 0 } ; // no segment was ready when one filled up
+        uti::u32_t segments { 0 } ;
+} ;
+
+// appends records to a memory mapped file. the file grows a segment at a
+// time, the background thread extends and maps the next segment before the
+// current one fills up and unmaps the ones left behind. recording itself
+// only copies into the mapping, it never blocks, allocates or makes a call.
+// one writer, the game thread
+
+class telemetry_recorder
+{
+public:
+        static constexpr uti::u32_t per_segment { FFFB_RECORDER_SEGMENT_SIZE / FFFB_RECORDER_RECORD_SIZE } ;
+
+         telemetry_recorder () noexcept = default ;
+        ~telemetry_recorder () noexcept { stop() ; }
+
+        telemetry_recorder ( telemetry_recorder const & ) = delete ;
+        telemetry_recorder & operator= ( telemetry_recorder const & ) = delete ;
+
+        bool start ( char const * _path_ ) noexcept ;
+        void stop  (                     ) noexcept ;
+
+        [[ nodiscard ]] bool recording () const noexcept { return recording_.load( std::memory_order_acquire ) ; }
+
+        void record_frame  ( telemetry_state const & _state_, uti::u32_t _fields_, effect_outputs const & _outputs_, q16 _torque_ ) noexcept ;
+        void record_pause  ( telemetry_state const & _state_, bool _paused_ ) noexcept ;
+        void record_config ( telemetry_state const & _state_, truck_constants const & _constants_ ) noexcept ;
+
+        [[ nodiscard ]] recorder_stats stats () const noexcept
+        {
+                return { records_.load( std::memory_order_relaxed ), dropped_.load( std::memory_order_relaxed ), segments_.load( std::memory_order_relaxed ) } ;
+        }
+private:
+        int fd_ { -1 } ;
+
+        recording_header header_ {} ;
+
+        // writer side
+        recording_record * current_ { nullptr } ;
+        uti::u32_t          cursor_ { 0 } ;
+        uti::u32_t        sequence_ { 0 } ;
+
+        // handed between the writer and the thread
+        std::atomic< recording_record * >   ready_ { nullptr } ;
+        std::atomic< recording_record * > retired_ { nullptr } ;
+
+        std::atomic< uti::u64_t >  records_ { 0 } ;
+        std::atomic< uti::u64_t >  dropped_ { 0 } ;
+        std::atomic< uti::u32_t > segments_ { 0 } ; // mapped so far, the file is this long
+
+        std::thread         thread_ ;
+        std::atomic< bool > running_ { false } ;
+        std::atomic< bool > recording_ { false } ;
+
+        [[ nodiscard ]] recording_record * _claim ( telemetry_state const & _state_ ) noexcept ;
+
+        [[ nodiscard ]] recording_record * _map_segment () noexcept ;
+
+        static void _unmap ( recording_record * _segment_ ) noexcept ;
+
+        void _run () noexcept ;
+} ;
+
+////////////////////////////////////////////////////////////////////////////////
+
+// the read side, maps a whole recording. a recording cut short has no record
+// count in its header, it ends at the first empty slot instead
+
+class recording_reader
+{
+public:
+         recording_reader () noexcept = default ;
+        ~recording_reader () noexcept { close() ; }
+
+        recording_reader ( recording_reader const & ) = delete ;
+        recording_reader & operator= ( recording_reader const & ) = delete ;
+
+        bool open  ( char const * _path_ ) noexcept ;
+        void close (                     ) noexcept ;
+
+        [[ nodiscard ]] bool is_open () const noexcept { return mapping_ != nullptr ; }
+
+        // valid while open
+        [[ nodiscard ]] recording_header const & header () const noexcept { return *static_cast< recording_header const * >( mapping_ ) ; }
+
+        [[ nodiscard ]] uti::u64_t records () const noexcept { return records_ ; }
+
+        [[ nodiscard ]] recording_record const & record ( uti::u64_t _index_ ) const noexcept
+        { return static_cast< recording_record const * >( mapping_ )[ _index_ + 1 ] ; }
+private:
+        void const * mapping_ { nullptr } ;
+        size_t          size_ { 0 } ;
+        uti::u64_t   records_ { 0 } ;
+} ;
+
+// puts a recorded frame back into _state_ the way the channels left it at
+// frame end, for replaying it. the frame start timestamps aren't recorded
+void restore_frame ( recording_record const & _record_, telemetry_state & _state_ ) noexcept ;
+
+////////////////////////////////////////////////////////////////////////////////
+////////////////////////////////////////////////////////////////////////////////
+
+inline bool telemetry_recorder::start ( char const * _path_ ) noexcept
+{
+        if( recording() ) return true ;
+
+        fd_ = ::open( _path_, O_RDWR | O_CREAT | O_TRUNC, 0644 ) ;
+
+        if( fd_ < 0 )
+        {
+                FFFB_F_ERR_S( "telemetry_recorder::start", "failed opening '%s' : %s", _path_, std::strerror( errno ) ) ;
+                return false ;
+        }
+        segments_.store( 0, std::memory_order_relaxed ) ;
+         records_.store( 0, std::memory_order_relaxed ) ;
+         dropped_.store( 0, std::memory_order_relaxed ) ;
+
+        current_ = _map_segment() ;
+
+        recording_record * const next = current_ ? _map_segment() : nullptr ;
+
+        if( !next )
+        {
+                _unmap( current_ ) ;
+                current_ = nullptr ;
+                ::close( fd_ ) ;
+                fd_ = -1 ;
+                return false ;
+        }
+        ready_.store( next, std::memory_order_release ) ;
+
+        header_ = {} ;
+        std::memcpy( header_.magic, recording_magic, sizeof( header_.magic ) ) ;
+        header_.version      = FFFB_RECORDER_VERSION ;
+        header_.record_size  = FFFB_RECORDER_RECORD_SIZE ;
+        header_.segment_size = FFFB_RECORDER_SEGMENT_SIZE ;
+        header_.field_count  = static_cast< uti::u32_t >( telemetry_field::count ) ;
+        header_.sink_count   = static_cast< uti::u32_t >( effect_sink::count ) ;
+        header_.max_wheels   = FFFB_TELEMETRY_MAX_WHEELS ;
+        header_.started_us   = host_time_us() ;
+
+        std::memcpy( current_, &header_, sizeof( header_ ) ) ;
+
+        cursor_   = 1 ;
+        sequence_ = 0 ;
+
+        running_.store( true, std::memory_order_release ) ;
+        thread_ = std::thread( &telemetry_recorder::_run, this ) ;
+
+        recording_.store( true, std::memory_order_release ) ;
+
+        FFFB_F_INFO_S( "telemetry_recorder::start", "recording to '%s'", _path_ ) ;
+        return true ;
+}
+
+inline void telemetry_recorder::stop () noexcept
+{
+        if( !recording_.exchange( false, std::memory_order_acq_rel ) ) return ;
+
+        running_.store( false, std::memory_order_release ) ;
+
+        if( thread_.joinable() ) thread_.join() ;
+
+        uti::u32_t const segments = segments_.load( std::memory_order_relaxed ) ;
+
+        // the ready segment is the last one in the file, current the one before it
+        recording_record * const ready = ready_.exchange( nullptr, std::memory_order_acq_rel ) ;
+
+        off_t const used = static_cast< off_t >( segments - ( ready ? 2 : 1 ) ) * FFFB_RECORDER_SEGMENT_SIZE
+                         + static_cast< off_t >( cursor_ ) * FFFB_RECORDER_RECORD_SIZE ;
+
+        _unmap( retired_.exchange( nullptr, std::memory_order_acq_rel ) ) ;
+        _unmap( ready ) ;
+        _unmap( current_ ) ;
+        current_ = nullptr ;
+
+        header_.records = records_.load( std::memory_order_relaxed ) ;
+
+        if( ::pwrite( fd_, &header_, sizeof( header_ ), 0 ) != static_cast< ssize_t >( sizeof( header_ ) ) || ::ftruncate( fd_, used ) != 0 )
+        {
+                FFFB_F_WARN_S( "telemetry_recorder::stop", "failed finishing recording : %s", std::strerror( errno ) ) ;
+        }
+        ::close( fd_ ) ;
+        fd_ = -1 ;
+
+        FFFB_F_INFO_S( "telemetry_recorder::stop", "recorded %lu records, dropped %lu", header_.records, dropped_.load( std::memory_order_relaxed ) ) ;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
+inline void telemetry_recorder::record_frame ( telemetry_state const & _state_, uti::u32_t _fields_, effect_outputs const & _outputs_, q16 _torque_ ) noexcept
+{
+        recording_record * const record = _claim( _state_ ) ;
+
+        if( !record ) return ;
+
+        recorded_frame & frame = record->frame ;
+
+        frame.fields    = _fields_ ;
+        frame.callbacks = _state_.callbacks ;
+
+        unsigned char const * base = reinterpret_cast< unsigned char const * >( &_state_ ) ;
+
+        for( uti::u8_t field = 0; field < static_cast< uti::u8_t >( telemetry_field::count ); ++field )
+        {
+                telemetry_field_info const & info = telemetry_fields[ field ] ;
+
+                if( info.is_int )
+                {
+                        int i ;
+                        std::memcpy( &i, base + info.offset, sizeof( int ) ) ;
+                        frame.values[ field ] = static_cast< float >( i ) ;
+                }
+                else
+                {
+                        std::memcpy( &frame.values[ field ], base + info.offset, sizeof( float ) ) ;
+                }
+        }
+        for( uti::u8_t wheel = 0; wheel < FFFB_TELEMETRY_MAX_WHEELS; ++wheel )
+        {
+                frame.substance[ wheel ] = static_cast< uti::u8_t >( _state_.substance[ wheel ] ) ;
+        }
+        frame.written = _outputs_.written ;
+
+        for( uti::u8_t sink = 0; sink < static_cast< uti::u8_t >( effect_sink::count ); ++sink )
+        {
+                frame.outputs[ sink ] = _outputs_.values[ sink ].raw() ;
+        }
+        frame.torque = _torque_.raw() ;
+
+        record->kind = record_kind::frame ;
+}
+
+inline void telemetry_recorder::record_pause ( telemetry_state const & _state_, bool _paused_ ) noexcept
+{
+        record_kind const kind = _paused_ ? record_kind::paused : record_kind::resumed ;
+
+        recording_record * const record = _claim( _state_ ) ;
+
+        if( record ) record->kind = kind ;
+}
+
+inline void telemetry_recorder::record_config ( telemetry_state const & _state_, truck_constants const & _constants_ ) noexcept
+{
+        recording_record * const record = _claim( _state_ ) ;
+
+        if( !record ) return ;
+
+        recorded_config & config = record->config ;
+
+        config.version             = _constants_.version ;
+        config.rpm_limit           = _constants_.rpm_limit ;
+        config.forward_gears       = _constants_.forward_gears ;
+        config.reverse_gears       = _constants_.reverse_gears ;
+        config.wheel_count         = _constants_.wheel_count ;
+        config.trailer_wheel_count = _constants_.trailer_wheel_count ;
+        config.steered_count       = _constants_.steered_count ;
+        config.powered_count       = _constants_.powered_count ;
+        config.substance_count     = static_cast< uti::u8_t >( _constants_.substances.count ) ;
+
+        record->kind = record_kind::config ;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
+// the slot for the next record with everything but the kind filled in, the
+// kind goes in last so a reader never mistakes a half written record for one
+inline recording_record * telemetry_recorder::_claim ( telemetry_state const & _state_ ) noexcept
+{
+        if( !recording() ) return nullptr ;
+
+        if( cursor_ == per_segment )
+        {
+                // the thread is behind, keep the current segment until it caught up
+                if( retired_.load( std::memory_order_acquire ) )
+                {
+                        dropped_.fetch_add( 1, std::memory_order_relaxed ) ;
+                        return nullptr ;
+                }
+                recording_record * const next = ready_.exchange( nullptr, std::memory_order_acq_rel ) ;
+
+                if( !next )
+                {
+                        dropped_.fetch_add( 1, std::memory_order_relaxed ) ;
+                        return nullptr ;
+                }
+                retired_.store( current_, std::memory_order_release ) ;
+
+                current_ = next ;
+                cursor_  = 0 ;
+        }
+        recording_record * const record = &current_[ cursor_++ ] ;
+
+        record->sequence       = sequence_++ ;
+        record->timestamp      = _state_.timestamp ;
+        record->host_timestamp = _state_.host_timestamp ;
+
+        records_.fetch_add( 1, std::memory_order_relaxed ) ;
+
+        return record ;
+}
+
+inline recording_record * telemetry_recorder::_map_segment () noexcept
+{
+        uti::u32_t const segment = segments_.load( std::memory_order_relaxed ) ;
+
+        off_t const offset = static_cast< off_t >( segment ) * FFFB_RECORDER_SEGMENT_SIZE ;
+
+        if( ::ftruncate( fd_, offset + FFFB_RECORDER_SEGMENT_SIZE ) != 0 )
+        {
+                FFFB_F_ERR_S( "telemetry_recorder::map_segment", "failed growing recording : %s", std::strerror( errno ) ) ;
+                return nullptr ;
+        }
+        void * const mapping = ::mmap( nullptr, FFFB_RECORDER_SEGMENT_SIZE, PROT_READ | PROT_WRITE, MAP_SHARED, fd_, offset ) ;
+
+        if( mapping == MAP_FAILED )
+        {
+                FFFB_F_ERR_S( "telemetry_recorder::map_segment", "failed mapping recording : %s", std::strerror( errno ) ) ;
+                return nullptr ;
+        }
+        // fault every page in here, not on the game thread
+        long const page = ::sysconf( _SC_PAGESIZE ) ;
+
+        for( uti::u32_t at = 0; at < FFFB_RECORDER_SEGMENT_SIZE; at += static_cast< uti::u32_t >( page ) )
+        {
+                static_cast< unsigned char volatile * >( mapping )[ at ] = 0 ;
+        }
+        segments_.store( segment + 1, std::memory_order_relaxed ) ;
+
+        return static_cast< recording_record * >( mapping ) ;
+}
+
+inline void telemetry_recorder::_unmap ( recording_record * _segment_ ) noexcept
+{
+        if( !_segment_ ) return ;
+
+        ::msync ( _segment_, FFFB_RECORDER_SEGMENT_SIZE, MS_ASYNC ) ;
+        ::munmap( _segment_, FFFB_RECORDER_SEGMENT_SIZE ) ;
+}
+
+inline void telemetry_recorder::_run () noexcept
+{
+        while( running_.load( std::memory_order_acquire ) )
+        {
+                _unmap( retired_.exchange( nullptr, std::memory_order_acq_rel ) ) ;
+
+                if( !ready_.load( std::memory_order_acquire ) )
+                {
+                        if( recording_record * const next = _map_segment() ) ready_.store( next, std::memory_order_release ) ;
+                }
+                std::this_thread::sleep_for( std::chrono::milliseconds( FFFB_RECORDER_POLL_MS ) ) ;
+        }
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
+inline bool recording_reader::open ( char const * _path_ ) noexcept
+{
+        close() ;
+
+        int const fd = ::open( _path_, O_RDONLY ) ;
+
+        if( fd < 0 )
+        {
+                FFFB_ERR_S( "recording_reader::open", "failed opening '%s' : %s", _path_, std::strerror( errno ) ) ;
+                return false ;
+        }
+        struct stat info ;
+
+        if( ::fstat( fd, &info ) != 0 || info.st_size < FFFB_RECORDER_RECORD_SIZE )
+        {
+                FFFB_ERR_S( "recording_reader::open", "'%s' is too short for a recording", _path_ ) ;
+                ::close( fd ) ;
+                return false ;
+        }
+        void * const mapping = ::mmap( nullptr, static_cast< size_t >( info.st_size ), PROT_READ, MAP_PRIVATE, fd, 0 ) ;
+
+        ::close( fd ) ;
+
+        if( mapping == MAP_FAILED )
+        {
+                FFFB_ERR_S( "recording_reader::open", "failed mapping '%s' : %s", _path_, std::strerror( errno ) ) ;
+                return false ;
+        }
+        mapping_ = mapping ;
+        size_    = static_cast< size_t >( info.st_size ) ;
+
+        recording_header const & head = header() ;
+
+        // records are copied as they are, the layout has to match this build's
+        if( std::memcmp( head.magic, recording_magic, sizeof( recording_magic ) ) != 0 ||
+            head.version     != FFFB_RECORDER_VERSION                              ||
+            head.record_size != FFFB_RECORDER_RECORD_SIZE                          ||
+            head.field_count != static_cast< uti::u32_t >( telemetry_field::count ) ||
+            head.sink_count  != static_cast< uti::u32_t >( effect_sink::count )     ||
+            head.max_wheels  != FFFB_TELEMETRY_MAX_WHEELS                           )
+        {
+                FFFB_ERR_S( "recording_reader::open", "'%s' isn't a recording this build can read", _path_ ) ;
+                close() ;
+                return false ;
+        }
+        uti::u64_t const slots = size_ / FFFB_RECORDER_RECORD_SIZE - 1 ;
+
+        if( head.records && head.records <= slots )
+        {
+                records_ = head.records ;
+        }
+        else
+        {
+                records_ = 0 ;
+                while( records_ < slots && record( records_ ).kind != record_kind::empty ) ++records_ ;
+        }
+        return true ;
+}
+
+inline void recording_reader::close () noexcept
+{
+        if( mapping_ ) ::munmap( const_cast< void * >( mapping_ ), size_ ) ;
+
+        mapping_ = nullptr ;
+        size_    = 0 ;
+        records_ = 0 ;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
+inline void restore_frame ( recording_record const & _record_, telemetry_state & _state_ ) noexcept
+{
+        recorded_frame const & frame = _record_.frame ;
+
+        _state_.timestamp      = _record_.timestamp ;
+        _state_.host_timestamp = _record_.host_timestamp ;
+        _state_.callbacks      = frame.callbacks ;
+
+        unsigned char * base = reinterpret_cast< unsigned char * >( &_state_ ) ;
+
+        for( uti::u8_t field = 0; field < static_cast< uti::u8_t >( telemetry_field::count ); ++field )
+        {
+                telemetry_field_info const & info = telemetry_fields[ field ] ;
+
+                if( info.is_int )
+                {
+                        int const i = static_cast< int >( frame.values[ field ] ) ;
+                        std::memcpy( base + info.offset, &i, sizeof( int ) ) ;
+                }
+                else
+                {
+                        std::memcpy( base + info.offset, &frame.values[ field ], sizeof( float ) ) ;
+                }
+        }
+        for( uti::u8_t wheel = 0; wheel < FFFB_TELEMETRY_MAX_WHEELS; ++wheel )
+        {
+                _state_.substance[ wheel ] = frame.substance[ wheel ] ;
+        }
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
+
+} // namespace fffb
@@ -0,0 +1,108 @@
+//
+//
+//      fffb
+//      telemetry/state.hxx
+//
+
+#pragma once
+
+#include <fffb/util/types.hxx>
+
+#include <cstddef>
+
+#define FFFB_TELEMETRY_MAX_WHEELS 16
+
+
+namespace fffb
+{
+
+
+////////////////////////////////////////////////////////////////////////////////
+
+struct telemetry_state
+{
+        timestamp_t                       timestamp { static_cast< timestamp_t >( -1 ) } ;
+        timestamp_t         raw_rendering_timestamp { static_cast< timestamp_t >( -1 ) } ;
+        timestamp_t        raw_simulation_timestamp { static_cast< timestamp_t >( -1 ) } ;
+        timestamp_t raw_paused_simulation_timestamp { static_cast< timestamp_t >( -1 ) } ;
+        timestamp_t                  host_timestamp { 0 } ;
+
+        bool orientation_available { false } ;
+
+        float heading { -1.0 } ;
+        float   pitch { -1.0 } ;
+        float    roll { -1.0 } ;
+
+        float steering { -1.0 } ;
+        float throttle { -1.0 } ;
+        float    brake { -1.0 } ;
+        float   clutch { -1.0 } ;
+
+        float    speed { -1.0 } ;
+        float      rpm { -1.0 } ;
+        int       gear { -1   } ;
+
+        // rpm over the truck's limit, filled in at frame end
+        float rpm_ratio { 0.0 } ;
+
+        // per wheel, indexed like the game's wheel channels
+        int substance [ FFFB_TELEMETRY_MAX_WHEELS ] {} ;
+
+        // channel callbacks since frame start
+        uti::u32_t callbacks { 0 } ;
+} ;
+
+////////////////////////////////////////////////////////////////////////////////
+
+enum class telemetry_field : uti::u8_t
+{
+        heading   ,
+        pitch     ,
+        roll      ,
+        steering  ,
+        throttle  ,
+        brake     ,
+        clutch    ,
+        speed     ,
+        rpm       ,
+        gear      ,
+        rpm_ratio ,
+        count     ,
+} ;
+
+struct telemetry_field_info
+{
+        char const *   name ;
+        uti::u16_t   offset ;
+        bool         is_int ;
+} ;
+
+constexpr telemetry_field_info telemetry_fields [ static_cast< uti::u8_t >( telemetry_field::count ) ]
+{
+        { "heading"  , offsetof( telemetry_state, heading   ), false },
+        { "pitch"    , offsetof( telemetry_state, pitch     ), false },
+        { "roll"     , offsetof( telemetry_state, roll      ), false },
+        { "steering" , offsetof( telemetry_state, steering  ), false },
+        { "throttle" , offsetof( telemetry_state, throttle  ), false },
+        { "brake"    , offsetof( telemetry_state, brake     ), false },
+        { "clutch"   , offsetof( telemetry_state, clutch    ), false },
+        { "speed"    , offsetof( telemetry_state, speed     ), false },
+        { "rpm"      , offsetof( telemetry_state, rpm       ), false },
+        { "gear"     , offsetof( telemetry_state, gear      ),  true },
+        { "rpm_ratio", offsetof( telemetry_state, rpm_ratio ), false },
+} ;
+
+[[ nodiscard ]] constexpr telemetry_field_info const & field_info ( telemetry_field _field_ ) noexcept
+{
+        return telemetry_fields[ static_cast< uti::u8_t >( _field_ ) ] ;
+}
+
+[[ nodiscard ]] constexpr uti::u32_t field_bit ( telemetry_field _field_ ) noexcept
+{
+        return uti::u32_t( 1 ) << static_cast< uti::u8_t >( _field_ ) ;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
+
+} // namespace fffb
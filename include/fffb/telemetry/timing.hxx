@@ -0,0 +1,187 @@
+//
+//
+//      fffb
+//      telemetry/timing.hxx
+//
+
+#pragma once
+
+#include <fffb/util/types.hxx>
+#include <fffb/util/clock.hxx>
+#include <fffb/util/histogram.hxx>
+#include <fffb/force/scheduler.hxx>
+
+// what fffb may take of a game frame before the frame is kept, 0 keeps none
+#define FFFB_FRAME_BUDGET_US 250
+
+#define FFFB_SLOW_FRAME_HISTORY 32
+
+
+namespace fffb
+{
+
+
+////////////////////////////////////////////////////////////////////////////////
+
+// everything fffb runs on the game thread. update_ffb runs inside frame_end,
+// pause and configure between frames, so they're not part of a frame's total
+enum class timed_callback : uti::u8_t
+{
+        frame_start ,
+        channel     ,
+        frame_end   ,
+        update_ffb  ,
+        pause       ,
+        configure   ,
+        count       ,
+} ;
+
+constexpr char const * timed_callback_names [ static_cast< uti::u8_t >( timed_callback::count ) ]
+{
+        "frame_start", "channel", "frame_end", "update_ffb", "pause", "configure",
+} ;
+
+// what fffb did in a frame that went over budget
+struct slow_frame
+{
+        timestamp_t at_us { 0 } ; // host time at frame start
+        uti::u64_t  frame { 0 } ;
+
+        uti::u32_t       total_ns { 0 } ; // frame start, channels and frame end
+        uti::u32_t frame_start_ns { 0 } ;
+        uti::u32_t    channels_ns { 0 } ;
+        uti::u32_t   frame_end_ns { 0 } ;
+        uti::u32_t      update_ns { 0 } ;
+
+        uti::u16_t channels { 0 } ; // channel callbacks
+        uti::u16_t  reports { 0 } ; // written while update_ffb ran
+        task_mask       due { 0 } ; // tasks the pipeline ran
+} ;
+
+////////////////////////////////////////////////////////////////////////////////
+
+// per callback histograms and the frames that went over budget. only ever
+// touched from the game thread, so dumping from a game callback is safe
+
+class callback_timing
+{
+public:
+        constexpr void set_budget_us ( timestamp_t _budget_us_ ) noexcept { budget_ns_ = _budget_us_ * 1000 ; }
+
+        [[ nodiscard ]] constexpr timestamp_t budget_us () const noexcept { return budget_ns_ / 1000 ; }
+
+        // a frame starts with frame_start and is done with frame_end
+        constexpr void record ( timed_callback _callback_, uti::u64_t _start_ns_, uti::u64_t _end_ns_ ) noexcept ;
+
+        // what the pipeline did this frame, from update_ffb
+        constexpr void note_update ( task_mask _due_, uti::u64_t _reports_ ) noexcept
+        {
+                current_.due     = _due_ ;
+                current_.reports = static_cast< uti::u16_t >( _reports_ < 0xFFFF ? _reports_ : 0xFFFF ) ;
+        }
+
+        [[ nodiscard ]] constexpr log_histogram const & histogram ( timed_callback _callback_ ) const noexcept
+        { return callbacks_[ static_cast< uti::u8_t >( _callback_ ) ] ; }
+
+        // fffb's whole share of each frame
+        [[ nodiscard ]] constexpr log_histogram const & frames () const noexcept { return frames_ ; }
+
+        [[ nodiscard ]] constexpr uti::u64_t over_budget () const noexcept { return over_budget_ ; }
+
+        [[ nodiscard ]] constexpr uti::u32_t size () const noexcept
+        { return over_budget_ < FFFB_SLOW_FRAME_HISTORY ? static_cast< uti::u32_t >( over_budget_ ) : FFFB_SLOW_FRAME_HISTORY ; }
+
+        // 0 is the newest, has to be below size()
+        [[ nodiscard ]] constexpr slow_frame const & recent ( uti::u32_t _age_ ) const noexcept
+        { return slow_[ ( head_ + FFFB_SLOW_FRAME_HISTORY - 1 - _age_ ) % FFFB_SLOW_FRAME_HISTORY ] ; }
+private:
+        log_histogram callbacks_ [ static_cast< uti::u8_t >( timed_callback::count ) ] {} ;
+        log_histogram frames_ {} ;
+
+        uti::u64_t budget_ns_ { FFFB_FRAME_BUDGET_US * 1000 } ;
+
+        slow_frame current_ {} ;
+
+        slow_frame     slow_ [ FFFB_SLOW_FRAME_HISTORY ] {} ;
+        uti::u32_t     head_ { 0 } ;
+        uti::u64_t over_budget_ { 0 } ;
+
+        constexpr void _end_frame () noexcept ;
+} ;
+
+// times the rest of the enclosing scope as _callback_
+class timed_scope
+{
+public:
+        timed_scope ( callback_timing & _timing_, timed_callback _callback_ ) noexcept
+                : timing_( _timing_ ), callback_( _callback_ ), start_ns_( monotonic_ns() ) {}
+
+        ~timed_scope () noexcept { timing_.record( callback_, start_ns_, monotonic_ns() ) ; }
+
+        timed_scope             ( timed_scope const & ) = delete ;
+        timed_scope & operator= ( timed_scope const & ) = delete ;
+private:
+        callback_timing & timing_ ;
+        timed_callback  callback_ ;
+        uti::u64_t      start_ns_ ;
+} ;
+
+////////////////////////////////////////////////////////////////////////////////
+////////////////////////////////////////////////////////////////////////////////
+
+constexpr void callback_timing::record ( timed_callback _callback_, uti::u64_t _start_ns_, uti::u64_t _end_ns_ ) noexcept
+{
+        uti::u64_t const ns = _end_ns_ > _start_ns_ ? _end_ns_ - _start_ns_ : 0 ;
+
+        callbacks_[ static_cast< uti::u8_t >( _callback_ ) ].add( ns ) ;
+
+        uti::u32_t const ns32 = static_cast< uti::u32_t >( ns < 0xFFFFFFFF ? ns : 0xFFFFFFFF ) ;
+
+        switch( _callback_ )
+        {
+                case timed_callback::frame_start :
+                {
+                        uti::u64_t const frame = current_.frame + 1 ;
+
+                        current_ = slow_frame{} ;
+                        current_.at_us          = _start_ns_ / 1000 ;
+                        current_.frame          = frame ;
+                        current_.frame_start_ns = ns32 ;
+                }
+                        break ;
+                case timed_callback::channel :
+                        current_.channels_ns += ns32 ;
+                        current_.channels    += current_.channels < 0xFFFF ;
+                        break ;
+                case timed_callback::update_ffb :
+                        current_.update_ns = ns32 ;
+                        break ;
+                case timed_callback::frame_end :
+                        current_.frame_end_ns = ns32 ;
+                        _end_frame() ;
+                        break ;
+                default :
+                        break ;
+        }
+}
+
+constexpr void callback_timing::_end_frame () noexcept
+{
+        uti::u64_t const total = static_cast< uti::u64_t >( current_.frame_start_ns ) + current_.channels_ns + current_.frame_end_ns ;
+
+        frames_.add( total ) ;
+
+        if( budget_ns_ == 0 || total <= budget_ns_ ) return ;
+
+        current_.total_ns = static_cast< uti::u32_t >( total < 0xFFFFFFFF ? total : 0xFFFFFFFF ) ;
+
+        slow_[ head_ ] = current_ ;
+        head_ = ( head_ + 1 ) % FFFB_SLOW_FRAME_HISTORY ;
+
+        ++over_budget_ ;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
+
+} // namespace fffb
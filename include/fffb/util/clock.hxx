@@ -0,0 +1,69 @@
+//
+//
+//      fffb
+//      util/clock.hxx
+//
+
+#pragma once
+
+#include <fffb/util/types.hxx>
+
+#include <ctime>
+#include <atomic>
+
+
+namespace fffb
+{
+
+
+////////////////////////////////////////////////////////////////////////////////
+
+// host monotonic time in microseconds, same unit as the telemetry timestamps.
+// offline tools build with FFFB_VIRTUAL_CLOCK and move host time themselves
+
+#ifdef FFFB_VIRTUAL_CLOCK
+
+[[ nodiscard ]] inline std::atomic< timestamp_t > & virtual_host_time () noexcept
+{
+        static std::atomic< timestamp_t > now { 0 } ;
+        return now ;
+}
+
+inline void set_host_time_us ( timestamp_t _now_ ) noexcept { virtual_host_time().store( _now_, std::memory_order_relaxed ) ; }
+
+[[ nodiscard ]] inline timestamp_t host_time_us () noexcept { return virtual_host_time().load( std::memory_order_relaxed ) ; }
+
+#else
+
+[[ nodiscard ]] inline timestamp_t host_time_us () noexcept
+{
+        timespec time ;
+        clock_gettime( CLOCK_MONOTONIC_RAW, &time ) ;
+
+        return static_cast< timestamp_t >( time.tv_sec ) * 1000000 + static_cast< timestamp_t >( time.tv_nsec / 1000 ) ;
+}
+
+#endif // FFFB_VIRTUAL_CLOCK
+
+// real monotonic time in nanoseconds for timing code, a virtual clock doesn't move it
+[[ nodiscard ]] inline uti::u64_t monotonic_ns () noexcept
+{
+        timespec time ;
+        clock_gettime( CLOCK_MONOTONIC_RAW, &time ) ;
+
+        return static_cast< uti::u64_t >( time.tv_sec ) * 1000000000 + static_cast< uti::u64_t >( time.tv_nsec ) ;
+}
+
+// cpu time consumed by the calling thread in microseconds
+[[ nodiscard ]] inline timestamp_t thread_cpu_us () noexcept
+{
+        timespec time ;
+        clock_gettime( CLOCK_THREAD_CPUTIME_ID, &time ) ;
+
+        return static_cast< timestamp_t >( time.tv_sec ) * 1000000 + static_cast< timestamp_t >( time.tv_nsec / 1000 ) ;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
+
+} // namespace fffb
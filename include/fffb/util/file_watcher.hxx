@@ -0,0 +1,220 @@
+//
+//
+//      fffb
+//      util/file_watcher.hxx
+//
+
+#pragma once
+
+#include <fffb/util/types.hxx>
+
+#include <cstring>
+#include <climits>
+
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+#if   defined( __APPLE__ )
+#include <sys/event.h>
+#elif defined( __linux__ )
+#include <poll.h>
+#include <sys/inotify.h>
+#endif
+
+
+namespace fffb
+{
+
+
+////////////////////////////////////////////////////////////////////////////////
+
+// blocks until a single file changes or the timeout runs out.
+// editors usually save by replacing the file, so a deleted or renamed
+// file is watched again once it reappears, reappearing counts as a change
+
+class file_watcher
+{
+public:
+        constexpr  file_watcher () noexcept = default ;
+                  ~file_watcher () noexcept { close() ; }
+
+        file_watcher ( file_watcher const & ) = delete ;
+        file_watcher & operator= ( file_watcher const & ) = delete ;
+
+        bool open  ( char const * _path_ ) noexcept ;
+        void close (                     ) noexcept ;
+
+        [[ nodiscard ]] bool wait ( int _timeout_ms_ ) noexcept ;
+
+        [[ nodiscard ]] char const * path () const noexcept { return path_ ; }
+private:
+        char path_ [ PATH_MAX ] {} ;
+
+        int fd_    { -1 } ;
+        int watch_ { -1 } ;
+
+        timespec mtime_ {} ;
+
+        bool _arm () noexcept ;
+
+        [[ nodiscard ]] bool _stat_changed () noexcept ;
+} ;
+
+////////////////////////////////////////////////////////////////////////////////
+////////////////////////////////////////////////////////////////////////////////
+
+inline bool file_watcher::open ( char const * _path_ ) noexcept
+{
+        close() ;
+
+        if( std::strlen( _path_ ) >= sizeof( path_ ) )
+        {
+                FFFB_F_ERR_S( "file_watcher::open", "path too long" ) ;
+                return false ;
+        }
+        std::strcpy( path_, _path_ ) ;
+
+        ( void ) _stat_changed() ;
+
+#if   defined( __APPLE__ )
+        fd_ = kqueue() ;
+#elif defined( __linux__ )
+        fd_ = inotify_init1( IN_NONBLOCK | IN_CLOEXEC ) ;
+#endif
+        if( fd_ < 0 )
+        {
+                FFFB_F_WARN_S( "file_watcher::open", "no change notifications, polling '%s'", path_ ) ;
+                return true ;
+        }
+        ( void ) _arm() ;
+        return true ;
+}
+
+inline void file_watcher::close () noexcept
+{
+#if defined( __APPLE__ )
+        if( watch_ >= 0 ) ::close( watch_ ) ;
+#endif
+        if( fd_ >= 0 ) ::close( fd_ ) ;
+
+        fd_ = watch_ = -1 ;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
+inline bool file_watcher::wait ( int _timeout_ms_ ) noexcept
+{
+#if   defined( __APPLE__ )
+        if( fd_ >= 0 && ( watch_ >= 0 || _arm() ) )
+        {
+                struct kevent event {} ;
+                timespec const timeout { _timeout_ms_ / 1000, ( _timeout_ms_ % 1000 ) * 1000000L } ;
+
+                int const count = kevent( fd_, nullptr, 0, &event, 1, &timeout ) ;
+
+                if( count <= 0 ) return false ;
+
+                if( event.fflags & ( NOTE_DELETE | NOTE_RENAME | NOTE_REVOKE ) )
+                {
+                        // the old inode is gone, pick up the replacement on the next call
+                        ::close( watch_ ) ;
+                        watch_ = -1 ;
+                        ( void ) _arm() ;
+                }
+                return _stat_changed() ;
+        }
+#elif defined( __linux__ )
+        if( fd_ >= 0 && ( watch_ >= 0 || _arm() ) )
+        {
+                pollfd pfd { fd_, POLLIN, 0 } ;
+
+                if( poll( &pfd, 1, _timeout_ms_ ) <= 0 ) return false ;
+
+                // the directory is watched, so drain everything and only look at our file
+                alignas( inotify_event ) char buffer[ 4096 ] ;
+
+                char const * name = std::strrchr( path_, '/' ) ;
+                name = name ? name + 1 : path_ ;
+
+                bool hit { false } ;
+                ssize_t len ;
+
+                while( ( len = read( fd_, buffer, sizeof( buffer ) ) ) > 0 )
+                {
+                        for( char const * p = buffer; p < buffer + len; )
+                        {
+                                inotify_event const * event = reinterpret_cast< inotify_event const * >( p ) ;
+
+                                if( event->len && std::strcmp( event->name, name ) == 0 ) hit = true ;
+
+                                p += sizeof( inotify_event ) + event->len ;
+                        }
+                }
+                return hit && _stat_changed() ;
+        }
+#endif
+        usleep( static_cast< useconds_t >( _timeout_ms_ ) * 1000 ) ;
+
+        return _stat_changed() ;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
+inline bool file_watcher::_arm () noexcept
+{
+#if   defined( __APPLE__ )
+        watch_ = ::open( path_, O_EVTONLY ) ;
+
+        if( watch_ < 0 ) return false ;
+
+        struct kevent change {} ;
+        EV_SET( &change, watch_, EVFILT_VNODE, EV_ADD | EV_CLEAR,
+                NOTE_WRITE | NOTE_EXTEND | NOTE_ATTRIB | NOTE_DELETE | NOTE_RENAME | NOTE_REVOKE, 0, nullptr ) ;
+
+        if( kevent( fd_, &change, 1, nullptr, 0, nullptr ) < 0 )
+        {
+                ::close( watch_ ) ;
+                watch_ = -1 ;
+                return false ;
+        }
+        return true ;
+#elif defined( __linux__ )
+        char dir [ PATH_MAX ] ;
+        std::strcpy( dir, path_ ) ;
+
+        char * slash = std::strrchr( dir, '/' ) ;
+
+        if( !slash            ) std::strcpy( dir, "." ) ;
+        else if( slash == dir ) slash[ 1 ] = '\0' ;
+        else                    slash[ 0 ] = '\0' ;
+
+        watch_ = inotify_add_watch( fd_, dir, IN_CLOSE_WRITE | IN_MOVED_TO | IN_CREATE | IN_DELETE ) ;
+
+        return watch_ >= 0 ;
+#else
+        return false ;
+#endif
+}
+
+inline bool file_watcher::_stat_changed () noexcept
+{
+        struct stat st {} ;
+
+        if( stat( path_, &st ) != 0 ) return false ;
+
+#if defined( __APPLE__ )
+        timespec const mtime = st.st_mtimespec ;
+#else
+        timespec const mtime = st.st_mtim ;
+#endif
+        bool const changed = mtime.tv_sec != mtime_.tv_sec || mtime.tv_nsec != mtime_.tv_nsec ;
+
+        mtime_ = mtime ;
+        return changed ;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
+
+} // namespace fffb
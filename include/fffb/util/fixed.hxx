@@ -0,0 +1,142 @@
+//
+//
+//      fffb
+//      util/fixed.hxx
+//
+
+#pragma once
+
+#include <fffb/util/types.hxx>
+
+
+namespace fffb
+{
+
+
+////////////////////////////////////////////////////////////////////////////////
+
+// signed Q16.16. integer arithmetic only, so every build computes the same bits
+// no matter the architecture, compiler or floating point flags. results saturate
+// instead of wrapping, floats are only converted at the edges (telemetry in, tuning
+// constants while building)
+
+class q16
+{
+public:
+        static constexpr uti::i32_t frac_bits {  16 } ;
+        static constexpr uti::i32_t   one_raw { 1 << frac_bits } ;
+        static constexpr uti::i32_t  half_raw { 1 << ( frac_bits - 1 ) } ;
+
+        constexpr q16 () noexcept = default ;
+
+        [[ nodiscard ]] static constexpr q16 from_raw ( uti::i32_t _raw_ ) noexcept { q16 q ; q.raw_ = _raw_ ; return q ; }
+        [[ nodiscard ]] static constexpr q16 from_int ( uti::i32_t _val_ ) noexcept { return _saturate( static_cast< uti::i64_t >( _val_ ) << frac_bits ) ; }
+
+        [[ nodiscard ]] static constexpr q16 from_float ( float _val_ ) noexcept
+        {
+                float const scaled = _val_ * static_cast< float >( one_raw ) ;
+
+                if( !( scaled == scaled )   ) return {} ;
+                if( scaled >=  2147483520.0f ) return max() ;
+                if( scaled <= -2147483520.0f ) return min() ;
+
+                return from_raw( static_cast< uti::i32_t >( scaled < 0.0f ? scaled - 0.5f : scaled + 0.5f ) ) ;
+        }
+
+        [[ nodiscard ]] static constexpr q16 max () noexcept { return from_raw(  2147483647      ) ; }
+        [[ nodiscard ]] static constexpr q16 min () noexcept { return from_raw( -2147483647 - 1  ) ; }
+        [[ nodiscard ]] static constexpr q16 one () noexcept { return from_raw( one_raw ) ; }
+
+        [[ nodiscard ]] constexpr uti::i32_t raw () const noexcept { return raw_ ; }
+
+        // rounds towards negative infinity
+        [[ nodiscard ]] constexpr uti::i32_t to_int () const noexcept { return raw_ >> frac_bits ; }
+
+        [[ nodiscard ]] constexpr float to_float () const noexcept { return static_cast< float >( raw_ ) / static_cast< float >( one_raw ) ; }
+
+        [[ nodiscard ]] constexpr q16 operator- () const noexcept { return _saturate( -static_cast< uti::i64_t >( raw_ ) ) ; }
+
+        [[ nodiscard ]] friend constexpr q16 operator+ ( q16 _a_, q16 _b_ ) noexcept { return _saturate( static_cast< uti::i64_t >( _a_.raw_ ) + _b_.raw_ ) ; }
+        [[ nodiscard ]] friend constexpr q16 operator- ( q16 _a_, q16 _b_ ) noexcept { return _saturate( static_cast< uti::i64_t >( _a_.raw_ ) - _b_.raw_ ) ; }
+
+        [[ nodiscard ]] friend constexpr q16 operator* ( q16 _a_, q16 _b_ ) noexcept
+        {
+                return _saturate( ( static_cast< uti::i64_t >( _a_.raw_ ) * _b_.raw_ + half_raw ) >> frac_bits ) ;
+        }
+        [[ nodiscard ]] friend constexpr q16 operator/ ( q16 _a_, q16 _b_ ) noexcept
+        {
+                if( _b_.raw_ == 0 ) return _a_.raw_ < 0 ? min() : max() ;
+
+                return _saturate( ( static_cast< uti::i64_t >( _a_.raw_ ) << frac_bits ) / _b_.raw_ ) ;
+        }
+
+        constexpr q16 & operator+= ( q16 _other_ ) noexcept { return *this = *this + _other_ ; }
+        constexpr q16 & operator-= ( q16 _other_ ) noexcept { return *this = *this - _other_ ; }
+        constexpr q16 & operator*= ( q16 _other_ ) noexcept { return *this = *this * _other_ ; }
+
+        [[ nodiscard ]] friend constexpr bool operator== ( q16 _a_, q16 _b_ ) noexcept = default ;
+        [[ nodiscard ]] friend constexpr auto operator<=> ( q16 _a_, q16 _b_ ) noexcept = default ;
+private:
+        uti::i32_t raw_ { 0 } ;
+
+        [[ nodiscard ]] static constexpr q16 _saturate ( uti::i64_t _raw_ ) noexcept
+        {
+                if( _raw_ >  2147483647LL ) return max() ;
+                if( _raw_ < -2147483648LL ) return min() ;
+
+                return from_raw( static_cast< uti::i32_t >( _raw_ ) ) ;
+        }
+} ;
+
+////////////////////////////////////////////////////////////////////////////////
+
+[[ nodiscard ]] constexpr q16 q16_abs ( q16 _x_ ) noexcept { return _x_ < q16{} ? -_x_ : _x_ ; }
+
+[[ nodiscard ]] constexpr q16 q16_clamp ( q16 _x_, q16 _lo_, q16 _hi_ ) noexcept
+{ return _x_ < _lo_ ? _lo_ : _x_ > _hi_ ? _hi_ : _x_ ; }
+
+[[ nodiscard ]] constexpr q16 q16_lerp ( q16 _a_, q16 _b_, q16 _t_ ) noexcept { return _a_ + ( _b_ - _a_ ) * _t_ ; }
+
+// microseconds to seconds, exact for anything below half an hour
+[[ nodiscard ]] constexpr q16 q16_from_us ( timestamp_t _us_ ) noexcept
+{
+        if( _us_ >= ( timestamp_t( 1 ) << 31 ) ) return q16::max() ;
+
+        return q16::from_raw( static_cast< uti::i32_t >( ( static_cast< uti::i64_t >( _us_ ) << q16::frac_bits ) / 1000000 ) ) ;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
+// torque in [-1, 1] to the classic 0..255 amplitude, 128 being no force
+[[ nodiscard ]] constexpr uti::u8_t to_classic_amplitude ( q16 _torque_ ) noexcept
+{
+        _torque_ = q16_clamp( _torque_, -q16::one(), q16::one() ) ;
+
+        return static_cast< uti::u8_t >( ( q16::from_int( 128 ) + _torque_ * q16::from_int( 127 ) + q16::from_raw( q16::half_raw ) ).to_int() ) ;
+}
+
+[[ nodiscard ]] constexpr uti::array< uti::i16_t, 256 > make_hidpp_level_table () noexcept
+{
+        uti::array< uti::i16_t, 256 > levels {} ;
+
+        for( uti::i32_t amplitude = 0; amplitude < 256; ++amplitude )
+        {
+                uti::i32_t const delta = amplitude - 128 ;
+
+                levels[ amplitude ] = static_cast< uti::i16_t >( delta >= 0 ? ( delta * 0x7fff ) / 127
+                                                                            : ( delta * 0x8000 ) / 128 ) ;
+        }
+        return levels ;
+}
+
+// classic amplitude to the signed 16 bit level of the HID++ constant effect
+constexpr uti::array< uti::i16_t, 256 > hidpp_level_table { make_hidpp_level_table() } ;
+
+[[ nodiscard ]] constexpr uti::i16_t hidpp_level ( uti::u8_t _amplitude_ ) noexcept { return hidpp_level_table[ _amplitude_ ] ; }
+
+[[ nodiscard ]] constexpr uti::i16_t to_hidpp_level ( q16 _torque_ ) noexcept { return hidpp_level( to_classic_amplitude( _torque_ ) ) ; }
+
+////////////////////////////////////////////////////////////////////////////////
+
+
+} // namespace fffb
@@ -0,0 +1,453 @@
+//
+//
+//      fffb
+//      util/fixed_simd.hxx
+//
+
+#pragma once
+
+#include <fffb/util/types.hxx>
+#include <fffb/util/fixed.hxx>
+
+#if   defined( __AVX2__ )
+#define FFFB_SIMD_AVX2
+#include <immintrin.h>
+#elif defined( __SSE4_1__ )
+#define FFFB_SIMD_SSE
+#include <smmintrin.h>
+#elif defined( __ARM_NEON )
+#define FFFB_SIMD_NEON
+#include <arm_neon.h>
+#endif
+
+#define FFFB_SIMD_LANES 8
+
+
+namespace fffb::simd
+{
+
+
+////////////////////////////////////////////////////////////////////////////////
+
+// q16 operations over FFFB_SIMD_LANES lanes of raw values. every backend
+// produces exactly the bits of the scalar q16 operators, including saturation
+// and rounding, so batched and per-frame results can be compared bit for bit.
+// multiplies need 64 bit products per lane which don't vectorize without
+// AVX-512, those stay with the scalar operators
+
+using lanes = uti::i32_t[ FFFB_SIMD_LANES ] ;
+
+constexpr char const * backend_name () noexcept
+{
+#if   defined( FFFB_SIMD_AVX2 )
+        return "avx2" ;
+#elif defined( FFFB_SIMD_SSE  )
+        return "sse4.1" ;
+#elif defined( FFFB_SIMD_NEON )
+        return "neon" ;
+#else
+        return "scalar" ;
+#endif
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
+#if defined( FFFB_SIMD_AVX2 )
+
+inline __m256i _load  ( uti::i32_t const * _src_ ) noexcept { return _mm256_loadu_si256( reinterpret_cast< __m256i const * >( _src_ ) ) ; }
+inline void    _store ( uti::i32_t * _dst_, __m256i _v_ ) noexcept { _mm256_storeu_si256( reinterpret_cast< __m256i * >( _dst_ ), _v_ ) ; }
+
+inline void from_float ( lanes & _dst_, float const * _src_ ) noexcept
+{
+        __m256 const scaled = _mm256_mul_ps( _mm256_loadu_ps( _src_ ), _mm256_set1_ps( static_cast< float >( q16::one_raw ) ) ) ;
+
+        __m256 const neg  = _mm256_cmp_ps( scaled, _mm256_setzero_ps(), _CMP_LT_OQ ) ;
+        __m256 const half = _mm256_blendv_ps( _mm256_set1_ps( 0.5f ), _mm256_set1_ps( -0.5f ), neg ) ;
+
+        __m256i r = _mm256_cvttps_epi32( _mm256_add_ps( scaled, half ) ) ;
+
+        r = _mm256_blendv_epi8( r, _mm256_set1_epi32( q16::max().raw() ), _mm256_castps_si256( _mm256_cmp_ps( scaled, _mm256_set1_ps(  2147483520.0f ), _CMP_GE_OQ ) ) ) ;
+        r = _mm256_blendv_epi8( r, _mm256_set1_epi32( q16::min().raw() ), _mm256_castps_si256( _mm256_cmp_ps( scaled, _mm256_set1_ps( -2147483520.0f ), _CMP_LE_OQ ) ) ) ;
+        r = _mm256_and_si256( r, _mm256_castps_si256( _mm256_cmp_ps( scaled, scaled, _CMP_ORD_Q ) ) ) ;
+
+        _store( _dst_, r ) ;
+}
+
+inline void from_int ( lanes & _dst_, int const * _src_ ) noexcept
+{
+        __m256i const v = _load( _src_ ) ;
+
+        __m256i r = _mm256_slli_epi32( _mm256_max_epi32( v, _mm256_set1_epi32( -32768 ) ), q16::frac_bits ) ;
+
+        r = _mm256_blendv_epi8( r, _mm256_set1_epi32( q16::max().raw() ), _mm256_cmpgt_epi32( v, _mm256_set1_epi32( 32767 ) ) ) ;
+
+        _store( _dst_, r ) ;
+}
+
+inline void add ( lanes & _dst_, lanes const & _a_, lanes const & _b_ ) noexcept
+{
+        __m256i const a = _load( _a_ ) ;
+        __m256i const b = _load( _b_ ) ;
+        __m256i const s = _mm256_add_epi32( a, b ) ;
+
+        // overflowed if both inputs share a sign the sum doesn't have
+        __m256i const overflow  = _mm256_srai_epi32( _mm256_andnot_si256( _mm256_xor_si256( a, b ), _mm256_xor_si256( a, s ) ), 31 ) ;
+        __m256i const saturated = _mm256_xor_si256( _mm256_srai_epi32( a, 31 ), _mm256_set1_epi32( q16::max().raw() ) ) ;
+
+        _store( _dst_, _mm256_blendv_epi8( s, saturated, overflow ) ) ;
+}
+
+inline void neg ( lanes & _dst_, lanes const & _a_ ) noexcept
+{
+        __m256i const a = _load( _a_ ) ;
+
+        _store( _dst_, _mm256_xor_si256( _mm256_sub_epi32( _mm256_setzero_si256(), a ), _mm256_cmpeq_epi32( a, _mm256_set1_epi32( q16::min().raw() ) ) ) ) ;
+}
+
+inline void abs ( lanes & _dst_, lanes const & _a_ ) noexcept
+{
+        __m256i const r = _mm256_abs_epi32( _load( _a_ ) ) ;
+
+        _store( _dst_, _mm256_xor_si256( r, _mm256_srai_epi32( r, 31 ) ) ) ;
+}
+
+inline void clamp ( lanes & _dst_, lanes const & _a_, q16 _lo_, q16 _hi_ ) noexcept
+{
+        __m256i const a  = _load( _a_ ) ;
+        __m256i const lo = _mm256_set1_epi32( _lo_.raw() ) ;
+        __m256i const hi = _mm256_set1_epi32( _hi_.raw() ) ;
+
+        __m256i r = _mm256_blendv_epi8( a, hi, _mm256_cmpgt_epi32( a, hi ) ) ;
+
+        _store( _dst_, _mm256_blendv_epi8( r, lo, _mm256_cmpgt_epi32( lo, a ) ) ) ;
+}
+
+inline void less ( lanes & _dst_, lanes const & _a_, q16 _k_ ) noexcept
+{
+        __m256i const lt = _mm256_cmpgt_epi32( _mm256_set1_epi32( _k_.raw() ), _load( _a_ ) ) ;
+
+        _store( _dst_, _mm256_and_si256( lt, _mm256_set1_epi32( q16::one_raw ) ) ) ;
+}
+
+inline void greater_equal ( lanes & _dst_, lanes const & _a_, q16 _k_ ) noexcept
+{
+        __m256i const lt = _mm256_cmpgt_epi32( _mm256_set1_epi32( _k_.raw() ), _load( _a_ ) ) ;
+
+        _store( _dst_, _mm256_andnot_si256( lt, _mm256_set1_epi32( q16::one_raw ) ) ) ;
+}
+
+inline void equal ( lanes & _dst_, lanes const & _a_, q16 _k_ ) noexcept
+{
+        __m256i const eq = _mm256_cmpeq_epi32( _load( _a_ ), _mm256_set1_epi32( _k_.raw() ) ) ;
+
+        _store( _dst_, _mm256_and_si256( eq, _mm256_set1_epi32( q16::one_raw ) ) ) ;
+}
+
+inline void select ( lanes & _dst_, lanes const & _cond_, lanes const & _a_, lanes const & _b_ ) noexcept
+{
+        __m256i const take = _mm256_cmpgt_epi32( _load( _cond_ ), _mm256_set1_epi32( q16::half_raw ) ) ;
+
+        _store( _dst_, _mm256_blendv_epi8( _load( _b_ ), _load( _a_ ), take ) ) ;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
+#elif defined( FFFB_SIMD_SSE )
+
+inline __m128i _load  ( uti::i32_t const * _src_ ) noexcept { return _mm_loadu_si128( reinterpret_cast< __m128i const * >( _src_ ) ) ; }
+inline void    _store ( uti::i32_t * _dst_, __m128i _v_ ) noexcept { _mm_storeu_si128( reinterpret_cast< __m128i * >( _dst_ ), _v_ ) ; }
+
+inline void from_float ( lanes & _dst_, float const * _src_ ) noexcept
+{
+        for( uti::i32_t i = 0; i < FFFB_SIMD_LANES; i += 4 )
+        {
+                __m128 const scaled = _mm_mul_ps( _mm_loadu_ps( _src_ + i ), _mm_set1_ps( static_cast< float >( q16::one_raw ) ) ) ;
+
+                __m128 const half = _mm_blendv_ps( _mm_set1_ps( 0.5f ), _mm_set1_ps( -0.5f ), _mm_cmplt_ps( scaled, _mm_setzero_ps() ) ) ;
+
+                __m128i r = _mm_cvttps_epi32( _mm_add_ps( scaled, half ) ) ;
+
+                r = _mm_blendv_epi8( r, _mm_set1_epi32( q16::max().raw() ), _mm_castps_si128( _mm_cmpge_ps( scaled, _mm_set1_ps(  2147483520.0f ) ) ) ) ;
+                r = _mm_blendv_epi8( r, _mm_set1_epi32( q16::min().raw() ), _mm_castps_si128( _mm_cmple_ps( scaled, _mm_set1_ps( -2147483520.0f ) ) ) ) ;
+                r = _mm_and_si128( r, _mm_castps_si128( _mm_cmpord_ps( scaled, scaled ) ) ) ;
+
+                _store( _dst_ + i, r ) ;
+        }
+}
+
+inline void from_int ( lanes & _dst_, int const * _src_ ) noexcept
+{
+        for( uti::i32_t i = 0; i < FFFB_SIMD_LANES; i += 4 )
+        {
+                __m128i const v = _load( _src_ + i ) ;
+
+                __m128i r = _mm_slli_epi32( _mm_max_epi32( v, _mm_set1_epi32( -32768 ) ), q16::frac_bits ) ;
+
+                _store( _dst_ + i, _mm_blendv_epi8( r, _mm_set1_epi32( q16::max().raw() ), _mm_cmpgt_epi32( v, _mm_set1_epi32( 32767 ) ) ) ) ;
+        }
+}
+
+inline void add ( lanes & _dst_, lanes const & _a_, lanes const & _b_ ) noexcept
+{
+        for( uti::i32_t i = 0; i < FFFB_SIMD_LANES; i += 4 )
+        {
+                __m128i const a = _load( _a_ + i ) ;
+                __m128i const b = _load( _b_ + i ) ;
+                __m128i const s = _mm_add_epi32( a, b ) ;
+
+                __m128i const overflow  = _mm_srai_epi32( _mm_andnot_si128( _mm_xor_si128( a, b ), _mm_xor_si128( a, s ) ), 31 ) ;
+                __m128i const saturated = _mm_xor_si128( _mm_srai_epi32( a, 31 ), _mm_set1_epi32( q16::max().raw() ) ) ;
+
+                _store( _dst_ + i, _mm_blendv_epi8( s, saturated, overflow ) ) ;
+        }
+}
+
+inline void neg ( lanes & _dst_, lanes const & _a_ ) noexcept
+{
+        for( uti::i32_t i = 0; i < FFFB_SIMD_LANES; i += 4 )
+        {
+                __m128i const a = _load( _a_ + i ) ;
+
+                _store( _dst_ + i, _mm_xor_si128( _mm_sub_epi32( _mm_setzero_si128(), a ), _mm_cmpeq_epi32( a, _mm_set1_epi32( q16::min().raw() ) ) ) ) ;
+        }
+}
+
+inline void abs ( lanes & _dst_, lanes const & _a_ ) noexcept
+{
+        for( uti::i32_t i = 0; i < FFFB_SIMD_LANES; i += 4 )
+        {
+                __m128i const r = _mm_abs_epi32( _load( _a_ + i ) ) ;
+
+                _store( _dst_ + i, _mm_xor_si128( r, _mm_srai_epi32( r, 31 ) ) ) ;
+        }
+}
+
+inline void clamp ( lanes & _dst_, lanes const & _a_, q16 _lo_, q16 _hi_ ) noexcept
+{
+        __m128i const lo = _mm_set1_epi32( _lo_.raw() ) ;
+        __m128i const hi = _mm_set1_epi32( _hi_.raw() ) ;
+
+        for( uti::i32_t i = 0; i < FFFB_SIMD_LANES; i += 4 )
+        {
+                __m128i const a = _load( _a_ + i ) ;
+                __m128i       r = _mm_blendv_epi8( a, hi, _mm_cmpgt_epi32( a, hi ) ) ;
+
+                _store( _dst_ + i, _mm_blendv_epi8( r, lo, _mm_cmplt_epi32( a, lo ) ) ) ;
+        }
+}
+
+inline void less ( lanes & _dst_, lanes const & _a_, q16 _k_ ) noexcept
+{
+        for( uti::i32_t i = 0; i < FFFB_SIMD_LANES; i += 4 )
+        {
+                _store( _dst_ + i, _mm_and_si128( _mm_cmplt_epi32( _load( _a_ + i ), _mm_set1_epi32( _k_.raw() ) ), _mm_set1_epi32( q16::one_raw ) ) ) ;
+        }
+}
+
+inline void greater_equal ( lanes & _dst_, lanes const & _a_, q16 _k_ ) noexcept
+{
+        for( uti::i32_t i = 0; i < FFFB_SIMD_LANES; i += 4 )
+        {
+                _store( _dst_ + i, _mm_andnot_si128( _mm_cmplt_epi32( _load( _a_ + i ), _mm_set1_epi32( _k_.raw() ) ), _mm_set1_epi32( q16::one_raw ) ) ) ;
+        }
+}
+
+inline void equal ( lanes & _dst_, lanes const & _a_, q16 _k_ ) noexcept
+{
+        for( uti::i32_t i = 0; i < FFFB_SIMD_LANES; i += 4 )
+        {
+                _store( _dst_ + i, _mm_and_si128( _mm_cmpeq_epi32( _load( _a_ + i ), _mm_set1_epi32( _k_.raw() ) ), _mm_set1_epi32( q16::one_raw ) ) ) ;
+        }
+}
+
+inline void select ( lanes & _dst_, lanes const & _cond_, lanes const & _a_, lanes const & _b_ ) noexcept
+{
+        for( uti::i32_t i = 0; i < FFFB_SIMD_LANES; i += 4 )
+        {
+                __m128i const take = _mm_cmpgt_epi32( _load( _cond_ + i ), _mm_set1_epi32( q16::half_raw ) ) ;
+
+                _store( _dst_ + i, _mm_blendv_epi8( _load( _b_ + i ), _load( _a_ + i ), take ) ) ;
+        }
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
+#elif defined( FFFB_SIMD_NEON )
+
+inline void from_float ( lanes & _dst_, float const * _src_ ) noexcept
+{
+        for( uti::i32_t i = 0; i < FFFB_SIMD_LANES; i += 4 )
+        {
+                float32x4_t const scaled = vmulq_n_f32( vld1q_f32( _src_ + i ), static_cast< float >( q16::one_raw ) ) ;
+
+                float32x4_t const half = vbslq_f32( vcltq_f32( scaled, vdupq_n_f32( 0.0f ) ), vdupq_n_f32( -0.5f ), vdupq_n_f32( 0.5f ) ) ;
+
+                // truncates like the scalar cast, nan comes out as 0
+                int32x4_t r = vcvtq_s32_f32( vaddq_f32( scaled, half ) ) ;
+
+                r = vbslq_s32( vcgeq_f32( scaled, vdupq_n_f32(  2147483520.0f ) ), vdupq_n_s32( q16::max().raw() ), r ) ;
+                r = vbslq_s32( vcleq_f32( scaled, vdupq_n_f32( -2147483520.0f ) ), vdupq_n_s32( q16::min().raw() ), r ) ;
+
+                vst1q_s32( _dst_ + i, r ) ;
+        }
+}
+
+inline void from_int ( lanes & _dst_, int const * _src_ ) noexcept
+{
+        for( uti::i32_t i = 0; i < FFFB_SIMD_LANES; i += 4 )
+        {
+                vst1q_s32( _dst_ + i, vqshlq_n_s32( vld1q_s32( _src_ + i ), q16::frac_bits ) ) ;
+        }
+}
+
+inline void add ( lanes & _dst_, lanes const & _a_, lanes const & _b_ ) noexcept
+{
+        for( uti::i32_t i = 0; i < FFFB_SIMD_LANES; i += 4 )
+        {
+                vst1q_s32( _dst_ + i, vqaddq_s32( vld1q_s32( _a_ + i ), vld1q_s32( _b_ + i ) ) ) ;
+        }
+}
+
+inline void neg ( lanes & _dst_, lanes const & _a_ ) noexcept
+{
+        for( uti::i32_t i = 0; i < FFFB_SIMD_LANES; i += 4 ) vst1q_s32( _dst_ + i, vqnegq_s32( vld1q_s32( _a_ + i ) ) ) ;
+}
+
+inline void abs ( lanes & _dst_, lanes const & _a_ ) noexcept
+{
+        for( uti::i32_t i = 0; i < FFFB_SIMD_LANES; i += 4 ) vst1q_s32( _dst_ + i, vqabsq_s32( vld1q_s32( _a_ + i ) ) ) ;
+}
+
+inline void clamp ( lanes & _dst_, lanes const & _a_, q16 _lo_, q16 _hi_ ) noexcept
+{
+        int32x4_t const lo = vdupq_n_s32( _lo_.raw() ) ;
+        int32x4_t const hi = vdupq_n_s32( _hi_.raw() ) ;
+
+        for( uti::i32_t i = 0; i < FFFB_SIMD_LANES; i += 4 )
+        {
+                int32x4_t const a = vld1q_s32( _a_ + i ) ;
+                int32x4_t       r = vbslq_s32( vcgtq_s32( a, hi ), hi, a ) ;
+
+                vst1q_s32( _dst_ + i, vbslq_s32( vcltq_s32( a, lo ), lo, r ) ) ;
+        }
+}
+
+inline void less ( lanes & _dst_, lanes const & _a_, q16 _k_ ) noexcept
+{
+        for( uti::i32_t i = 0; i < FFFB_SIMD_LANES; i += 4 )
+        {
+                uint32x4_t const m = vcltq_s32( vld1q_s32( _a_ + i ), vdupq_n_s32( _k_.raw() ) ) ;
+
+                vst1q_s32( _dst_ + i, vandq_s32( vreinterpretq_s32_u32( m ), vdupq_n_s32( q16::one_raw ) ) ) ;
+        }
+}
+
+inline void greater_equal ( lanes & _dst_, lanes const & _a_, q16 _k_ ) noexcept
+{
+        for( uti::i32_t i = 0; i < FFFB_SIMD_LANES; i += 4 )
+        {
+                uint32x4_t const m = vcgeq_s32( vld1q_s32( _a_ + i ), vdupq_n_s32( _k_.raw() ) ) ;
+
+                vst1q_s32( _dst_ + i, vandq_s32( vreinterpretq_s32_u32( m ), vdupq_n_s32( q16::one_raw ) ) ) ;
+        }
+}
+
+inline void equal ( lanes & _dst_, lanes const & _a_, q16 _k_ ) noexcept
+{
+        for( uti::i32_t i = 0; i < FFFB_SIMD_LANES; i += 4 )
+        {
+                uint32x4_t const m = vceqq_s32( vld1q_s32( _a_ + i ), vdupq_n_s32( _k_.raw() ) ) ;
+
+                vst1q_s32( _dst_ + i, vandq_s32( vreinterpretq_s32_u32( m ), vdupq_n_s32( q16::one_raw ) ) ) ;
+        }
+}
+
+inline void select ( lanes & _dst_, lanes const & _cond_, lanes const & _a_, lanes const & _b_ ) noexcept
+{
+        for( uti::i32_t i = 0; i < FFFB_SIMD_LANES; i += 4 )
+        {
+                uint32x4_t const take = vcgtq_s32( vld1q_s32( _cond_ + i ), vdupq_n_s32( q16::half_raw ) ) ;
+
+                vst1q_s32( _dst_ + i, vbslq_s32( take, vld1q_s32( _a_ + i ), vld1q_s32( _b_ + i ) ) ) ;
+        }
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
+#else
+
+inline void from_float ( lanes & _dst_, float const * _src_ ) noexcept
+{
+        for( uti::i32_t i = 0; i < FFFB_SIMD_LANES; ++i ) _dst_[ i ] = q16::from_float( _src_[ i ] ).raw() ;
+}
+
+inline void from_int ( lanes & _dst_, int const * _src_ ) noexcept
+{
+        for( uti::i32_t i = 0; i < FFFB_SIMD_LANES; ++i ) _dst_[ i ] = q16::from_int( _src_[ i ] ).raw() ;
+}
+
+inline void add ( lanes & _dst_, lanes const & _a_, lanes const & _b_ ) noexcept
+{
+        for( uti::i32_t i = 0; i < FFFB_SIMD_LANES; ++i ) _dst_[ i ] = ( q16::from_raw( _a_[ i ] ) + q16::from_raw( _b_[ i ] ) ).raw() ;
+}
+
+inline void neg ( lanes & _dst_, lanes const & _a_ ) noexcept
+{
+        for( uti::i32_t i = 0; i < FFFB_SIMD_LANES; ++i ) _dst_[ i ] = ( -q16::from_raw( _a_[ i ] ) ).raw() ;
+}
+
+inline void abs ( lanes & _dst_, lanes const & _a_ ) noexcept
+{
+        for( uti::i32_t i = 0; i < FFFB_SIMD_LANES; ++i ) _dst_[ i ] = q16_abs( q16::from_raw( _a_[ i ] ) ).raw() ;
+}
+
+inline void clamp ( lanes & _dst_, lanes const & _a_, q16 _lo_, q16 _hi_ ) noexcept
+{
+        for( uti::i32_t i = 0; i < FFFB_SIMD_LANES; ++i ) _dst_[ i ] = q16_clamp( q16::from_raw( _a_[ i ] ), _lo_, _hi_ ).raw() ;
+}
+
+inline void less ( lanes & _dst_, lanes const & _a_, q16 _k_ ) noexcept
+{
+        for( uti::i32_t i = 0; i < FFFB_SIMD_LANES; ++i ) _dst_[ i ] = _a_[ i ] < _k_.raw() ? q16::one_raw : 0 ;
+}
+
+inline void greater_equal ( lanes & _dst_, lanes const & _a_, q16 _k_ ) noexcept
+{
+        for( uti::i32_t i = 0; i < FFFB_SIMD_LANES; ++i ) _dst_[ i ] = _a_[ i ] >= _k_.raw() ? q16::one_raw : 0 ;
+}
+
+inline void equal ( lanes & _dst_, lanes const & _a_, q16 _k_ ) noexcept
+{
+        for( uti::i32_t i = 0; i < FFFB_SIMD_LANES; ++i ) _dst_[ i ] = _a_[ i ] == _k_.raw() ? q16::one_raw : 0 ;
+}
+
+inline void select ( lanes & _dst_, lanes const & _cond_, lanes const & _a_, lanes const & _b_ ) noexcept
+{
+        for( uti::i32_t i = 0; i < FFFB_SIMD_LANES; ++i ) _dst_[ i ] = _cond_[ i ] > q16::half_raw ? _a_[ i ] : _b_[ i ] ;
+}
+
+#endif
+
+////////////////////////////////////////////////////////////////////////////////
+
+// no vector backend has a rounded 32x32->64 multiply, these go lane by lane on every target
+
+inline void mul ( lanes & _dst_, lanes const & _a_, lanes const & _b_ ) noexcept
+{
+        for( uti::i32_t i = 0; i < FFFB_SIMD_LANES; ++i ) _dst_[ i ] = ( q16::from_raw( _a_[ i ] ) * q16::from_raw( _b_[ i ] ) ).raw() ;
+}
+
+inline void affine ( lanes & _dst_, lanes const & _a_, q16 _scale_, q16 _offset_ ) noexcept
+{
+        for( uti::i32_t i = 0; i < FFFB_SIMD_LANES; ++i ) _dst_[ i ] = ( q16::from_raw( _a_[ i ] ) * _scale_ + _offset_ ).raw() ;
+}
+
+inline void broadcast ( lanes & _dst_, q16 _value_ ) noexcept
+{
+        for( uti::i32_t i = 0; i < FFFB_SIMD_LANES; ++i ) _dst_[ i ] = _value_.raw() ;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
+
+} // namespace fffb::simd
@@ -0,0 +1,119 @@
+//
+//
+//      fffb
+//      util/histogram.hxx
+//
+
+#pragma once
+
+#include <fffb/util/types.hxx>
+
+#include <bit>
+
+// values below this go in a bucket of their own
+#define FFFB_HISTOGRAM_LINEAR 32
+
+// buckets per power of two above that, an eighth of an octave wide
+#define FFFB_HISTOGRAM_SUB_BUCKETS 8
+
+#define FFFB_HISTOGRAM_BUCKETS ( FFFB_HISTOGRAM_LINEAR + ( 32 - 5 ) * FFFB_HISTOGRAM_SUB_BUCKETS )
+
+
+namespace fffb
+{
+
+
+////////////////////////////////////////////////////////////////////////////////
+
+// counts of 32 bit values in fixed log scale buckets, for durations in
+// nanoseconds that's up to about 4 seconds at 12.5% resolution. adding is a
+// few instructions and never allocates, percentiles come back as the upper
+// edge of the bucket they fall in
+
+class log_histogram
+{
+public:
+        constexpr void add ( uti::u64_t _value_ ) noexcept
+        {
+                uti::u32_t const value = _value_ < 0xFFFFFFFF ? static_cast< uti::u32_t >( _value_ ) : 0xFFFFFFFF ;
+
+                ++counts_[ bucket( value ) ] ;
+                ++count_ ;
+                sum_ += value ;
+
+                if( value > max_ ) max_ = value ;
+        }
+
+        constexpr void reset () noexcept { *this = log_histogram{} ; }
+
+        [[ nodiscard ]] constexpr uti::u64_t count () const noexcept { return count_ ; }
+        [[ nodiscard ]] constexpr uti::u32_t   max () const noexcept { return   max_ ; }
+
+        [[ nodiscard ]] constexpr double mean () const noexcept
+        { return count_ ? static_cast< double >( sum_ ) / static_cast< double >( count_ ) : 0.0 ; }
+
+        // _q_ in [ 0, 1 ], never above the largest value seen
+        [[ nodiscard ]] constexpr uti::u32_t percentile ( double _q_ ) const noexcept ;
+
+        [[ nodiscard ]] static constexpr uti::u32_t bucket ( uti::u32_t _value_ ) noexcept
+        {
+                if( _value_ < FFFB_HISTOGRAM_LINEAR ) return _value_ ;
+
+                uti::u32_t const octave = static_cast< uti::u32_t >( std::bit_width( _value_ ) ) - 1 ;
+                uti::u32_t const    sub = ( _value_ >> ( octave - 3 ) ) & ( FFFB_HISTOGRAM_SUB_BUCKETS - 1 ) ;
+
+                return FFFB_HISTOGRAM_LINEAR + ( octave - 5 ) * FFFB_HISTOGRAM_SUB_BUCKETS + sub ;
+        }
+
+        // the smallest value landing in _bucket_
+        [[ nodiscard ]] static constexpr uti::u64_t lower_edge ( uti::u32_t _bucket_ ) noexcept
+        {
+                if( _bucket_ < FFFB_HISTOGRAM_LINEAR ) return _bucket_ ;
+
+                uti::u32_t const octave = 5 + ( _bucket_ - FFFB_HISTOGRAM_LINEAR ) / FFFB_HISTOGRAM_SUB_BUCKETS ;
+                uti::u32_t const    sub =     ( _bucket_ - FFFB_HISTOGRAM_LINEAR ) % FFFB_HISTOGRAM_SUB_BUCKETS ;
+
+                return static_cast< uti::u64_t >( FFFB_HISTOGRAM_SUB_BUCKETS + sub ) << ( octave - 3 ) ;
+        }
+private:
+        uti::u32_t counts_ [ FFFB_HISTOGRAM_BUCKETS ] {} ;
+
+        uti::u64_t count_ { 0 } ;
+        uti::u64_t   sum_ { 0 } ;
+        uti::u32_t   max_ { 0 } ;
+} ;
+
+static_assert( log_histogram::bucket( 0xFFFFFFFF ) == FFFB_HISTOGRAM_BUCKETS - 1 ) ;
+static_assert( log_histogram::lower_edge( log_histogram::bucket( 1000 ) ) <= 1000 && 1000 < log_histogram::lower_edge( log_histogram::bucket( 1000 ) + 1 ) ) ;
+
+////////////////////////////////////////////////////////////////////////////////
+////////////////////////////////////////////////////////////////////////////////
+
+constexpr uti::u32_t log_histogram::percentile ( double _q_ ) const noexcept
+{
+        if( count_ == 0 ) return 0 ;
+
+        double const q = _q_ < 0.0 ? 0.0 : _q_ > 1.0 ? 1.0 : _q_ ;
+
+        // the rank of the value asked for, 1 based
+        uti::u64_t const rank = static_cast< uti::u64_t >( q * static_cast< double >( count_ - 1 ) ) + 1 ;
+
+        uti::u64_t seen { 0 } ;
+
+        for( uti::u32_t bucket = 0; bucket < FFFB_HISTOGRAM_BUCKETS; ++bucket )
+        {
+                seen += counts_[ bucket ] ;
+
+                if( seen < rank ) continue ;
+
+                uti::u64_t const upper = bucket + 1 < FFFB_HISTOGRAM_BUCKETS ? lower_edge( bucket + 1 ) - 1 : 0xFFFFFFFF ;
+
+                return upper < max_ ? static_cast< uti::u32_t >( upper ) : max_ ;
+        }
+        return max_ ;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
+
+} // namespace fffb
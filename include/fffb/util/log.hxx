@@ -15,7 +15,9 @@
 
 #include <pthread.h>
 
-#define FFFB_LOG_FILE_PATH "/tmp/fffb.log"
+#ifndef   FFFB_LOG_FILE_PATH
+#define   FFFB_LOG_FILE_PATH "/tmp/fffb.log"
+#endif // FFFB_LOG_FILE_PATH
 
 #define FFFB_VTSEQ(ID) ("\x1b[" #ID "m")
 
@@ -0,0 +1,143 @@
+//
+//
+//      fffb
+//      util/seqlock.hxx
+//
+
+#pragma once
+
+#include <fffb/util/types.hxx>
+
+#include <atomic>
+#include <cstring>
+#include <type_traits>
+
+
+namespace fffb
+{
+
+
+////////////////////////////////////////////////////////////////////////////////
+
+// single writer, any number of readers. the writer fills the buffer readers
+// aren't pointed at and publishes it with one release store, so a reader only
+// has to retry when the writer laps it twice during one copy. every buffer
+// carries its own sequence, odd while it's being written, which is what
+// catches that case. the payload is copied as relaxed atomic words, a race
+// between a slow reader and the writer is detected, never undefined
+
+template< typename T >
+class seqlock
+{
+        static_assert( std::is_trivially_copyable_v< T >, "seqlock payload has to be trivially copyable" ) ;
+public:
+        using value_type = T ;
+
+        seqlock () noexcept { for( auto & buffer : buffers_ ) _store( buffer, T{} ) ; }
+
+        explicit seqlock ( T const & _value_ ) noexcept { for( auto & buffer : buffers_ ) _store( buffer, _value_ ) ; }
+
+        seqlock ( seqlock const & ) = delete ;
+        seqlock & operator= ( seqlock const & ) = delete ;
+
+        // writer side only
+        void publish ( T const & _value_ ) noexcept ;
+
+        // a consistent copy of the newest value
+        [[ nodiscard ]] T read () const noexcept ;
+
+        // one attempt, false if the writer got in the way
+        [[ nodiscard ]] bool try_read ( T & _out_ ) const noexcept ;
+
+        // values published so far, changes exactly when read() would return something new
+        [[ nodiscard ]] uti::u64_t version () const noexcept { return published_.load( std::memory_order_acquire ) ; }
+private:
+        static constexpr uti::u32_t words { ( sizeof( T ) + sizeof( uti::u64_t ) - 1 ) / sizeof( uti::u64_t ) } ;
+
+        struct alignas( 64 ) _buffer
+        {
+                std::atomic< uti::u64_t > sequence { 0 } ;
+                std::atomic< uti::u64_t > data [ words ] ;
+        } ;
+
+        _buffer buffers_ [ 2 ] ;
+
+        alignas( 64 ) std::atomic< uti::u64_t > published_ { 0 } ;
+
+        static void _store ( _buffer       & _buffer_, T const & _value_ ) noexcept ;
+        static void _load  ( _buffer const & _buffer_, T       & _value_ ) noexcept ;
+} ;
+
+////////////////////////////////////////////////////////////////////////////////
+////////////////////////////////////////////////////////////////////////////////
+
+template< typename T >
+void seqlock< T >::publish ( T const & _value_ ) noexcept
+{
+        uti::u64_t const next = published_.load( std::memory_order_relaxed ) + 1 ;
+
+        _buffer & buffer = buffers_[ next & 1 ] ;
+
+        uti::u64_t const sequence = buffer.sequence.load( std::memory_order_relaxed ) ;
+
+        buffer.sequence.store( sequence + 1, std::memory_order_relaxed ) ;
+        std::atomic_thread_fence( std::memory_order_release ) ;
+
+        _store( buffer, _value_ ) ;
+
+        buffer.sequence.store( sequence + 2, std::memory_order_release ) ;
+
+        published_.store( next, std::memory_order_release ) ;
+}
+
+template< typename T >
+T seqlock< T >::read () const noexcept
+{
+        T value ;
+
+        while( !try_read( value ) ) {}
+
+        return value ;
+}
+
+template< typename T >
+bool seqlock< T >::try_read ( T & _out_ ) const noexcept
+{
+        _buffer const & buffer = buffers_[ published_.load( std::memory_order_acquire ) & 1 ] ;
+
+        uti::u64_t const before = buffer.sequence.load( std::memory_order_acquire ) ;
+
+        if( before & 1 ) return false ;
+
+        _load( buffer, _out_ ) ;
+
+        std::atomic_thread_fence( std::memory_order_acquire ) ;
+
+        return buffer.sequence.load( std::memory_order_relaxed ) == before ;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
+template< typename T >
+void seqlock< T >::_store ( _buffer & _buffer_, T const & _value_ ) noexcept
+{
+        uti::u64_t raw [ words ] {} ;
+        std::memcpy( raw, &_value_, sizeof( T ) ) ;
+
+        for( uti::u32_t i = 0; i < words; ++i ) _buffer_.data[ i ].store( raw[ i ], std::memory_order_relaxed ) ;
+}
+
+template< typename T >
+void seqlock< T >::_load ( _buffer const & _buffer_, T & _value_ ) noexcept
+{
+        uti::u64_t raw [ words ] ;
+
+        for( uti::u32_t i = 0; i < words; ++i ) raw[ i ] = _buffer_.data[ i ].load( std::memory_order_relaxed ) ;
+
+        std::memcpy( &_value_, raw, sizeof( T ) ) ;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
+
+} // namespace fffb
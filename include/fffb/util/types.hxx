@@ -12,16 +12,21 @@
 #include <uti/core/container/array.hxx>
 #include <uti/core/container/vector.hxx>
 
+// iokit is the only transport to a real wheel, tools built with
+// FFFB_MEMORY_TRANSPORT get devices in memory, see hid/memory_device.hxx
+#ifndef FFFB_MEMORY_TRANSPORT
 #include <IOKit/hid/IOHIDDevice.h>
 #include <IOKit/hid/IOHIDManager.h>
 
 #include <mach/mach_error.h>
+#endif
 
 
 namespace fffb
 {
 
 
+#ifndef FFFB_MEMORY_TRANSPORT
 namespace apple
 {
 
@@ -49,6 +54,7 @@ constexpr bool _try ( io_result result, [[ maybe_unused ]] char const * scope )
 
 
 } // namespace apple
+#endif // FFFB_MEMORY_TRANSPORT
 
 
 using timestamp_t = uti::u64_t ;
@@ -10,6 +10,7 @@
 #include <cassert>
 #include <cstdarg>
 #include <cstring>
+#include <mutex>
 
 /// SDK
 
@@ -26,6 +27,15 @@
 #include <fffb/hid/device.hxx>
 #include <fffb/joy/wheel.hxx>
 #include <fffb/force/simulator.hxx>
+#include <fffb/force/streamer.hxx>
+#include <fffb/force/profile.hxx>
+#include <fffb/force/rate_controller.hxx>
+#include <fffb/force/pipeline.hxx>
+#include <fffb/telemetry/channels.hxx>
+#include <fffb/telemetry/config.hxx>
+#include <fffb/telemetry/recorder.hxx>
+#include <fffb/telemetry/timing.hxx>
+#include <fffb/util/clock.hxx>
 
 
 
@@ -36,7 +46,26 @@ bool g_telemetry_paused { true } ;
 
 fffb::timestamp_t     g_last_timestamp  { static_cast< fffb::timestamp_t >( -1 ) } ;
 fffb::telemetry_state g_telemetry_state {} ;
+
+// what the configuration events said about the truck, and the led thresholds
+// resolved against it. both only change between frames
+fffb::telemetry_config g_telemetry_config {} ;
+fffb::led_ladder       g_leds             {} ;
+
+fffb::channel_subscription g_channels {} ;
+
+// game thread cost of every callback, FFFB_FRAME_BUDGET_US=<us> sets when a frame is kept
+fffb::callback_timing g_timing {} ;
+
+// opt in through FFFB_RECORD=<path>
+fffb::telemetry_recorder g_recorder {} ;
+
 fffb::simulator       g_simulator       {} ;
+fffb::force_streamer  g_streamer        { g_simulator.wheel_ref() } ;
+fffb::task_scheduler  g_scheduler       {} ;
+fffb::rate_controller g_rate            {} ;
+fffb::profile_manager g_profiles        {} ;
+fffb::frame_pipeline  g_pipeline        { g_simulator, g_streamer, g_scheduler, g_rate } ;
 
 scs_log_t g_game_log { nullptr } ;
 
@@ -47,17 +76,16 @@ bool   init_wheel () noexcept ;
 bool  reset_wheel () noexcept ;
 void deinit_wheel () noexcept ;
 
-bool update_leds ( float rpm ) noexcept ;
-bool update_ffb  ( fffb::telemetry_state const & telemetry ) noexcept ;
+bool  start_streaming () noexcept ;
+void dump_diagnostics () noexcept ;
+
+void subscribe_channels ( fffb::force_profile const & profile ) noexcept ;
+bool update_ffb         ( fffb::telemetry_state const & telemetry ) noexcept ;
 
 SCSAPI_VOID telemetry_frame_start ( [[ maybe_unused ]] scs_event_t const event,                    void const * const event_info, [[ maybe_unused ]] scs_context_t const context ) ;
 SCSAPI_VOID telemetry_frame_end   ( [[ maybe_unused ]] scs_event_t const event, [[ maybe_unused ]] void const * const event_info, [[ maybe_unused ]] scs_context_t const context ) ;
 SCSAPI_VOID telemetry_pause       (                    scs_event_t const event, [[ maybe_unused ]] void const * const event_info, [[ maybe_unused ]] scs_context_t const context ) ;
-
-SCSAPI_VOID telemetry_store_orientation ( [[ maybe_unused ]] scs_string_t const name, [[ maybe_unused ]] scs_u32_t const index, scs_value_t const * const value, scs_context_t const context ) ;
-SCSAPI_VOID telemetry_store_float       ( [[ maybe_unused ]] scs_string_t const name, [[ maybe_unused ]] scs_u32_t const index, scs_value_t const * const value, scs_context_t const context ) ;
-SCSAPI_VOID telemetry_store_s32         ( [[ maybe_unused ]] scs_string_t const name, [[ maybe_unused ]] scs_u32_t const index, scs_value_t const * const value, scs_context_t const context ) ;
-SCSAPI_VOID telemetry_store_u32         ( [[ maybe_unused ]] scs_string_t const name, [[ maybe_unused ]] scs_u32_t const index, scs_value_t const * const value, scs_context_t const context ) ;
+SCSAPI_VOID telemetry_configure   ( [[ maybe_unused ]] scs_event_t const event,                    void const * const event_info, [[ maybe_unused ]] scs_context_t const context ) ;
 
 SCSAPI_RESULT scs_telemetry_init     ( scs_u32_t const version, scs_telemetry_init_params_t const * const params ) ;
 SCSAPI_VOID   scs_telemetry_shutdown (                                                                           ) ;
@@ -80,28 +108,25 @@ bool init_wheel () noexcept
         return true ;
 }
 
-bool update_leds ( float rpm ) noexcept
+void subscribe_channels ( fffb::force_profile const & profile ) noexcept
 {
-        static constexpr uti::u8_t led_0 { 0x00 } ;
-        static constexpr uti::u8_t led_1 { 0x01 } ;
-        static constexpr uti::u8_t led_2 { 0x03 } ;
-        static constexpr uti::u8_t led_3 { 0x07 } ;
-        static constexpr uti::u8_t led_4 { 0x0F } ;
-        static constexpr uti::u8_t led_5 { 0x1F } ;
-
-        if(      rpm ==   0 ) { return g_simulator.wheel_ref().set_led_pattern( led_0 ) ; }
-        else if( rpm < 1000 ) { return g_simulator.wheel_ref().set_led_pattern( led_1 ) ; }
-        else if( rpm < 1300 ) { return g_simulator.wheel_ref().set_led_pattern( led_2 ) ; }
-        else if( rpm < 1600 ) { return g_simulator.wheel_ref().set_led_pattern( led_3 ) ; }
-        else if( rpm < 1800 ) { return g_simulator.wheel_ref().set_led_pattern( led_4 ) ; }
-        else if( rpm < 1900 ) { return g_simulator.wheel_ref().set_led_pattern( led_5 ) ; }
-        else                  { return g_simulator.wheel_ref().set_led_pattern( led_5 ) ; }
+        // the predictor, the rate controller and the leds read these whatever the effects do
+        constexpr uti::u32_t plugin_fields = fffb::field_bit( fffb::telemetry_field::steering )
+                                           | fffb::field_bit( fffb::telemetry_field::speed    )
+                                           | fffb::field_bit( fffb::telemetry_field::rpm      ) ;
+
+        if( uti::u32_t const failed = g_channels.update( profile.program.field_mask | plugin_fields, g_telemetry_config.constants().wheel_count ) )
+        {
+                FFFB_F_WARN_S( "scs::subscribe_channels", "%u channel registrations failed", failed ) ;
+        }
 }
 
 bool reset_wheel () noexcept
 {
         FFFB_F_INFO_S( "scs::reset_wheel", "resetting wheel" ) ;
 
+        std::lock_guard< std::mutex > io_lock( g_streamer.io_mutex() ) ;
+
         return g_simulator.wheel_ref() ? g_simulator.wheel_ref().q_disable_autocenter()
                                        , g_simulator.wheel_ref().q_stop_forces()
                                        , g_simulator.wheel_ref().q_set_led_pattern( 0 )
@@ -112,28 +137,142 @@ bool reset_wheel () noexcept
 
 bool update_ffb ( fffb::telemetry_state const & telemetry ) noexcept
 {
-        if( !g_simulator.wheel_ref() ) return false ;
+        fffb::timed_scope const timed( g_timing, fffb::timed_callback::update_ffb ) ;
 
-        static uti::i32_t ffb_rate       { 32 } ;
-        static uti::i32_t ffb_rate_count { 32 } ;
+        if( !g_simulator.wheel_ref() ) return false ;
 
-        --ffb_rate_count ;
+        fffb::force_profile const & profile = g_profiles.current() ;
 
-        if( ffb_rate_count == 0 )
+        if( g_pipeline.apply_profile( profile ) )
         {
-                g_simulator.update_forces( telemetry ) ;
-                update_leds( telemetry.rpm ) ;
+                g_leds = profile.leds( g_telemetry_config.constants().rpm_limit ) ;
+
+                subscribe_channels( profile ) ;
 
-                ffb_rate_count = ffb_rate ;
+                g_profiles.applied( profile ) ;
         }
-        return true ;
+        uti::u64_t const reports = g_simulator.wheel_ref().reports_written() ;
+
+        bool const ok = g_pipeline.update( telemetry, g_leds ) ;
+
+        g_timing.note_update( g_pipeline.last_due(), g_simulator.wheel_ref().reports_written() - reports ) ;
+
+        return ok ;
+}
+
+void deinit_wheel () noexcept
+{
+        g_profiles.stop() ;
+        g_streamer.stop() ;
+        g_recorder.stop() ;
+}
+
+bool start_streaming () noexcept
+{
+        // the hid++ path only knows the constant effect, so that's where streaming pays off
+        if( g_simulator.wheel_ref().protocol() != fffb::ffb_protocol::logitech_hidpp )
+        {
+                return true ;
+        }
+        g_streamer.suspend() ;
+
+        // the stream thread owns the constant slot from here on
+        g_scheduler.set_period( fffb::ffb_task::constant, 0 ) ;
+
+        return g_streamer.start( FFFB_STREAM_RATE_HZ, fffb::stream_mode::interpolate ) ;
 }
 
-void deinit_wheel () noexcept {}
+void dump_diagnostics () noexcept
+{
+        [[ maybe_unused ]] auto const & predictor = g_simulator.predictor_ref() ;
+        FFFB_F_INFO_S( "scs::diagnostics", "latency : pipeline mean=%luus max=%luus, update interval mean=%luus, lead=%luus",
+                       predictor.pipeline_latency().mean_us(), predictor.pipeline_latency().max_us(),
+                       predictor.update_interval().mean_us(), predictor.lead_us() ) ;
+
+        if( g_streamer.running() )
+        {
+                [[ maybe_unused ]] fffb::stream_stats const s = g_streamer.stats() ;
+                FFFB_F_INFO_S( "scs::diagnostics", "stream %u Hz lead=%luus : ticks=%lu writes=%lu skipped=%lu failures=%lu overruns=%lu jitter mean=%.1fus rms=%.1fus max=%.1fus",
+                               g_streamer.rate_hz(), predictor.lead_us( g_streamer.period_us() ), s.ticks, s.writes, s.skipped, s.failures, s.overrun, s.jitter_mean_us(), s.jitter_rms_us(), s.jitter_max_us ) ;
+        }
+        std::lock_guard< std::mutex > io_lock( g_streamer.io_mutex() ) ;
+
+        constexpr char const * force_names [] { "constant", "spring", "damper", "trapezoid" } ;
+
+        for( uti::u8_t type = 0; type < static_cast< uti::u8_t >( fffb::force_type::COUNT ); ++type )
+        {
+                [[ maybe_unused ]] fffb::delta_gate_stats const & g = g_simulator.wheel_ref().gate_stats( static_cast< fffb::force_type >( type ) ) ;
+                FFFB_F_INFO_S( "scs::diagnostics", "%s updates : sent=%lu stale=%lu identical=%lu suppressed=%lu",
+                               force_names[ type ], g.sent, g.stale, g.identical, g.suppressed ) ;
+        }
+        for( uti::u8_t slot = 0; slot < static_cast< uti::u8_t >( fffb::filter_slot::count ); ++slot )
+        {
+                [[ maybe_unused ]] fffb::clip_window const & c = g_simulator.clip_stats( static_cast< fffb::filter_slot >( slot ) ) ;
+                FFFB_F_INFO_S( "scs::diagnostics", "%s levels : clipped=%.1f%% of %u peak=%.3f rms=%.3f",
+                               force_names[ slot ], c.clip_ratio().to_float() * 100.0f, c.count(), c.peak().to_float(), c.rms() ) ;
+        }
+        FFFB_F_INFO_S( "scs::diagnostics", "master gain %.3f", g_simulator.gain().to_float() ) ;
+
+        [[ maybe_unused ]] fffb::plan_log    const & plans = g_simulator.wheel_ref().plans() ;
+        [[ maybe_unused ]] fffb::plan_totals const & t     = plans.totals() ;
+        FFFB_F_INFO_S( "scs::diagnostics", "command plans : executed=%lu empty=%lu failed=%lu, stops=%lu downloads=%lu refreshes=%lu reports=%lu",
+                       t.plans, t.empty, t.failed, t.stops, t.downloads, t.refreshes, t.reports ) ;
+
+        for( uti::u32_t age = 0; age < plans.size() && age < 8; ++age )
+        {
+                [[ maybe_unused ]] fffb::command_plan const & p = plans.recent( age ) ;
+                FFFB_F_INFO_S( "scs::diagnostics", "plan -%u @%luus : stop=%x download=%x refresh=%x autocenter=%s leds=%s reports=%u%s",
+                               age, p.at_us, p.stop, p.download, p.refresh, p.set_autocenter ? ( p.autocenter ? "on" : "off" ) : "-",
+                               p.set_leds ? "set" : "-", p.reports, p.ok ? "" : " FAILED" ) ;
+        }
+        [[ maybe_unused ]] fffb::encode_cache_stats const & e = g_simulator.wheel_ref().encode_stats() ;
+        FFFB_F_INFO_S( "scs::diagnostics", "encode cache : hits=%lu misses=%lu evictions=%lu (%.1f%% hit)",
+                       e.hits, e.misses, e.evictions, e.hit_ratio() * 100.0f ) ;
+
+        for( uti::u8_t callback = 0; callback < static_cast< uti::u8_t >( fffb::timed_callback::count ); ++callback )
+        {
+                [[ maybe_unused ]] fffb::log_histogram const & h = g_timing.histogram( static_cast< fffb::timed_callback >( callback ) ) ;
+                FFFB_F_INFO_S( "scs::diagnostics", "%s : calls=%lu mean=%.2fus p50=%.2fus p99=%.2fus max=%.2fus",
+                               fffb::timed_callback_names[ callback ], h.count(), h.mean() * 1e-3,
+                               h.percentile( 0.5 ) * 1e-3, h.percentile( 0.99 ) * 1e-3, h.max() * 1e-3 ) ;
+        }
+        [[ maybe_unused ]] fffb::log_histogram const & frames = g_timing.frames() ;
+        FFFB_F_INFO_S( "scs::diagnostics", "game frames : %lu, fffb took mean=%.2fus p50=%.2fus p99=%.2fus max=%.2fus, %lu over the %luus budget",
+                       frames.count(), frames.mean() * 1e-3, frames.percentile( 0.5 ) * 1e-3, frames.percentile( 0.99 ) * 1e-3, frames.max() * 1e-3,
+                       g_timing.over_budget(), g_timing.budget_us() ) ;
+
+        for( uti::u32_t age = 0; age < g_timing.size() && age < 8; ++age )
+        {
+                [[ maybe_unused ]] fffb::slow_frame const & f = g_timing.recent( age ) ;
+                FFFB_F_INFO_S( "scs::diagnostics", "slow frame -%u #%lu @%luus : total=%.1fus start=%.1fus channels=%u in %.1fus end=%.1fus update=%.1fus due=%x reports=%u",
+                               age, f.frame, f.at_us, f.total_ns * 1e-3, f.frame_start_ns * 1e-3, f.channels, f.channels_ns * 1e-3,
+                               f.frame_end_ns * 1e-3, f.update_ns * 1e-3, f.due, f.reports ) ;
+        }
+
+        if( g_recorder.recording() )
+        {
+                [[ maybe_unused ]] fffb::recorder_stats const rs = g_recorder.stats() ;
+                FFFB_F_INFO_S( "scs::diagnostics", "recorder : records=%lu dropped=%lu segments=%u", rs.records, rs.dropped, rs.segments ) ;
+        }
+        [[ maybe_unused ]] fffb::channel_stats const & ch = g_channels.stats() ;
+        FFFB_F_INFO_S( "scs::diagnostics", "channels : %u registered for fields %x, callbacks per frame mean=%.1f max=%u last=%u",
+                       g_channels.registered(), g_channels.fields(), ch.per_frame(), ch.max_per_frame, ch.last ) ;
+
+        constexpr char const * mode_names [] { "active", "idle" } ;
+
+        for( uti::u8_t mode = 0; mode < static_cast< uti::u8_t >( fffb::rate_mode::count ); ++mode )
+        {
+                [[ maybe_unused ]] fffb::rate_mode_stats const & r = g_rate.stats( static_cast< fffb::rate_mode >( mode ) ) ;
+                FFFB_F_INFO_S( "scs::diagnostics", "%s : %.1fs over %lu frames, cpu=%.2fms/min reports=%.1f/min stream=%.1f/min",
+                               mode_names[ mode ], static_cast< float >( r.time_us ) * 1e-6f, r.frames, r.cpu_ms_per_minute(), r.reports_per_minute(), r.stream_per_minute() ) ;
+        }
+}
 
 
 SCSAPI_VOID telemetry_frame_start ( [[ maybe_unused ]] scs_event_t const event, void const * const event_info, [[ maybe_unused ]] scs_context_t const context )
 {
+        fffb::timed_scope const timed( g_timing, fffb::timed_callback::frame_start ) ;
+
         scs_telemetry_frame_start_t const * const info = static_cast< scs_telemetry_frame_start_t const * >( event_info ) ;
 
         if( g_last_timestamp == static_cast< scs_timestamp_t >( -1 ) )
@@ -150,78 +289,70 @@ SCSAPI_VOID telemetry_frame_start ( [[ maybe_unused ]] scs_event_t const event,
         g_telemetry_state.        raw_rendering_timestamp = info->           render_time ;
         g_telemetry_state.       raw_simulation_timestamp = info->       simulation_time ;
         g_telemetry_state.raw_paused_simulation_timestamp = info->paused_simulation_time ;
+        g_telemetry_state.                 host_timestamp = fffb::host_time_us() ;
+        g_telemetry_state.                      callbacks = 0 ;
 }
 
 SCSAPI_VOID telemetry_frame_end ( [[ maybe_unused ]] scs_event_t const event, [[ maybe_unused ]] void const * const event_info, [[ maybe_unused ]] scs_context_t const context )
 {
+        fffb::timed_scope const timed( g_timing, fffb::timed_callback::frame_end ) ;
+
+        g_channels.count_frame( g_telemetry_state ) ;
+
         if( g_telemetry_paused )
         {
                 return ;
         }
+        g_telemetry_state.rpm_ratio = g_telemetry_config.constants().rpm_ratio( g_telemetry_state.rpm ) ;
+
+
         if( !update_ffb( g_telemetry_state ) )
         {
                 g_game_log( SCS_LOG_TYPE_error, "fffb::error : failed updating force feedback!" ) ;
                 FFFB_F_ERR_S( "scs::telemetry_frame_end", "failed updating force feedback!" ) ;
         }
+        g_recorder.record_frame( g_telemetry_state, g_channels.fields(), g_simulator.outputs(), g_simulator.torque_target() ) ;
 }
 
 SCSAPI_VOID telemetry_pause ( scs_event_t const event, [[ maybe_unused ]] void const * const event_info, [[ maybe_unused ]] scs_context_t const context )
 {
+        fffb::timed_scope const timed( g_timing, fffb::timed_callback::pause ) ;
+
         g_telemetry_paused = ( event == SCS_TELEMETRY_EVENT_paused ) ;
 
+        g_recorder.record_pause( g_telemetry_state, g_telemetry_paused ) ;
+
         if( g_telemetry_paused )
         {
+                g_streamer.suspend() ;
                 reset_wheel() ;
+                dump_diagnostics() ;
                 g_game_log( SCS_LOG_TYPE_message, "fffb::info : telemetry paused, force feedback stopped" ) ;
                 FFFB_F_INFO_S( "scs::telemetry_pause", "telemetry paused, force feedback stopped" ) ;
         }
         else
         {
+                g_scheduler.reset() ;
+                g_streamer.resume() ;
                 FFFB_F_INFO_S( "scs::telemetry_pause", "telemetry unpaused, resuming force feedback" ) ;
         }
 }
 
-SCSAPI_VOID telemetry_store_orientation ( [[ maybe_unused ]] scs_string_t const name, [[ maybe_unused ]] scs_u32_t const index, scs_value_t const * const value, scs_context_t const context )
+SCSAPI_VOID telemetry_configure ( [[ maybe_unused ]] scs_event_t const event, void const * const event_info, [[ maybe_unused ]] scs_context_t const context )
 {
-        assert( context ) ;
+        fffb::timed_scope const timed( g_timing, fffb::timed_callback::configure ) ;
 
-        fffb::telemetry_state * const state = static_cast< fffb::telemetry_state * >( context ) ;
+        scs_telemetry_configuration_t const * const info = static_cast< scs_telemetry_configuration_t const * >( event_info ) ;
 
-        if( !value )
+        if( g_telemetry_config.ingest( *info ) )
         {
-                state->orientation_available = false ;
-                return ;
-        }
-        assert( value ) ;
-        assert( value->type == SCS_VALUE_TYPE_euler ) ;
-        state->orientation_available = true ;
-        state->heading = value->value_euler.heading * 360.0f ;
-        state->  pitch = value->value_euler.  pitch * 360.0f ;
-        state->   roll = value->value_euler.   roll * 360.0f ;
-}
+                g_leds = g_profiles.current().leds( g_telemetry_config.constants().rpm_limit ) ;
 
-SCSAPI_VOID telemetry_store_float ( [[ maybe_unused ]] scs_string_t const name, [[ maybe_unused ]] scs_u32_t const index, scs_value_t const * const value, scs_context_t const context )
-{
-        assert( value ) ;
-        assert( value->type == SCS_VALUE_TYPE_float ) ;
-        assert( context ) ;
-        *static_cast< float * >( context ) = value->value_float.value ;
-}
-
-SCSAPI_VOID telemetry_store_s32 ( [[ maybe_unused ]] scs_string_t const name, [[ maybe_unused ]] scs_u32_t const index, scs_value_t const * const value, scs_context_t const context )
-{
-        assert( value ) ;
-        assert( value->type == SCS_VALUE_TYPE_s32 ) ;
-        assert( context ) ;
-        *static_cast< int * >( context ) = value->value_s32.value ;
-}
+                // the wheel count might have changed
+                subscribe_channels( g_profiles.current() ) ;
 
-SCSAPI_VOID telemetry_store_u32 ( [[ maybe_unused ]] scs_string_t const name, [[ maybe_unused ]] scs_u32_t const index, scs_value_t const * const value, scs_context_t const context )
-{
-        assert( value ) ;
-        assert( value->type == SCS_VALUE_TYPE_u32 ) ;
-        assert( context ) ;
-        *static_cast< int * >( context ) = value->value_u32.value ;
+                g_recorder.record_config( g_telemetry_state, g_telemetry_config.constants() ) ;
+        }
 }
 
 SCSAPI_RESULT scs_telemetry_init ( scs_u32_t const version, scs_telemetry_init_params_t const * const params )
@@ -280,10 +411,11 @@ SCSAPI_RESULT scs_telemetry_init ( scs_u32_t const version, scs_telemetry_init_p
         FFFB_F_INFO_S( "scs::scs_telemetry_init", "registering to events..." ) ;
 
         bool const events_registered =
-                ( version_params->register_for_event( SCS_TELEMETRY_EVENT_frame_start, telemetry_frame_start, nullptr ) == SCS_RESULT_ok ) &&
-                ( version_params->register_for_event( SCS_TELEMETRY_EVENT_frame_end  , telemetry_frame_end  , nullptr ) == SCS_RESULT_ok ) &&
-                ( version_params->register_for_event( SCS_TELEMETRY_EVENT_paused     , telemetry_pause      , nullptr ) == SCS_RESULT_ok ) &&
-                ( version_params->register_for_event( SCS_TELEMETRY_EVENT_started    , telemetry_pause      , nullptr ) == SCS_RESULT_ok )  ;
+                ( version_params->register_for_event( SCS_TELEMETRY_EVENT_frame_start  , telemetry_frame_start, nullptr ) == SCS_RESULT_ok ) &&
+                ( version_params->register_for_event( SCS_TELEMETRY_EVENT_frame_end    , telemetry_frame_end  , nullptr ) == SCS_RESULT_ok ) &&
+                ( version_params->register_for_event( SCS_TELEMETRY_EVENT_paused       , telemetry_pause      , nullptr ) == SCS_RESULT_ok ) &&
+                ( version_params->register_for_event( SCS_TELEMETRY_EVENT_started      , telemetry_pause      , nullptr ) == SCS_RESULT_ok ) &&
+                ( version_params->register_for_event( SCS_TELEMETRY_EVENT_configuration, telemetry_configure  , nullptr ) == SCS_RESULT_ok )  ;
 
         if( !events_registered )
         {
@@ -296,18 +428,9 @@ SCSAPI_RESULT scs_telemetry_init ( scs_u32_t const version, scs_telemetry_init_p
         g_game_log( SCS_LOG_TYPE_message, "fffb::info : registering to channels..." ) ;
         FFFB_F_INFO_S( "scs::scs_telemetry_init", "registering to channels..." ) ;
 
-        version_params->register_for_channel( SCS_TELEMETRY_TRUCK_CHANNEL_world_placement, SCS_U32_NIL, SCS_VALUE_TYPE_euler, SCS_TELEMETRY_CHANNEL_FLAG_no_value, telemetry_store_orientation, &g_telemetry_state       ) ;
-        version_params->register_for_channel( SCS_TELEMETRY_TRUCK_CHANNEL_speed          , SCS_U32_NIL, SCS_VALUE_TYPE_float, SCS_TELEMETRY_CHANNEL_FLAG_none    , telemetry_store_float      , &g_telemetry_state.speed ) ;
-        version_params->register_for_channel( SCS_TELEMETRY_TRUCK_CHANNEL_engine_rpm     , SCS_U32_NIL, SCS_VALUE_TYPE_float, SCS_TELEMETRY_CHANNEL_FLAG_none    , telemetry_store_float      , &g_telemetry_state.rpm   ) ;
-        version_params->register_for_channel( SCS_TELEMETRY_TRUCK_CHANNEL_engine_gear    , SCS_U32_NIL, SCS_VALUE_TYPE_s32  , SCS_TELEMETRY_CHANNEL_FLAG_none    , telemetry_store_s32        , &g_telemetry_state.gear  ) ;
-
-        version_params->register_for_channel( SCS_TELEMETRY_TRUCK_CHANNEL_effective_steering, SCS_U32_NIL, SCS_VALUE_TYPE_float, SCS_TELEMETRY_CHANNEL_FLAG_none, telemetry_store_float, &g_telemetry_state.steering  ) ;
-        version_params->register_for_channel( SCS_TELEMETRY_TRUCK_CHANNEL_effective_throttle, SCS_U32_NIL, SCS_VALUE_TYPE_float, SCS_TELEMETRY_CHANNEL_FLAG_none, telemetry_store_float, &g_telemetry_state.throttle  ) ;
-        version_params->register_for_channel( SCS_TELEMETRY_TRUCK_CHANNEL_effective_brake   , SCS_U32_NIL, SCS_VALUE_TYPE_float, SCS_TELEMETRY_CHANNEL_FLAG_none, telemetry_store_float, &g_telemetry_state.brake     ) ;
-        version_params->register_for_channel( SCS_TELEMETRY_TRUCK_CHANNEL_effective_clutch  , SCS_U32_NIL, SCS_VALUE_TYPE_float, SCS_TELEMETRY_CHANNEL_FLAG_none, telemetry_store_float, &g_telemetry_state.clutch    ) ;
+        g_channels.bind( version_params->register_for_channel, version_params->unregister_from_channel, g_telemetry_state, &g_timing ) ;
 
-        version_params->register_for_channel( SCS_TELEMETRY_TRUCK_CHANNEL_wheel_substance, 0, SCS_VALUE_TYPE_u32, SCS_TELEMETRY_CHANNEL_FLAG_no_value, telemetry_store_u32, &g_telemetry_state.substance_l ) ;
-        version_params->register_for_channel( SCS_TELEMETRY_TRUCK_CHANNEL_wheel_substance, 1, SCS_VALUE_TYPE_u32, SCS_TELEMETRY_CHANNEL_FLAG_no_value, telemetry_store_u32, &g_telemetry_state.substance_r ) ;
+        subscribe_channels( g_profiles.current() ) ;
 
         g_game_log( SCS_LOG_TYPE_message, "fffb::info : channel registration completed" ) ;
         FFFB_F_INFO_S( "scs::scs_telemetry_init", "channel registration completed" ) ;
@@ -323,6 +446,32 @@ SCSAPI_RESULT scs_telemetry_init ( scs_u32_t const version, scs_telemetry_init_p
         g_game_log( SCS_LOG_TYPE_message, "fffb::info : wheel initialization successful" ) ;
         FFFB_F_INFO_S( "scs::scs_telemetry_init", "wheel initialization successful" ) ;
 
+        char const * const profile_path = getenv( "FFFB_PROFILE" ) ;
+
+        if( !g_profiles.start( profile_path ? profile_path : FFFB_PROFILE_FILE_PATH ) )
+        {
+                g_game_log( SCS_LOG_TYPE_warning, "fffb::warning : failed to watch force profile, using defaults" ) ;
+                FFFB_F_WARN_S( "scs::scs_telemetry_init", "failed to watch force profile, using defaults" ) ;
+        }
+
+        if( char const * const budget = getenv( "FFFB_FRAME_BUDGET_US" ) )
+        {
+                g_timing.set_budget_us( strtoul( budget, nullptr, 10 ) ) ;
+                FFFB_F_INFO_S( "scs::scs_telemetry_init", "frame budget %luus", g_timing.budget_us() ) ;
+        }
+
+        if( char const * const record_path = getenv( "FFFB_RECORD" ) ; record_path && !g_recorder.start( record_path ) )
+        {
+                g_game_log( SCS_LOG_TYPE_warning, "fffb::warning : failed to start telemetry recording" ) ;
+                FFFB_F_WARN_S( "scs::scs_telemetry_init", "failed to start telemetry recording" ) ;
+        }
+
+        if( !start_streaming() )
+        {
+                g_game_log( SCS_LOG_TYPE_warning, "fffb::warning : failed to start force streaming" ) ;
+                FFFB_F_WARN_S( "scs::scs_telemetry_init", "failed to start force streaming" ) ;
+        }
+
         memset( &g_telemetry_state, 0, sizeof( g_telemetry_state ) ) ;
         g_last_timestamp = static_cast< scs_timestamp_t >( -1 ) ;
 
@@ -337,6 +486,10 @@ SCSAPI_VOID scs_telemetry_shutdown ()
 {
         g_game_log = nullptr ;
         deinit_wheel() ;
+
+        // the game drops every registration with the plugin
+        g_channels         = {} ;
+        g_telemetry_config = {} ;
 }
 
 void __attribute__(( destructor )) unload ()
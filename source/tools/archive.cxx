@@ -0,0 +1,333 @@
+//
+//
+//      fffb
+//      source/tools/archive.cxx
+//
+
+/// STD
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+/// FFFB
+
+#include <fffb/util/types.hxx>
+#include <fffb/util/clock.hxx>
+#include <fffb/telemetry/recorder.hxx>
+#include <fffb/telemetry/archive.hxx>
+
+#define FFFB_ARCHIVE_BENCH_SECONDS 2
+#define FFFB_ARCHIVE_BENCH_SEEKS   4096
+#define FFFB_ARCHIVE_BENCH_COLUMNS "steering,speed,rpm"
+
+
+// keeps the decoded rows from being optimized out
+uti::u64_t volatile g_bench_sink { 0 } ;
+
+
+////////////////////////////////////////////////////////////////////////////////
+////////////////////////////////////////////////////////////////////////////////
+
+static void usage ()
+{
+        std::fprintf( stderr,
+                "usage: fffb_archive convert <recording> <archive> [rows per block]\n"
+                "       fffb_archive info    <archive>\n"
+                "       fffb_archive dump    <archive> [from us] [columns]\n"
+                "       fffb_archive bench   <archive> [columns] [seconds]\n"
+                "\n"
+                "columns are comma separated names, info lists them\n" ) ;
+}
+
+static bool parse_columns ( char const * _list_, uti::u64_t & _columns_ )
+{
+        if( !fffb::parse_archive_columns( _list_, _columns_ ) )
+        {
+                FFFB_ERR_S( "fffb_archive", "unknown column in '%s'", _list_ ) ;
+                return false ;
+        }
+        return true ;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
+// converts and reads the result back, every row has to come out as it went in
+static int convert ( char const * _recording_, char const * _archive_, uti::u32_t _block_rows_ )
+{
+        fffb::recording_reader recording ;
+
+        if( !recording.open( _recording_ ) ) return 1 ;
+
+        fffb::archive_writer writer ;
+
+        if( !writer.open( _archive_, recording.header(), _block_rows_ ) ) return 1 ;
+
+        fffb::timestamp_t const started = fffb::thread_cpu_us() ;
+
+        for( uti::u64_t i = 0; i < recording.records(); ++i )
+        {
+                if( !writer.push( recording.record( i ) ) ) return 1 ;
+        }
+        if( !writer.close() ) return 1 ;
+
+        fffb::timestamp_t const encoded = fffb::thread_cpu_us() - started ;
+
+        fffb::archive_reader reader ;
+
+        if( !reader.open( _archive_ ) ) return 1 ;
+
+        fffb::archive_cursor cursor( reader ) ;
+
+        uti::u64_t rows { 0 } ;
+        uti::u64_t  bad { 0 } ;
+
+        while( fffb::recording_record const * row = cursor.next() )
+        {
+                if( rows >= recording.records() || std::memcmp( row, &recording.record( rows ), sizeof( *row ) ) != 0 ) ++bad ;
+                ++rows ;
+        }
+        if( cursor.failed() || rows != recording.records() || bad )
+        {
+                FFFB_ERR_S( "fffb_archive::convert", "read back %lu of %lu rows, %lu differ", rows, recording.records(), bad ) ;
+                return 1 ;
+        }
+        fffb::archive_writer_stats const & stats = writer.stats() ;
+
+        double const raw = static_cast< double >( rows + 1 ) * FFFB_RECORDER_RECORD_SIZE ;
+
+        std::printf( "%lu rows in %u blocks, %lu bytes from %.0f, %.1fx, %.1f bytes per row\n",
+                     stats.rows, stats.blocks, stats.bytes, raw, raw / static_cast< double >( stats.bytes ),
+                     rows ? static_cast< double >( stats.bytes ) / static_cast< double >( rows ) : 0.0 ) ;
+        std::printf( "encoded at %.0f rows/s, read back intact\n", encoded ? static_cast< double >( rows ) * 1e6 / static_cast< double >( encoded ) : 0.0 ) ;
+
+        return 0 ;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
+static int info ( char const * _archive_ )
+{
+        fffb::archive_reader reader ;
+
+        if( !reader.open( _archive_ ) ) return 1 ;
+
+        fffb::archive_header const & header = reader.header() ;
+
+        std::printf( "%lu rows in %u blocks of up to %u rows\n", header.rows, header.blocks, header.block_rows ) ;
+
+        if( header.blocks )
+        {
+                std::printf( "game time %lu us to %lu us\n", reader.block( 0 ).first, reader.block( header.blocks - 1 ).last ) ;
+        }
+        uti::u64_t bytes [ fffb::archive_column_count ] {} ;
+        uti::u64_t configs { 0 } ;
+
+        for( uti::u32_t block = 0; block < header.blocks; ++block )
+        {
+                fffb::archive_block_header head ;
+
+                if( !reader.block_header( block, head ) ) return 1 ;
+
+                configs += head.configs ;
+
+                for( uti::u32_t column = 0; column < fffb::archive_column_count; ++column )
+                {
+                        bytes[ column ] += head.column_end[ column ] - ( column ? head.column_end[ column - 1 ] : 0 ) ;
+                }
+        }
+        std::printf( "%lu config records\n\n%-20s %12s %10s\n", configs, "column", "bytes", "per row" ) ;
+
+        for( uti::u32_t column = 0; column < fffb::archive_column_count; ++column )
+        {
+                std::printf( "%-20s %12lu %10.3f\n", fffb::archive_columns[ column ].name, bytes[ column ],
+                             header.rows ? static_cast< double >( bytes[ column ] ) / static_cast< double >( header.rows ) : 0.0 ) ;
+        }
+        return 0 ;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
+static void print_column ( fffb::recording_record const & _row_, uti::u32_t _column_ )
+{
+        fffb::archive_column const & column = fffb::archive_columns[ _column_ ] ;
+
+        unsigned char const * at = reinterpret_cast< unsigned char const * >( &_row_ ) + column.offset ;
+
+        constexpr std::size_t values_begin { fffb::_detail::archived_frame( offsetof( fffb::recorded_frame, values ) ) } ;
+        constexpr std::size_t values_end   { values_begin + sizeof( fffb::recorded_frame::values ) } ;
+
+        if( column.offset >= values_begin && column.offset < values_end )
+        {
+                float value ;
+                std::memcpy( &value, at, sizeof( value ) ) ;
+                std::printf( ",%g", value ) ;
+        }
+        else if( column.codec == fffb::archive_codec::delta && column.width == 4 )
+        {
+                uti::i32_t value ;
+                std::memcpy( &value, at, sizeof( value ) ) ;
+                std::printf( ",%d", value ) ;
+        }
+        else
+        {
+                std::printf( ",%lu", fffb::_detail::load_column( at, column.width ) ) ;
+        }
+}
+
+// csv from the first row at or after _from_, kind and game time always come first
+static int dump ( char const * _archive_, fffb::timestamp_t _from_, uti::u64_t _columns_ )
+{
+        fffb::archive_reader reader ;
+
+        if( !reader.open( _archive_ ) ) return 1 ;
+
+        fffb::archive_cursor cursor( reader, _columns_ ) ;
+
+        if( !cursor.seek( _from_ ) ) return cursor.failed() ? 1 : 0 ;
+
+        _columns_ &= ~fffb::archive_required_columns ;
+
+        std::printf( "kind,timestamp" ) ;
+        for( uti::u32_t column = 0; column < fffb::archive_column_count; ++column )
+        {
+                if( _columns_ & fffb::archive_column_bit( column ) ) std::printf( ",%s", fffb::archive_columns[ column ].name ) ;
+        }
+        std::printf( "\n" ) ;
+
+        while( fffb::recording_record const * row = cursor.next() )
+        {
+                std::printf( "%u,%lu", static_cast< unsigned >( row->kind ), row->timestamp ) ;
+
+                for( uti::u32_t column = 0; column < fffb::archive_column_count; ++column )
+                {
+                        if( _columns_ & fffb::archive_column_bit( column ) ) print_column( *row, column ) ;
+                }
+                std::printf( "\n" ) ;
+        }
+        return cursor.failed() ? 1 : 0 ;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
+// rows decoded per second of cpu time on one core, repeating the whole
+// archive until _seconds_ of cpu time went by
+static double bench_decode ( fffb::archive_reader const & _reader_, uti::u64_t _columns_, uti::u32_t _seconds_, uti::u64_t & _check_ )
+{
+        fffb::archive_cursor cursor( _reader_, _columns_ ) ;
+
+        uti::u64_t rows { 0 } ;
+
+        fffb::timestamp_t const started = fffb::thread_cpu_us() ;
+        fffb::timestamp_t         spent { 0 } ;
+
+        do
+        {
+                cursor.rewind() ;
+
+                while( fffb::recording_record const * row = cursor.next() )
+                {
+                        _check_ += row->timestamp ^ row->frame.fields ;
+                        ++rows ;
+                }
+                if( cursor.failed() ) return 0.0 ;
+
+                spent = fffb::thread_cpu_us() - started ;
+        }
+        while( spent < static_cast< fffb::timestamp_t >( _seconds_ ) * 1000000 ) ;
+
+        return static_cast< double >( rows ) * 1e6 / static_cast< double >( spent ) ;
+}
+
+static int bench ( char const * _archive_, uti::u64_t _columns_, uti::u32_t _seconds_ )
+{
+        fffb::archive_reader reader ;
+
+        if( !reader.open( _archive_ ) ) return 1 ;
+
+        if( reader.header().rows == 0 )
+        {
+                FFFB_ERR_S( "fffb_archive::bench", "'%s' holds no rows", _archive_ ) ;
+                return 1 ;
+        }
+        uti::u64_t check { 0 } ;
+
+        double const all  = bench_decode( reader, fffb::archive_all_columns, _seconds_, check ) ;
+        double const some = bench_decode( reader,                 _columns_, _seconds_, check ) ;
+
+        if( all == 0.0 || some == 0.0 ) return 1 ;
+
+        int columns { 0 } ;
+        for( uti::u64_t bits = _columns_ | fffb::archive_required_columns; bits; bits &= bits - 1 ) ++columns ;
+
+        std::printf( "%-24s %14s %10s\n", "decode", "rows/s/core", "MB/s" ) ;
+        std::printf( "%-24s %14.0f %10.1f\n", "all columns", all, all * FFFB_RECORDER_RECORD_SIZE / 1e6 ) ;
+
+        char label [ 32 ] ;
+        std::snprintf( label, sizeof( label ), "%d columns", columns ) ;
+        std::printf( "%-24s %14.0f %10.1f\n", label, some, some * FFFB_RECORDER_RECORD_SIZE / 1e6 ) ;
+
+        // seeks land anywhere in the recorded span, each decodes one block
+        fffb::archive_cursor cursor( reader, _columns_ ) ;
+
+        fffb::timestamp_t const first = reader.block( 0 ).first ;
+        fffb::timestamp_t const  span = reader.block( reader.blocks() - 1 ).last - first + 1 ;
+
+        uti::u64_t state { 0x9e3779b97f4a7c15ull } ;
+
+        fffb::timestamp_t const started = fffb::thread_cpu_us() ;
+
+        for( uti::u32_t i = 0; i < FFFB_ARCHIVE_BENCH_SEEKS; ++i )
+        {
+                state ^= state << 13 ; state ^= state >> 7 ; state ^= state << 17 ;
+
+                if( cursor.seek( first + state % span ) ) check += cursor.next()->timestamp ;
+        }
+        double const seek_us = static_cast< double >( fffb::thread_cpu_us() - started ) / FFFB_ARCHIVE_BENCH_SEEKS ;
+
+        std::printf( "%-24s %14.1f us\n", "seek", seek_us ) ;
+
+        g_bench_sink = check ;
+
+        return 0 ;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+////////////////////////////////////////////////////////////////////////////////
+
+int main ( int argc, char ** argv )
+{
+        if( argc < 3 )
+        {
+                usage() ;
+                return 1 ;
+        }
+        char const * command = argv[ 1 ] ;
+
+        if( std::strcmp( command, "convert" ) == 0 && argc >= 4 )
+        {
+                return convert( argv[ 2 ], argv[ 3 ], argc > 4 ? static_cast< uti::u32_t >( std::strtoul( argv[ 4 ], nullptr, 10 ) ) : FFFB_ARCHIVE_BLOCK_ROWS ) ;
+        }
+        if( std::strcmp( command, "info" ) == 0 )
+        {
+                return info( argv[ 2 ] ) ;
+        }
+        if( std::strcmp( command, "dump" ) == 0 )
+        {
+                uti::u64_t columns { fffb::archive_all_columns } ;
+
+                if( argc > 4 && !parse_columns( argv[ 4 ], columns ) ) return 1 ;
+
+                return dump( argv[ 2 ], argc > 3 ? std::strtoull( argv[ 3 ], nullptr, 10 ) : 0, columns ) ;
+        }
+        if( std::strcmp( command, "bench" ) == 0 )
+        {
+                uti::u64_t columns { 0 } ;
+
+                if( !parse_columns( argc > 3 ? argv[ 3 ] : FFFB_ARCHIVE_BENCH_COLUMNS, columns ) ) return 1 ;
+
+                return bench( argv[ 2 ], columns, argc > 4 ? static_cast< uti::u32_t >( std::strtoul( argv[ 4 ], nullptr, 10 ) ) : FFFB_ARCHIVE_BENCH_SECONDS ) ;
+        }
+        usage() ;
+        return 1 ;
+}
@@ -0,0 +1,243 @@
+//
+//
+//      fffb
+//      source/tools/batch_check.cxx
+//
+
+/// STD
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+/// FFFB
+
+#include <fffb/util/types.hxx>
+#include <fffb/util/fixed.hxx>
+#include <fffb/telemetry/state.hxx>
+#include <fffb/telemetry/recorder.hxx>
+#include <fffb/telemetry/archive.hxx>
+#include <fffb/force/effect_graph.hxx>
+#include <fffb/force/batch.hxx>
+#include <fffb/force/profile.hxx>
+
+// not a multiple of the lane count, so every run ends in a padded block and
+// the filters carry over between runs mid block
+#define FFFB_BATCH_CHECK_CHUNK 1021
+
+// mismatches printed before only counting the rest
+#define FFFB_BATCH_CHECK_SHOWN 16
+
+
+constexpr char const * sink_names [ static_cast< uti::u8_t >( fffb::effect_sink::count ) ]
+{
+        "constant_torque", "spring_enabled", "spring_amplitude", "spring_slope", "damper_enabled",
+        "damper_slope", "trapezoid_enabled", "trapezoid_amplitude", "trapezoid_period",
+} ;
+
+
+////////////////////////////////////////////////////////////////////////////////
+////////////////////////////////////////////////////////////////////////////////
+
+static void usage ()
+{
+        std::fprintf( stderr,
+                "usage: fffb_batch_check <recording or archive> [profile]\n"
+                "\n"
+                "runs the recorded frames through the batch evaluator and through evaluate()\n"
+                "one frame at a time, every output has to come out bit for bit the same.\n"
+                "both see the raw telemetry, the simulator's predictor is not part of the\n"
+                "check. without a profile the default effects run\n" ) ;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
+// the recorded frames, as states for evaluate() and as columns for the batch
+struct recorded_frames
+{
+        fffb::vector< fffb::telemetry_state > states {} ;
+
+        fffb::vector< fffb::timestamp_t > timestamps {} ;
+
+        fffb::vector< float > floats [ static_cast< uti::u8_t >( fffb::telemetry_field::count ) ] {} ;
+        fffb::vector< int   >   ints [ static_cast< uti::u8_t >( fffb::telemetry_field::count ) ] {} ;
+
+        void push ( fffb::telemetry_state const & _state_ ) noexcept
+        {
+                states.push_back( _state_ ) ;
+                timestamps.push_back( _state_.timestamp ) ;
+
+                unsigned char const * base = reinterpret_cast< unsigned char const * >( &_state_ ) ;
+
+                for( uti::u8_t field = 0; field < static_cast< uti::u8_t >( fffb::telemetry_field::count ); ++field )
+                {
+                        fffb::telemetry_field_info const & info = fffb::telemetry_fields[ field ] ;
+
+                        if( info.is_int )
+                        {
+                                int value ;
+                                std::memcpy( &value, base + info.offset, sizeof( value ) ) ;
+                                ints[ field ].push_back( value ) ;
+                        }
+                        else
+                        {
+                                float value ;
+                                std::memcpy( &value, base + info.offset, sizeof( value ) ) ;
+                                floats[ field ].push_back( value ) ;
+                        }
+                }
+        }
+
+        [[ nodiscard ]] uti::u64_t size () const noexcept { return static_cast< uti::u64_t >( states.size() ) ; }
+
+        // _count_ rows starting at _first_
+        [[ nodiscard ]] fffb::telemetry_columns columns ( uti::u64_t _first_, uti::u64_t _count_ ) const noexcept
+        {
+                fffb::telemetry_columns in {} ;
+
+                in.timestamp = timestamps.data() + _first_ ;
+                in.count     = _count_ ;
+
+                for( uti::u8_t field = 0; field < static_cast< uti::u8_t >( fffb::telemetry_field::count ); ++field )
+                {
+                        fffb::telemetry_field const f = static_cast< fffb::telemetry_field >( field ) ;
+
+                        if( fffb::telemetry_fields[ field ].is_int ) in.set( f, ints  [ field ].data() + _first_ ) ;
+                        else                                         in.set( f, floats[ field ].data() + _first_ ) ;
+                }
+                return in ;
+        }
+} ;
+
+////////////////////////////////////////////////////////////////////////////////
+
+// every sink the program writes, frame by frame with the dt the simulator derives
+static void run_scalar ( fffb::effect_program const & _program_, recorded_frames const & _frames_,
+                         fffb::vector< fffb::q16 > ( & _out_ )[ static_cast< uti::u8_t >( fffb::effect_sink::count ) ] )
+{
+        fffb::effect_state   fx_state {} ;
+        fffb::effect_outputs  outputs {} ;
+        fffb::timestamp_t   last_eval { 0 } ;
+
+        for( uti::u64_t i = 0; i < _frames_.size(); ++i )
+        {
+                fffb::telemetry_state const & state = _frames_.states[ i ] ;
+
+                fffb::q16 dt {} ;
+
+                if( state.timestamp > last_eval && last_eval != 0 ) dt = fffb::q16_from_us( state.timestamp - last_eval ) ;
+
+                last_eval = state.timestamp ;
+
+                fffb::evaluate( _program_, state, dt, fx_state, outputs ) ;
+
+                for( uti::u8_t sink = 0; sink < static_cast< uti::u8_t >( fffb::effect_sink::count ); ++sink )
+                {
+                        if( ( _program_.sink_mask >> sink ) & 1 ) _out_[ sink ].push_back( outputs.values[ sink ] ) ;
+                }
+        }
+}
+
+static bool run_batch ( fffb::effect_program const & _program_, recorded_frames const & _frames_,
+                        fffb::vector< fffb::q16 > ( & _out_ )[ static_cast< uti::u8_t >( fffb::effect_sink::count ) ] )
+{
+        for( uti::u8_t sink = 0; sink < static_cast< uti::u8_t >( fffb::effect_sink::count ); ++sink )
+        {
+                if( !( ( _program_.sink_mask >> sink ) & 1 ) ) continue ;
+
+                for( uti::u64_t i = 0; i < _frames_.size(); ++i ) _out_[ sink ].push_back( fffb::q16{} ) ;
+        }
+        fffb::batch_evaluator batch( _program_ ) ;
+
+        for( uti::u64_t first = 0; first < _frames_.size(); first += FFFB_BATCH_CHECK_CHUNK )
+        {
+                uti::u64_t const left  = _frames_.size() - first ;
+                uti::u64_t const count = left < FFFB_BATCH_CHECK_CHUNK ? left : FFFB_BATCH_CHECK_CHUNK ;
+
+                fffb::effect_columns out {} ;
+
+                for( uti::u8_t sink = 0; sink < static_cast< uti::u8_t >( fffb::effect_sink::count ); ++sink )
+                {
+                        if( ( _program_.sink_mask >> sink ) & 1 ) out.set( static_cast< fffb::effect_sink >( sink ), _out_[ sink ].data() + first ) ;
+                }
+                if( !batch.run( _frames_.columns( first, count ), out ) ) return false ;
+        }
+        return true ;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+////////////////////////////////////////////////////////////////////////////////
+
+int main ( int argc, char ** argv )
+{
+        if( argc < 2 )
+        {
+                usage() ;
+                return 1 ;
+        }
+        fffb::force_profile profile ;
+
+        if( argc > 2 ? !fffb::load_profile( argv[ 2 ], profile ) : !profile.compile() )
+        {
+                FFFB_ERR_S( "fffb_batch_check", "failed loading force profile" ) ;
+                return 1 ;
+        }
+        recorded_frames frames ;
+
+        fffb::telemetry_state state {} ;
+
+        // pauses and configs don't reach the graph, only the frames in between do
+        bool const read = fffb::for_each_record( argv[ 1 ], [ & ]( fffb::recording_record const & _record_ )
+        {
+                if( _record_.kind != fffb::record_kind::frame ) return ;
+
+                fffb::restore_frame( _record_, state ) ;
+                frames.push( state ) ;
+        } ) ;
+
+        if( !read ) return 1 ;
+
+        if( frames.size() == 0 )
+        {
+                FFFB_ERR_S( "fffb_batch_check", "'%s' holds no frames", argv[ 1 ] ) ;
+                return 1 ;
+        }
+        fffb::effect_program const & program = profile.program ;
+
+        fffb::vector< fffb::q16 > scalar [ static_cast< uti::u8_t >( fffb::effect_sink::count ) ] {} ;
+        fffb::vector< fffb::q16 >  batch [ static_cast< uti::u8_t >( fffb::effect_sink::count ) ] {} ;
+
+        run_scalar( program, frames, scalar ) ;
+
+        if( !run_batch( program, frames, batch ) )
+        {
+                FFFB_ERR_S( "fffb_batch_check", "batch evaluator refused the program" ) ;
+                return 1 ;
+        }
+        uti::u64_t differ { 0 } ;
+        uti::u32_t  sinks { 0 } ;
+
+        for( uti::u8_t sink = 0; sink < static_cast< uti::u8_t >( fffb::effect_sink::count ); ++sink )
+        {
+                if( !( ( program.sink_mask >> sink ) & 1 ) ) continue ;
+
+                ++sinks ;
+
+                for( uti::u64_t i = 0; i < frames.size(); ++i )
+                {
+                        uti::i32_t const s = scalar[ sink ][ i ].raw() ;
+                        uti::i32_t const b =  batch[ sink ][ i ].raw() ;
+
+                        if( s == b ) continue ;
+
+                        if( differ++ < FFFB_BATCH_CHECK_SHOWN )
+                        {
+                                std::printf( "frame %lu @%luus %s : evaluate %08x batch %08x\n",
+                                             i, frames.timestamps[ i ], sink_names[ sink ], static_cast< unsigned >( s ), static_cast< unsigned >( b ) ) ;
+                        }
+                }
+        }
+        std::printf( "%lu frames, %u sinks, %lu outputs differ\n", frames.size(), sinks, differ ) ;
+
+        return differ ? 1 : 0 ;
+}
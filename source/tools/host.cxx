@@ -0,0 +1,823 @@
+//
+//
+//      fffb
+//      source/tools/host.cxx
+//
+
+/// STD
+
+#include <cerrno>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <ctime>
+#include <cmath>
+#include <algorithm>
+#include <chrono>
+#include <thread>
+
+#include <dlfcn.h>
+
+/// SDK
+
+#include <scssdk_telemetry.h>
+#include <common/scssdk_telemetry_common_configs.h>
+#include <common/scssdk_telemetry_truck_common_channels.h>
+#include <eurotrucks2/scssdk_eut2.h>
+#include <eurotrucks2/scssdk_telemetry_eut2.h>
+
+/// FFFB
+
+#include <fffb/util/types.hxx>
+#include <fffb/telemetry/state.hxx>
+#include <fffb/telemetry/recorder.hxx>
+#include <fffb/telemetry/archive.hxx>
+
+#define FFFB_HOST_DEFAULT_RATES  "30,60,144,240"
+#define FFFB_HOST_DEFAULT_SECONDS 10
+
+#define FFFB_HOST_MAX_RATES     8
+#define FFFB_HOST_MAX_CHANNELS 64
+
+// what the synthetic truck says about itself
+#define FFFB_HOST_RPM_LIMIT   2500.0f
+#define FFFB_HOST_WHEEL_COUNT 6
+
+// glibc lets the executable take over malloc, elsewhere there are no heap numbers
+#if defined( __GLIBC__ )
+#define FFFB_HOST_HEAP_COUNTS
+#endif
+
+
+////////////////////////////////////////////////////////////////////////////////
+////////////////////////////////////////////////////////////////////////////////
+
+// what the game thread allocated while the plugin had it. only the thread
+// that set t_heap is counted, the plugin's own threads are left out
+
+struct heap_counter
+{
+        uti::u64_t allocs { 0 } ;
+        uti::u64_t  frees { 0 } ;
+        uti::u64_t  bytes { 0 } ;
+} ;
+
+static thread_local heap_counter * t_heap { nullptr } ;
+
+#ifdef FFFB_HOST_HEAP_COUNTS
+
+extern "C"
+{
+
+void * __libc_malloc   ( std::size_t               ) ;
+void * __libc_calloc   ( std::size_t, std::size_t  ) ;
+void * __libc_realloc  ( void *     , std::size_t  ) ;
+void * __libc_memalign ( std::size_t, std::size_t  ) ;
+void   __libc_free     ( void *                    ) ;
+
+void * malloc ( std::size_t _size_ ) noexcept
+{
+        if( t_heap ) { ++t_heap->allocs ; t_heap->bytes += _size_ ; }
+        return __libc_malloc( _size_ ) ;
+}
+
+void * calloc ( std::size_t _count_, std::size_t _size_ ) noexcept
+{
+        if( t_heap ) { ++t_heap->allocs ; t_heap->bytes += _count_ * _size_ ; }
+        return __libc_calloc( _count_, _size_ ) ;
+}
+
+void * realloc ( void * _ptr_, std::size_t _size_ ) noexcept
+{
+        if( t_heap ) { ++t_heap->allocs ; t_heap->bytes += _size_ ; if( _ptr_ ) ++t_heap->frees ; }
+        return __libc_realloc( _ptr_, _size_ ) ;
+}
+
+void * aligned_alloc ( std::size_t _align_, std::size_t _size_ ) noexcept
+{
+        if( t_heap ) { ++t_heap->allocs ; t_heap->bytes += _size_ ; }
+        return __libc_memalign( _align_, _size_ ) ;
+}
+
+int posix_memalign ( void ** _ptr_, std::size_t _align_, std::size_t _size_ ) noexcept
+{
+        if( t_heap ) { ++t_heap->allocs ; t_heap->bytes += _size_ ; }
+        *_ptr_ = __libc_memalign( _align_, _size_ ) ;
+        return *_ptr_ ? 0 : ENOMEM ;
+}
+
+void free ( void * _ptr_ ) noexcept
+{
+        if( t_heap && _ptr_ ) ++t_heap->frees ;
+        __libc_free( _ptr_ ) ;
+}
+
+} // extern "C"
+
+#endif // FFFB_HOST_HEAP_COUNTS
+
+////////////////////////////////////////////////////////////////////////////////
+
+[[ nodiscard ]] static uti::u64_t clock_ns ( clockid_t _clock_ ) noexcept
+{
+        timespec time ;
+        clock_gettime( _clock_, &time ) ;
+
+        return static_cast< uti::u64_t >( time.tv_sec ) * 1000000000 + static_cast< uti::u64_t >( time.tv_nsec ) ;
+}
+
+[[ nodiscard ]] static uti::u64_t    wall_ns () noexcept { return clock_ns( CLOCK_MONOTONIC          ) ; }
+[[ nodiscard ]] static uti::u64_t  thread_ns () noexcept { return clock_ns( CLOCK_THREAD_CPUTIME_ID  ) ; }
+[[ nodiscard ]] static uti::u64_t process_ns () noexcept { return clock_ns( CLOCK_PROCESS_CPUTIME_ID ) ; }
+
+// one duration per call, sorted for the percentiles once the run is over
+struct sample_set
+{
+        fffb::vector< uti::u32_t > ns {} ;
+        uti::u64_t              total { 0 } ;
+
+        void add ( uti::u64_t _ns_ )
+        {
+                ns.push_back( static_cast< uti::u32_t >( _ns_ < 0xFFFFFFFF ? _ns_ : 0xFFFFFFFF ) ) ;
+                total += _ns_ ;
+        }
+
+        void print ( char const * _name_ )
+        {
+                if( ns.size() == 0 )
+                {
+                        std::printf( "  %-11s -\n", _name_ ) ;
+                        return ;
+                }
+                std::sort( ns.data(), ns.data() + ns.size() ) ;
+
+                auto const at = [ & ]( double _q_ ) { return static_cast< double >( ns[ static_cast< uti::u64_t >( _q_ * static_cast< double >( ns.size() - 1 ) ) ] ) * 1e-3 ; } ;
+
+                std::printf( "  %-11s %9lu calls, mean %7.2f us, p50 %7.2f us, p99 %7.2f us, p99.9 %7.2f us, max %8.2f us\n",
+                             _name_, static_cast< uti::u64_t >( ns.size() ), static_cast< double >( total ) * 1e-3 / static_cast< double >( ns.size() ),
+                             at( 0.5 ), at( 0.99 ), at( 0.999 ), at( 1.0 ) ) ;
+        }
+} ;
+
+////////////////////////////////////////////////////////////////////////////////
+////////////////////////////////////////////////////////////////////////////////
+
+// where the value of a game channel comes from. the host keeps a telemetry_state
+// of its own, synthesized or restored from a recording, and reads channels off it
+
+struct channel_source
+{
+        char const *     name ;
+        scs_value_type_t type ;
+        bool          indexed ;
+
+        void ( * fill )( fffb::telemetry_state const & _state_, scs_u32_t _index_, scs_value_t & _value_ ) ;
+} ;
+
+template< float fffb::telemetry_state::* Member >
+static void fill_float ( fffb::telemetry_state const & _state_, [[ maybe_unused ]] scs_u32_t _index_, scs_value_t & _value_ )
+{
+        _value_.value_float.value = _state_.*Member ;
+}
+
+static constexpr channel_source channel_sources []
+{
+        { SCS_TELEMETRY_TRUCK_CHANNEL_world_placement, SCS_VALUE_TYPE_euler, false,
+          []( fffb::telemetry_state const & _state_, scs_u32_t, scs_value_t & _value_ )
+          {
+                  _value_.value_euler.heading = _state_.heading / 360.0f ;
+                  _value_.value_euler.  pitch = _state_.  pitch / 360.0f ;
+                  _value_.value_euler.   roll = _state_.   roll / 360.0f ;
+          } },
+        { SCS_TELEMETRY_TRUCK_CHANNEL_speed             , SCS_VALUE_TYPE_float, false, &fill_float< &fffb::telemetry_state::   speed > },
+        { SCS_TELEMETRY_TRUCK_CHANNEL_engine_rpm        , SCS_VALUE_TYPE_float, false, &fill_float< &fffb::telemetry_state::     rpm > },
+        { SCS_TELEMETRY_TRUCK_CHANNEL_effective_steering, SCS_VALUE_TYPE_float, false, &fill_float< &fffb::telemetry_state::steering > },
+        { SCS_TELEMETRY_TRUCK_CHANNEL_effective_throttle, SCS_VALUE_TYPE_float, false, &fill_float< &fffb::telemetry_state::throttle > },
+        { SCS_TELEMETRY_TRUCK_CHANNEL_effective_brake   , SCS_VALUE_TYPE_float, false, &fill_float< &fffb::telemetry_state::   brake > },
+        { SCS_TELEMETRY_TRUCK_CHANNEL_effective_clutch  , SCS_VALUE_TYPE_float, false, &fill_float< &fffb::telemetry_state::  clutch > },
+        { SCS_TELEMETRY_TRUCK_CHANNEL_engine_gear, SCS_VALUE_TYPE_s32, false,
+          []( fffb::telemetry_state const & _state_, scs_u32_t, scs_value_t & _value_ ) { _value_.value_s32.value = _state_.gear ; } },
+        { SCS_TELEMETRY_TRUCK_CHANNEL_wheel_substance, SCS_VALUE_TYPE_u32, true,
+          []( fffb::telemetry_state const & _state_, scs_u32_t _index_, scs_value_t & _value_ )
+          {
+                  _value_.value_u32.value = _index_ < FFFB_TELEMETRY_MAX_WHEELS ? static_cast< scs_u32_t >( _state_.substance[ _index_ ] ) : 0 ;
+          } },
+} ;
+
+////////////////////////////////////////////////////////////////////////////////
+
+struct channel_registration
+{
+        channel_source const *            source ;
+        scs_u32_t                          index ;
+        scs_u32_t                          flags ;
+        scs_telemetry_channel_callback_t callback ;
+        scs_context_t                     context ;
+
+        scs_value_t     last {} ;
+        bool       delivered { false } ;
+} ;
+
+struct event_registration
+{
+        scs_telemetry_event_callback_t callback { nullptr } ;
+        scs_context_t                   context { nullptr } ;
+} ;
+
+// where the game is in its frame, registrations are only taken outside of channel callbacks
+enum class host_phase : uti::u8_t
+{
+        init     ,
+        event    ,
+        channel  ,
+        shutdown ,
+        idle     ,
+} ;
+
+struct host_state
+{
+        host_phase phase { host_phase::idle } ;
+
+        event_registration events [ SCS_TELEMETRY_EVENT_gameplay + 1 ] {} ;
+
+        channel_registration channels [ FFFB_HOST_MAX_CHANNELS ] {} ;
+        uti::u32_t      channel_count { 0 } ;
+
+        uti::u64_t   refused { 0 } ; // registrations asked for at the wrong time
+        uti::u64_t  messages { 0 } ;
+        uti::u64_t    errors { 0 } ;
+        bool           quiet { false } ; // the plugin's log only counted while frames run
+} ;
+
+static host_state g_host {} ;
+
+////////////////////////////////////////////////////////////////////////////////
+
+[[ nodiscard ]] static channel_source const * find_source ( scs_string_t _name_ ) noexcept
+{
+        for( channel_source const & source : channel_sources )
+        {
+                if( std::strcmp( source.name, _name_ ) == 0 ) return &source ;
+        }
+        return nullptr ;
+}
+
+[[ nodiscard ]] static channel_registration * find_channel ( scs_string_t _name_, scs_u32_t _index_ ) noexcept
+{
+        for( uti::u32_t i = 0; i < g_host.channel_count; ++i )
+        {
+                channel_registration & channel = g_host.channels[ i ] ;
+
+                if( channel.index == _index_ && std::strcmp( channel.source->name, _name_ ) == 0 ) return &channel ;
+        }
+        return nullptr ;
+}
+
+[[ nodiscard ]] static bool registrations_allowed () noexcept
+{
+        if( g_host.phase == host_phase::init || g_host.phase == host_phase::event ) return true ;
+
+        ++g_host.refused ;
+        return false ;
+}
+
+SCSAPI_VOID game_log ( scs_log_type_t const type, scs_string_t const message )
+{
+        ++g_host.messages ;
+
+        if( type == SCS_LOG_TYPE_error ) ++g_host.errors ;
+
+        if( g_host.quiet ) return ;
+
+        char const * const kind = type == SCS_LOG_TYPE_error   ? "error"
+                                : type == SCS_LOG_TYPE_warning ? "warning"
+                                :                                "message" ;
+        std::fprintf( stderr, "game log %s : %s\n", kind, message ) ;
+}
+
+SCSAPI_RESULT register_for_event ( scs_event_t const event, scs_telemetry_event_callback_t const callback, scs_context_t const context )
+{
+        if( !registrations_allowed() ) return SCS_RESULT_not_now ;
+
+        if( event == SCS_TELEMETRY_EVENT_invalid || event > SCS_TELEMETRY_EVENT_gameplay || !callback ) return SCS_RESULT_invalid_parameter ;
+
+        if( g_host.events[ event ].callback ) return SCS_RESULT_already_registered ;
+
+        g_host.events[ event ] = { callback, context } ;
+        return SCS_RESULT_ok ;
+}
+
+SCSAPI_RESULT unregister_from_event ( scs_event_t const event )
+{
+        if( g_host.phase != host_phase::shutdown && !registrations_allowed() ) return SCS_RESULT_not_now ;
+
+        if( event == SCS_TELEMETRY_EVENT_invalid || event > SCS_TELEMETRY_EVENT_gameplay ) return SCS_RESULT_invalid_parameter ;
+
+        if( !g_host.events[ event ].callback ) return SCS_RESULT_not_found ;
+
+        g_host.events[ event ] = {} ;
+        return SCS_RESULT_ok ;
+}
+
+SCSAPI_RESULT register_for_channel ( scs_string_t const name, scs_u32_t const index, scs_value_type_t const type, scs_u32_t const flags,
+                                     scs_telemetry_channel_callback_t const callback, scs_context_t const context )
+{
+        if( !registrations_allowed() ) return SCS_RESULT_not_now ;
+
+        if( !name || !callback ) return SCS_RESULT_invalid_parameter ;
+
+        channel_source const * const source = find_source( name ) ;
+
+        if( !source ) return SCS_RESULT_not_found ;
+
+        if( source->indexed != ( index != SCS_U32_NIL ) ) return SCS_RESULT_invalid_parameter ;
+        if( source->type != type                       ) return SCS_RESULT_unsupported_type  ;
+
+        if( find_channel( name, index ) ) return SCS_RESULT_already_registered ;
+
+        if( g_host.channel_count == FFFB_HOST_MAX_CHANNELS ) return SCS_RESULT_generic_error ;
+
+        g_host.channels[ g_host.channel_count++ ] = { source, index, flags, callback, context } ;
+        return SCS_RESULT_ok ;
+}
+
+SCSAPI_RESULT unregister_from_channel ( scs_string_t const name, scs_u32_t const index, [[ maybe_unused ]] scs_value_type_t const type )
+{
+        if( g_host.phase != host_phase::shutdown && !registrations_allowed() ) return SCS_RESULT_not_now ;
+
+        if( !name ) return SCS_RESULT_invalid_parameter ;
+
+        channel_registration * const channel = find_channel( name, index ) ;
+
+        if( !channel ) return SCS_RESULT_not_found ;
+
+        *channel = g_host.channels[ --g_host.channel_count ] ;
+        return SCS_RESULT_ok ;
+}
+
+// what the event callback did to the clock and the heap
+struct call_cost
+{
+        uti::u64_t wall_ns ;
+        uti::u64_t  cpu_ns ;
+        heap_counter  heap ;
+} ;
+
+static call_cost fire_event ( scs_event_t _event_, void const * _info_ )
+{
+        event_registration const & event = g_host.events[ _event_ ] ;
+
+        call_cost cost {} ;
+
+        if( !event.callback ) return cost ;
+
+        g_host.phase = host_phase::event ;
+        t_heap = &cost.heap ;
+
+        uti::u64_t const  cpu_start = thread_ns() ;
+        uti::u64_t const wall_start =   wall_ns() ;
+
+        event.callback( _event_, _info_, event.context ) ;
+
+        cost.wall_ns =   wall_ns() - wall_start ;
+        cost. cpu_ns = thread_ns() -  cpu_start ;
+
+        t_heap = nullptr ;
+        g_host.phase = host_phase::idle ;
+
+        return cost ;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+////////////////////////////////////////////////////////////////////////////////
+
+// a truck going through the gears on a winding road, every channel moves
+static void synthesize ( double _t_, fffb::telemetry_state & _state_ ) noexcept
+{
+        constexpr double two_pi = 6.283185307179586 ;
+
+        double const cycle = std::fmod( _t_, 60.0 ) / 60.0 ;
+
+        _state_.steering = static_cast< float >( 0.3 * std::sin( two_pi * 0.2 * _t_ ) + 0.02 * std::sin( two_pi * 3.1 * _t_ ) ) ;
+        _state_.speed    = static_cast< float >( 25.0 * std::sin( 0.5 * two_pi * cycle ) ) ;
+        _state_.gear     = 1 + static_cast< int >( cycle * 11.99 ) ;
+        _state_.rpm      = static_cast< float >( 900.0 + 800.0 * std::fmod( cycle * 12.0, 1.0 ) ) ;
+        _state_.throttle = static_cast< float >( cycle < 0.5 ? 0.8 : 0.1 ) ;
+        _state_.brake    = static_cast< float >( cycle < 0.5 ? 0.0 : 0.3 ) ;
+        _state_.clutch   = static_cast< float >( std::fmod( cycle * 12.0, 1.0 ) < 0.05 ? 1.0 : 0.0 ) ;
+        _state_.heading  = static_cast< float >( std::fmod( _t_ * 3.0, 360.0 ) ) ;
+        _state_.pitch    = static_cast< float >( 2.0 * std::sin( two_pi * 0.05 * _t_ ) ) ;
+        _state_.roll     = static_cast< float >( 1.0 * std::sin( two_pi * 0.07 * _t_ ) ) ;
+
+        for( uti::u32_t wheel = 0; wheel < FFFB_TELEMETRY_MAX_WHEELS; ++wheel )
+        {
+                _state_.substance[ wheel ] = cycle > 0.9 ? 2 : 0 ;
+        }
+}
+
+// recorded frames are played back at whatever rate the host runs, each host
+// frame gets the latest recorded frame that isn't ahead of it. at the end
+// the recording starts over
+struct recorded_source
+{
+        fffb::vector< fffb::recording_record > frames {} ;
+
+        float rpm_limit { 0.0f } ;
+        uti::u8_t wheels { 0 } ;
+
+        uti::u64_t next { 0 } ;
+        double      lap { 0.0 } ; // host seconds the recording started at last
+
+        [[ nodiscard ]] bool load ( char const * _path_ )
+        {
+                bool const read = fffb::for_each_record( _path_, [ & ]( fffb::recording_record const & _record_ )
+                {
+                        if( _record_.kind == fffb::record_kind::frame ) frames.push_back( _record_ ) ;
+
+                        else if( _record_.kind == fffb::record_kind::config && rpm_limit == 0.0f )
+                        {
+                                rpm_limit = _record_.config.rpm_limit   ;
+                                wheels    = _record_.config.wheel_count ;
+                        }
+                } ) ;
+                return read && frames.size() > 0 ;
+        }
+
+        void sample ( double _t_, fffb::telemetry_state & _state_ ) noexcept
+        {
+                auto const at = [ & ]( uti::u64_t _i_ )
+                {
+                        return static_cast< double >( frames[ _i_ ].timestamp - frames[ 0 ].timestamp ) * 1e-6 ;
+                } ;
+                uti::u64_t const count = static_cast< uti::u64_t >( frames.size() ) ;
+
+                if( next == count )
+                {
+                        next = 0 ;
+                        lap  = _t_ ;
+                }
+                uti::u64_t const first = next ;
+
+                while( next < count && at( next ) <= _t_ - lap ) ++next ;
+
+                if( next > first ) fffb::restore_frame( frames[ next - 1 ], _state_ ) ;
+        }
+} ;
+
+////////////////////////////////////////////////////////////////////////////////
+
+struct frame_costs
+{
+        sample_set frame_start {} ;
+        sample_set     channel {} ;
+        sample_set   frame_end {} ;
+        sample_set       frame {} ;
+        sample_set   frame_cpu {} ;
+
+        heap_counter heap {} ;
+        uti::u64_t   heap_frames { 0 } ; // frames that touched the heap at all
+        uti::u64_t   heap_max    { 0 } ;
+
+        uti::u64_t        frames { 0 } ;
+        uti::u64_t     callbacks { 0 } ;
+        uti::u64_t          late { 0 } ; // frames the host itself didn't start on time
+        uti::u64_t background_ns { 0 } ; // cpu the plugin's other threads took meanwhile
+} ;
+
+struct pending_call
+{
+        channel_registration * channel ;
+        scs_value_t              value ;
+        bool                  no_value ;
+        uti::u64_t             wall_ns ; // filled in by the call
+} ;
+
+// the game's frame, config and pause events are sent between frames
+static void run_frames ( uti::u32_t _hz_, double _seconds_, double & _game_s_, recorded_source * _recorded_, fffb::telemetry_state & _state_, frame_costs & _costs_ )
+{
+        using clock = std::chrono::steady_clock ;
+
+        uti::u64_t const frames    = static_cast< uti::u64_t >( _seconds_ * _hz_ ) ;
+        double     const period_s  = 1.0 / _hz_ ;
+
+        auto const period = std::chrono::duration_cast< clock::duration >( std::chrono::duration< double >( period_s ) ) ;
+        auto const start  = clock::now() ;
+
+        pending_call pending [ FFFB_HOST_MAX_CHANNELS ] ;
+
+        uti::u64_t const process_start = process_ns() ;
+        uti::u64_t const  thread_start =  thread_ns() ;
+
+        g_host.quiet = true ;
+
+        for( uti::u64_t frame = 0; frame < frames; ++frame )
+        {
+                auto const slot = start + period * static_cast< clock::rep >( frame ) ;
+
+                if( clock::now() > slot + period ) ++_costs_.late ;
+
+                std::this_thread::sleep_until( slot ) ;
+
+                _game_s_ += period_s ;
+
+                if( _recorded_ ) _recorded_->sample( _game_s_, _state_ ) ;
+                else             synthesize        ( _game_s_, _state_ ) ;
+
+                // the values due this frame, worked out before the clock starts
+                uti::u32_t due { 0 } ;
+
+                for( uti::u32_t i = 0; i < g_host.channel_count; ++i )
+                {
+                        channel_registration & channel = g_host.channels[ i ] ;
+
+                        scs_value_t value {} ;
+                        value.type = channel.source->type ;
+                        channel.source->fill( _state_, channel.index, value ) ;
+
+                        bool const changed = !channel.delivered || std::memcmp( &value, &channel.last, sizeof( value ) ) != 0 ;
+
+                        if( !changed && !( channel.flags & SCS_TELEMETRY_CHANNEL_FLAG_each_frame ) ) continue ;
+
+                        channel.last      = value ;
+                        channel.delivered = true ;
+
+                        pending[ due++ ] = { &channel, value, false, 0 } ;
+                }
+                scs_timestamp_t const game_us = static_cast< scs_timestamp_t >( _game_s_ * 1e6 ) ;
+
+                scs_telemetry_frame_start_t const info { 0, 0, game_us, game_us, game_us } ;
+
+                heap_counter heap {} ;
+
+                uti::u64_t const frame_cpu = thread_ns() ;
+                uti::u64_t const frame_at  =   wall_ns() ;
+
+                call_cost const start_cost = fire_event( SCS_TELEMETRY_EVENT_frame_start, &info ) ;
+
+                g_host.phase = host_phase::channel ;
+                t_heap = &heap ;
+
+                for( uti::u32_t i = 0; i < due; ++i )
+                {
+                        channel_registration const & channel = *pending[ i ].channel ;
+
+                        uti::u64_t const at = wall_ns() ;
+
+                        channel.callback( channel.source->name, channel.index, &pending[ i ].value, channel.context ) ;
+
+                        pending[ i ].wall_ns = wall_ns() - at ;
+                }
+                t_heap = nullptr ;
+                g_host.phase = host_phase::idle ;
+
+                // only now, growing the samples mustn't count against the plugin's heap
+                for( uti::u32_t i = 0; i < due; ++i ) _costs_.channel.add( pending[ i ].wall_ns ) ;
+
+                call_cost const end_cost = fire_event( SCS_TELEMETRY_EVENT_frame_end, nullptr ) ;
+
+                _costs_.frame    .add(   wall_ns() - frame_at  ) ;
+                _costs_.frame_cpu.add( thread_ns() - frame_cpu ) ;
+
+                _costs_.frame_start.add( start_cost.wall_ns ) ;
+                _costs_.frame_end  .add(   end_cost.wall_ns ) ;
+
+                uti::u64_t const allocs = heap.allocs + start_cost.heap.allocs + end_cost.heap.allocs ;
+
+                _costs_.heap.allocs += allocs ;
+                _costs_.heap.frees  += heap.frees + start_cost.heap.frees + end_cost.heap.frees ;
+                _costs_.heap.bytes  += heap.bytes + start_cost.heap.bytes + end_cost.heap.bytes ;
+
+                if( allocs ) ++_costs_.heap_frames ;
+                if( allocs > _costs_.heap_max ) _costs_.heap_max = allocs ;
+
+                _costs_.frames    += 1 ;
+                _costs_.callbacks += due ;
+        }
+        g_host.quiet = false ;
+
+        uti::u64_t const process = process_ns() - process_start ;
+        uti::u64_t const thread  =  thread_ns() -  thread_start ;
+
+        _costs_.background_ns = process > thread ? process - thread : 0 ;
+}
+
+static void print_costs ( uti::u32_t _hz_, frame_costs & _costs_ )
+{
+        double const frames  = static_cast< double >( _costs_.frames ) ;
+        double const seconds = frames / _hz_ ;
+        double const budget  = 1e9 / _hz_ ;
+
+        std::printf( "%u Hz : %lu frames over %.1f s, %.1f channel callbacks per frame, %lu frames late\n",
+                     _hz_, _costs_.frames, seconds, frames > 0 ? static_cast< double >( _costs_.callbacks ) / frames : 0.0, _costs_.late ) ;
+
+        _costs_.frame_start.print( "frame_start" ) ;
+        _costs_.channel    .print( "channel"     ) ;
+        _costs_.frame_end  .print( "frame_end"   ) ;
+        _costs_.frame      .print( "frame"       ) ;
+        _costs_.frame_cpu  .print( "frame cpu"   ) ;
+
+        if( frames > 0 )
+        {
+                std::printf( "  game frame  %.4f%% of the %.2f ms budget on average\n",
+                             static_cast< double >( _costs_.frame.total ) / frames / budget * 100.0, budget * 1e-6 ) ;
+        }
+#ifdef FFFB_HOST_HEAP_COUNTS
+        std::printf( "  heap        %lu allocations, %lu frees, %lu bytes, in %lu frames, at most %lu in one\n",
+                     _costs_.heap.allocs, _costs_.heap.frees, _costs_.heap.bytes, _costs_.heap_frames, _costs_.heap_max ) ;
+#else
+        std::printf( "  heap        not counted on this platform\n" ) ;
+#endif
+        std::printf( "  background  %.3f ms cpu per second on the plugin's own threads\n",
+                     seconds > 0.0 ? static_cast< double >( _costs_.background_ns ) * 1e-6 / seconds : 0.0 ) ;
+}
+
+static void print_cost ( char const * _name_, call_cost const & _cost_ )
+{
+        std::printf( "%s : %.3f ms wall, %.3f ms cpu", _name_, static_cast< double >( _cost_.wall_ns ) * 1e-6, static_cast< double >( _cost_.cpu_ns ) * 1e-6 ) ;
+#ifdef FFFB_HOST_HEAP_COUNTS
+        std::printf( ", %lu allocations, %lu frees, %lu bytes", _cost_.heap.allocs, _cost_.heap.frees, _cost_.heap.bytes ) ;
+#endif
+        std::printf( "\n" ) ;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
+static void usage ()
+{
+        std::fprintf( stderr,
+                "usage: fffb_host <plugin> [rates] [seconds] [recording or archive]\n"
+                "\n"
+                "loads the plugin the way the game does and runs frames at each of the\n"
+                "comma separated rates for the given seconds, " FFFB_HOST_DEFAULT_RATES " Hz for\n"
+                "%d s by default. channel values are synthesized unless a recording is given.\n"
+                "off macos the plugin to load is libfffb_emulated, which drives a memory wheel\n", FFFB_HOST_DEFAULT_SECONDS ) ;
+}
+
+[[ nodiscard ]] static uti::u32_t parse_rates ( char const * _list_, uti::u32_t ( & _rates_ )[ FFFB_HOST_MAX_RATES ] ) noexcept
+{
+        uti::u32_t count { 0 } ;
+
+        while( *_list_ && count < FFFB_HOST_MAX_RATES )
+        {
+                char * end ;
+                unsigned long const hz = std::strtoul( _list_, &end, 10 ) ;
+
+                if( end == _list_ || hz == 0 || hz > 10000 || ( *end && *end != ',' ) ) return 0 ;
+
+                _rates_[ count++ ] = static_cast< uti::u32_t >( hz ) ;
+                _list_ = *end ? end + 1 : end ;
+        }
+        return count ;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+////////////////////////////////////////////////////////////////////////////////
+
+int main ( int argc, char ** argv )
+{
+        if( argc < 2 || argc > 5 )
+        {
+                usage() ;
+                return 1 ;
+        }
+        uti::u32_t rates [ FFFB_HOST_MAX_RATES ] {} ;
+
+        uti::u32_t const rate_count = parse_rates( argc > 2 ? argv[ 2 ] : FFFB_HOST_DEFAULT_RATES, rates ) ;
+        double     const seconds    = argc > 3 ? std::strtod( argv[ 3 ], nullptr ) : FFFB_HOST_DEFAULT_SECONDS ;
+
+        if( rate_count == 0 || !( seconds > 0.0 ) )
+        {
+                usage() ;
+                return 1 ;
+        }
+        static recorded_source recorded ;
+
+        if( argc > 4 && !recorded.load( argv[ 4 ] ) )
+        {
+                FFFB_ERR_S( "fffb_host", "no frames in '%s'", argv[ 4 ] ) ;
+                return 1 ;
+        }
+        recorded_source * const source = argc > 4 ? &recorded : nullptr ;
+
+        void * const plugin = dlopen( argv[ 1 ], RTLD_NOW | RTLD_LOCAL ) ;
+
+        if( !plugin )
+        {
+                FFFB_ERR_S( "fffb_host", "failed loading plugin : %s", dlerror() ) ;
+                return 1 ;
+        }
+        using init_fn     = scs_result_t ( * )( scs_u32_t, scs_telemetry_init_params_t const * ) ;
+        using shutdown_fn = void         ( * )(                                               ) ;
+
+        init_fn     const init     = reinterpret_cast< init_fn     >( dlsym( plugin, "scs_telemetry_init"     ) ) ;
+        shutdown_fn const shutdown = reinterpret_cast< shutdown_fn >( dlsym( plugin, "scs_telemetry_shutdown" ) ) ;
+
+        if( !init || !shutdown )
+        {
+                FFFB_ERR_S( "fffb_host", "plugin doesn't export the telemetry api" ) ;
+                dlclose( plugin ) ;
+                return 1 ;
+        }
+        scs_telemetry_init_params_v101_t params {} ;
+
+        params.common.log          = &game_log ;
+        params.common.game_name    = "Euro Truck Simulator 2" ;
+        params.common.game_id      = SCS_GAME_ID_EUT2 ;
+        params.common.game_version = SCS_TELEMETRY_EUT2_GAME_VERSION_CURRENT ;
+
+        params.register_for_event      = &register_for_event      ;
+        params.unregister_from_event   = &unregister_from_event   ;
+        params.register_for_channel    = &register_for_channel    ;
+        params.unregister_from_channel = &unregister_from_channel ;
+
+        // init, wheel calibration included
+        call_cost init_cost {} ;
+        {
+                g_host.phase = host_phase::init ;
+                t_heap = &init_cost.heap ;
+
+                uti::u64_t const  cpu_start = thread_ns() ;
+                uti::u64_t const wall_start =   wall_ns() ;
+
+                scs_result_t const result = init( SCS_TELEMETRY_VERSION_1_01, &params ) ;
+
+                init_cost.wall_ns =   wall_ns() - wall_start ;
+                init_cost. cpu_ns = thread_ns() -  cpu_start ;
+
+                t_heap = nullptr ;
+                g_host.phase = host_phase::idle ;
+
+                if( result != SCS_RESULT_ok )
+                {
+                        FFFB_ERR_S( "fffb_host", "scs_telemetry_init failed with %d", result ) ;
+                        dlclose( plugin ) ;
+                        return 1 ;
+                }
+        }
+        print_cost( "init", init_cost ) ;
+
+        // the initial configuration comes before anything else
+        scs_named_value_t attributes [ 5 ] {} ;
+
+        auto const attribute = [ & ]( uti::u32_t _i_, scs_string_t _name_, scs_value_type_t _type_ ) -> scs_value_t &
+        {
+                attributes[ _i_ ].name       = _name_       ;
+                attributes[ _i_ ].index      = SCS_U32_NIL  ;
+                attributes[ _i_ ].value.type = _type_       ;
+                return attributes[ _i_ ].value ;
+        } ;
+        attribute( 0, SCS_TELEMETRY_CONFIG_ATTRIBUTE_rpm_limit         , SCS_VALUE_TYPE_float ).value_float.value = recorded.rpm_limit > 0.0f ? recorded.rpm_limit : FFFB_HOST_RPM_LIMIT ;
+        attribute( 1, SCS_TELEMETRY_CONFIG_ATTRIBUTE_forward_gear_count, SCS_VALUE_TYPE_u32   ).value_u32  .value = 12 ;
+        attribute( 2, SCS_TELEMETRY_CONFIG_ATTRIBUTE_reverse_gear_count, SCS_VALUE_TYPE_u32   ).value_u32  .value =  2 ;
+        attribute( 3, SCS_TELEMETRY_CONFIG_ATTRIBUTE_wheel_count       , SCS_VALUE_TYPE_u32   ).value_u32  .value = recorded.wheels ? recorded.wheels : FFFB_HOST_WHEEL_COUNT ;
+
+        scs_telemetry_configuration_t const truck { SCS_TELEMETRY_CONFIG_truck, attributes } ;
+
+        print_cost( "configuration", fire_event( SCS_TELEMETRY_EVENT_configuration, &truck ) ) ;
+        print_cost( "started"      , fire_event( SCS_TELEMETRY_EVENT_started      , nullptr ) ) ;
+
+        std::printf( "%u channel callbacks registered\n", g_host.channel_count ) ;
+
+        static fffb::telemetry_state state {} ;
+
+        double game_s { 0.0 } ;
+
+        for( uti::u32_t i = 0; i < rate_count; ++i )
+        {
+                frame_costs costs ;
+
+                run_frames( rates[ i ], seconds, game_s, source, state, costs ) ;
+                print_costs( rates[ i ], costs ) ;
+        }
+
+        // pausing is where the plugin dumps its diagnostics
+        print_cost( "paused", fire_event( SCS_TELEMETRY_EVENT_paused, nullptr ) ) ;
+
+        call_cost shutdown_cost {} ;
+        {
+                g_host.phase = host_phase::shutdown ;
+                t_heap = &shutdown_cost.heap ;
+
+                uti::u64_t const  cpu_start = thread_ns() ;
+                uti::u64_t const wall_start =   wall_ns() ;
+
+                shutdown() ;
+
+                shutdown_cost.wall_ns =   wall_ns() - wall_start ;
+                shutdown_cost. cpu_ns = thread_ns() -  cpu_start ;
+
+                t_heap = nullptr ;
+                g_host.phase = host_phase::idle ;
+        }
+        print_cost( "shutdown", shutdown_cost ) ;
+
+        // whatever the plugin left registered goes with it
+        g_host.channel_count = 0 ;
+        for( event_registration & event : g_host.events ) event = {} ;
+
+        std::printf( "plugin log : %lu messages, %lu errors, %lu registrations refused\n", g_host.messages, g_host.errors, g_host.refused ) ;
+
+        dlclose( plugin ) ;
+
+        return g_host.errors || g_host.refused ? 2 : 0 ;
+}
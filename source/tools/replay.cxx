@@ -0,0 +1,346 @@
+//
+//
+//      fffb
+//      source/tools/replay.cxx
+//
+
+/// STD
+
+#include <cerrno>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <ctime>
+#include <algorithm>
+
+/// FFFB
+
+#include <fffb/util/types.hxx>
+#include <fffb/util/clock.hxx>
+#include <fffb/hid/device.hxx>
+#include <fffb/joy/wheel.hxx>
+#include <fffb/force/simulator.hxx>
+#include <fffb/force/streamer.hxx>
+#include <fffb/force/scheduler.hxx>
+#include <fffb/force/rate_controller.hxx>
+#include <fffb/force/profile.hxx>
+#include <fffb/force/pipeline.hxx>
+#include <fffb/telemetry/recorder.hxx>
+#include <fffb/telemetry/archive.hxx>
+
+#ifndef FFFB_VIRTUAL_CLOCK
+#error "fffb_replay has to drive host time itself, build it with FFFB_VIRTUAL_CLOCK"
+#endif
+
+#ifndef FFFB_MEMORY_TRANSPORT
+#error "fffb_replay needs the memory wheel, build it with FFFB_MEMORY_TRANSPORT"
+#endif
+
+// the record before the first frame, what the wheel was sent while coming up
+#define FFFB_REPLAY_INIT static_cast< uti::u64_t >( -1 )
+
+
+////////////////////////////////////////////////////////////////////////////////
+////////////////////////////////////////////////////////////////////////////////
+
+struct captured_report
+{
+        uti::u64_t        record ;
+        fffb::timestamp_t  at_us ;
+        fffb::report         rep ;
+} ;
+
+// everything the memory wheel was sent. reports are kept in memory and only
+// written out once the replay is done, so the file doesn't end up in the timing
+struct report_capture
+{
+        uti::u64_t record { FFFB_REPLAY_INIT } ;
+        uti::u64_t   hash { 0xcbf29ce484222325ull } ; // fnv-1a over id, length and bytes
+        bool         keep { false } ;
+
+        fffb::vector< captured_report > reports {} ;
+
+        void take ( fffb::report const & _report_ ) noexcept
+        {
+                auto const mix = [ & ]( uti::u8_t _byte_ ) { hash = ( hash ^ _byte_ ) * 0x100000001b3ull ; } ;
+
+                mix( _report_.report_id ) ;
+                mix( static_cast< uti::u8_t >( _report_.len ) ) ;
+
+                for( std::size_t i = 0; i < _report_.len; ++i ) mix( _report_.data[ i ] ) ;
+
+                if( keep ) reports.push_back( captured_report{ record, fffb::host_time_us(), _report_ } ) ;
+        }
+
+        static void sink ( void * _context_, fffb::report const & _report_ ) noexcept
+        {
+                static_cast< report_capture * >( _context_ )->take( _report_ ) ;
+        }
+} ;
+
+struct replay_totals
+{
+        uti::u64_t  frames { 0 } ;
+        uti::u64_t  pauses { 0 } ;
+        uti::u64_t configs { 0 } ;
+        uti::u64_t  failed { 0 } ;
+
+        fffb::timestamp_t cpu_us { 0 } ; // the whole replay, stream ticks and reading included
+
+        fffb::timestamp_t first { static_cast< fffb::timestamp_t >( -1 ) } ;
+        fffb::timestamp_t  last { 0 } ;
+
+        fffb::vector< uti::u32_t > update_ns {} ;
+} ;
+
+////////////////////////////////////////////////////////////////////////////////
+
+// wall time for the per frame latencies, host time is the recording's
+[[ nodiscard ]] static uti::u64_t wall_ns () noexcept
+{
+        timespec time ;
+        clock_gettime( CLOCK_MONOTONIC, &time ) ;
+
+        return static_cast< uti::u64_t >( time.tv_sec ) * 1000000000 + static_cast< uti::u64_t >( time.tv_nsec ) ;
+}
+
+static void usage ()
+{
+        std::fprintf( stderr,
+                "usage: fffb_replay <recording or archive> [reports] [profile]\n"
+                "\n"
+                "feeds the recorded frames through the force pipeline into a memory wheel.\n"
+                "reports is written one report per line, '-' skips it. without a profile\n"
+                "the default effects run\n" ) ;
+}
+
+static bool write_reports ( char const * _path_, report_capture const & _capture_ )
+{
+        FILE * file = std::fopen( _path_, "w" ) ;
+
+        if( !file )
+        {
+                FFFB_ERR_S( "fffb_replay", "failed opening '%s' : %s", _path_, std::strerror( errno ) ) ;
+                return false ;
+        }
+        for( captured_report const & captured : _capture_.reports )
+        {
+                if( captured.record == FFFB_REPLAY_INIT ) std::fprintf( file, "init" ) ;
+                else                                      std::fprintf( file, "%lu", captured.record ) ;
+
+                std::fprintf( file, " %lu %02x %2zu :", captured.at_us, captured.rep.report_id, captured.rep.len ) ;
+
+                for( std::size_t i = 0; i < captured.rep.len; ++i ) std::fprintf( file, " %02x", captured.rep.data[ i ] ) ;
+
+                std::fprintf( file, "\n" ) ;
+        }
+        return std::fclose( file ) == 0 ;
+}
+
+// what the plugin does when the game pauses
+static void reset_wheel ( fffb::wheel & _wheel_ )
+{
+        _wheel_.q_disable_autocenter() ;
+        _wheel_.q_stop_forces() ;
+        _wheel_.q_set_led_pattern( 0 ) ;
+        _wheel_.flush_reports() ;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
+// the same counters the plugin dumps on pause
+static void print_wheel ( fffb::wheel const & _wheel_ )
+{
+        fffb::plan_totals const & t = _wheel_.plans().totals() ;
+
+        std::printf( "command plans : executed=%lu empty=%lu failed=%lu, stops=%lu downloads=%lu refreshes=%lu reports=%lu\n",
+                     t.plans, t.empty, t.failed, t.stops, t.downloads, t.refreshes, t.reports ) ;
+
+        constexpr char const * force_names [] { "constant", "spring", "damper", "trapezoid" } ;
+
+        for( uti::u8_t type = 0; type < static_cast< uti::u8_t >( fffb::force_type::COUNT ); ++type )
+        {
+                fffb::delta_gate_stats const & g = _wheel_.gate_stats( static_cast< fffb::force_type >( type ) ) ;
+
+                std::printf( "%s updates : sent=%lu stale=%lu identical=%lu suppressed=%lu\n", force_names[ type ], g.sent, g.stale, g.identical, g.suppressed ) ;
+        }
+}
+
+static void print_timing ( replay_totals & _totals_, fffb::rate_controller const & _rate_ )
+{
+        fffb::timestamp_t cpu_us { 0 } ;
+
+        for( uti::u8_t mode = 0; mode < static_cast< uti::u8_t >( fffb::rate_mode::count ); ++mode )
+        {
+                cpu_us += _rate_.stats( static_cast< fffb::rate_mode >( mode ) ).cpu_us ;
+        }
+        double const span_s = _totals_.last > _totals_.first ? static_cast< double >( _totals_.last - _totals_.first ) * 1e-6 : 0.0 ;
+        double const  cpu_s = static_cast< double >( cpu_us ) * 1e-6 ;
+        double const  all_s = static_cast< double >( _totals_.cpu_us ) * 1e-6 ;
+
+        std::printf( "pipeline cpu %.3f s, %.2f us/frame, %.0f frames/s, %.0fx real time\n",
+                     cpu_s, _totals_.frames ? cpu_s * 1e6 / static_cast< double >( _totals_.frames ) : 0.0,
+                     cpu_s > 0.0 ? static_cast< double >( _totals_.frames ) / cpu_s : 0.0,
+                     cpu_s > 0.0 ? span_s / cpu_s : 0.0 ) ;
+        std::printf( "replay cpu %.3f s, %.0f frames/s, %.0fx real time\n",
+                     all_s, all_s > 0.0 ? static_cast< double >( _totals_.frames ) / all_s : 0.0, all_s > 0.0 ? span_s / all_s : 0.0 ) ;
+
+        fffb::vector< uti::u32_t > & ns = _totals_.update_ns ;
+
+        if( ns.size() == 0 ) return ;
+
+        std::sort( ns.data(), ns.data() + ns.size() ) ;
+
+        auto const at = [ & ]( double _q_ ) { return static_cast< double >( ns[ static_cast< uti::u64_t >( _q_ * static_cast< double >( ns.size() - 1 ) ) ] ) * 1e-3 ; } ;
+
+        std::printf( "update wall p50 %.2f us, p99 %.2f us, p99.9 %.2f us, max %.2f us\n", at( 0.5 ), at( 0.99 ), at( 0.999 ), at( 1.0 ) ) ;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+////////////////////////////////////////////////////////////////////////////////
+
+int main ( int argc, char ** argv )
+{
+        if( argc < 2 )
+        {
+                usage() ;
+                return 1 ;
+        }
+        char const *   input = argv[ 1 ] ;
+        char const * reports = argc > 2 && std::strcmp( argv[ 2 ], "-" ) != 0 ? argv[ 2 ] : nullptr ;
+
+        fffb::force_profile profile ;
+
+        if( argc > 3 ? !fffb::load_profile( argv[ 3 ], profile ) : !profile.compile() )
+        {
+                FFFB_ERR_S( "fffb_replay", "failed loading force profile" ) ;
+                return 1 ;
+        }
+
+        report_capture capture ;
+        capture.keep = reports != nullptr ;
+
+        fffb::memory_transport & transport = fffb::memory_wheel() ;
+        transport.set_sink( &report_capture::sink, &capture ) ;
+        transport.attach() ;
+
+        // the same pieces the plugin holds
+        static fffb::simulator       simulator {} ;
+        static fffb::force_streamer  streamer  { simulator.wheel_ref() } ;
+        static fffb::task_scheduler  scheduler {} ;
+        static fffb::rate_controller rate      {} ;
+        static fffb::frame_pipeline  pipeline  { simulator, streamer, scheduler, rate } ;
+
+        if( !simulator.wheel_ref() )
+        {
+                FFFB_ERR_S( "fffb_replay", "memory wheel didn't come up" ) ;
+                return 1 ;
+        }
+        // streamed where the plugin streams, ticked on the recording's host time
+        if( simulator.wheel_ref().protocol() == fffb::ffb_protocol::logitech_hidpp )
+        {
+                streamer.suspend() ;
+                scheduler.set_period( fffb::ffb_task::constant, 0 ) ;
+
+                if( !streamer.start_stepped( FFFB_STREAM_RATE_HZ, fffb::stream_mode::interpolate ) )
+                {
+                        FFFB_ERR_S( "fffb_replay", "failed starting the force stream" ) ;
+                        return 1 ;
+                }
+        }
+        fffb::telemetry_state state {} ;
+        fffb::led_ladder       leds {} ;
+
+        float rpm_limit { 0.0f } ;
+
+        replay_totals totals ;
+
+        uti::u64_t        index { 0 } ;
+        fffb::timestamp_t  tick { 0 } ;
+
+        fffb::timestamp_t const cpu_start = fffb::thread_cpu_us() ;
+
+        bool const read = fffb::for_each_record( input, [ & ]( fffb::recording_record const & _record_ )
+        {
+                capture.record = index++ ;
+
+                if( streamer.running() )
+                {
+                        if( tick == 0 ) tick = _record_.host_timestamp ;
+
+                        for( ; tick <= _record_.host_timestamp; tick += streamer.period_us() )
+                        {
+                                fffb::set_host_time_us( tick ) ;
+                                streamer.tick() ;
+                        }
+                }
+                fffb::set_host_time_us( _record_.host_timestamp ) ;
+
+                switch( _record_.kind )
+                {
+                        case fffb::record_kind::config :
+                                rpm_limit = _record_.config.rpm_limit ;
+                                leds      = profile.leds( rpm_limit ) ;
+                                ++totals.configs ;
+                                break ;
+                        case fffb::record_kind::paused :
+                                streamer.suspend() ;
+                                reset_wheel( simulator.wheel_ref() ) ;
+                                ++totals.pauses ;
+                                break ;
+                        case fffb::record_kind::resumed :
+                                scheduler.reset() ;
+                                streamer.resume() ;
+                                break ;
+                        case fffb::record_kind::frame :
+                        {
+                                fffb::restore_frame( _record_, state ) ;
+
+                                if( pipeline.apply_profile( profile ) ) leds = profile.leds( rpm_limit ) ;
+
+                                uti::u64_t const started = wall_ns() ;
+
+                                if( !pipeline.update( state, leds ) ) ++totals.failed ;
+
+                                totals.update_ns.push_back( static_cast< uti::u32_t >( wall_ns() - started ) ) ;
+
+                                if( totals.first == static_cast< fffb::timestamp_t >( -1 ) ) totals.first = _record_.timestamp ;
+                                totals.last = _record_.timestamp ;
+                                ++totals.frames ;
+                                break ;
+                        }
+                        default :
+                                break ;
+                }
+        } ) ;
+
+        totals.cpu_us = fffb::thread_cpu_us() - cpu_start ;
+
+        // the wheel outlives main, whatever it sends on the way out isn't part of the replay
+        transport.set_sink( nullptr, nullptr ) ;
+
+        if( !read ) return 1 ;
+
+        fffb::memory_transport_stats const & wire = transport.stats() ;
+
+        std::printf( "%lu frames, %lu pauses, %lu configs, %.1f s of game time\n", totals.frames, totals.pauses, totals.configs,
+                     totals.last > totals.first ? static_cast< double >( totals.last - totals.first ) * 1e-6 : 0.0 ) ;
+        std::printf( "%lu reports, %lu bytes, stream hash %016lx\n", wire.writes, wire.bytes, capture.hash ) ;
+
+        if( totals.failed ) std::printf( "%lu frames failed\n", totals.failed ) ;
+
+        print_wheel( simulator.wheel_ref() ) ;
+
+        if( streamer.running() )
+        {
+                fffb::stream_stats const st = streamer.stats() ;
+
+                std::printf( "stream %u Hz : ticks=%lu writes=%lu skipped=%lu failures=%lu\n", streamer.rate_hz(), st.ticks, st.writes, st.skipped, st.failures ) ;
+        }
+
+        print_timing( totals, rate ) ;
+
+        if( reports && !write_reports( reports, capture ) ) return 1 ;
+
+        return totals.failed ? 1 : 0 ;
+}
@@ -0,0 +1,215 @@
+//
+//
+//      fffb
+//      source/tools/seqlock_stress.cxx
+//
+
+/// STD
+
+#include <cstdio>
+#include <cstdlib>
+#include <atomic>
+#include <chrono>
+#include <functional>
+#include <thread>
+
+/// FFFB
+
+#include <fffb/util/types.hxx>
+#include <fffb/util/seqlock.hxx>
+#include <fffb/telemetry/state.hxx>
+
+#define FFFB_STRESS_READERS 4
+#define FFFB_STRESS_SECONDS 2
+
+// torn reads printed before only counting the rest
+#define FFFB_STRESS_SHOWN 8
+
+
+////////////////////////////////////////////////////////////////////////////////
+////////////////////////////////////////////////////////////////////////////////
+
+static void usage ()
+{
+        std::fprintf( stderr,
+                "usage: fffb_seqlock_stress [readers] [seconds]\n"
+                "\n"
+                "one writer publishes telemetry as fast as it can while the readers read it.\n"
+                "every field of a write is derived from its number, a read mixing two writes\n"
+                "or going back in version fails the run\n" ) ;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
+// every field from _n_, floats stay exact below 2^24
+static fffb::telemetry_state make_state ( uti::u64_t _n_ ) noexcept
+{
+        fffb::telemetry_state state {} ;
+
+        float const f = static_cast< float >( _n_ & 0xFFFFFF ) ;
+        int   const i = static_cast< int   >( _n_ & 0x7FFFFFFF ) ;
+
+        state.timestamp                       = _n_ ;
+        state.raw_rendering_timestamp         = _n_ + 1 ;
+        state.raw_simulation_timestamp        = _n_ + 2 ;
+        state.raw_paused_simulation_timestamp = _n_ + 3 ;
+        state.host_timestamp                  = _n_ * 3 ;
+        state.orientation_available           = _n_ & 1 ;
+
+        state.heading   = f ;
+        state.pitch     = f + 1.0f ;
+        state.roll      = f + 2.0f ;
+        state.steering  = f + 3.0f ;
+        state.throttle  = f + 4.0f ;
+        state.brake     = f + 5.0f ;
+        state.clutch    = f + 6.0f ;
+        state.speed     = f + 7.0f ;
+        state.rpm       = f + 8.0f ;
+        state.gear      = i ;
+        state.rpm_ratio = f + 9.0f ;
+
+        for( int w = 0; w < FFFB_TELEMETRY_MAX_WHEELS; ++w ) state.substance[ w ] = i ^ w ;
+
+        state.callbacks = static_cast< uti::u32_t >( _n_ ) ;
+
+        return state ;
+}
+
+// a read is whole when it equals the write its timestamp names
+static bool consistent ( fffb::telemetry_state const & _state_ ) noexcept
+{
+        fffb::telemetry_state const expected = make_state( _state_.timestamp ) ;
+
+        bool same = _state_.raw_rendering_timestamp         == expected.raw_rendering_timestamp
+                 && _state_.raw_simulation_timestamp        == expected.raw_simulation_timestamp
+                 && _state_.raw_paused_simulation_timestamp == expected.raw_paused_simulation_timestamp
+                 && _state_.host_timestamp                  == expected.host_timestamp
+                 && _state_.orientation_available           == expected.orientation_available
+                 && _state_.heading  == expected.heading  && _state_.pitch    == expected.pitch
+                 && _state_.roll     == expected.roll     && _state_.steering == expected.steering
+                 && _state_.throttle == expected.throttle && _state_.brake    == expected.brake
+                 && _state_.clutch   == expected.clutch   && _state_.speed    == expected.speed
+                 && _state_.rpm      == expected.rpm      && _state_.gear     == expected.gear
+                 && _state_.rpm_ratio == expected.rpm_ratio
+                 && _state_.callbacks == expected.callbacks ;
+
+        for( int w = 0; w < FFFB_TELEMETRY_MAX_WHEELS; ++w ) same = same && _state_.substance[ w ] == expected.substance[ w ] ;
+
+        return same ;
+}
+
+// write 0 is there from the start, so every read names a write
+fffb::seqlock< fffb::telemetry_state > g_snapshot { make_state( 0 ) } ;
+
+std::atomic< bool > g_done { false } ;
+
+////////////////////////////////////////////////////////////////////////////////
+
+struct reader_result
+{
+        uti::u64_t     reads { 0 } ;
+        uti::u64_t   retries { 0 } ; // try_read attempts the writer got in the way of
+        uti::u64_t      torn { 0 } ;
+        uti::u64_t backwards { 0 } ;
+} ;
+
+static void run_writer ( uti::u64_t & _writes_ ) noexcept
+{
+        uti::u64_t n { 0 } ;
+
+        while( !g_done.load( std::memory_order_relaxed ) ) g_snapshot.publish( make_state( ++n ) ) ;
+
+        _writes_ = n ;
+}
+
+// the version before a read bounds what it may return from below, the one
+// after from above, and neither may ever be older than what came before
+static void run_reader ( reader_result & _result_ ) noexcept
+{
+        uti::u64_t last_version { 0 } ;
+        uti::u64_t   last_write { 0 } ;
+
+        fffb::telemetry_state state ;
+
+        while( !g_done.load( std::memory_order_relaxed ) )
+        {
+                uti::u64_t const before = g_snapshot.version() ;
+
+                while( !g_snapshot.try_read( state ) ) ++_result_.retries ;
+
+                uti::u64_t const after = g_snapshot.version() ;
+
+                ++_result_.reads ;
+
+                if( !consistent( state ) )
+                {
+                        if( _result_.torn++ < FFFB_STRESS_SHOWN )
+                        {
+                                std::printf( "torn read : timestamp=%lu host=%lu gear=%d callbacks=%u\n",
+                                             state.timestamp, state.host_timestamp, state.gear, state.callbacks ) ;
+                        }
+                        continue ;
+                }
+                uti::u64_t const write = state.timestamp ;
+
+                if( before < last_version || after < before || write < before || write > after || write < last_write )
+                {
+                        if( _result_.backwards++ < FFFB_STRESS_SHOWN )
+                        {
+                                std::printf( "out of order : versions %lu..%lu after %lu, write %lu after %lu\n",
+                                             before, after, last_version, write, last_write ) ;
+                        }
+                }
+                last_version = after ;
+                last_write   = write ;
+        }
+}
+
+////////////////////////////////////////////////////////////////////////////////
+////////////////////////////////////////////////////////////////////////////////
+
+int main ( int argc, char ** argv )
+{
+        int        const readers = argc > 1 ? std::atoi( argv[ 1 ] ) : FFFB_STRESS_READERS ;
+        uti::u32_t const seconds = argc > 2 ? static_cast< uti::u32_t >( std::strtoul( argv[ 2 ], nullptr, 10 ) ) : FFFB_STRESS_SECONDS ;
+
+        if( readers < 1 || readers > 64 || seconds == 0 )
+        {
+                usage() ;
+                return 1 ;
+        }
+        reader_result results [ 64 ] {} ;
+        std::thread   threads [ 64 ] ;
+
+        uti::u64_t writes { 0 } ;
+
+        for( int i = 0; i < readers; ++i ) threads[ i ] = std::thread( run_reader, std::ref( results[ i ] ) ) ;
+
+        std::thread writer( run_writer, std::ref( writes ) ) ;
+
+        std::this_thread::sleep_for( std::chrono::seconds( seconds ) ) ;
+
+        g_done.store( true, std::memory_order_relaxed ) ;
+
+        writer.join() ;
+        for( int i = 0; i < readers; ++i ) threads[ i ].join() ;
+
+        reader_result total {} ;
+
+        for( int i = 0; i < readers; ++i )
+        {
+                total.reads     += results[ i ].reads     ;
+                total.retries   += results[ i ].retries   ;
+                total.torn      += results[ i ].torn      ;
+                total.backwards += results[ i ].backwards ;
+        }
+        std::printf( "%lu writes, %d readers, %lu reads, %lu retries, %lu torn, %lu out of order\n",
+                     writes, readers, total.reads, total.retries, total.torn, total.backwards ) ;
+
+        if( total.reads == 0 )
+        {
+                FFFB_ERR_S( "fffb_seqlock_stress", "readers never got a read in" ) ;
+                return 1 ;
+        }
+        return total.torn || total.backwards ? 1 : 0 ;
+}